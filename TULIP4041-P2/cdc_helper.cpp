@@ -24,6 +24,7 @@
 //      3 - HP-IL/PILBox communication
 //      4 - HP-IL scope output
 
+#include "pico/stdlib.h"
 #include "cdc_helper.h"
 
 // for the TULIP4041 we will use the following CDC ports:
@@ -53,14 +54,34 @@ bool cdc_connected(int itf)
 }
 
 
+struct CDCStall cdc_stall[ITF_COUNT];
+
+// returns true if output for the port is still waiting in the USB output buffer
+bool cdc_write_pending(int itf)
+{
+    return tud_cdc_n_write_available(itf) < CFG_TUD_CDC_TX_BUFSIZE;
+}
+
+
 // function to wait for enough room in the USB output buffer
+// the time spent waiting is counted in cdc_stall[itf]
 static void wait_for_write(int itf, uint32_t len)
 {
     uint32_t avail;
+    uint32_t start = time_us_32();
+    bool stalled = false;
     do {
         tud_task();
         avail = tud_cdc_n_write_available(itf);
+        if (avail < len) stalled = true;
     } while (avail < len);
+
+    if (stalled) {
+        uint32_t us = time_us_32() - start;
+        cdc_stall[itf].count++;
+        cdc_stall[itf].us += us;
+        if (us > cdc_stall[itf].max_us) cdc_stall[itf].max_us = us;
+    }
 }
 
 
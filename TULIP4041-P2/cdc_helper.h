@@ -47,7 +47,16 @@ extern "C" {
 #define ITF_HPIL        2           // CDC port 2: HP-IL/ PILBox frames
 #define ITF_ILSCOPE     3           // CDC port 3: HP-IL scope, PILBox frame monitor
 #define ITF_PRINT       4           // CDC port 4: printer bytes
+#define ITF_COUNT       5           // number of CDC ports, CFG_TUD_CDC in tusb_config.h
 
+// time spent waiting for room in the USB output buffer of a port, see wait_for_write()
+struct CDCStall {
+    uint32_t    count;              // number of writes that had to wait
+    uint64_t    us;                 // total time waited
+    uint32_t    max_us;             // longest wait
+};
+
+extern struct CDCStall cdc_stall[ITF_COUNT];
 
 extern const char* __in_flash() ITF_str[];
 
@@ -61,6 +70,7 @@ void cdc_send_char_flush(int itf, char c);
 
 void cdc_send_printport(char c);
 bool cdc_connected(int itf);
+bool cdc_write_pending(int itf);
 
 void cdc_flush_console();
 void cdc_flush(int itf);
@@ -170,6 +170,37 @@ const char* __in_flash()system_cmds[] =
     "calcreset",
     "configinit",
     "configlist",
+    "cache",
+    "dispatch",
+    "timing",
+    "bench",
+};
+
+const char* __in_flash()cache_cmds[] =
+// list of arguments for the system cache and system dispatch command
+{
+    "status",
+    "reset",
+    "toggle",
+};
+
+const char* __in_flash()timing_cmds[] =
+// list of arguments for the system timing command
+{
+    "status",
+    "reset",
+    "margin",
+    "toggle",
+};
+
+const char* __in_flash()bench_cmds[] =
+// list of traffic mixes for the system bench command, same order as SIM_FETCH .. SIM_MIXED in emulation.h
+{
+    "fetch",
+    "usermem",
+    "prph",
+    "banked",
+    "mixed",
 };
 
 void onSystemCLI(EmbeddedCli *cli, char *args, void *context)
@@ -221,6 +252,70 @@ void onSystemCLI(EmbeddedCli *cli, char *args, void *context)
             break;
       case 10 : uif_configlist();        // re-initialize persistent settings
             break;            
+      case 11 : // SRAM page cache, arg2 is the optional subcommand
+            if (arg2 == NULL) {
+              uif_cache(cache_status);
+            } else {
+              int c = 0;
+              int num_cache = sizeof(cache_cmds) / sizeof(char *);
+              while ((c < num_cache) && (strcmp(arg2, cache_cmds[c]) != 0)) c++;
+              if (c < num_cache) {
+                uif_cache(c + 1);
+              } else {
+                cli_printf("system cache: unknown argument %s", arg2);
+              }
+            }
+            break;
+      case 12 : // dispatch table, arg2 is the optional subcommand
+            if (arg2 == NULL) {
+              uif_dispatch(dispatch_status);
+            } else {
+              int c = 0;
+              int num_cache = sizeof(cache_cmds) / sizeof(char *);
+              while ((c < num_cache) && (strcmp(arg2, cache_cmds[c]) != 0)) c++;
+              if (c < num_cache) {
+                uif_dispatch(c + 1);
+              } else {
+                cli_printf("system dispatch: unknown argument %s", arg2);
+              }
+            }
+            break;
+      case 13 : // core1 bus cycle timing, arg2 is the optional subcommand, arg3 the margin in us
+            if (arg2 == NULL) {
+              uif_timing(timing_cmd_status, 0);
+            } else {
+              int c = 0;
+              int us = 0;
+              int num_timing = sizeof(timing_cmds) / sizeof(char *);
+              while ((c < num_timing) && (strcmp(arg2, timing_cmds[c]) != 0)) c++;
+              if (c == num_timing) {
+                cli_printf("system timing: unknown argument %s", arg2);
+              } else if ((c + 1) == timing_cmd_margin) {
+                const char *arg3 = embeddedCliGetToken(args, 3);
+                if ((arg3 == NULL) || (sscanf(arg3, "%d", &us) != 1) || (us < 0) || (us > 100)) {
+                  cli_printf("system timing margin: give the margin in usecs, 0..100");
+                } else {
+                  uif_timing(timing_cmd_margin, us);
+                }
+              } else {
+                uif_timing(c + 1, 0);
+              }
+            }
+            break;
+      case 14 : // bus loop benchmark, arg2 is the optional traffic mix
+            if (arg2 == NULL) {
+              uif_bench(-1);                    // all mixes
+            } else {
+              int m = 0;
+              int num_bench = sizeof(bench_cmds) / sizeof(char *);
+              while ((m < num_bench) && (strcmp(arg2, bench_cmds[m]) != 0)) m++;
+              if (m < num_bench) {
+                uif_bench(m);
+              } else {
+                cli_printf("system bench: unknown traffic mix %s", arg2);
+              }
+            }
+            break;
       default:
           cli_printf("system: unkown command %s\n", arg1);    // unknown command
     }
@@ -415,7 +510,8 @@ const char* __in_flash()plug_cmds[] =
     "hpil",        // plug the embedded HP-IL ROM in Page 7 and enables emulation
     "ilprinter",   // plug the embedded HP-IL Printer ROM in Page 6
     "printer",     // plug the embedded HP82143A Printer ROM in Page 6 and enables emulation
-    // "module",   for later use, to plug a physical module
+    "module",      // for later use, to plug a physical module
+    "qrom",        // plug a writeable QROM Page
 };
 
         #define plug_hpil       1
@@ -423,6 +519,10 @@ const char* __in_flash()plug_cmds[] =
         #define plug_printer    3
         #define plug_module     4
         #define plug_file       5
+        #define plug_qrom       6
+        #define plug_file_qrom  7
+
+        #define plug_cmd_qrom   5       // index of "qrom" in plug_cmds
 
 const char* __in_flash()plug_module_args[] =
 // list of arguments for the plug module command
@@ -465,7 +565,7 @@ void onPlugCLI(EmbeddedCli *cli, char *args, void *context)
 {
     const char *arg1 = embeddedCliGetToken(args, 1);        // file name
     const char *arg2 = embeddedCliGetToken(args, 2);        // Page number in hex
-    const char *arg3 = embeddedCliGetToken(args, 3);        // not used for now
+    const char *arg3 = embeddedCliGetToken(args, 3);        // Bank number bN, optional
     int cmd = -1;
     int num_cmds = sizeof(plug_cmds) / sizeof(char *);
 
@@ -505,6 +605,20 @@ void onPlugCLI(EmbeddedCli *cli, char *args, void *context)
                 // this is not yet implemented
                 cli_printf("plug module not yet implemented");
                 return;
+            case plug_cmd_qrom : {
+                // plug qrom X, arg2 has the Page number
+                int qp = 0;
+                if (arg2 == NULL) {
+                    cli_printf("no Page number given, use: plug qrom Page (in hex)");
+                    return;
+                }
+                if ((sscanf(arg2, "%X", &qp) != 1) || (qp > 15) || (qp < 4)) {
+                    cli_printf("invalid Page number, must be >4 and <F (hex)");
+                    return;
+                }
+                uif_plug(plug_qrom, qp, 1, NULL);
+                return;
+            }
             default:
                 // proceed with the file name
         }
@@ -527,10 +641,22 @@ void onPlugCLI(EmbeddedCli *cli, char *args, void *context)
         cli_printf("invalid Page number, must be >4 and <F (hex)", arg2);    // unknown command
         return;
     }
+    // check for the optional bN with the Bank number, or qrom for a writeable copy
+    int b = 1;
+    if ((arg3 != NULL) && (strcmp(arg3, "qrom") == 0)) {
+        uif_plug(plug_file_qrom, p, 1, arg1);
+        return;
+    }
+    if (arg3 != NULL) {
+        res = sscanf(arg3, "%*[bB]%d", &b);
+        if ((res != 1) | (b < 1) | (b > 4)) {
+            cli_printf("invalid Bank number %s, must be b1..b4", arg3);
+            return;
+        }
+    }
     // p now contains a valid page number, pass this with the ROM file name
     // file name checking is done in the uif_plug function
-    // Bank is not used here now
-    uif_plug(plug_file, p, 1, arg1);
+    uif_plug(plug_file, p, b, arg1);
 }
 
 
@@ -556,10 +682,17 @@ void onUnPlugCLI(EmbeddedCli *cli, char *args, void *context)
         cli_printf("invalid Page number, must be >=4 and <=F (hex)", arg2);    // unknown command
         return;
     }
-    // p now contains a valid page number, pass this with the ROM file name
-    // file name checking is done in the uif_plug function
-    // Bank is not used here now
-    uif_unplug(p);
+    // check for the optional bN with the Bank number, default is all Banks
+    int b = 0;
+    if (arg2 != NULL) {
+        res = sscanf(arg2, "%*[bB]%d", &b);
+        if ((res != 1) | (b < 1) | (b > 4)) {
+            cli_printf("invalid Bank number %s, must be b1..b4", arg2);
+            return;
+        }
+    }
+    // p now contains a valid page number
+    uif_unplug(p, b);
 
 }
 
@@ -646,6 +779,13 @@ const char* __in_flash()xmem_cmds[] =
     "dump",             // dump xmem contents
     "PATTERN",          // program test pattern in FRAM
     "ERASE",            // erase all Extended Memory
+    "test",             // User Memory decoding self test
+    "mm1",              // toggle Memory Module 1
+    "mm2",              // toggle Memory Module 2
+    "mm3",              // toggle Memory Module 3
+    "mm4",              // toggle Memory Module 4
+    "quad",             // toggle Quad Memory Module
+    "xfun",             // toggle X-Functions memory
 };
 
 void onXMEMCLI(EmbeddedCli *cli, char *args, void *context)
@@ -683,8 +823,11 @@ void onXMEMCLI(EmbeddedCli *cli, char *args, void *context)
     }
 
     // we get here if there is a valid command (i >= 0 or a value 0..2)
-    if (i > 0) {
-        // status, dump or pattern command found, pass 1..3
+    if (i > xmem_test) {
+        // memory module command found, pass 20..25
+        uif_xmem(i - xmem_mm1 + 20);
+    } else if (i > 0) {
+        // status, dump, pattern, erase or test command found, pass 1..5
         uif_xmem(i);    
     } else {
         // no command found but a valid number 0..2
@@ -727,6 +870,64 @@ const char* __in_flash()tracer_cmds[] =
     "pilbox",           // toggle PILBox serial tracing
     "ilregs",           // toggle tracing of HP-IL registers
     "save",             // save tracer settings
+    "replay",           // capture and replay of bus cycles
+    "binary",           // toggle binary trace stream
+    "bintest",          // self test of the binary trace encoder and decoder
+    "filter",           // block, pass and trigger filters
+    "fmtbench",         // compare and time the trace line formatters
+    "sd",               // trace capture to the uSD card
+    "snap",             // snapshot capture in the TraceBuffer
+    "prof",             // profiler
+    "symbols",          // toggle the function names in the trace
+    "stats",            // trace pipeline telemetry
+};
+
+const char* __in_flash()tfilter_cmds[] =
+// list of arguments for the tracer filter command
+{
+    "list",
+    "block",
+    "pass",
+    "trig",
+    "count",
+    "del",
+    "toggle",
+    "depth",
+    "clear",
+};
+
+const char* __in_flash()snap_cmds[] =
+// list of arguments for the tracer snap command
+{
+    "status",
+    "start",
+    "adr",
+    "inst",
+    "frame",
+    "stop",
+    "dump",
+    "sd",
+    "off",
+};
+
+const char* __in_flash()prof_cmds[] =
+// list of arguments for the tracer prof command, a number is the length of the report
+{
+    "report",
+    "start",
+    "stop",
+    "csv",
+    "off",
+};
+
+const char* __in_flash()replay_cmds[] =
+// list of arguments for the tracer replay command
+{
+    "status",
+    "capture",
+    "run",
+    "clear",
+    "load",
 };
 
 
@@ -735,8 +936,10 @@ const char* __in_flash()tracer_cmds[] =
 void onTracerCLI(EmbeddedCli *cli, char *args, void *context)
 {
     const char *arg1 = embeddedCliGetToken(args, 1);        // command
-    // const char *arg2 = embeddedCliGetToken(args, 2);        // start address
-    // const char *arg3 = embeddedCliGetToken(args, 3);        // end address
+    const char *arg2 = embeddedCliGetToken(args, 2);        // replay or filter subcommand
+    const char *arg3 = embeddedCliGetToken(args, 3);        // filter start address or number
+    const char *arg4 = embeddedCliGetToken(args, 4);        // filter end address or count
+    const char *arg5 = embeddedCliGetToken(args, 5);        // filter bank
     int cmd = -1;
     int num_cmds = sizeof(tracer_cmds) / sizeof(char *);
 
@@ -758,7 +961,140 @@ void onTracerCLI(EmbeddedCli *cli, char *args, void *context)
         i = -1;
     }
 
-    if (i >= 0) {
+    if (i == trace_filter_cmd) {
+        int f = 0;
+        int num_f = sizeof(tfilter_cmds) / sizeof(char *);
+        unsigned int v1 = 0, v2 = 0;
+        int bank = 0;
+        if (arg2 == NULL) {
+            uif_tracer_filter(tfilter_list, 0, 0, 0);
+            return;
+        }
+        while ((f < num_f) && (strcmp(arg2, tfilter_cmds[f]) != 0)) f++;
+        f++;
+        switch (f) {
+            case tfilter_block:
+            case tfilter_pass:
+            case tfilter_trig:
+            case tfilter_count:
+                // start address in hex, end address in hex or a decimal count, optional bank as b1..b4
+                if ((arg3 == NULL) || (arg4 == NULL) || (sscanf(arg3, "%X", &v1) != 1) || (v1 > 0xFFFF) ||
+                    (sscanf(arg4, (f == tfilter_count) ? "%u" : "%X", &v2) != 1) || (v2 > 0xFFFF)) {
+                    cli_printf("tracer filter %s: give a start address and %s", arg2, (f == tfilter_count) ? "a count" : "an end address");
+                    return;
+                }
+                if ((arg5 != NULL) && ((sscanf(arg5, "%*[bB]%d", &bank) != 1) || (bank < 1) || (bank > 4))) {
+                    cli_printf("tracer filter %s: bank must be b1..b4", arg2);
+                    return;
+                }
+                break;
+            case tfilter_del:
+            case tfilter_toggle:
+                if ((arg3 == NULL) || (sscanf(arg3, "%u", &v1) != 1)) {
+                    cli_printf("tracer filter %s: give the filter number", arg2);
+                    return;
+                }
+                break;
+            case tfilter_depth:
+                if ((arg3 == NULL) || (arg4 == NULL) || (sscanf(arg3, "%u", &v1) != 1) || (sscanf(arg4, "%u", &v2) != 1) || (v2 > 0xFFFF)) {
+                    cli_printf("tracer filter depth: give the number of samples before and after a trigger");
+                    return;
+                }
+                break;
+            case tfilter_list:
+            case tfilter_clear:
+                break;
+            default:
+                cli_printf("tracer filter: unknown argument %s, see help", arg2);
+                return;
+        }
+        uif_tracer_filter(f, v1, v2, bank);
+    }
+    else if (i == trace_sd_cmd) {
+        uif_tracer_sd(arg2);
+    }
+    else if (i == trace_stats_cmd) {
+        uif_tracer_stats(arg2);
+    }
+    else if (i == trace_snap_cmd) {
+        int s = 0;
+        int num_snap = sizeof(snap_cmds) / sizeof(char *);
+        unsigned int v = 0;
+        int post = -1;                      // default number of records after the trigger
+        if (arg2 == NULL) {
+            uif_tracer_snap(snap_cmd_status, 0, 0, NULL);
+            return;
+        }
+        while ((s < num_snap) && (strcmp(arg2, snap_cmds[s]) != 0)) s++;
+        s++;
+        switch (s) {
+            case snap_cmd_adr:
+            case snap_cmd_inst:
+            case snap_cmd_frame:
+                // trigger value in hex, optional number of records after the trigger
+                if ((arg3 == NULL) || (sscanf(arg3, "%X", &v) != 1) || (v > ((s == snap_cmd_adr) ? 0xFFFF : 0x7FF)) ||
+                    ((arg4 != NULL) && ((sscanf(arg4, "%d", &post) != 1) || (post < 0)))) {
+                    cli_printf("tracer snap %s: give the trigger value in hex and optional the records after it", arg2);
+                    return;
+                }
+                break;
+            case snap_cmd_sd:
+                if (arg3 == NULL) {
+                    cli_printf("tracer snap sd: give a file name");
+                    return;
+                }
+                break;
+            case snap_cmd_status:
+            case snap_cmd_start:
+            case snap_cmd_stop:
+            case snap_cmd_dump:
+            case snap_cmd_off:
+                break;
+            default:
+                cli_printf("tracer snap: unknown argument %s, see help", arg2);
+                return;
+        }
+        uif_tracer_snap(s, v, post, arg3);
+    }
+    else if (i == trace_prof_cmd) {
+        int p = 0;
+        int num_prof = sizeof(prof_cmds) / sizeof(char *);
+        int n = 0;
+        if ((arg2 == NULL) || (sscanf(arg2, "%d", &n) == 1)) {
+            uif_tracer_prof(prof_cmd_report, n, NULL);
+            return;
+        }
+        while ((p < num_prof) && (strcmp(arg2, prof_cmds[p]) != 0)) p++;
+        p++;
+        if (p > num_prof) {
+            cli_printf("tracer prof: unknown argument %s, see help", arg2);
+            return;
+        }
+        if ((p == prof_cmd_csv) && (arg3 == NULL)) {
+            cli_printf("tracer prof csv: give a file name");
+            return;
+        }
+        uif_tracer_prof(p, 0, arg3);
+    }
+    else if (i == trace_replay) {
+        int r = 0;
+        int num_replay = sizeof(replay_cmds) / sizeof(char *);
+        if (arg2 == NULL) {
+            uif_replay(replay_cmd_status, NULL);
+            return;
+        }
+        while ((r < num_replay) && (strcmp(arg2, replay_cmds[r]) != 0)) r++;
+        if (r >= num_replay) {
+            cli_printf("tracer replay: unknown argument %s, use status, capture, run, clear or load", arg2);
+            return;
+        }
+        if ((r + 1 == replay_cmd_load) && (arg3 == NULL)) {
+            cli_printf("tracer replay load: give a file name");
+            return;
+        }
+        uif_replay(r + 1, arg3);
+    }
+    else if (i >= 0) {
         // cli_printf("argument %s, %d", arg1, i);
         uif_tracer(i);
     }
@@ -814,6 +1150,8 @@ const char* __in_flash()flash_cmds[] =
     "dump",             // dump FLASH contents
     "INIT",             // initialize FLASH file system
     "NUKEALL",          // erase all FLASH pages
+    "fram",             // dump FRAM contents
+    "compact",          // move the files down over the deleted files
 };
 
 void onFlashCLI(EmbeddedCli *cli, char *args, void *context) {
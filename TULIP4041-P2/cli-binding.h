@@ -42,7 +42,19 @@ extern "C" {
         poweron       drive ISA for 20 usecs to switch HP41 on\r\n\
         calcreset     drive PWO to reset HP41\r\n\
         configinit    re-initialize the FRAM persistent settings configuration\r\n\
-        configlist    list all configuration settings\r\n"
+        configlist    list all configuration settings\r\n\
+        cache         shows the SRAM page cache and ROM fetch timing\r\n\
+        cache reset   clears the ROM fetch timing\r\n\
+        cache toggle  enable/disable the SRAM page cache, to compare with fetching from FLASH\r\n\
+        dispatch      shows the instruction dispatch table and T54 timing\r\n\
+        dispatch reset  clears the T54 timing\r\n\
+        dispatch toggle switch between the dispatch table and running all decoders\r\n\
+        timing        shows the core1 bus cycle stage timing and slack\r\n\
+        timing reset  clears the stage timing\r\n\
+        timing margin N  count slack below N usecs as a near miss\r\n\
+        timing toggle switch the timing measurement in core1 on/off, off by default\r\n\
+        bench         runs the bus loop on simulated bus cycles, HP41 must be off\r\n\
+        bench [fetch|usermem|prph|banked|mixed] only for this traffic mix\r\n"
 
         #define help_status     1
         #define help_pio        2
@@ -54,6 +66,23 @@ extern "C" {
         #define help_calcreset  8
         #define help_configinit 9
         #define help_configlist 10
+        #define help_cache      11
+        #define help_dispatch   12
+        #define help_timing     13
+        #define help_bench      14
+
+        #define cache_status    1
+        #define cache_reset     2
+        #define cache_toggle    3
+
+        #define dispatch_status 1
+        #define dispatch_reset  2
+        #define dispatch_toggle 3
+
+        #define timing_cmd_status 1
+        #define timing_cmd_reset  2
+        #define timing_cmd_margin 3
+        #define timing_cmd_toggle 4
 
 #define SDCARD_HELP_TXT "uSD card functions\r\n\
         [no argument] shows the uSD card status and mounts the card\r\n\
@@ -92,17 +121,24 @@ extern "C" {
         ilprinter     plugs the embedded HP-IL Printer ROM in Page 6\r\n\
         printer       plugs the embedded HP82143A Printer ROM in Page 6 and enables emulation\r\n\
         [filename] X  plug the ROM in Page X (hex) \r\n\
-          [filename]   is the name of the file in FLASH with extension\r\n"
+        [filename] X bN plug the ROM in Page X (hex) and Bank N (1..4)\r\n\
+        [filename] X qrom copy the ROM to a writeable QROM in Page X (hex), Bank 1\r\n\
+        qrom X        plug the writeable QROM in Page X (hex) with the image saved in FRAM\r\n\
+          [filename]   is the name of the file in FLASH with extension\r\n\
+          Bank 1 must be plugged before Banks 2..4\r\n"
 
         #define plug_hpil       1
         #define plug_ilprinter  2
         #define plug_printer    3
         #define plug_module     4
         #define plug_file       5
+        #define plug_qrom       6
+        #define plug_file_qrom  7
 
 #define UNPLUG_HELP_TXT "plug functions\r\n\
         [no argument] shows the current plugged ROMs\r\n\
-        X (hex unplug the ROM in Page X\r\n"
+        X (hex unplug the ROM in Page X, all Banks\r\n\
+        X bN  unplug only Bank N (1..4) in Page X\r\n"
 
 
 #define PRINTER_HELP_TXT "printer functions for the HP82143\r\n\
@@ -138,7 +174,45 @@ extern "C" {
         hpil          toggle HP-IL tracing to ILSCOPE USB serial port\r\n\
         pilbox        toggle PILBox serial tracing to ILSCOPE USB serial port\r\n\
         ilregs        toggle tracing of HP-IL registers\r\n\
-        save          save tracer settings\r\n"
+        save          save tracer settings\r\n\
+        replay        show the replay capture and the result of the last replay\r\n\
+        replay capture capture the next 512 traced bus cycles for replay\r\n\
+        replay run    replay the captured cycles through the bus loop and compare\r\n\
+        replay clear  discard the replay capture, frees the upper half of the TraceBuffer\r\n\
+        replay load [file] load 512 consecutive cycles from a binary trace file on the uSD card\r\n\
+        binary        toggle the binary trace stream on the tracer port (text by default)\r\n\
+        bintest       encode and decode the replay capture and compare\r\n\
+        fmtbench      compare and time the trace line formatters\r\n\
+        sd            show the progress of the capture to the uSD card\r\n\
+        sd [file]     capture the trace to a file on the uSD card in the binary format\r\n\
+        sd stop       stop the capture and close the file, do this before ejecting the card\r\n\
+        snap          show the state of the snapshot capture\r\n\
+        snap start    snapshot capture in the TraceBuffer until snap stop\r\n\
+        snap adr [a] [post]     snapshot capture, frozen [post] records after address a (hex)\r\n\
+        snap inst [i] [post]    snapshot capture, frozen [post] records after instruction i (hex)\r\n\
+        snap frame [f] [post]   snapshot capture, frozen [post] records after HP-IL frame f (hex)\r\n\
+        snap stop     freeze the snapshot now\r\n\
+        snap dump     send the frozen snapshot to the tracer port\r\n\
+        snap sd [file]          write the frozen snapshot to the uSD card in the binary format\r\n\
+        snap off      leave the snapshot capture and continue live tracing\r\n\
+        prof [n]      profiler report, top n (default 10) addresses, ranges and functions\r\n\
+        prof start    start counting the fetches of every address, live tracing stops\r\n\
+        prof stop     stop counting, the results are kept\r\n\
+        prof csv [file]         write the fetch count of all addresses to a CSV file on the uSD card\r\n\
+        prof off      leave the profiler and continue live tracing\r\n\
+        symbols       toggle the function of the address (FAT name or XROM nn,ff +offset) in the trace\r\n\
+        stats         trace pipeline counters: produced, filtered, dropped, rendered, bytes, USB stalls\r\n\
+        stats reset   start the counters and high water marks from 0\r\n\
+        stats [n]     show a status line with the counters every n seconds, 0 to stop\r\n\
+        filter        list the block, pass and trigger filters\r\n\
+        filter block [a1] [a2] [bn]  do not trace a1..a2 (hex), optional only in bank n\r\n\
+        filter pass [a1] [a2] [bn]   only trace a1..a2 (hex), optional only in bank n\r\n\
+        filter trig [a1] [a2] [bn]   trace from address a1 until address a2\r\n\
+        filter count [a1] [n] [bn]   trace n samples from address a1\r\n\
+        filter del [n]     delete filter n\r\n\
+        filter toggle [n]  toggle filter n active/inactive\r\n\
+        filter depth [pre] [post]    samples traced before and after a trigger\r\n\
+        filter clear       delete all filters\r\n"
 
         #define trace_status      1
         #define trace_trace       2
@@ -149,6 +223,48 @@ extern "C" {
         #define trace_pilbox      7
         #define trace_ilregs      8
         #define trace_save        9
+        #define trace_replay      10
+        #define trace_binary      11
+        #define trace_bintest     12
+        #define trace_filter_cmd  13
+        #define trace_fmtbench    14
+        #define trace_sd_cmd      15
+        #define trace_snap_cmd    16
+        #define trace_prof_cmd    17
+        #define trace_symbols     18
+        #define trace_stats_cmd   19
+
+        #define tfilter_list      1
+        #define tfilter_block     2
+        #define tfilter_pass      3
+        #define tfilter_trig      4
+        #define tfilter_count     5
+        #define tfilter_del       6
+        #define tfilter_toggle    7
+        #define tfilter_depth     8
+        #define tfilter_clear     9
+
+        #define snap_cmd_status     1
+        #define snap_cmd_start      2
+        #define snap_cmd_adr        3
+        #define snap_cmd_inst       4
+        #define snap_cmd_frame      5
+        #define snap_cmd_stop       6
+        #define snap_cmd_dump       7
+        #define snap_cmd_sd         8
+        #define snap_cmd_off        9
+
+        #define prof_cmd_report     1
+        #define prof_cmd_start      2
+        #define prof_cmd_stop       3
+        #define prof_cmd_csv        4
+        #define prof_cmd_off        5
+
+        #define replay_cmd_status   1
+        #define replay_cmd_capture  2
+        #define replay_cmd_run      3
+        #define replay_cmd_clear    4
+        #define replay_cmd_load     5
 
         /*  functions for later implemntation:
         block [no arg] show block entries\r\n\
@@ -164,10 +280,14 @@ extern "C" {
         */
 
 #define XMEM_HELP_TXT "Extended Memory functions\r\n\
-        status        shows the Extended Memory status\r\n\
+        status        shows the Extended Memory status and FRAM write-back statistics\r\n\
         dump          creates a dump of Extended Memory\r\n\
         PATTERN       programs a pattern for FRAM test\r\n\
         ERASE         erase all Extended Memory\r\n\
+        test          self test of the User Memory decoding, shows failures\r\n\
+        mm1 .. mm4    toggle Memory Module 1..4 emulation (HP41C only, registers 100-1FF)\r\n\
+        quad          toggle Quad Memory Module emulation (HP41C only)\r\n\
+        xfun          toggle X-Functions memory emulation (registers 040-0BF)\r\n\
         [n]           n= 0, 1, 2 \r\n\
                       plugs 0, 1 or 2 Extended Memory Modules\r\n\
                       do not use in combination with physical Extended Memory modules\r\n\
@@ -178,6 +298,8 @@ extern "C" {
         #define xmem_dump       2
         #define xmem_pattern    3
         #define xmem_erase      4
+        #define xmem_test       5
+        #define xmem_mm1        6
 
 #define FLASH_HELP_TXT "FLASH test functions\r\n\
         DANGER: the FLASH functions are for development testing only!!!\r\n\
@@ -189,13 +311,16 @@ extern "C" {
                       subsequent use of dump without [ADDR] lists the next 4K\r\n\
         INIT          initializes the FLASH file system\r\n\
         NUKEALL       erases all FLASH pages\r\n\
-        fram [ADDR]   creates a dump of FRAM\r\n"
+        fram [ADDR]   creates a dump of FRAM\r\n\
+        compact       moves the files down over the deleted files and frees the space\r\n\
+                      the plugged ROMs follow their files, resumes after a power loss\r\n"
 
         #define flash_status    1
         #define flash_dump      2
         #define flash_init      3
         #define flash_nukeall   4
         #define flash_fram      5
+        #define flash_compact   6
 
 #define FRAM_HELP_TXT "FRAM test functions\r\n\
         DANGER: the FRAM functions are for development testing only!!!\r\n\
@@ -287,6 +412,10 @@ extern "C" {
   extern void uif_poweron();            // drive ISA to powerup the HP41
   extern void uif_configinit();         // reinitialize peristent settings
   extern void uif_configlist();         // list all settings
+  extern void uif_cache(int i);         // SRAM page cache status and control
+  extern void uif_dispatch(int i);      // core1 dispatch table status and control
+  extern void uif_timing(int i, int val);   // core1 bus cycle timing status and control
+  extern void uif_bench(int mix);       // bus loop benchmark with simulated bus cycles
 
 // all dir functions
   extern void uif_dir(const char *dir);                // dir root
@@ -305,7 +434,7 @@ extern "C" {
 
 // ROM plug and unplug functions
   extern void uif_plug(int func, int Page, int Bank, const char *fname);          // plug the selected ROM  
-  extern void uif_unplug(int i);        // unplug the selected ROM
+  extern void uif_unplug(int i, int b);  // unplug the selected ROM, b = 0 for all Banks
   extern void uif_cat(int p);                // show the plugged ROMs
 
   extern void uif_printer(int i);       // function for the HP82143A printer
@@ -313,6 +442,12 @@ extern "C" {
   extern void uif_xmem(int i);          // functions for Extended Memory control
 
   extern void uif_tracer(int i);        // functions for the bus tracer
+  extern void uif_replay(int i, const char *fname);     // capture and replay of traced bus cycles
+  extern void uif_tracer_filter(int i, int v1, int v2, int bank);   // tracer filters and triggers
+  extern void uif_tracer_sd(const char *arg);   // trace capture to the uSD card
+  extern void uif_tracer_snap(int i, int v, int post, const char *fname);   // snapshot capture in the TraceBuffer
+  extern void uif_tracer_prof(int i, int n, const char *fname);   // profiler
+  extern void uif_tracer_stats(const char *arg);   // trace pipeline telemetry
 
   extern void uif_flash(int i, uint32_t addr);   // functions for the FLASH test
   extern void uif_fram(int i, uint32_t addr);    // functions for the FRAM test
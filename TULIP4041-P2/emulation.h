@@ -40,6 +40,7 @@ extern "C" {
 #include "hardware/structs/systick.h"
 #include "hardware/uart.h"                      // used for UART0 Printer port
 #include "hp41_defs.h"
+#include "hp41_state.h"
 #include "hpinterface_hardware.h"
 #include "hp41_pio.pio.h"
 // #include "userinterface.h"
@@ -75,8 +76,6 @@ extern const int WandBufSize;               // size of WandBuffer
 extern queue_t HPIL_SendBuffer;             // buffer for HP-IL send and receive
 extern queue_t HPIL_RecvBuffer;             // buffer for HP-IL send and receive
 
-extern int xmem_mods;                       // number of Extended Memory modules active (0, 1 or 2)
-
 
 
 uint32_t cycles();
@@ -92,6 +91,31 @@ enum HP41powermode {eAwake, eLightSleep, eDeepSleep};       // sleep modes
 
 void uif_pio_report();
 
+void fetch_timing_reset();
+void timing_set_margin(uint32_t us);
+
+uint32_t sim_run(const struct SimCycle *in, int n, const struct TLine *start,
+                 void (*check)(int k, const struct SimOut *res));
+extern bool sim_stopped;                // the last sim_run() was stopped because PWO went high
+
+void emuconfig_publish();
+
+// User Memory registers 0x000..0x3FF in SRAM, written back to FRAM by core0
+#define USERMEM_FLUSH_INTERVAL  10          // ms between background write-back passes
+#define USERMEM_FLUSH_MAX       64          // max registers written in one background pass
+
+void usermem_load();
+int usermem_flush(int max);
+int usermem_backlog();
+void UserMem_task();
+void usermem_selftest();
+
+// QROM write-back, see module.h
+#define QROM_FLUSH_INTERVAL     20          // ms between background write-back passes
+#define QROM_FLUSH_MAX          4           // max blocks of 256 words written in one background pass
+
+void QROM_task();
+
 extern uint16_t SELP9_status;      // contains the HP82143A printer status bits, set to default values
 extern uint8_t HPIL_REG[9];
 
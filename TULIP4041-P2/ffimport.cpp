@@ -0,0 +1,77 @@
+/*
+ * ffimport.cpp
+ *
+ * This file is part of the TULIP4041 project.
+ * Copyright (C) 2024 Meindert Kuipers
+ *
+ * This is free software: you are free to change and redistribute it.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * 
+ * USE AT YOUR OWN RISK
+ *
+ */
+
+// streaming of a file from the uSD card to FLASH for import
+// built in the firmware and in the host build, see host/CMakeLists.txt
+// the reading and the programming itself are done by the callbacks in struct FFImportIO
+// reading and programming take turns, f_read() and the SD card driver wait for their DMA on core0
+// and core1 cannot program FLASH while it runs the bus loop
+
+#include <string.h>
+
+#include "ffimport.h"
+
+static uint8_t imp_buf[IMPORT_CHUNK];   // file data waiting to be programmed
+static uint8_t imp_first[256];          // first page with the header, programmed when the whole file is in FLASH
+
+// program the header and the open file at offs in FLASH, the FLASH must be erased
+// the file is read in chunks of IMPORT_CHUNK bytes, large reads let the SD card driver use multi block transfers
+// the file is programmed from imp_buf in whole FLASH pages, a partial page is kept for the next chunk
+// the first page with the header is programmed last and the index is updated then, so a file that could
+// not be read completely is never in the chain
+// returns false on a read error or when the file ends before header->FileSize bytes
+bool ff_import_stream(const ModuleMetaHeader_t *header, uint32_t offs, const struct FFImportIO *io)
+{
+  memcpy(imp_buf, header, sizeof(ModuleMetaHeader_t));
+  int len = sizeof(ModuleMetaHeader_t);       // bytes waiting in imp_buf
+  uint32_t left = header->FileSize;           // bytes left to read from the file
+  uint32_t prog = offs;                       // next offset to program
+  int read;
+
+  while (true) {
+    read = io->read(imp_buf + len, (left < (uint32_t)(IMPORT_CHUNK - len)) ? left : IMPORT_CHUNK - len);
+    if (read < 0) return false;
+    if ((read == 0) && (left > 0)) return false;        // the file is shorter than its size
+    len += read;
+    left -= read;
+
+    // program the whole pages, all that is left at the end of the file padded with 0xFF
+    bool last = (left == 0);
+    int num = last ? ((len + 0xFF) & ~0xFF) : (len & ~0xFF);
+    if (last) memset(imp_buf + len, 0xFF, num - len);
+
+    int p = 0;
+    if ((prog == offs) && (num > 0)) {
+      memcpy(imp_first, imp_buf, sizeof(imp_first));   // the header page is kept back
+      p = sizeof(imp_first);
+      prog += p;
+    }
+    while (p < num) {
+      int n = (num - p < IMPORT_PROGRAM) ? num - p : IMPORT_PROGRAM;
+      io->program(prog, imp_buf + p, n);
+      prog += n;
+      p += n;
+    }
+
+    if (last) {
+      io->program(offs, imp_first, sizeof(imp_first));
+      ff_index_update(offs);                  // the header is in FLASH now
+      return true;
+    }
+    memmove(imp_buf, imp_buf + num, len - num);
+    len -= num;
+  }
+}
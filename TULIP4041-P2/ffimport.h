@@ -0,0 +1,47 @@
+/*
+ * ffimport.h
+ *
+ * This file is part of the TULIP4041 project.
+ * Copyright (C) 2024 Meindert Kuipers
+ *
+ * This is free software: you are free to change and redistribute it.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * 
+ * USE AT YOUR OWN RISK
+ *
+ */
+
+// streaming of a file from the uSD card to FLASH for import, without any Pico SDK includes
+// built in the firmware and in the host build, host/fftest.cpp checks the chunks and pages
+
+#ifndef __FFIMPORT_H__
+#define __FFIMPORT_H__
+
+#ifdef __cplusplus 
+extern "C" { 
+#endif 
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "ffindex.h"
+
+#define IMPORT_CHUNK    0x4000      // bytes read from the uSD card at once, a multiple of the FLASH page of 256 bytes
+#define IMPORT_PROGRAM  0x1000      // max bytes programmed with the interrupts disabled
+
+// file and FLASH access of ff_import_stream(), the firmware versions are in userinterface.cpp
+struct FFImportIO {
+  int   (*read)(uint8_t *buf, uint32_t len);                          // up to len bytes of the file, returns the bytes read, -1 on an error
+  void  (*program)(uint32_t offs, const uint8_t *buf, uint32_t num);  // whole pages at offs in the erased FLASH, at most IMPORT_PROGRAM bytes
+};
+
+bool ff_import_stream(const ModuleMetaHeader_t *header, uint32_t offs, const struct FFImportIO *io);
+
+#ifdef __cplusplus 
+} 
+#endif 
+    
+#endif  // __FFIMPORT_H__
@@ -0,0 +1,399 @@
+/*
+ * ffindex.cpp
+ *
+ * This file is part of the TULIP4041 project.
+ * Copyright (C) 2024 Meindert Kuipers
+ *
+ * This is free software: you are free to change and redistribute it.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * 
+ * USE AT YOUR OWN RISK
+ *
+ */
+
+// lookups in the FLASH File System, with the SRAM index or with a walk of the chain of headers in FLASH
+// built in the firmware and in the host build, see host/CMakeLists.txt
+// the rest of the file system is in ffmanager.cpp
+
+#include <ctype.h>
+#include <strings.h>
+
+#include "ffindex.h"
+
+#ifdef DEBUG
+  #include "cli-binding.h"
+#endif
+
+// SRAM index of the FLASH File System
+// walking the chain of headers in FLASH for every lookup makes import ALL quadratic in the number of files,
+// the index is built once at boot and kept up to date by import, delete, init and nuke
+//  - entries in chain order, so sorted on the offset
+//  - a hash of the upper case file name for ff_findfile()
+//  - a list of the deleted and dummy entries for ff_findfree()
+// when the chain does not fit in the index or is not valid, the functions walk the chain in FLASH as before
+FFIndex_t ff_index;
+
+// FNV-1a hash of the upper case name, ff_findfile() is case insensitive
+static uint32_t ff_hash(const char *name)
+{
+  uint32_t h = 2166136261u;
+  for (int i = 0; (i < 31) && (name[i] != 0); i++) {
+    h ^= (uint8_t)toupper(name[i]);
+    h *= 16777619u;
+  }
+  return h;
+}
+
+// add entry n to its hash bucket and the free list, from the header in FLASH
+static void ff_index_link(int n)
+{
+  FFEntry_t *e = &ff_index.e[n];
+  ModuleMetaHeader_t *MetaH = (ModuleMetaHeader_t*)(FF_SYSTEM_BASE + e->offs);
+
+  e->type = MetaH->FileType;
+  e->next = MetaH->NextFile;
+  e->hash = ff_hash(MetaH->FileName);
+  e->chain = FF_NONE;
+  if (ff_named(e->type)) {
+    int b = e->hash & (FF_HASH_SIZE - 1);
+    e->chain = ff_index.bucket[b];
+    ff_index.bucket[b] = n;
+    ff_index.files++;
+  }
+  if (ff_reusable(e->type)) ff_index.freelist[ff_index.nfree++] = n;
+}
+
+// remove entry n from its hash bucket and the free list
+static void ff_index_unlink(int n)
+{
+  FFEntry_t *e = &ff_index.e[n];
+
+  if (ff_named(e->type)) {
+    uint16_t *p = &ff_index.bucket[e->hash & (FF_HASH_SIZE - 1)];
+    while ((*p != FF_NONE) && (*p != n)) p = &ff_index.e[*p].chain;
+    if (*p == n) *p = e->chain;
+    ff_index.files--;
+  }
+  if (ff_reusable(e->type)) {
+    for (int i = 0; i < ff_index.nfree; i++) {
+      if (ff_index.freelist[i] == n) {
+        ff_index.freelist[i] = ff_index.freelist[--ff_index.nfree];
+        break;
+      }
+    }
+  }
+}
+
+// build the index from the chain in FLASH, the time is kept in ff_index.build_us
+void ff_index_build()
+{
+  uint32_t start = ff_time_us();
+  uint32_t offs = 0;
+
+  ff_index.valid = false;
+  ff_index.count = 0;
+  ff_index.files = 0;
+  ff_index.nfree = 0;
+  memset(ff_index.bucket, 0xFF, sizeof(ff_index.bucket));         // all FF_NONE
+
+  while (offs < FF_SYSTEM_SIZE) {
+    ModuleMetaHeader_t *MetaH = (ModuleMetaHeader_t*)(FF_SYSTEM_BASE + offs);
+    if (MetaH->FileType == FILETYPE_FFFF) break;                  // end of the chain
+    if ((MetaH->FileType > FILETYPE_4041) && (MetaH->FileType != FILETYPE_DUMMY)) break;   // not a valid file
+    if ((MetaH->NextFile <= offs) || (ff_index.count == FF_INDEX_MAX)) break;            // loop or too many files
+    ff_index.e[ff_index.count].offs = offs;
+    ff_index_link(ff_index.count++);
+    offs = MetaH->NextFile;
+  }
+  ff_index.end = offs;
+  // the last file may end exactly at the end of FLASH
+  ff_index.valid = (offs == FF_SYSTEM_SIZE) ||
+                   ((offs < FF_SYSTEM_SIZE) && (((ModuleMetaHeader_t*)(FF_SYSTEM_BASE + offs))->FileType == FILETYPE_FFFF));
+  ff_index.build_us = ff_time_us() - start;
+}
+
+// the header at offs was written or changed, offs is an entry in the chain or the end of the chain
+void ff_index_update(uint32_t offs)
+{
+  int lo = 0, hi = ff_index.count;
+
+  if (!ff_index.valid) return;
+  if (offs == ff_index.end) {
+    // a new file at the end of the chain
+    ModuleMetaHeader_t *MetaH = (ModuleMetaHeader_t*)(FF_SYSTEM_BASE + offs);
+    if ((ff_index.count == FF_INDEX_MAX) || (MetaH->NextFile <= offs)) {
+      ff_index_build();
+      return;
+    }
+    ff_index.e[ff_index.count].offs = offs;
+    ff_index_link(ff_index.count++);
+    ff_index.end = MetaH->NextFile;
+    return;
+  }
+
+  // an existing entry, binary search on the offset
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    if (ff_index.e[mid].offs < offs) lo = mid + 1; else hi = mid;
+  }
+  if ((lo == ff_index.count) || (ff_index.e[lo].offs != offs)) {
+    ff_index_build();                   // not in the chain, start again
+    return;
+  }
+  ff_index_unlink(lo);
+  ff_index_link(lo);
+}
+
+// ff_findfile() with the index
+static uint32_t ff_index_find(const char *name)
+{
+  uint32_t h = ff_hash(name);
+
+  for (uint16_t n = ff_index.bucket[h & (FF_HASH_SIZE - 1)]; n != FF_NONE; n = ff_index.e[n].chain) {
+    if (ff_index.e[n].hash != h) continue;
+    ModuleMetaHeader_t *MetaH = (ModuleMetaHeader_t*)(FF_SYSTEM_BASE + ff_index.e[n].offs);
+    if (strcasecmp(MetaH->FileName, name) == 0) return ff_index.e[n].offs;
+  }
+  return NOTFOUND;
+}
+
+// ff_findfree() with the index, the smallest deleted or dummy entry that fits, otherwise the end of the chain
+// size includes the header, the result is the same as the walk through the chain in ff_findfree()
+static uint32_t ff_index_free(uint32_t size)
+{
+  uint32_t candidate = 0;
+  uint32_t cand_size = 0;
+  uint32_t space;
+
+  for (int i = 0; i < ff_index.nfree; i++) {
+    const FFEntry_t *e = &ff_index.e[ff_index.freelist[i]];
+    space = e->next - e->offs;
+    if (space < size) continue;
+    if ((cand_size == 0) || (space < cand_size) || ((space == cand_size) && (e->offs < candidate))) {
+      candidate = e->offs;
+      cand_size = space;
+    }
+  }
+
+  space = FF_SYSTEM_SIZE - ff_index.end;
+  if (space <= size) return (candidate != 0) ? candidate : NOTFOUND;   // FLASH is full, a deleted slot may still fit
+  if ((candidate == 0) || (space < cand_size)) return ff_index.end;
+  return candidate;
+}
+
+// ff_findfree
+// finds the smallest free entry in the FLASH File System matching the given file size
+// size is the filesize WITHOUT the header size	
+// starts at the given FLASH offset, which must be a valid file start, typically 0 for the first call
+// returns the offset in FLASH of this free file slot, this may be an empty or deleted entry
+// this may also the offset to the end of the file system if no free space is found
+// offset is always from the start of the FF_SYSTEM_BASE 
+// returns NOTFOUND when no free space is found
+uint32_t ff_findfree(uint32_t offs, uint32_t size)
+{
+  ModuleMetaHeader_t *MetaH;                    // pointer to meta header for getting info of file
+  ModuleMetaHeader_t *MetaH_next;               // pointer to meta header for getting info of the next file
+
+  // find the first free slot in FLASH
+  uint32_t ff_end = FF_SYSTEM_SIZE;             // end of the file system
+  uint32_t next;                                // offset to the next file
+  uint32_t candidate = 0;                       // candidate for the file slot
+  uint32_t cand_size = 0;                       // size of the candidate file slot
+  uint32_t current = 0;                         // current file slot under investigation
+  uint32_t space = 0;                           // size of the free space
+  uint32_t space_acc = 0;                       // accumulated size of the free space
+
+
+  size = size + sizeof(ModuleMetaHeader_t);     // required size of file plus header
+
+  if (ff_index.valid && (offs == 0)) return ff_index_free(size);
+
+  #ifdef DEBUG
+    cli_printf("  searching for free space in FLASH, size %d / %d bytes", size, size - sizeof(ModuleMetaHeader_t));
+  #endif
+
+  while (offs < ff_end) {
+    MetaH = (ModuleMetaHeader_t*)(FF_SYSTEM_BASE + offs);    // map header to struct
+    uint8_t filetype = MetaH->FileType;                      // get the file type
+    ff_poll();  // keep the USB port updated
+
+    switch(filetype) {
+      case FILETYPE_FFFF:                                   // end of the file system
+        #ifdef DEBUG
+          cli_printf("  end of file system reached at %08X", offs);
+        #endif
+        // we have reached the end of the File System
+        // check the remaining space
+
+        if ((ff_end - offs) > size) {
+          // there is enough size left
+          // is this space is smaller than the current candidate then this is better
+          // and we can return the offset
+          if ((ff_end - offs) < cand_size) {
+            return offs;
+          }
+          // if the new slot is larger than the candidate then we use the candidate
+          // but we have to check if the candidate is valid as it could be 0
+          if (candidate == 0) {
+            // no candidate found yet, so this is the first one
+            return offs;
+          }
+        } else {
+          // not enough space left, this means that our candidate, if any, is now valid
+          // if the candidate was 0, then bad luck, no space available
+          return (candidate != 0) ? candidate : NOTFOUND;
+        }   
+
+        return candidate;
+        break;                      // we should never get here
+
+      case FILETYPE_DELETED:                                   
+      case FILETYPE_DUMMY:                  
+        // found an empty file or dummy, check if it is large enough
+        // get the offset to the next file to determine the size
+        // no check for subsequent dummy or deleted files, maybe add this later
+        next = MetaH->NextFile;             // pointer to the next file to get the available space
+        space = next - offs;                // available space in this file
+
+        #ifdef DEBUG
+          cli_printf("  deleted space at %08X of %d bytes", offs, space);
+        #endif
+
+        // if the file fits we report this space, if not we check if there is free space after this file
+        if (space >= size) {
+          // there is enough space in this file
+          // check if this is smaller than the current candidate then this is better
+          // and we can return the offset and continue the search
+          // if the cadidate was still 0 this is a possible candidate
+          if (cand_size == 0) {
+            // no candidate found yet, so this is the first one
+            candidate = offs;              // remember the current file offset as a candidate
+            cand_size = space;             // remember the size of the candidate
+            #ifdef DEBUG
+              cli_printf("  first candidate found at %08X of %d bytes", offs, space);
+            #endif
+          } else if (space < cand_size) {
+            // this slot is smaller then the previous candidate and it fits
+            // this is now a better candidate
+            #ifdef DEBUG
+              cli_printf("  better candidate at %08X of %d bytes", offs, space);
+            #endif
+            candidate = offs;              // remember the current file offset as a candidate
+            cand_size = space;             // remember the size of the candidate
+          }
+        } 
+        offs = next;
+        
+        // the next part is skipped for now
+        // this is checking if 2 consecutive files are ok
+        /* 
+        else {
+          // if this slot is smaller then we can check if there is free space after this file
+          // get the filetype of the next file
+          MetaH_next = (ModuleMetaHeader_t*)(FF_SYSTEM_BASE + next);    // map header to struct
+
+          // if this slot is smaller then we can check if there is free space after this fil      
+          if ((MetaH_next->FileType != FILETYPE_FFFF) || (MetaH_next->FileType != FILETYPE_DELETED) || 
+            (MetaH_next->FileType != FILETYPE_DUMMY)) {
+            // there is a file which is in use, so the space cannot be used
+            // we keep the current candidate
+            offs = next;                  // go to the next file
+          } else {
+            // there is erased or free space after this
+            // for now we skip this, implement later
+            offs = next;                // go to the next file
+          }
+        }
+          */
+        break;
+      default:
+        // all other filetypes can be skipped, this is not potential free space
+        // move to the next file
+        #ifdef DEBUG
+          // cli_printf("  skipping file at %08X of type %02X, next is %08X", offs, filetype, MetaH->NextFile);
+        #endif
+        offs = MetaH->NextFile;                                     // go to the next file
+        break;
+    }
+  }
+
+  // if we get here then the last file ends exactly at the end of the file system
+  // only a deleted slot can be used, offset 0 is the header of the file system and never a free slot
+  return (candidate != 0) ? candidate : NOTFOUND;
+
+}
+
+
+// ff_lastfree
+// finds the last free entry in the list of MOD/ROM files in FLASH
+// starts at the given FLASH offset, which must be a valid file start, typically 0 for the first call
+// returns the offset in FLASH of the first free erased entry, this will usually be after the last file
+// use this call when searching for a free slot to prevent wear on the FLASH, but may increase fragmentation
+// offset is always from the start of the FF_SYSTEM_BASE, default at 0x00080000 + XIP_BASE 
+// returns 0xFFFFFFFF when no free space is found
+uint32_t ff_lastfree(uint32_t offs)
+{
+  ModuleMetaHeader_t *MetaH;          // pointer to meta header for getting info of next file
+
+  // first find the last available slot in FLASH
+  uint32_t end = FF_SYSTEM_SIZE;
+  if (ff_index.valid && (offs == 0)) return ff_index.end;
+  while (offs < end) {
+    #ifdef DEBUG
+      // cli_printf("  checking file at 0x%08X end at: 0x%08X", offs, end);
+    #endif
+    MetaH = (ModuleMetaHeader_t*)(FF_SYSTEM_BASE + offs);       // map header to struct
+    if (MetaH->FileType == FILETYPE_FFFF) break;                // if it erased then it is useable
+    // check if this is a valid file to prevent looping, dummies are part of the chain
+    if ((MetaH->FileType > FILETYPE_4041) && (MetaH->FileType != FILETYPE_DUMMY)) {
+      // unsupported file type, this is not a valid file
+      return NOTFOUND;                                          // no free space found
+    }
+    offs = MetaH->NextFile;                                     // go to the next file
+  }
+  if (offs > end) return NOTFOUND;                              // no free space found
+  return offs;                                                  // return the offset of the last free slot
+}
+
+
+// ff_findnext
+// returns a pointer to the next file in the chain of MOD/ROM files in FLASH
+// offs must point to a valid file start, typically 0 for the first call
+uint32_t ff_findnextf(uint32_t offs)
+{
+  ModuleMetaHeader_t *MetaH;          // pointer to meta header for getting info of next file
+  MetaH = (ModuleMetaHeader_t*)(FF_SYSTEM_BASE + offs);       // map header to struct
+  return MetaH->NextFile;                                     // return a pointer to the next file
+}
+
+
+// ff_findfile
+// search for a file by name and return the pointer
+// returns the offset in FLASH of the file with the given name
+// returns 0xFFFFFFFF when the file is not found
+// deleted files and dummies are skipped
+uint32_t ff_findfile(const char *name)
+{
+  ModuleMetaHeader_t *MetaH;          // pointer to meta header for getting info of next file
+  uint32_t offs = 0;                  // start of the file system
+  uint32_t end = FF_SYSTEM_SIZE;      // end of the file system
+
+  if (ff_index.valid) return ff_index_find(name);
+
+  // check if a file exists, do a case insensitive compare
+  while (offs < end) {
+    MetaH = (ModuleMetaHeader_t*)(FF_SYSTEM_BASE + offs);       // map header to struct
+    if (MetaH->FileType == FILETYPE_FFFF) return NOTFOUND;      // end of chain reached
+    // if the file is marked for erase or a dummy then we must skip it
+    if (strcasecmp(MetaH->FileName, name) == 0 && (MetaH->FileType != FILETYPE_DELETED) &&
+        (MetaH->FileType != FILETYPE_DUMMY)) {
+      return offs;    // found the file
+    }
+    offs = MetaH->NextFile;                                     // go to the next file
+  }
+
+  return NOTFOUND;                                              // file not found
+}
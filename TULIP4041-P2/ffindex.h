@@ -0,0 +1,89 @@
+/*
+ * ffindex.h
+ *
+ * This file is part of the TULIP4041 project.
+ * Copyright (C) 2024 Meindert Kuipers
+ *
+ * This is free software: you are free to change and redistribute it.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * 
+ * USE AT YOUR OWN RISK
+ *
+ */
+
+// SRAM index of the FLASH File System and the lookups in the chain of file headers, without any Pico SDK includes
+// built in the firmware and in the host build, host/fftest.cpp checks the index against the walks of the chain
+
+#ifndef __FFINDEX_H__
+#define __FFINDEX_H__
+
+#ifdef __cplusplus 
+extern "C" { 
+#endif 
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "hpinterface_hardware.h"
+#include "modfile.h"
+
+#ifdef FF_HOST_SIZE
+// host build, the file system is an image of FF_HOST_SIZE bytes in RAM
+extern uint8_t ff_host_image[];
+#undef FF_SYSTEM_BASE
+#undef FF_SYSTEM_SIZE
+#define FF_SYSTEM_BASE  ((uintptr_t)ff_host_image)
+#define FF_SYSTEM_SIZE  FF_HOST_SIZE
+#endif
+
+// SRAM index of the FLASH File System, see ff_index_build()
+#define FF_INDEX_MAX    1024        // max number of files in the chain, including deleted files
+#define FF_HASH_SIZE    1024        // number of hash buckets for the file names, must be a power of 2
+#define FF_NONE         0xFFFF      // end of a hash bucket
+
+typedef struct {
+  uint32_t  offs;                   // offset of the header in the file system
+  uint32_t  next;                   // NextFile from the header
+  uint32_t  hash;                   // hash of the upper case file name
+  uint16_t  chain;                  // next entry in the same hash bucket
+  uint8_t   type;                   // FileType from the header
+} FFEntry_t;
+
+typedef struct {
+  bool      valid;                  // false when the chain does not fit or is broken, the chain in FLASH is used
+  int       count;                  // number of entries
+  int       files;                  // entries that can be found by name, all but deleted files and dummies
+  int       nfree;                  // deleted and dummy entries in freelist[]
+  uint32_t  end;                    // offset of the end of the chain
+  uint32_t  build_us;               // duration of the last ff_index_build()
+  uint16_t  bucket[FF_HASH_SIZE];   // first entry of each hash bucket
+  uint16_t  freelist[FF_INDEX_MAX]; // deleted and dummy entries
+  FFEntry_t e[FF_INDEX_MAX];        // in chain order
+} FFIndex_t;
+
+extern FFIndex_t ff_index;
+
+// entries of deleted files and dummies are not found by name, both can be reused
+static inline bool ff_named(uint8_t type) { return (type != FILETYPE_DELETED) && (type != FILETYPE_DUMMY); }
+static inline bool ff_reusable(uint8_t type) { return (type == FILETYPE_DELETED) || (type == FILETYPE_DUMMY); }
+
+void ff_index_build();
+void ff_index_update(uint32_t offs);
+
+uint32_t ff_lastfree(uint32_t offs);
+uint32_t ff_findfree(uint32_t offs, uint32_t size);
+uint32_t ff_findnextf(uint32_t offs);
+uint32_t ff_findfile(const char *name);
+
+// per target, the firmware versions are in ffmanager.cpp
+uint32_t ff_time_us();              // time for ff_index.build_us
+void ff_poll();                     // called in the walks of the chain, keeps the USB port updated
+
+#ifdef __cplusplus 
+} 
+#endif 
+    
+#endif  // __FFINDEX_H__
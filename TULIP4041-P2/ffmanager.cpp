@@ -47,11 +47,18 @@
 //  ff_delete       - delete a file from FLASH/FRAM
 //  ff_erase        - erase an arbitrary block of FLASH (256-byte boundaries)
 //                    to prepare for writing a block
+//  ff_erase_sector - erase a single 4K sector, keeping its first part
+//  ff_compact      - move the files down over the deleted entries, resumable after a power loss
 //  ff_program      - erase and re-program an arbitrary range of FLASH
 //                    based on 256-byte boundaries
 //  ff_findfile_n   - find file by index number and return the pointer
 //  ff_show         - show FLASH contents in the CLI with 16 bytes per line
 
+// SRAM index
+//  ff_index_build  - build the index from the chain in FLASH, done at boot
+//  ff_index_update - update the index after a header was written or changed
+// the index, ff_lastfree, ff_findfree, ff_findnextf and ff_findfile are in ffindex.cpp, also built on the host
+
 
 /*  layout of FLASH memory
 
@@ -93,26 +100,25 @@ const uint16_t *flash_contents_wd = (const uint16_t *)(XIP_BASE + FF_OFFSET);
 
 static uint32_t ints;
 
-// function to wait 0.5 seconds while flushing the console output
-// use this before erasing or programming flash
-void ff_delay500()
+// send the pending console output before erasing or programming flash
+// the USB stack cannot run while the interrupts are disabled, so the output would come out late
+// returns as soon as the console output is sent, or after FF_FLUSH_TIMEOUT ms when the host does not read it
+void ff_flush_console()
 {
-    int waitcount = 500;  // 0.5 seconds
-    while(waitcount > 0) {
-    sleep_ms(2);
-    waitcount--;
-  
-    // flush the outpout buffer
+  uint32_t start = time_us_32();
+
+  if (!cdc_connected(ITF_CONSOLE)) return;
+  do {
     cdc_flush(ITF_CONSOLE);
     tud_task();  // must keep the USB port updated
-  }
+  } while (cdc_write_pending(ITF_CONSOLE) && (time_us_32() - start < FF_FLUSH_TIMEOUT * 1000));
 }
 
 // erase all FLASH in the filesystem area
 void ff_nuke()
 {
 
-  ff_delay500();  // wait for 0.5 seconds to flush the console output
+  ff_flush_console();  // send the console output first
 
   // to prevent issues with the tusb stack, erasing is done in chunks of 1 MByte
 
@@ -125,7 +131,7 @@ void ff_nuke()
 
     cli_printf("  Erasing FLASH File System block %2d at 0x%08X", i, ff_start);
 
-    ff_delay500();  // wait for 0.5 seconds to flush the console output
+    ff_flush_console();  // send the console output first
 
     // disable interrupts to prevent issues with the flash programming
     ints = save_and_disable_interrupts();
@@ -138,6 +144,7 @@ void ff_nuke()
 
     ff_start += (1024 * 1024); // next block to erase
   }
+  ff_index_build();
 }
 
 // check if the FLASH is fully erased
@@ -237,6 +244,7 @@ void ff_init()
     printbuf(flash_contents_bt, FLASH_PAGE_SIZE);
   #endif
 
+  ff_index_build();
 }
 
 bool ff_isinited()
@@ -300,212 +308,16 @@ void ff_show(uint32_t addr)
 
 }
 
-// ff_findfree
-// finds the smallest free entry in the FLASH File System matching the given file size
-// size is the filesize WITHOUT the header size	
-// starts at the given FLASH offset, which must be a valid file start, typically 0 for the first call
-// returns the offset in FLASH of this free file slot, this may be an empty or deleted entry
-// this may also the offset to the end of the file system if no free space is found
-// offset is always from the start of the FF_SYSTEM_BASE 
-// returns 0 when no free space is found
-uint32_t ff_findfree(uint32_t offs, uint32_t size)
-{
-  ModuleMetaHeader_t *MetaH;                    // pointer to meta header for getting info of file
-  ModuleMetaHeader_t *MetaH_next;               // pointer to meta header for getting info of the next file
-
-  // find the first free slot in FLASH
-  uint32_t ff_end = FF_SYSTEM_SIZE;             // end of the file system
-  uint32_t next;                                // offset to the next file
-  uint32_t candidate = 0;                       // candidate for the file slot
-  uint32_t cand_size = 0;                       // size of the candidate file slot
-  uint32_t current = 0;                         // current file slot under investigation
-  uint32_t space = 0;                           // size of the free space
-  uint32_t space_acc = 0;                       // accumulated size of the free space
-
-
-  size = size + sizeof(ModuleMetaHeader_t);     // required size of file plus header
-
-  #ifdef DEBUG
-    cli_printf("  searching for free space in FLASH, size %d / %d bytes", size, size - sizeof(ModuleMetaHeader_t));
-  #endif
-
-  while (offs < ff_end) {
-    MetaH = (ModuleMetaHeader_t*)(FF_SYSTEM_BASE + offs);    // map header to struct
-    uint8_t filetype = MetaH->FileType;                      // get the file type
-    tud_task();  // keep the USB port updated
-
-    switch(filetype) {
-      case FILETYPE_FFFF:                                   // end of the file system
-        #ifdef DEBUG
-          cli_printf("  end of file system reached at %08X", offs);
-        #endif
-        // we have reached the end of the File System
-        // check the remaining space
-
-        if ((ff_end - offs) > size) {
-          // there is enough size left
-          // is this space is smaller than the current candidate then this is better
-          // and we can return the offset
-          if ((ff_end - offs) < cand_size) {
-            return offs;
-          }
-          // if the new slot is larger than the candidate then we use the candidate
-          // but we have to check if the candidate is valid as it could be 0
-          if (candidate == 0) {
-            // no candidate found yet, so this is the first one
-            return offs;
-          }
-        } else {
-          // not enough space left, this means that our candidate, if any, is now valid
-          // if the candidate was 0, then bad luck, no space available
-          return NOTFOUND;         // no free space found
-        }   
-
-        return candidate;
-        break;                      // we should never get here
-
-      case FILETYPE_DELETED:                                   
-      case FILETYPE_DUMMY:                  
-        // found an empty file or dummy, check if it is large enough
-        // get the offset to the next file to determine the size
-        // no check for subsequent dummy or deleted files, maybe add this later
-        next = MetaH->NextFile;             // pointer to the next file to get the available space
-        space = next - offs;                // available space in this file
-
-        #ifdef DEBUG
-          cli_printf("  deleted space at %08X of %d bytes", offs, space);
-        #endif
-
-        // if the file fits we report this space, if not we check if there is free space after this file
-        if (space >= size) {
-          // there is enough space in this file
-          // check if this is smaller than the current candidate then this is better
-          // and we can return the offset and continue the search
-          // if the cadidate was still 0 this is a possible candidate
-          if (cand_size == 0) {
-            // no candidate found yet, so this is the first one
-            candidate = offs;              // remember the current file offset as a candidate
-            cand_size = space;             // remember the size of the candidate
-            #ifdef DEBUG
-              cli_printf("  first candidate found at %08X of %d bytes", offs, space);
-            #endif
-          } else if (space < cand_size) {
-            // this slot is smaller then the previous candidate and it fits
-            // this is now a better candidate
-            #ifdef DEBUG
-              cli_printf("  better candidate at %08X of %d bytes", offs, space);
-            #endif
-            candidate = offs;              // remember the current file offset as a candidate
-            cand_size = space;             // remember the size of the candidate
-          }
-        } 
-        offs = next;
-        
-        // the next part is skipped for now
-        // this is checking if 2 consecutive files are ok
-        /* 
-        else {
-          // if this slot is smaller then we can check if there is free space after this file
-          // get the filetype of the next file
-          MetaH_next = (ModuleMetaHeader_t*)(FF_SYSTEM_BASE + next);    // map header to struct
-
-          // if this slot is smaller then we can check if there is free space after this fil      
-          if ((MetaH_next->FileType != FILETYPE_FFFF) || (MetaH_next->FileType != FILETYPE_DELETED) || 
-            (MetaH_next->FileType != FILETYPE_DUMMY)) {
-            // there is a file which is in use, so the space cannot be used
-            // we keep the current candidate
-            offs = next;                  // go to the next file
-          } else {
-            // there is erased or free space after this
-            // for now we skip this, implement later
-            offs = next;                // go to the next file
-          }
-        }
-          */
-        break;
-      default:
-        // all other filetypes can be skipped, this is not potential free space
-        // move to the next file
-        #ifdef DEBUG
-          // cli_printf("  skipping file at %08X of type %02X, next is %08X", offs, filetype, MetaH->NextFile);
-        #endif
-        offs = MetaH->NextFile;                                     // go to the next file
-        break;
-    }
-  }
-
-  // if we get here then we have reached the end of the file system
-  // and most likely no free space is found and candidate is still 0
-  return candidate;                               
-
-}
-
-
-// ff_lastfree
-// finds the last free entry in the list of MOD/ROM files in FLASH
-// starts at the given FLASH offset, which must be a valid file start, typically 0 for the first call
-// returns the offset in FLASH of the first free erased entry, this will usually be after the last file
-// use this call when searching for a free slot to prevent wear on the FLASH, but may increase fragmentation
-// offset is always from the start of the FF_SYSTEM_BASE, default at 0x00080000 + XIP_BASE 
-// returns 0xFFFFFFFF when no free space is found
-uint32_t ff_lastfree(uint32_t offs)
-{
-  ModuleMetaHeader_t *MetaH;          // pointer to meta header for getting info of next file
-
-  // first find the last available slot in FLASH
-  uint32_t end = FF_SYSTEM_SIZE;
-  while (offs < end) {
-    #ifdef DEBUG
-      // cli_printf("  checking file at 0x%08X end at: 0x%08X", offs, end);
-    #endif
-    MetaH = (ModuleMetaHeader_t*)(FF_SYSTEM_BASE + offs);       // map header to struct
-    if (MetaH->FileType == FILETYPE_FFFF) break;                // if it erased then it is useable
-    // check if this is a valid file to prevent looping
-    if ((MetaH->FileType > FILETYPE_4041)) {
-      // unsupported file type, this is not a valid file
-      return NOTFOUND;                                          // no free space found
-    }
-    offs = MetaH->NextFile;                                     // go to the next file
-  }
-  if (offs > end) return NOTFOUND;                              // no free space found
-  return offs;                                                  // return the offset of the last free slot
-}
-
-
-// ff_findnext
-// returns a pointer to the next file in the chain of MOD/ROM files in FLASH
-// offs must point to a valid file start, typically 0 for the first call
-uint32_t ff_findnextf(uint32_t offs)
+// time for ff_index.build_us, see ffindex.h
+uint32_t ff_time_us()
 {
-  ModuleMetaHeader_t *MetaH;          // pointer to meta header for getting info of next file
-  MetaH = (ModuleMetaHeader_t*)(FF_SYSTEM_BASE + offs);       // map header to struct
-  return MetaH->NextFile;                                     // return a pointer to the next file
+  return time_us_32();
 }
 
-
-// ff_findfile
-// search for a file by name and return the pointer
-// returns the offset in FLASH of the file with the given name
-// returns 0xFFFFFFFF when the file is not found
-// will also find a deleted file!
-uint32_t ff_findfile(const char *name)
+// called in the walks of the chain in ffindex.cpp
+void ff_poll()
 {
-  ModuleMetaHeader_t *MetaH;          // pointer to meta header for getting info of next file
-  uint32_t offs = 0;                  // start of the file system
-  uint32_t end = FF_SYSTEM_SIZE;      // end of the file system
-
-  // check if a file exists, do a case insensitive compare
-  while (offs < end) {
-    MetaH = (ModuleMetaHeader_t*)(FF_SYSTEM_BASE + offs);       // map header to struct
-    if (MetaH->FileType == FILETYPE_FFFF) return NOTFOUND;      // end of chain reached
-    // if the file is marked for erase then we must skip it
-    if (strcasecmp(MetaH->FileName, name) == 0 && (MetaH->FileType != FILETYPE_DELETED)) {
-      return offs;    // found the file
-    }
-    offs = MetaH->NextFile;                                     // go to the next file
-  }
-
-  return NOTFOUND;                                              // file not found
+  tud_task();  // keep the USB port updated
 }
 
 
@@ -593,7 +405,7 @@ bool ff_write(uint32_t offs, uint8_t data)
     uint8_t bt = buf[offs & FLASH_PAGE_MASK];                         // original byte we want to change
     buf[offs & FLASH_PAGE_MASK] = data;                               // change the byte in the buffer
 
-    ff_delay500();  // wait for 0.5 seconds to flush the console output
+    ff_flush_console();  // send the console output first
     // disable interrupts to prevent issues with the flash programming
     ints = save_and_disable_interrupts();
     flash_range_program(FF_OFFSET + (offs & FLASH_PAGE_OFFS), buf, FLASH_PAGE_SIZE ); 
@@ -617,7 +429,7 @@ bool ff_write(uint32_t offs, uint8_t data)
 bool ff_write_range(uint32_t offs, uint8_t *buf, int num)
 {
 
-    ff_delay500();  // wait for 0.5 seconds to flush the console output
+    ff_flush_console();  // send the console output first
 
     // disable interrupts to prevent issues with the flash programming
     ints = save_and_disable_interrupts();
@@ -717,7 +529,7 @@ void ff_erase(uint32_t fl_start, uint32_t fl_end)
     memcpy(buf2, (void *)flashPointer(fl_end), savebytes2);      // copy last block to buffer
 
 
-    ff_delay500();  // wait for 0.5 seconds to flush the console output
+    ff_flush_console();  // send the console output first
 
     // disable interrupts to prevent issues with the flash programming
     ints = save_and_disable_interrupts();
@@ -734,6 +546,232 @@ void ff_erase(uint32_t fl_start, uint32_t fl_end)
 }
 
 
+// erase a single 4K sector of FLASH at offs in the Flash File System
+// offs must be 4K aligned, the first keep bytes of the sector are preserved (programmed back)
+// keep must be a multiple of 256, used by the bulk import to erase every sector only once
+void ff_erase_sector(uint32_t offs, uint32_t keep)
+{
+    uint8_t buf[FLASH_SECTOR_SIZE];         // 4K buffer for temporary storage
+    uint32_t sector = (offs & FLASH_SECTOR_OFFS) + FF_OFFSET;
+
+    keep &= FLASH_PAGE_OFFS;
+    if (keep > FLASH_SECTOR_SIZE) keep = FLASH_SECTOR_SIZE;
+    memcpy(buf, (void *)flashPointer(sector), keep);
+
+    ff_flush_console();  // send the console output first
+
+    ints = save_and_disable_interrupts();
+    flash_range_erase(sector, FLASH_SECTOR_SIZE);
+    if (keep > 0) flash_range_program(sector, buf, keep);
+    restore_interrupts(ints);
+}
+
+
+// FLASH compaction
+// the live files are moved down over the deleted and dummy entries, one file at a time
+// a move rewrites the FLASH sectors from the new offset of the file in ascending order,
+// the new contents of a sector only come from the sector itself and higher addresses, 
+// which are not rewritten yet
+// after a move the chain is valid again: the file at the new offset is followed by a dummy entry
+// for the rest of the hole and the old place of the file, which is the hole for the next file
+// finally the chain is cut at the last hole and the space behind it is erased
+// the state of a move is kept in FRAM at FRAM_compact_start and each sector is journaled in FRAM
+// before it is erased, ff_compact_resume() finishes a move that was interrupted by a power loss
+
+static FFCompact_t ff_cmp;
+
+static void ff_compact_save()
+{
+  fram_write(SPI_PORT_FRAM, PIN_SPI0_CS, FRAM_compact_start, (uint8_t*)&ff_cmp, sizeof(ff_cmp));
+}
+
+// build the new contents of sector s for the move in ff_cmp in buf
+static void ff_compact_sector(uint32_t s, uint8_t *buf)
+{
+  uint32_t end = s + FLASH_SECTOR_SIZE;
+  uint32_t fend = ff_cmp.dst + ff_cmp.size;                     // end of the file at the new offset
+  uint32_t from = (ff_cmp.dst > s) ? ff_cmp.dst : s;
+
+  memcpy(buf, flash_contents_bt + s, FLASH_SECTOR_SIZE);       // all outside the move is kept
+
+  if (ff_cmp.size == 0) {
+    // cut the chain at dst, all behind it is erased
+    if (from < end) memset(buf + from - s, 0xFF, end - from);
+    return;
+  }
+
+  // the file contents from the old offset
+  uint32_t to = (fend < end) ? fend : end;
+  if (from < to) memcpy(buf + from - s, flash_contents_bt + from + ff_cmp.src - ff_cmp.dst, to - from);
+
+  // the header of the file with the new NextFile
+  if ((ff_cmp.dst >= s) && (ff_cmp.dst < end)) {
+    ModuleMetaHeader_t header;
+    memcpy(&header, flash_contents_bt + ff_cmp.src, sizeof(header));
+    header.NextFile = fend;
+    memcpy(buf + ff_cmp.dst - s, &header, sizeof(header));
+  }
+
+  // the dummy entry behind the file
+  if ((fend >= s) && (fend < end)) {
+    ModuleMetaHeader_t dummy;
+    memset(&dummy, 0, sizeof(dummy));
+    dummy.FileType = FILETYPE_DUMMY;
+    dummy.NextFile = ff_cmp.next;
+    memset(buf + fend - s, 0xFF, FLASH_PAGE_SIZE);
+    memcpy(buf + fend - s, &dummy, sizeof(dummy));
+  }
+}
+
+// erase sector s and program buf, the sector is journaled in FRAM first
+// nothing is done when the sector does not change, an erased sector is not journaled
+static void ff_compact_write(uint32_t s, const uint8_t *buf)
+{
+  bool blank = true;
+
+  if (memcmp(buf, flash_contents_bt + s, FLASH_SECTOR_SIZE) == 0) return;
+  for (int i = 0; (i < FLASH_SECTOR_SIZE) && blank; i++) blank = (buf[i] == 0xFF);
+  if (!blank) {
+    fram_write(SPI_PORT_FRAM, PIN_SPI0_CS, FRAM_compact_start + FLASH_PAGE_SIZE, (uint8_t*)buf, FLASH_SECTOR_SIZE);
+    ff_cmp.journal = s;
+    ff_compact_save();
+  }
+
+  ff_flush_console();  // send the console output first
+
+  ints = save_and_disable_interrupts();
+  flash_range_erase(FF_OFFSET + s, FLASH_SECTOR_SIZE);
+  if (!blank) flash_range_program(FF_OFFSET + s, buf, FLASH_SECTOR_SIZE);
+  restore_interrupts(ints);
+}
+
+// rewrite the sectors of the move in ff_cmp, starting with the journaled sector if there is one
+static void ff_compact_move()
+{
+  uint8_t buf[FLASH_SECTOR_SIZE];         // 4K buffer for the new sector contents
+  uint32_t last = (ff_cmp.size == 0) ? ff_cmp.next : ff_cmp.dst + ff_cmp.size + FLASH_PAGE_SIZE;
+
+  if (last > FF_SYSTEM_SIZE) last = FF_SYSTEM_SIZE;
+  if (ff_cmp.journal != NOTFOUND) {
+    // the sector may be partly erased or programmed, the journal has the new contents
+    fram_read(SPI_PORT_FRAM, PIN_SPI0_CS, FRAM_compact_start + FLASH_PAGE_SIZE, buf, FLASH_SECTOR_SIZE);
+    ints = save_and_disable_interrupts();
+    flash_range_erase(FF_OFFSET + ff_cmp.journal, FLASH_SECTOR_SIZE);
+    flash_range_program(FF_OFFSET + ff_cmp.journal, buf, FLASH_SECTOR_SIZE);
+    restore_interrupts(ints);
+    ff_cmp.sector = ff_cmp.journal + FLASH_SECTOR_SIZE;
+    ff_cmp.journal = NOTFOUND;
+    ff_compact_save();
+  }
+
+  while (ff_cmp.sector < last) {
+    ff_compact_sector(ff_cmp.sector, buf);
+    ff_compact_write(ff_cmp.sector, buf);
+    ff_cmp.journal = NOTFOUND;
+    ff_cmp.sector += FLASH_SECTOR_SIZE;
+    ff_compact_save();
+    tud_task();                           // keep the USB port updated between the sectors
+  }
+
+  ff_cmp.magic = 0;                       // the move is done, the chain is valid
+  ff_compact_save();
+}
+
+// finish a move of ff_compact() that was interrupted by a power loss, called at boot before the
+// index is built, returns true when a move was finished
+bool ff_compact_resume()
+{
+  fram_read(SPI_PORT_FRAM, PIN_SPI0_CS, FRAM_compact_start, (uint8_t*)&ff_cmp, sizeof(ff_cmp));
+  if (ff_cmp.magic != FF_COMPACT_MAGIC) return false;
+  if ((ff_cmp.dst > ff_cmp.src) || (ff_cmp.next > FF_SYSTEM_SIZE) || (ff_cmp.sector > FF_SYSTEM_SIZE) ||
+      ((ff_cmp.journal != NOTFOUND) && (ff_cmp.journal >= FF_SYSTEM_SIZE))) {
+    // not a valid record, leave the FLASH alone
+    ff_cmp.magic = 0;
+    ff_compact_save();
+    return false;
+  }
+  ff_compact_move();
+  return true;
+}
+
+// compact the FLASH File System, an interrupted compaction is finished first
+// *freed returns the number of bytes that are added to the free space at the end of the chain
+// returns the number of files moved, -1 when the chain is broken and nothing is done
+// the Banks that are plugged from FLASH must be relocated after this, see CModules::relocate()
+int ff_compact(uint32_t *freed)
+{
+  ModuleMetaHeader_t *MetaH;
+  uint32_t offs = 0;
+  uint32_t hole = NOTFOUND;               // first of the deleted and dummy entries before offs
+  int moved = 0;
+
+  *freed = 0;
+  if (ff_compact_resume()) {
+    cli_printf("  finished the interrupted move from 0x%08X to 0x%08X", ff_cmp.src, ff_cmp.dst);
+  }
+
+  while (offs < FF_SYSTEM_SIZE) {
+    MetaH = (ModuleMetaHeader_t*)(FF_SYSTEM_BASE + offs);       // map header to struct
+    if (MetaH->FileType == FILETYPE_FFFF) break;                // end of the chain
+    if (((MetaH->FileType > FILETYPE_4041) && (MetaH->FileType != FILETYPE_DUMMY)) || (MetaH->NextFile <= offs)) {
+      ff_index_build();
+      return -1;                                                // not a valid file
+    }
+    if (ff_reusable(MetaH->FileType)) {
+      if (hole == NOTFOUND) hole = offs;
+      offs = MetaH->NextFile;
+      continue;
+    }
+
+    // move the file at offs down to the hole, the slack behind the file is dropped
+    uint32_t size = (MetaH->FileSize + sizeof(ModuleMetaHeader_t) + 255) & ~255;
+    if (size > (MetaH->NextFile - offs)) {
+      ff_index_build();
+      return -1;                                                // the file does not fit its entry
+    }
+    if (hole == NOTFOUND) {
+      if (size == (MetaH->NextFile - offs)) {
+        offs = MetaH->NextFile;                                 // nothing to move
+        continue;
+      }
+      hole = offs;                                              // the file stays, only the slack is freed
+    } else {
+      cli_printf("  moving %-31s %8d bytes from 0x%08X to 0x%08X", MetaH->FileName, MetaH->FileSize, offs, hole);
+      moved++;
+    }
+    ff_cmp.magic = FF_COMPACT_MAGIC;
+    ff_cmp.src = offs;
+    ff_cmp.dst = hole;
+    ff_cmp.size = size;
+    ff_cmp.next = MetaH->NextFile;
+    ff_cmp.sector = hole & FLASH_SECTOR_OFFS;
+    ff_cmp.journal = NOTFOUND;
+    ff_compact_save();
+    ff_compact_move();
+
+    offs = hole + size;                   // the dummy entry, the start of the next hole
+    hole = NOTFOUND;
+  }
+
+  if ((offs < FF_SYSTEM_SIZE) && (hole != NOTFOUND)) {
+    // cut the chain at the last hole
+    ff_cmp.magic = FF_COMPACT_MAGIC;
+    ff_cmp.src = hole;
+    ff_cmp.dst = hole;
+    ff_cmp.size = 0;
+    ff_cmp.next = offs;
+    ff_cmp.sector = hole & FLASH_SECTOR_OFFS;
+    ff_cmp.journal = NOTFOUND;
+    ff_compact_save();
+    ff_compact_move();
+    *freed = offs - hole;
+  }
+
+  ff_index_build();
+  return moved;
+}
+
+
 // to erase all flash in the filesystem
 // no checks, use with care!
 void ff_erase_all() {
@@ -46,18 +46,34 @@ extern "C" {
 #include "my_debug.h"
 #include "sd_card.h"
 #include "crash.h"
+#include "ffindex.h"
+#include "ffimport.h"
 
 // definitions for the flash memory
 
-void ff_delay500();
+// state of a move of flash compact, kept in FRAM at FRAM_compact_start
+#define FF_COMPACT_MAGIC  0x434D5046    // a move is in progress
+
+typedef struct {
+  uint32_t  magic;                  // FF_COMPACT_MAGIC while a move is in progress
+  uint32_t  src;                    // old offset of the file
+  uint32_t  dst;                    // new offset of the file
+  uint32_t  size;                   // bytes of the file in FLASH with the header, 0 to cut the chain at dst
+  uint32_t  next;                   // NextFile of the file before the move, or the end of the chain to cut
+  uint32_t  sector;                 // next sector to rewrite
+  uint32_t  journal;                // sector in the FRAM journal, NOTFOUND when empty
+} FFCompact_t;
+
+bool ff_compact_resume();
+int ff_compact(uint32_t *freed);
+#define FF_FLUSH_TIMEOUT  500      // ms, max wait for the console output before FLASH is erased or programmed
+
+void ff_flush_console();
 void ff_show(uint32_t addr);
 void ff_init();
 void ff_nuke();
-uint32_t ff_lastfree(uint32_t offs);
-uint32_t ff_findfree(uint32_t offs, uint32_t size);
-uint32_t ff_findnextf(uint32_t offs);
-uint32_t ff_findfile(const char *name);
 void ff_erase(uint32_t fl_start, uint32_t fl_end);
+void ff_erase_sector(uint32_t offs, uint32_t keep);
 bool ff_flasherased(int num);
 int ff_compare(uint32_t offs, uint8_t *buf, int num);
 uint32_t ff_erased(uint32_t offs, uint32_t size, int num);
@@ -64,14 +64,20 @@ extern "C" {
 // FRAM address map
 //  0x00000 .. 0x01FFF      ROM image #0
 //
+//  0x1B000                 FLASH compaction state, journal sector at 0x1B100
 //  0x1D000                 Global settings start
-//  0x1E000                 XMEM start
+//  0x1E000                 XMEM start, registers 0x200..0x3FF
+//  0x1F000                 Main memory start, registers 0x000..0x1FF (0x040..0x1FF used)
+//  0x20000                 QROM images, 8 KByte per Page, Page 4..F
 //   
 
 #define FRAM_SIZE               0x40000                 // size of the FRAM device in bytes (256k*8 = 2 Mbit device)
+#define FRAM_compact_start      0x1B000                 // state and journal of flash compact, 0x1B000..0x1C0FF
 #define FRAM_gsettings_start    0x1D000                 // start of global peristent settings in FRAM
 #define FRAM_tracer_start       0x1D400                 // start of tracer settings
 #define XMEMstart               0x1E000                 // start address of XMEM modules in FRAM
+#define MAINMEMstart            0x1F000                 // start address of main memory registers in FRAM
+#define FRAM_QROM_START         0x20000                 // start of the QROM images, Page n at + n * 0x2000
 
 #define FRAM_INIT_ADDR          0x00000                  // address to store the FRAM initialization value
 #define FRAM_INIT_VALUE         0x4041                  // value to indicate that the FRAM is initialized
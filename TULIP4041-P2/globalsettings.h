@@ -83,6 +83,8 @@
         	                                //      0x0177 - 0x0178       delay for debounce
         	                                //      0x089C - 0x089D       BLINK01
 #define     tracer_ilroms_on    41          // tracing of IL ROMs enabled, Page 6+7
+#define     tracer_binary       42          // binary trace stream instead of text, see tracer.h
+#define     tracer_symbols      43          // function of the address from the FAT in the text trace
 
 // HP-IL scope settings
 #define     ilscope_IL_enabled  51          // PILBox tracing enabled
@@ -91,12 +93,12 @@
 
 // XMEM/User memory settings
 #define     xmem_pages          60          // number of XMEM pages (0, 1, 2)
-#define     xfun_enabled        61          // XFunction memory enabled
-#define     mmod1_enabled       62          // Memory Module #1 enabled
-#define     mmod2_enabled       63          // Memory Module #2 enabled
-#define     mmod3_enabled       63          // Memory Module #3 enabled
-#define     mmod4_enabled       64          // Memory Module #4 enabled
-#define     mmod_quad_enabled   65          // Quad Memory Module enabled
+#define     xfun_enabled        61          // XFunction memory enabled, registers 0x040..0x0BF
+#define     mmod1_enabled       62          // Memory Module #1 enabled, registers 0x100..0x13F
+#define     mmod2_enabled       63          // Memory Module #2 enabled, registers 0x140..0x17F
+#define     mmod3_enabled       64          // Memory Module #3 enabled, registers 0x180..0x1BF
+#define     mmod4_enabled       65          // Memory Module #4 enabled, registers 0x1C0..0x1FF
+#define     mmod_quad_enabled   66          // Quad Memory Module enabled, registers 0x100..0x1FF
 
 // control of various messages
 #define     PRT_monitor_enabled 70          // monitor printer characters to console
@@ -126,6 +128,9 @@
 
 #define     init_value          0x4041
 
+// core1 uses a snapshot of the settings, a new one is published when these change
+extern "C" void emuconfig_publish();
+
 class GSettings { 
 
     public:
@@ -172,6 +177,9 @@ class GSettings {
         gsettings[tracer_sysrom_on]     = 1;
         gsettings[tracer_sysloop_on]    = 1;
         gsettings[tracer_ilroms_on]     = 1;
+        gsettings[tracer_symbols]       = 1;
+
+        emuconfig_publish();
 
         if (gpio_get(P_PWO) == 0) {
             // when PWO = low we can write to FRAM
@@ -188,13 +196,14 @@ class GSettings {
     }
 
     // change a setting
-    // used inline here to enable quick access from core1 loop
+    // only from core0, core1 gets the change with the next published snapshot
     inline void set(int idx, uint16_t value) {
         gsettings[idx] = value;
+        emuconfig_publish();
     }
 
     // retrieve a current setting
-    // used inline here to enable quick access from core1 loop
+    // core1 must use the snapshot in emu_cfg instead
     inline uint16_t get(int idx) {
         if (idx <= gsettings_lastitem) {
             return gsettings[idx];
@@ -227,6 +236,7 @@ class GSettings {
             // fram_write(SPI_PORT_FRAM, PIN_SPI0_CS, FRAM_gsettings_start, gsettings, sizeof(gsettings));
             // when PWO = low we can read from FRAM
             fram_read(SPI_PORT_FRAM, PIN_SPI0_CS, FRAM_gsettings_start, (uint8_t*)gsettings, sizeof(gsettings));  
+            emuconfig_publish();
 
 
 
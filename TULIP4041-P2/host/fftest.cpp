@@ -0,0 +1,368 @@
+/*
+ * fftest.cpp
+ *
+ * This file is part of the TULIP4041 project.
+ * Copyright (C) 2024 Meindert Kuipers
+ *
+ * This is free software: you are free to change and redistribute it.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * 
+ * USE AT YOUR OWN RISK
+ *
+ */
+
+// tests of the FLASH File System on an image in RAM
+//   fftest index [operations]
+// random imports, deletes and dummies, the index is kept up to date with ff_index_update() as import
+// and delete do, and every lookup is compared with the walk of the chain in FLASH
+//   fftest import
+// files with sizes around the page, program and chunk boundaries streamed to FLASH with ff_import_stream()
+// with random short reads, the image must hold the header, the file and 0xFF padding to the next page
+// exit code 1 on a difference
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <chrono>
+
+#include "ffimport.h"
+
+#define TEST_OPS        20000
+#define TEST_NAMES      900             // names used, so imports of existing files and deletes of missing ones happen
+#define TEST_IMPORTS    30              // imports of random sizes, after the ones around the boundaries
+
+uint8_t ff_host_image[FF_HOST_SIZE];
+
+uint32_t ff_time_us()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+           std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void ff_poll()
+{
+}
+
+static int errors = 0;
+
+static void error(int op, const char *what, uint32_t index, uint32_t walk)
+{
+    if (errors++ < 10) printf("  operation %d: %s, index %08X, walk %08X\n", op, what, index, walk);
+}
+
+// the lookups without the index
+static uint32_t walk_findfile(const char *name)
+{
+    bool valid = ff_index.valid;
+    uint32_t offs;
+
+    ff_index.valid = false;
+    offs = ff_findfile(name);
+    ff_index.valid = valid;
+    return offs;
+}
+
+static uint32_t walk_findfree(uint32_t size)
+{
+    bool valid = ff_index.valid;
+    uint32_t offs;
+
+    ff_index.valid = false;
+    offs = ff_findfree(0, size);
+    ff_index.valid = valid;
+    return offs;
+}
+
+static uint32_t walk_lastfree()
+{
+    bool valid = ff_index.valid;
+    uint32_t offs;
+
+    ff_index.valid = false;
+    offs = ff_lastfree(0);
+    ff_index.valid = valid;
+    return offs;
+}
+
+// write a header like import does, next is the end of the file for a new file at the end of the chain
+static void write_header(uint32_t offs, uint8_t type, const char *name, uint32_t size)
+{
+    ModuleMetaHeader_t *MetaH = (ModuleMetaHeader_t*)(FF_SYSTEM_BASE + offs);
+
+    if (MetaH->FileType == FILETYPE_FFFF) {
+        MetaH->NextFile = offs + ((size + sizeof(ModuleMetaHeader_t) + 255) & ~255);
+    }
+    MetaH->FileType = type;
+    memset(MetaH->FileName, 0, sizeof(MetaH->FileName));
+    strncpy(MetaH->FileName, name, sizeof(MetaH->FileName) - 1);
+    MetaH->FileSize = size;
+}
+
+static void random_name(char *name)
+{
+    sprintf(name, "FILE%03d.ROM", rand() % TEST_NAMES);
+    if (rand() % 2) {
+        for (char *c = name; *c; c++) *c = tolower(*c);     // ff_findfile() is case insensitive
+    }
+}
+
+static int index_test(int ops)
+{
+    int imports = 0, reused = 0, full = 0, deletes = 0, dummies = 0;
+    char name[32];
+    uint32_t offs, walk, size;
+    int count, files, nfree;
+    uint32_t end;
+
+    srand(4041);
+    memset(ff_host_image, 0xFF, sizeof(ff_host_image));
+    write_header(0, FILETYPE_4041, "TULIP4041 FLASH HEADER", 2);
+    ff_index_build();
+    if (!ff_index.valid) error(0, "index not valid", 0, 0);
+
+    for (int op = 1; op <= ops; op++) {
+        random_name(name);
+        offs = ff_findfile(name);
+        walk = walk_findfile(name);
+        if (offs != walk) error(op, "ff_findfile()", offs, walk);
+
+        switch (rand() % 8) {
+            case 0:
+            case 1:
+            case 2:
+                // delete, the type byte is cleared
+                if (offs == NOTFOUND) break;
+                ((ModuleMetaHeader_t*)(FF_SYSTEM_BASE + offs))->FileType = FILETYPE_DELETED;
+                ff_index_update(offs);
+                deletes++;
+                break;
+
+            default:
+                // import, or a dummy for the empty space
+                if (offs != NOTFOUND) break;
+                size = 200 + rand() % 20000;
+                offs = ff_findfree(0, size);
+                walk = walk_findfree(size);
+                if (offs != walk) error(op, "ff_findfree()", offs, walk);
+                if (offs == NOTFOUND) {
+                    full++;
+                    break;
+                }
+                if (offs != ff_lastfree(0)) reused++;
+                if ((rand() % 20) == 0) {
+                    write_header(offs, FILETYPE_DUMMY, name, size);
+                    dummies++;
+                } else {
+                    write_header(offs, FILETYPE_ROM, name, size);
+                    imports++;
+                }
+                ff_index_update(offs);
+                break;
+        }
+
+        offs = ff_lastfree(0);
+        walk = walk_lastfree();
+        if (offs != walk) error(op, "ff_lastfree()", offs, walk);
+
+        // the index kept up to date must be the same as a new one
+        if ((op % 1000) == 0) {
+            count = ff_index.count;
+            files = ff_index.files;
+            nfree = ff_index.nfree;
+            end = ff_index.end;
+            ff_index_build();
+            if (ff_index.count != count) error(op, "entries after a rebuild", count, ff_index.count);
+            if (ff_index.files != files) error(op, "files after a rebuild", files, ff_index.files);
+            if (ff_index.nfree != nfree) error(op, "free entries after a rebuild", nfree, ff_index.nfree);
+            if (ff_index.end != end) error(op, "end after a rebuild", end, ff_index.end);
+        }
+        if (!ff_index.valid) {
+            error(op, "index not valid", 0, 0);
+            break;
+        }
+    }
+
+    ff_index_build();
+    printf("  %d operations: %d imports, %d into a deleted slot, %d dummies, %d deletes, %d times full\n",
+           ops, imports, reused, dummies, deletes, full);
+    printf("  index: %d entries, %d files, %d free, end %08X, built in %u us\n",
+           ff_index.count, ff_index.files, ff_index.nfree, ff_index.end, ff_index.build_us);
+    printf("  %d differences with the walk of the chain\n", errors);
+    return (errors == 0) ? 0 : 1;
+}
+
+static uint8_t imp_file[0x20000];           // contents of the file being imported
+static uint32_t imp_size;                   // its size
+static uint32_t imp_pos;                    // bytes read
+static uint32_t imp_offs;                   // offset of the header
+static uint32_t imp_next;                   // next offset that must be programmed, the header page is last
+static bool imp_header;                     // the header page is programmed
+static int imp_k;                           // number of the import
+static int imp_reads, imp_programs;
+static int imp_fail = -1;                   // read that returns an error, -1 for none
+
+static void import_error(int k, const char *what, uint32_t a, uint32_t b)
+{
+    if (errors++ < 10) printf("  import %d: %s, %08X %08X\n", k, what, a, b);
+}
+
+// f_read() of the file, with random short reads
+static int test_read(uint8_t *buf, uint32_t len)
+{
+    uint32_t n = len;
+
+    if (imp_reads++ == imp_fail) return -1;
+    if ((n > 0) && (rand() % 2)) n = 1 + rand() % n;
+    if (n > imp_size - imp_pos) n = imp_size - imp_pos;
+    memcpy(buf, imp_file + imp_pos, n);
+    imp_pos += n;
+    return n;
+}
+
+// flash_range_program(), whole pages in order into erased FLASH
+static void test_program(uint32_t offs, const uint8_t *buf, uint32_t num)
+{
+    imp_programs++;
+    if (((offs & 0xFF) != 0) || ((num & 0xFF) != 0) || (num == 0) || (num > IMPORT_PROGRAM)) {
+        import_error(imp_k, "program of a partial page or too many bytes", offs, num);
+        return;
+    }
+    if ((offs >= FF_SYSTEM_SIZE) || (num > FF_SYSTEM_SIZE - offs)) {
+        import_error(imp_k, "program outside the image", offs, num);
+        return;
+    }
+    if (imp_header || ((offs == imp_offs) ? (num != 256) : (offs != imp_next))) {
+        import_error(imp_k, "program out of order", offs, imp_next);
+        return;
+    }
+    if (offs == imp_offs) imp_header = true;
+    for (uint32_t i = 0; i < num; i++) {
+        if (ff_host_image[offs + i] != 0xFF) {
+            import_error(imp_k, "program of FLASH that is not erased", offs + i, ff_host_image[offs + i]);
+            return;
+        }
+        ff_host_image[offs + i] = buf[i];
+    }
+    if (offs != imp_offs) imp_next += num;
+}
+
+static const struct FFImportIO test_io = { test_read, test_program };
+
+// header and file of size bytes for an import at the end of the chain, returns the offset, NOTFOUND when the image is full
+static uint32_t import_setup(ModuleMetaHeader_t *header, int k, uint32_t size)
+{
+    uint32_t offs = ff_lastfree(0);
+
+    memset(header, 0, sizeof(ModuleMetaHeader_t));
+    header->FileType = FILETYPE_ROM;
+    sprintf(header->FileName, "IMPORT%03d.ROM", k);
+    header->FileSize = size;
+    header->NextFile = offs + ((size + sizeof(ModuleMetaHeader_t) + 255) & ~255);
+    for (uint32_t i = 0; i < size; i++) imp_file[i] = rand();
+    imp_size = size;
+    imp_pos = 0;
+    imp_offs = offs;
+    imp_next = offs + 256;
+    imp_header = false;
+    imp_k = k;
+    if ((offs >= FF_SYSTEM_SIZE) || (header->NextFile > FF_SYSTEM_SIZE) || (header->NextFile <= offs)) {
+        import_error(k, "test image full", offs, size);
+        return NOTFOUND;
+    }
+    return offs;
+}
+
+// import one file of size bytes at the end of the chain and check the image and the index
+static void import_one(int k, uint32_t size)
+{
+    ModuleMetaHeader_t header;
+    uint32_t offs = import_setup(&header, k, size);
+    const uint8_t *p;
+
+    if (offs == NOTFOUND) return;
+    if (!ff_import_stream(&header, offs, &test_io)) {
+        import_error(k, "read error", size, 0);
+        return;
+    }
+    if (imp_next != header.NextFile) import_error(k, "programmed up to", imp_next, header.NextFile);
+    if (!imp_header) import_error(k, "header not programmed", offs, size);
+    p = ff_host_image + offs;
+    if (memcmp(p, &header, sizeof(header)) != 0) import_error(k, "header", offs, size);
+    if (memcmp(p + sizeof(header), imp_file, size) != 0) import_error(k, "file contents", offs, size);
+    for (uint32_t i = offs + sizeof(header) + size; i < header.NextFile; i++) {
+        if (ff_host_image[i] != 0xFF) {
+            import_error(k, "padding", i, ff_host_image[i]);
+            break;
+        }
+    }
+    if (ff_findfile(header.FileName) != offs) import_error(k, "ff_findfile() after the import", ff_findfile(header.FileName), offs);
+    if (ff_lastfree(0) != walk_lastfree()) import_error(k, "ff_lastfree() after the import", ff_lastfree(0), walk_lastfree());
+}
+
+// an import that must fail, the header must still be erased and the chain must not change
+// the partly programmed space is erased again afterwards, as the next import does
+static void import_failed(int k, const ModuleMetaHeader_t *header, uint32_t offs)
+{
+    if (offs == NOTFOUND) return;
+    if (ff_import_stream(header, offs, &test_io)) import_error(k, "error not reported", offs, header->FileSize);
+    if (imp_header) import_error(k, "header programmed after an error", offs, header->FileSize);
+    if (ff_lastfree(0) != offs) import_error(k, "chain changed after an error", ff_lastfree(0), offs);
+    if (ff_findfile(header->FileName) != NOTFOUND) import_error(k, "file found after an error", offs, 0);
+    memset(ff_host_image + offs, 0xFF, header->NextFile - offs);
+}
+
+static int import_test()
+{
+    // the header is 40 bytes, a page 256 bytes, a program IMPORT_PROGRAM and a read IMPORT_CHUNK bytes
+    static const uint32_t bound[] = { 0, 256, IMPORT_PROGRAM, IMPORT_CHUNK, 2 * IMPORT_CHUNK, 3 * IMPORT_CHUNK + IMPORT_PROGRAM };
+    static const int delta[] = { -41, -40, -39, -1, 0, 1, 215, 216, 217 };
+    ModuleMetaHeader_t header;
+    int k = 0;
+    uint32_t offs;
+
+    srand(41);
+    memset(ff_host_image, 0xFF, sizeof(ff_host_image));
+    write_header(0, FILETYPE_4041, "TULIP4041 FLASH HEADER", 2);
+    ff_index_build();
+
+    for (unsigned b = 0; b < sizeof(bound) / sizeof(bound[0]); b++) {
+        for (unsigned d = 0; d < sizeof(delta) / sizeof(delta[0]); d++) {
+            if ((int)bound[b] + delta[d] < 0) continue;
+            import_one(k++, bound[b] + delta[d]);
+        }
+    }
+    for (int i = 0; i < TEST_IMPORTS; i++) {
+        import_one(k++, rand() % sizeof(imp_file));
+    }
+
+    // a read error and a file shorter than its size stop the import, the header is not programmed
+    offs = import_setup(&header, k, 3 * IMPORT_CHUNK);
+    imp_fail = imp_reads + 2;
+    import_failed(k++, &header, offs);
+    offs = import_setup(&header, k, 3 * IMPORT_CHUNK);
+    imp_size -= 1000;
+    import_failed(k++, &header, offs);
+
+    printf("  %d imports, %d reads, %d programs, %d errors\n", k, imp_reads, imp_programs, errors);
+    return (errors == 0) ? 0 : 1;
+}
+
+int main(int argc, char *argv[])
+{
+    int ops = TEST_OPS;
+
+    if ((argc >= 2) && (strcmp(argv[1], "index") == 0)) {
+        if (argc == 3) ops = atoi(argv[2]);
+        if ((argc <= 3) && (ops > 0)) return index_test(ops);
+    }
+    if ((argc == 2) && (strcmp(argv[1], "import") == 0)) {
+        return import_test();
+    }
+
+    fprintf(stderr, "usage: fftest index [operations] | import\n");
+    return 2;
+}
@@ -0,0 +1,165 @@
+/*
+ * fmtbench.c
+ *
+ * This file is part of the TULIP4041 project.
+ * Copyright (C) 2024 Meindert Kuipers
+ *
+ * This is free software: you are free to change and redistribute it.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * 
+ * USE AT YOUR OWN RISK
+ *
+ */
+
+// host version of tracer fmtbench
+//   fmtbench [lines]
+// formats random trace lines with trace_format() and trace_format_ref(), without and with HP-IL
+// tracing, checks that the output is identical and reports ns/line of both, exit code 1 on a difference
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "tracefmt.h"
+
+#define BENCH_LINES     20000
+#define BENCH_REPEAT    20          // passes over the lines for the timing
+
+static uint32_t seed = 4041;
+
+static uint32_t rnd()
+{
+    seed = seed * 1103515245 + 12345;
+    return seed >> 8;
+}
+
+// random lines, all instructions and classes, with HP-IL frames and registers in some of them
+static void gen_lines(struct TLine *lines, int n)
+{
+    struct TLine *l;
+    uint32_t r;
+
+    for (int k = 0; k < n; k++) {
+        l = &lines[k];
+        r = rnd();
+        memset(l, 0, sizeof(struct TLine));
+        l->cycle_number = k * 3;
+        l->skipped = ((r & 0x3F) == 0) ? (rnd() & 0x1FF) : 0;
+        l->isa_address = rnd() & 0xFFFF;
+        l->isa_instruction = rnd() & 0xFFF;
+        l->bank = 1 + (r >> 8) % 4;
+        l->data1 = rnd() ^ (rnd() << 8);
+        l->data2 = rnd() & 0x00FFFFFF;
+        l->fi1 = ((r & 0x300) == 0) ? (rnd() ^ (rnd() << 8)) : 0xFFFFFFFF;
+        l->fi2 = ((r & 0xC00) == 0) ? (rnd() ^ (rnd() << 8)) : 0xFFFFFFFF;
+        l->xq_instr = ((r & 0x7000) == 0) ? (rnd() & 0x3FF) : 0;
+        l->xq_carry = (r >> 15) & 1;
+        l->ramslct = rnd() & 0x3FF;
+        l->frame_in = rnd() & 0x7FF;
+        l->frame_out = ((r & 0x70000) == 0) ? (rnd() & 0x7FF) : 0xFFFF;
+        for (int i = 0; i < 9; i++) l->HPILregs[i] = rnd();
+    }
+}
+
+static void fmt_reset()
+{
+    delayed_dis = 0;
+    activeSELP = -1;
+    ILframe_in = 0;
+    memset(HPIL_REG_copy, 0, sizeof(HPIL_REG_copy));
+}
+
+static double now_us()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+// compare and time both formatters over all lines, returns the number of lines that differ
+static int bench(const struct TLine *lines, int n)
+{
+    static char ref[sizeof(TracePrint)];
+    int diffs = 0;
+    int ref_len;
+    uint32_t d;
+    int16_t selp;
+    uint16_t frame;
+    uint8_t regs[9];
+    double t, t_ref, t_new;
+
+    // line by line, both formatters start from the same disassembly state
+    fmt_reset();
+    for (int k = 0; k < n; k++) {
+        d = delayed_dis;
+        selp = activeSELP;
+        frame = ILframe_in;
+        memcpy(regs, HPIL_REG_copy, sizeof(regs));
+
+        trace_format_ref(&lines[k], ' ');
+        memcpy(ref, TracePrint, TracePrintLen + 1);
+        ref_len = TracePrintLen;
+
+        delayed_dis = d;
+        activeSELP = selp;
+        ILframe_in = frame;
+        memcpy(HPIL_REG_copy, regs, sizeof(regs));
+        trace_format(&lines[k], ' ');
+        if ((TracePrintLen != ref_len) || (memcmp(ref, TracePrint, ref_len) != 0)) {
+            if (diffs++ < 2) {
+                printf("  line %d differs\n", k);
+                printf("  ref  %s", ref);
+                printf("  new  %s", TracePrint);
+            }
+        }
+    }
+
+    fmt_reset();
+    t = now_us();
+    for (int r = 0; r < BENCH_REPEAT; r++) {
+        for (int k = 0; k < n; k++) trace_format_ref(&lines[k], ' ');
+    }
+    t_ref = now_us() - t;
+    fmt_reset();
+    t = now_us();
+    for (int r = 0; r < BENCH_REPEAT; r++) {
+        for (int k = 0; k < n; k++) trace_format(&lines[k], ' ');
+    }
+    t_new = now_us() - t;
+
+    printf("  HP-IL %-3s  %d lines: %d differences\n", trace_fmt_opts.ilregs ? "on" : "off", n, diffs);
+    printf("    sprintf   %6.1f ns/line\n", t_ref * 1000 / ((double)n * BENCH_REPEAT));
+    printf("    tables    %6.1f ns/line  %.1fx\n", t_new * 1000 / ((double)n * BENCH_REPEAT), t_ref / (t_new + 1e-3));
+    return diffs;
+}
+
+int main(int argc, char *argv[])
+{
+    int n = BENCH_LINES;
+    int diffs = 0;
+    struct TLine *lines;
+
+    if (argc == 2) n = atoi(argv[1]);
+    if ((argc > 2) || (n <= 0)) {
+        fprintf(stderr, "usage: fmtbench [lines]\n");
+        return 2;
+    }
+    lines = malloc(sizeof(struct TLine) * n);
+    if (lines == NULL) return 2;
+
+    trace_mnem_init();
+    gen_lines(lines, n);
+    trace_fmt_opts.symbol = NULL;
+    trace_fmt_opts.ilregs = false;
+    diffs += bench(lines, n);
+    trace_fmt_opts.ilregs = true;
+    diffs += bench(lines, n);
+
+    free(lines);
+    return (diffs == 0) ? 0 : 1;
+}
@@ -0,0 +1,575 @@
+/*
+ * hp41sim.cpp
+ *
+ * This file is part of the TULIP4041 project.
+ * Copyright (C) 2024 Meindert Kuipers
+ *
+ * This is free software: you are free to change and redistribute it.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * USE AT YOUR OWN RISK
+ *
+ */
+
+// the core1 bus loop on the host, with a SimBus instead of the PIO state machines
+// the bus loop is the same source as in the firmware, see hp41_core.h
+//   hp41sim bench [mix]    benchmark of the traffic mixes, as the system bench command
+//   hp41sim check          check the responses and the Bank switching of the bus loop, exit code 1 on a failure
+//   hp41sim record file    the bus cycles of all traffic mixes as a binary trace, as the tracer writes it
+//   hp41sim replay [-i] file   replay a binary trace and compare, exit code 1 on a mismatch
+// the Pages are filled with a synthetic ROM image, the settings are in host_config()
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+
+#include "hp41_core.h"
+#include "replay.h"
+
+// settings and peripheral state, in the firmware defined with the code that owns them
+bool HP82153A_active = false;               // no Wand
+int16_t SLCT_PRPH = -1;
+bool SELP9_status_BUSY = false;
+bool SELP9_status_VALID = true;
+uint16_t SELP9_status = prtstatus_def;
+uint16_t LocalAdvIgnore = false;
+int keycount_print = 0;
+int m_eMode = 0;
+int trace_enabled = 1;                      // the trace line of each cycle is in SimOut
+int trace_outside = 1;
+
+// the host has no SysTick, count down in ns in the same 24 bits
+// the histograms and the bench output are then in ns instead of clk_sys cycles
+uint32_t sim_ticks()
+{
+    static const auto t0 = std::chrono::steady_clock::now();
+    uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count();
+
+    return (uint32_t)(0 - ns) & 0x00FFFFFF;
+}
+
+// there is no PWO on the host, the simulated cycles always run to the end
+bool sim_stop()
+{
+    return false;
+}
+
+void replay_print(const char *line)
+{
+    printf("%s\n", line);
+}
+
+static CPageMap host_pages;                 // the Pages for the ROM fetch
+static uint16_t flash_img[3][PAGE_SIZE];    // images of Page 0xC, not cached and read as a ROM file in FLASH
+static uint16_t bank_img[NR_PAGES][5][PAGE_SIZE];   // Banks 2..4, Bank 1 is in the page cache
+
+// the Banks of each Page with a ROM image, bit n for Bank n
+// Page 5 is switched by an ENBANK in Page 3 as in the HP41CX, Page 9 has no Bank 3, Page 0xC has 2 Banks
+// and Pages 0xA and 0xE have only Bank 1 or none, so an ENBANK does not switch all Pages of the Port
+// Page 0xC is read through getbankword() like a Page that is not in the page cache
+static const uint8_t host_banks[NR_PAGES] = {
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x06, 0x02, 0x02,     // Page 0..7
+    0x1E, 0x16, 0x00, 0x1E, 0x06, 0x1E, 0x02, 0x1E,     // Page 8..F
+};
+
+// the synthetic ROM word of a Page and Bank, 0xFFFF if there is no ROM (no response of TULIP)
+static uint16_t rom_word(int pg, int bank, uint16_t offs)
+{
+    if ((host_banks[pg] & (1 << bank)) == 0) return 0xFFFF;
+    return ((offs * 7) + (pg << 6) + ((bank - 1) << 8)) & 0x3FF;
+}
+
+// ENBANK in a cycle with an address in Page pg, switches the Banks in bank[] as the HP41 would:
+// Page 3 switches Page 5, Page 8..F switches both Pages of the Port, a Page without the Bank is not switched
+// returns false if inst is not an ENBANK
+static bool host_enbank(uint8_t *bank, uint16_t inst, int pg)
+{
+    static const uint16_t enbank[4] = { inst_ENBANK1, inst_ENBANK2, inst_ENBANK3, inst_ENBANK4 };
+    int first = pg, last = pg;
+    int b = 0;
+
+    for (int i = 0; i < 4; i++) {
+        if (inst == enbank[i]) b = i + 1;
+    }
+    if (b == 0) return false;
+    if (pg == 3) {
+        first = last = 5;
+    } else if (pg >= 8) {
+        first = pg & ~1;
+        last = pg | 1;
+    }
+    for (int p = first; p <= last; p++) {
+        if (host_banks[p] & (1 << b)) bank[p] = b;
+    }
+    return true;
+}
+
+// all Pages in Bank 1, as after PWO
+static void host_banks_reset(uint8_t *bank)
+{
+    host_pages.resetbanks();
+    for (int i = 0; i < NR_PAGES; i++) {
+        active_bank[i] = 1;
+        bank[i] = 1;
+    }
+}
+
+static uint8_t host_bank[NR_PAGES];         // the Banks the bus loop must have selected
+
+// fill the Pages, Bank 1 of the ROM Pages in the page cache
+static void host_pages_init()
+{
+    uint16_t *img;
+    int slot = 0;
+
+    memset(&host_pages, 0, sizeof(host_pages));
+    host_pages.clearCache();
+    for (int pg = FIRST_PAGE; pg < NR_PAGES; pg++) {
+        for (int b = 1; b <= 4; b++) {
+            if ((host_banks[pg] & (1 << b)) == 0) continue;
+            host_pages.Pages[pg].m_banks[b].b_img_flags = ACTIVE_ROM_FLASH;
+            if (pg == 0xC) {
+                for (int i = 0; i < PAGE_SIZE; i++) flash_img[b][i] = swap16(rom_word(pg, b, i));
+                host_pages.Pages[pg].m_banks[b].b_img_data = flash_img[b];
+                continue;
+            }
+            if (b == 1) {
+                img = host_pages.PageCache[slot];
+                host_pages.CacheOwner[slot] = (pg << 4) | 1;
+                slot++;
+            } else {
+                img = bank_img[pg][b];
+            }
+            for (int i = 0; i < PAGE_SIZE; i++) img[i] = rom_word(pg, b, i);
+            host_pages.BankImage[pg][b] = img;
+        }
+    }
+    host_banks_reset(host_bank);
+}
+
+// settings used for the simulated cycles, as emuconfig_publish() would set them
+// X-Functions, Memory Module 1 and 2 and one Extended Memory module
+static void host_config()
+{
+    dispatch_build(inst_dispatch[0], true, false);
+    memset(&emu_cfg, 0, sizeof(emu_cfg));
+    emu_cfg.dispatch  = inst_dispatch[0];
+    emu_cfg.printer   = true;
+    emu_cfg.prt_power = true;
+    emu_cfg.hpil      = false;
+    emu_cfg.xmem_mods = 1;
+    emu_cfg.xfun      = true;
+    emu_cfg.mmods     = 0x03;
+    emu_cfg_pub = emu_cfg;
+}
+
+// registers that exist with host_config()
+static bool host_usermem(uint32_t reg)
+{
+    if ((reg >= 0x040) && (reg < 0x0C0)) return true;           // X-Functions
+    if ((reg >= 0x100) && (reg < 0x180)) return true;           // Memory Module 1 and 2
+    if ((reg > 0x200) && (reg < 0x2F0)) return true;            // Extended Memory module 1
+    return false;
+}
+
+static const struct SimCycle *check_in;     // the cycles being checked
+static int check_errors = 0;
+
+static void check_error(int k, const char *what, uint32_t got, uint32_t expected)
+{
+    if (check_errors < 10) {
+        printf("  cycle %4d inst %03X addr %04X: %s is %06X, expected %06X\n",
+               k, check_in[k].inst, check_in[k].addr, what, got, expected);
+    }
+    check_errors++;
+}
+
+// check the responses of one simulated cycle
+static void check_cycle(int k, const struct SimOut *res)
+{
+    const struct SimCycle *c = &check_in[k];
+    int pg = c->addr >> 12;
+    uint16_t w;
+    uint32_t reg;
+
+    // ROM fetch of the cycle address, from the Bank selected by an ENBANK in this or an earlier cycle
+    host_enbank(host_bank, c->inst, pg);
+    w = rom_word(pg, host_bank[pg], c->addr & PAGE_MASK);
+    // the words differ per Bank, a fetch from the wrong Bank shows as an ISA error
+    if (res->isa != w) {
+        check_error(k, "ISA", res->isa, w);
+    }
+
+    // READDATA of the register selected by the RAMSLCT two cycles back, see sim_cycle()
+    if (c->inst == inst_READDATA) {
+        reg = check_in[k - 2].data1;
+        if (!host_usermem(reg)) {
+            if (res->ndata != 0) check_error(k, "DATA count", res->ndata, 0);
+        }
+        else if (res->ndata != 2) {
+            check_error(k, "DATA count", res->ndata, 2);
+        }
+        else {
+            if (res->data[0] != (0x12345678 ^ reg)) check_error(k, "DATA D31..D00", res->data[0], 0x12345678 ^ reg);
+            if (res->data[1] != (0x00ABCDEF ^ reg)) check_error(k, "DATA D55..D32", res->data[1], 0x00ABCDEF ^ reg);
+        }
+    }
+}
+
+// run n cycles through the bus loop, returns the time in us
+static uint32_t host_run(const struct SimCycle *in, int n, void (*check)(int k, const struct SimOut *res))
+{
+    SimBus bus(host_pages, in, n, check);
+    auto t = std::chrono::steady_clock::now();
+
+    core1_loop(bus);
+    bus.finish();
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - t).count();
+}
+
+// benchmark of the traffic mixes, all mixes if mix < 0
+static int host_bench(int mix)
+{
+    int first = (mix < 0) ? 0 : mix;
+    int last = (mix < 0) ? SIM_MIXES - 1 : mix;
+    const int passes = SIM_BENCH_PASSES * 64;   // the host is a lot faster
+    uint64_t n = (uint64_t)SIM_CYCLES * passes;
+    uint64_t us;
+    struct CycleHist *h;
+
+    printf("  bus loop benchmark, %llu simulated bus cycles per traffic mix\n", (unsigned long long)n);
+    printf("  mix         cycles/s   ns/cycle\n");
+    for (int m = first; m <= last; m++) {
+        sim_mix(m, sim_cycles, SIM_CYCLES);
+        sim_hist_reset();
+        us = 0;
+        for (int p = 0; p < passes; p++) {
+            us += host_run(sim_cycles, SIM_CYCLES, NULL);
+        }
+        if (us == 0) us = 1;
+        printf("  %-8s %11llu %10.1f\n", sim_mix_name[m], (unsigned long long)(n * 1000000 / us),
+               us * 1000.0 / n);
+        for (int j = TIM_T54; j < TIM_FIRST_SLACK; j++) {
+            h = &sim_hist[j];
+            if (h->count == 0) continue;
+            printf("    %-20s median %5u  p99 %5u  max %5u ns\n", timing_name[j],
+                   cyclehist_percentile(h, 50), cyclehist_percentile(h, 99), h->max);
+        }
+    }
+    return 0;
+}
+
+// check the responses of the bus loop for all traffic mixes
+static int host_check()
+{
+    int failed = 0;
+
+    for (int m = 0; m < SIM_MIXES; m++) {
+        sim_mix(m, sim_cycles, SIM_CYCLES);
+        check_in = sim_cycles;
+        check_errors = 0;
+        host_banks_reset(host_bank);
+        host_run(sim_cycles, SIM_CYCLES, check_cycle);
+        printf("  %-8s %s, %d errors\n", sim_mix_name[m], (check_errors == 0) ? "passed" : "FAILED", check_errors);
+        if (check_errors != 0) failed++;
+    }
+    return (failed == 0) ? 0 : 1;
+}
+
+// settings for the User Memory self test, as emuconfig_publish() would set them
+struct UsermemConfig {
+    const char *name;
+    bool        xfun;
+    uint8_t     mmods;          // Memory Module 1..4 in bits 0..3, 0x0F for the Quad Memory
+    uint8_t     xmem_mods;
+};
+
+static const struct UsermemConfig usermem_configs[] = {
+    { "nothing plugged",            false, 0x00, 0 },
+    { "X-Fun, MM 1 and 3, XMem 1",  true,  0x05, 1 },
+    { "Quad Memory, XMem 1 and 2",  false, 0x0F, 2 },
+    { "MM 2 and 4, XMem 1 and 2",   true,  0x0A, 2 },
+};
+
+static void usermem_print(const char *line)
+{
+    printf("%s\n", line);
+}
+
+// User Memory self test with several settings, the registers that must exist follow from the settings
+static int host_usermem_test()
+{
+    const struct UsermemConfig *u;
+    uint16_t reg;
+    int failed = 0;
+
+    usermem_test_cycles(sim_cycles);
+    usermem_test.print = usermem_print;
+    for (unsigned i = 0; i < sizeof(usermem_configs) / sizeof(usermem_configs[0]); i++) {
+        u = &usermem_configs[i];
+        emu_cfg.xfun = u->xfun;
+        emu_cfg.mmods = u->mmods;
+        emu_cfg.xmem_mods = u->xmem_mods;
+        emu_cfg_pub = emu_cfg;
+
+        for (int p = 0; p < USERMEM_PROBES; p++) {
+            reg = usermem_probe[p];
+            usermem_test.exists[p] =
+                (u->xfun && (reg >= 0x040) && (reg < 0x0C0)) ||
+                ((reg >= 0x100) && (reg < 0x200) && (u->mmods & (1 << ((reg - 0x100) >> 6)))) ||
+                ((u->xmem_mods > 0) && (reg > 0x200) && (reg < 0x2F0)) ||
+                ((u->xmem_mods > 1) && (reg > 0x300) && (reg < 0x3F0));
+        }
+        usermem_test.checks = 0;
+        usermem_test.fails = 0;
+        host_run(sim_cycles, USERMEM_TEST_CYCLES, usermem_test_check);
+        printf("  %-28s %s, %d checks, %d failed\n", u->name, (usermem_test.fails == 0) ? "passed" : "FAILED",
+               usermem_test.checks, usermem_test.fails);
+        if ((usermem_test.fails != 0) || (usermem_test.checks != USERMEM_PROBES * 3)) failed++;
+    }
+    host_config();
+    return (failed == 0) ? 0 : 1;
+}
+
+// record the cycles of all traffic mixes as a trace of the real bus would show them
+// the ISA instruction after a ROM fetch of TULIP is the fetched word, the DATA and FI
+// of TULIP are on the bus, so hp41sim replay of the file must not find any mismatch
+// the trace line of cycle k has D31..D00 read at T32 of cycle k - 1, see replay_setup()
+#define REC_CYCLES      (SIM_MIXES * SIM_CYCLES)    // all mixes in one run of the bus loop
+
+static struct SimCycle rec_in[REC_CYCLES];
+static std::vector<struct TLine> rec_lines;
+static uint32_t rec_lo = 0;                 // D31..D00 sent by TULIP in the previous cycle
+
+static void record_cycle(int k, const struct SimOut *res)
+{
+    struct TLine line = res->line;
+
+    line.data1 |= rec_lo;
+    rec_lo = (res->ndata > 0) ? res->data[0] : 0;
+    if ((res->ndata > 1) && (k + 1 < REC_CYCLES)) {
+        rec_in[k + 1].data2 |= res->data[1] & 0x00FFFFFF;       // D55..D32 at T0 of the next cycle
+    }
+    line.fi1 |= res->fi1;
+    line.fi2 |= res->fi2;
+    rec_lines.push_back(line);
+}
+
+static int host_record(const char *fname)
+{
+    static uint8_t rec[TBIN_MAXREC];
+    uint8_t bank[NR_PAGES];
+    struct TLine ref;
+    uint16_t w;
+    bool enbank;
+    FILE *f;
+    int n;
+
+    if ((f = fopen(fname, "wb")) == NULL) {
+        perror(fname);
+        return 2;
+    }
+    for (int m = 0; m < SIM_MIXES; m++) {
+        sim_mix(m, &rec_in[m * SIM_CYCLES], SIM_CYCLES);
+    }
+    host_banks_reset(host_bank);
+    for (int k = 0; k + 1 < REC_CYCLES; k++) {
+        // a ROM fetch only before a NOP, the other instructions are fetched from Page 0
+        // an ENBANK that is not answered keeps its address, in Page 3 it switches Page 5
+        // the fetched word is from the Bank selected by the ENBANK in this cycle, if any
+        memcpy(bank, host_bank, sizeof(bank));
+        enbank = host_enbank(bank, rec_in[k].inst, rec_in[k].addr >> 12);
+        w = rom_word(rec_in[k].addr >> 12, bank[rec_in[k].addr >> 12], rec_in[k].addr & PAGE_MASK);
+        if ((rec_in[k + 1].inst == 0x800) && (w != 0xFFFF)) {
+            rec_in[k + 1].inst = 0x800 | w;
+        } else if ((w != 0xFFFF) || !enbank) {
+            rec_in[k].addr &= PAGE_MASK;
+        }
+        host_enbank(host_bank, rec_in[k].inst, rec_in[k].addr >> 12);
+    }
+    host_run(rec_in, REC_CYCLES, record_cycle);
+
+    memset(&ref, 0, sizeof(ref));
+    for (size_t k = 0; k < rec_lines.size(); k++) {
+        n = tbin_encode(rec, &rec_lines[k], &ref, (k % TBIN_KEY_INTERVAL) == 0);
+        ref = rec_lines[k];
+        fwrite(rec, 1, n, f);
+    }
+    fclose(f);
+    printf("  %d cycles recorded\n", (int)rec_lines.size());
+    return 0;
+}
+
+// replay of a binary trace, the Pages and User Memory are filled from the trace
+// the ROM images and the register contents of the traced session are not known otherwise
+// the settings are those of host_config(), -i adds HP-IL
+static uint16_t replay_img[NR_PAGES][5][PAGE_SIZE];      // ROM words fetched in the trace
+static bool replay_other[NR_PAGES][5][PAGE_SIZE];        // different words fetched, not a ROM of TULIP
+
+// a trace line has the address and the word fetched from it, see replay_setup()
+// Pages 0..3 and 5 are in the HP41, these are never ours, their Banks are empty but can be switched
+// only the Banks seen in the trace exist, so an ENBANK to another Bank does not switch
+static void replay_pages(const struct TLine *lines, int n)
+{
+    int pg, b, offs;
+    uint16_t w;
+
+    for (int k = 0; k < n; k++) {
+        pg = lines[k].isa_address >> 12;
+        b = lines[k].bank;
+        offs = lines[k].isa_address & PAGE_MASK;
+        w = lines[k].isa_instruction & 0x03FF;
+        if ((b < 1) || (b > 4)) continue;
+        if (host_pages.BankImage[pg][b] == NULL) {
+            for (int i = 0; i < PAGE_SIZE; i++) replay_img[pg][b][i] = 0xFFFF;
+            host_pages.BankImage[pg][b] = replay_img[pg][b];
+        }
+        if ((pg < 6) && (pg != 4)) continue;
+        if ((replay_img[pg][b][offs] != 0xFFFF) && (replay_img[pg][b][offs] != w)) replay_other[pg][b][offs] = true;
+        replay_img[pg][b][offs] = replay_other[pg][b][offs] ? 0xFFFF : w;
+    }
+}
+
+// the register contents read before they are written in the trace
+static void replay_usermem(const struct TLine *lines, int n)
+{
+    static bool written[USERMEM_REGS];
+    uint32_t reg;
+
+    for (int k = 0; k + 1 < n; k++) {
+        reg = lines[k].ramslct;
+        if (reg >= USERMEM_REGS) continue;
+        if (lines[k].isa_instruction == inst_WRITDATA) written[reg] = true;
+        if ((lines[k].isa_instruction == inst_READDATA) && !written[reg]) {
+            usermem_regs[reg][0] = lines[k].data1;
+            usermem_regs[reg][1] = lines[k + 1].data2;
+            written[reg] = true;
+        }
+    }
+}
+
+static int host_replay(const char *fname, bool hpil)
+{
+    std::vector<uint8_t> buf;
+    std::vector<struct TLine> lines;
+    std::vector<int> runs;                  // start of each run of consecutive lines
+    std::vector<struct SimCycle> in;
+    struct ReplayLoad ld;
+    struct ReplayStats total;
+    uint8_t b[4096];
+    uint64_t us = 0;
+    size_t n;
+    int pos = 0, len;
+    FILE *f;
+
+    if ((f = fopen(fname, "rb")) == NULL) {
+        perror(fname);
+        return 2;
+    }
+    while ((n = fread(b, 1, sizeof(b), f)) > 0) buf.insert(buf.end(), b, b + n);
+    fclose(f);
+
+    // a record is at least 3 bytes, the runs are stored one after the other in lines[]
+    lines.resize(buf.size() / 3 + 1);
+    replay_load_init(&ld, lines.data(), lines.size());
+    runs.push_back(0);
+    len = buf.size();
+    while (true) {
+        pos += replay_load(&ld, buf.data() + pos, len - pos);
+        if (!ld.gap) break;
+        ld.lines += ld.count;
+        ld.max -= ld.count;
+        ld.count = 0;
+        runs.push_back(ld.lines - lines.data());
+    }
+    runs.push_back(ld.lines - lines.data() + ld.count);
+
+    if (hpil) {
+        dispatch_build(inst_dispatch[0], true, true);
+        emu_cfg.hpil = true;
+        emu_cfg_pub = emu_cfg;
+    }
+    memset(&host_pages, 0, sizeof(host_pages));
+    host_pages.clearCache();
+    for (size_t r = 0; r + 1 < runs.size(); r++) {
+        replay_pages(&lines[runs[r]], runs[r + 1] - runs[r]);
+        replay_usermem(&lines[runs[r]], runs[r + 1] - runs[r]);
+    }
+    host_pages.resetbanks();
+
+    memset(&total, 0, sizeof(total));
+    for (size_t r = 0; r + 1 < runs.size(); r++) {
+        const struct TLine *run = &lines[runs[r]];
+        int count = runs[r + 1] - runs[r];
+
+        if (count < 2) continue;
+        in.resize(count);
+        replay_setup(run, count, in.data());
+        memset(&replay_stats, 0, sizeof(replay_stats));
+
+        // first with the checks, then again for the throughput
+        sim_start(host_pages, run);
+        host_run(in.data(), count, replay_check);
+        sim_start(host_pages, run);
+        us += host_run(in.data(), count, NULL);
+
+        total.cycles += count;
+        total.checked += replay_stats.checked;
+        total.isa += replay_stats.isa;
+        total.carry += replay_stats.carry;
+        total.data += replay_stats.data;
+        total.fi += replay_stats.fi;
+        total.frame += replay_stats.frame;
+        total.state += replay_stats.state;
+    }
+    replay_stats = total;
+    if (us == 0) us = 1;
+
+    printf("  %u records, %u bytes not decoded, %d runs of consecutive cycles\n",
+           ld.records, ld.lost, (int)runs.size() - 1);
+    printf("  %u cycles replayed, %llu cycles/s, %.1f ns/cycle\n", total.cycles,
+           (unsigned long long)((uint64_t)total.cycles * 1000000 / us), us * 1000.0 / (total.cycles ? total.cycles : 1));
+    printf("  %u cycles compared, mismatches: ISA %u, carry %u, DATA %u, FI %u, HP-IL out %u, decoder state %u\n",
+           total.checked, total.isa, total.carry, total.data, total.fi, total.frame, total.state);
+    return ((replay_mismatches() == 0) && (total.cycles > 0)) ? 0 : 1;
+}
+
+int main(int argc, char *argv[])
+{
+    int mix = -1;
+
+    host_pages_init();
+    host_config();
+
+    if ((argc >= 2) && (strcmp(argv[1], "bench") == 0)) {
+        if (argc >= 3) {
+            mix = atoi(argv[2]);
+            if ((mix < 0) || (mix >= SIM_MIXES)) {
+                printf("mix must be 0..%d\n", SIM_MIXES - 1);
+                return 2;
+            }
+        }
+        return host_bench(mix);
+    }
+    if ((argc >= 2) && (strcmp(argv[1], "check") == 0)) {
+        return host_check();
+    }
+    if ((argc >= 2) && (strcmp(argv[1], "usermem") == 0)) {
+        return host_usermem_test();
+    }
+    if ((argc == 3) && (strcmp(argv[1], "record") == 0)) {
+        return host_record(argv[2]);
+    }
+    if ((argc >= 3) && (strcmp(argv[1], "replay") == 0)) {
+        if ((argc == 4) && (strcmp(argv[2], "-i") == 0)) return host_replay(argv[3], true);
+        if (argc == 3) return host_replay(argv[2], false);
+    }
+
+    printf("usage: hp41sim bench [mix] | check | usermem | record file | replay [-i] file\n");
+    return 2;
+}
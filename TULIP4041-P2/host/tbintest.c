@@ -0,0 +1,141 @@
+/*
+ * tbintest.c
+ *
+ * This file is part of the TULIP4041 project.
+ * Copyright (C) 2024 Meindert Kuipers
+ *
+ * This is free software: you are free to change and redistribute it.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * 
+ * USE AT YOUR OWN RISK
+ *
+ */
+
+// test of the binary trace records
+//   tbintest out.tbin out.txt
+// encodes generated trace lines as a binary stream like the tracer does, decodes every record
+// again and compares all fields, exit code 1 on a difference
+// out.txt is the text trace of the same lines, tools/tbin2txt must render out.tbin as exactly this
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tbin.h"
+#include "tracefmt.h"
+
+#define TEST_LINES      5000
+
+static uint32_t seed = 4041;
+
+static uint32_t rnd()
+{
+    seed = seed * 1103515245 + 12345;
+    return seed >> 8;
+}
+
+// the next generated line, mostly sequential fetches with the odd jump, gap and HP-IL traffic
+static void gen_line(int k, struct TLine *l)
+{
+    uint32_t r = rnd();
+
+    l->skipped = 0;
+    l->cycle_number += 1;
+    if ((k % 97) == 0) {
+        l->skipped = r % 300;                   // blocked by the trace filter
+        l->cycle_number += l->skipped;
+    }
+    if ((k % 1001) == 500) l->skipped = 0xFFFF;
+    if ((k % 501) == 250) l->cycle_number += 50;        // a TraceBuffer overflow
+    l->isa_address += 1;
+    if ((k % 13) == 0) l->isa_address = r >> 4;
+    if ((l->isa_instruction & 0x0803) == 0x0801) {
+        l->isa_instruction = r & 0x3FF;         // second word of a GO/XQ
+    } else {
+        l->isa_instruction = (r & 0x3FF) | (((k % 4) != 3) ? 0x0800 : 0);
+    }
+    if ((k % 5) == 0) {
+        l->data1 = rnd();
+        l->data2 = rnd() & 0x00FFFFFF;
+    }
+    if ((k % 11) == 0) {
+        l->fi1 = ((k % 3) == 0) ? 0xFFFFFFFF : rnd();
+        l->fi2 = 0xFFFFFFFF;
+    }
+    if ((k % 200) == 0) l->bank = 1 + (k / 200) % 4;
+    l->xq_instr = ((k % 7) == 0) ? (r & 0x3FF) : 0;
+    l->xq_carry = ((k % 17) == 0);
+    if ((k % 23) == 0) l->ramslct = r & 0x3FF;
+    l->frame_out = ((k % 61) == 0) ? (r & 0x7FF) : 0xFFFF;
+    if ((k % 41) == 0) l->frame_in = rnd() & 0x7FF;
+    if ((k % 37) == 0) l->HPILregs[k % 9] = r;
+}
+
+static bool same(const struct TLine *a, const struct TLine *b)
+{
+    return (a->skipped == b->skipped) && (a->cycle_number == b->cycle_number) &&
+           (a->isa_address == b->isa_address) && (a->isa_instruction == b->isa_instruction) &&
+           (a->bank == b->bank) && (a->data1 == b->data1) && (a->data2 == b->data2) &&
+           (a->fi1 == b->fi1) && (a->fi2 == b->fi2) && (a->xq_instr == b->xq_instr) &&
+           (a->xq_carry == b->xq_carry) && (a->ramslct == b->ramslct) &&
+           (a->frame_in == b->frame_in) && (a->frame_out == b->frame_out) &&
+           (memcmp(a->HPILregs, b->HPILregs, sizeof(a->HPILregs)) == 0);
+}
+
+int main(int argc, char *argv[])
+{
+    static uint8_t rec[TBIN_MAXREC];
+    struct TLine s, ref, dec, dref;
+    FILE *fb, *ft;
+    uint32_t bytes = 0, prev = 0;
+    int errors = 0;
+    int n, m;
+    char marker;
+
+    if (argc != 3) {
+        fprintf(stderr, "usage: tbintest out.tbin out.txt\n");
+        return 2;
+    }
+    if (((fb = fopen(argv[1], "wb")) == NULL) || ((ft = fopen(argv[2], "wb")) == NULL)) {
+        perror("tbintest");
+        return 2;
+    }
+
+    trace_mnem_init();
+    trace_fmt_opts.ilregs = true;               // tbin2txt -i
+    memset(&s, 0, sizeof(s));
+    memset(&ref, 0, sizeof(ref));
+    memset(&dref, 0, sizeof(dref));
+    s.bank = 1;
+    s.frame_out = 0xFFFF;
+
+    for (int k = 0; k < TEST_LINES; k++) {
+        gen_line(k, &s);
+
+        // the stream as the tracer sends it, with a key record every TBIN_KEY_INTERVAL records
+        n = tbin_encode(rec, &s, &ref, (k % TBIN_KEY_INTERVAL) == 0);
+        ref = s;
+        fwrite(rec, 1, n, fb);
+        bytes += n;
+
+        m = tbin_decode(rec, n, &dec, &dref);
+        if ((m != n) || !same(&dec, &s)) {
+            if (errors++ < 4) printf("  line %d cycle %u: encoded %d bytes, decoded %d, fields differ\n", k, s.cycle_number, n, m);
+            dref = s;
+        }
+
+        // the text trace, marked as Trace_sample() does
+        marker = ((k > 0) && (s.cycle_number != prev + 1 + s.skipped) && (s.skipped != 0xFFFF)) ? 'O' : ' ';
+        prev = s.cycle_number;
+        trace_format(&s, marker);
+        fwrite(TracePrint, 1, TracePrintLen, ft);
+    }
+    fclose(fb);
+    fclose(ft);
+
+    printf("  %d lines, %u bytes, %.2f bytes/line, %d errors\n", TEST_LINES, bytes, (double)bytes / TEST_LINES, errors);
+    return (errors == 0) ? 0 : 1;
+}
@@ -0,0 +1,124 @@
+/*
+ * hp41_bus.h
+ *
+ * This file is part of the TULIP4041 project.
+ * Copyright (C) 2024 Meindert Kuipers
+ *
+ * This is free software: you are free to change and redistribute it.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * USE AT YOUR OWN RISK
+ *
+ */
+
+// the real HP41 bus for the core1 bus loop, see hp41_core.h for the bus loop and SimBus
+// all PioBus functions are forced inline and compile to the same PIO FIFO accesses
+// as before, so this layer costs core1 nothing
+// only to be included in emulation.cpp
+
+#ifndef __HP41_BUS_H__
+#define __HP41_BUS_H__
+
+#include "emulation.h"
+#include "hp41_core.h"
+
+extern PIO pio0_pio;
+extern PIO pio1_pio;
+extern int sync_sm;
+extern int datain_sm;
+extern int debugout_sm;
+extern int isaout_sm;
+extern int isaout_offset;
+extern int dataout_sm;
+extern int fiout_sm;
+extern int fiin_sm;
+
+extern queue_t PrintBuffer;
+extern queue_t WandBuffer;
+extern queue_t HPIL_SendBuffer;
+extern queue_t HPIL_RecvBuffer;
+
+extern CModules TULIP_Pages;
+
+// adopt the last published settings snapshot, called by core1 at the start of a bus cycle
+// if core0 is writing a new snapshot it is tried again in the next cycle
+static inline void __not_in_flash_func(emuconfig_adopt)()
+{
+    uint32_t seq = emu_cfg_seq;
+    struct EmuConfig cfg;
+
+    if ((seq & 1) != 0) return;             // core0 is busy
+    __dmb();
+    cfg = emu_cfg_pub;
+    __dmb();
+    if (emu_cfg_seq != seq) return;         // changed while copying
+    emu_cfg = cfg;
+    emu_cfg_adopted++;
+}
+
+// the real HP41 bus, used by core1
+struct PioBus {
+    static constexpr bool live = true;                  // timing statistics and tracing are kept
+    static constexpr struct CycleHist *hist = timing_hist;
+
+    // the bus loop never ends
+    __force_inline bool running() { return true; }
+    __force_inline CPageMap &pages() { return TULIP_Pages; }
+    __force_inline uint32_t ticks() { return systick_hw->cvr; }        // core1 SysTick, see core1_pio()
+    __force_inline void adopt() { emuconfig_adopt(); }
+
+    // HP41 inputs
+    __force_inline bool pwo() { return gpio_get(P_PWO); }
+
+    // first cycle after PWO went high, wait while core0 runs simulated cycles with the same state
+    // sim_run() stops within one simulated cycle when PWO goes high and restores the state first
+    // this is a few us, much shorter than a bus cycle, so the FIFOs do not overflow
+    __force_inline void powerup() {
+        while (sim_active) {
+            tight_loop_contents();
+        }
+        __dmb();
+    }
+    __force_inline uint32_t get_inst() { return pio_sm_get_blocking(pio0_pio, sync_sm) >> 20; }
+    __force_inline bool addr_ready() { return !pio_sm_is_rx_fifo_empty(pio0_pio, sync_sm); }
+    __force_inline uint32_t get_addr() { return pio_sm_get_blocking(pio0_pio, sync_sm); }
+    __force_inline bool data_ready() { return pio_sm_get_rx_fifo_level(pio0_pio, datain_sm) != 0; }
+    __force_inline uint32_t get_data() { return pio_sm_get_blocking(pio0_pio, datain_sm); }
+    __force_inline bool fi_ready() { return pio_sm_get_rx_fifo_level(pio0_pio, fiin_sm) > 0; }
+    __force_inline uint32_t get_fi() { return pio_sm_get_blocking(pio0_pio, fiin_sm); }
+
+    // HP41 outputs
+    __force_inline void put_carry() { pio_sm_put_blocking(pio1_pio, isaout_sm, 0x001); }
+    __force_inline void put_inst(uint32_t inst) {
+        // force the isaout state machine to the ISA instruction output, see core1_loop()
+        pio_sm_exec(pio1_pio, isaout_sm, pio_encode_jmp(isaout_offset + hp41_pio_isaout_offset_isa_inst_out) | pio_encode_sideset(1, 0));
+        pio_sm_put_blocking(pio1_pio, isaout_sm, inst);
+    }
+    __force_inline void put_data(uint32_t data) { pio_sm_put_blocking(pio1_pio, dataout_sm, data); }
+    __force_inline void put_fi(uint32_t fi1, uint32_t fi2) {
+        pio_sm_put(pio1_pio, fiout_sm, fi1);
+        pio_sm_put(pio1_pio, fiout_sm, fi2);
+    }
+    __force_inline void debug(uint32_t marker) { pio_sm_put(pio0_pio, debugout_sm, marker); }
+
+    // queues to core0
+    __force_inline bool trace_blocked(const struct TLine *line) {
+        if (!trace_filter_blocked(line->isa_address, line->bank)) return false;
+        trace_ring.filtered++;
+        return true;
+    }
+    __force_inline bool trace(struct TLine *line) { return trace_put(line); }
+    __force_inline bool print_full() { return queue_is_full(&PrintBuffer); }
+    __force_inline void print(uint16_t *ch) { queue_try_add(&PrintBuffer, ch); }
+    __force_inline bool wand_empty() { return queue_is_empty(&WandBuffer); }
+    __force_inline void wand_get(uint16_t *w) { queue_try_remove(&WandBuffer, w); }
+    __force_inline bool frame_ready() { return !queue_is_empty(&HPIL_RecvBuffer); }
+    __force_inline void get_frame(uint16_t *frame) { queue_remove_blocking(&HPIL_RecvBuffer, frame); }
+    __force_inline void send_frame(uint16_t *frame) { queue_try_add(&HPIL_SendBuffer, frame); }
+};
+
+
+#endif
@@ -0,0 +1,396 @@
+/*
+ * hp41_core.cpp
+ *
+ * This file is part of the TULIP4041 project.
+ * Copyright (C) 2024 Meindert Kuipers
+ *
+ * This is free software: you are free to change and redistribute it.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * 
+ * USE AT YOUR OWN RISK
+ *
+ */
+
+// the state of the core1 bus loop and the parts of the emulation that do not need the Pico SDK
+// built in the firmware and in the host build, see host/CMakeLists.txt
+// the bus loop itself is in hp41_core.h
+
+#include <stdio.h>
+
+#include "hp41_core.h"
+
+uint32_t cycle_counter = 0;         // counts cycles since last PWO
+struct TLine TraceLine;             // the variable with the TraceLine used in capturing cycles in core1
+
+// definitions for HP41 user memory. Testing only supports the HP41CX
+// active here are Extended Memory Modules 1 and 2.
+uint32_t ramselected = 0;                   // selected user memory register
+uint32_t ourselected = 0;                   // selected user memory register,
+                                            // 0 means not our or invalid
+                                            // any other value is the valid memory address
+bool write_pending = false;                 // in case a WRITDATA was detected
+bool read_pending  = false;                 // in case READDATA was detected
+uint32_t prphselected = 0;                  // selected peripheral
+uint16_t WandCached = 0xFFFF;               // cached input from Wand, reading from the queue between T53 and T0 is not safe
+
+// FI output
+uint32_t fi_out1 = 0;                       // for flag output driver
+uint32_t fi_out2 = 0;
+
+// Bank Switching, keep trackof enabled Bank for each page
+uint8_t active_bank[16];
+
+// User Memory register file in SRAM for all registers 0x000..0x3FF, loaded from FRAM at startup
+// core1 only uses the SRAM copy, core0 writes the dirty registers back to FRAM in UserMem_task()
+// the layout is the same as in FRAM, 8 bytes per register starting with D00..D31
+// main memory 0x000..0x1FF is stored at MAINMEMstart, Extended Memory 0x200..0x3FF at XMEMstart
+uint32_t usermem_regs[USERMEM_REGS][2];     // [0] is D00..D31, [1] is D32..D55
+volatile uint8_t usermem_dirty[USERMEM_REGS];   // set by core1 after a write, cleared by core0 before the write-back
+struct WriteBackStats usermem_stats;          // write-back statistics
+struct WriteBackStats qrom_stats;           // WROM and write-back statistics
+
+struct FetchTiming fetch_sram;      // ROM fetch timing from the SRAM page cache
+struct FetchTiming fetch_banked;    // ROM fetch timing from the SRAM page cache, Bank 2..4 active
+struct FetchTiming fetch_flash;     // ROM fetch timing from FLASH
+uint32_t bank_switches = 0;         // number of ENBANKx instructions seen
+
+uint8_t inst_dispatch[2][4096];     // dispatch tables for core1, indexed by the SYNC + instruction bits
+bool dispatch_linear = false;       // true to run all enabled decoders for every instruction, as before the table
+bool timing_enabled = false;        // true to measure the stage and ROM fetch timing in core1, costs time in every cycle
+
+struct EmuConfig emu_cfg;           // settings snapshot in use by core1
+struct EmuConfig emu_cfg_pub;       // last published settings snapshot
+volatile uint32_t emu_cfg_seq = 0;  // sequence lock for emu_cfg_pub
+uint32_t emu_cfg_published = 0;     // number of published snapshots
+uint32_t emu_cfg_adopted = 0;       // number of snapshots adopted by core1
+volatile bool core1_running = false;    // set when core1 has started the bus loop
+
+// timing of the stages of a bus cycle in core1, see TIM_xxx in hp41_state.h
+struct CycleHist timing_hist[TIM_STAGES];
+const char *timing_name[TIM_STAGES] = {
+    "T54 decode",                   // TIM_T54
+    "T54 to ISA out",               // TIM_T54_ISA
+    "T0 to ADDRESS",                // TIM_T0_ADDR
+    "ADDRESS to ISA out",           // TIM_FETCH
+    "T32 to end of cycle",          // TIM_T32
+    "slack before T0",              // TIM_SLACK_T0
+    "slack before ADDRESS",         // TIM_SLACK_T30
+    "slack before T32",             // TIM_SLACK_T32
+};
+// bin width of each histogram as a shift, 256 bins of 1 << shift cycles
+static const uint8_t timing_shift[TIM_STAGES] = { 0, 6, 6, 1, 2, 6, 6, 6 };
+uint32_t timing_margin_us = 2;              // slack below this margin is counted as a near miss
+volatile uint32_t timing_margin;            // the same in clk_sys cycles, used by core1, see timing_set_margin()
+
+uint8_t HPIL_REG[9];            // HP-IL register stack 
+                                // HPIL_REG[0..7] used for read
+                                // HPIL_REG[8] is the R1W register (write only)
+                                // HPIL_REG[2] is different for read and write!
+
+uint16_t IL_lastframe;          // last frame sent
+uint16_t IL_inframe;            // incoming frame
+uint16_t IL_reg = 0;            // used for selected HP-IL register
+uint16_t nextIL_inst = 0;       // used for detection of IL instructions
+
+// simulated bus cycles, see SimBus in hp41_core.h
+struct CycleHist sim_hist[TIM_STAGES];      // stage timing of the simulated cycles
+const char *sim_mix_name[SIM_MIXES] = {
+    "fetch",                                // SIM_FETCH
+    "usermem",                              // SIM_USERMEM
+    "prph",                                 // SIM_PRPH
+    "banked",                               // SIM_BANKED
+    "mixed",                                // SIM_MIXED
+};
+
+struct SimCycle sim_cycles[SIM_CYCLES];     // cycles for the benchmark
+volatile bool sim_active = false;           // set by sim_run(), see PioBus::powerup()
+
+
+// clear a cycle histogram, the bin width is kept
+void cyclehist_reset(struct CycleHist *h)
+{
+    uint8_t shift = h->shift;
+
+    memset(h, 0, sizeof(struct CycleHist));
+    h->min = 0xFFFFFFFF;
+    h->shift = shift;
+}
+
+// returns the cycle count below which pct % of all measurements are, from the histogram
+// with pct = 50 this is the median, the last bin holds all values above the histogram range
+// the result is rounded down to the bin width, but never below min or above max
+uint32_t cyclehist_percentile(struct CycleHist *h, int pct)
+{
+    uint64_t limit = ((uint64_t)h->count * pct + 99) / 100;
+    uint64_t n = 0;
+    uint32_t t = h->max;
+
+    if (h->count == 0) return 0;
+    if (pct == 0) return h->min;
+    for (int i = 0; i < HIST_BINS; i++) {
+        n += h->bins[i];
+        if ((n >= limit) && (n != 0)) {
+            t = (uint32_t)i << h->shift;
+            break;
+        }
+    }
+    if (t < h->min) t = h->min;
+    if (t > h->max) t = h->max;
+    return t;
+}
+
+// clear all stage timing histograms
+void timing_reset()
+{
+    for (int i = 0; i < TIM_STAGES; i++) {
+        cyclehist_reset(&timing_hist[i]);
+        timing_hist[i].shift = timing_shift[i];
+    }
+}
+
+// build a dispatch table for core1 with the HP82143A printer and HP-IL decoders enabled or not
+// called by emuconfig_publish() on core0, the table must not be in use by core1
+// in linear mode all enabled decoders run for every instruction, this is how the loop worked before
+// the dispatch table and is only used for comparing the timing
+void dispatch_build(uint8_t *table, bool printer, bool hpil_enabled)
+{
+    uint8_t prt  = printer ? DISP_SELP9 : 0;
+    uint8_t hpil = hpil_enabled ? DISP_HPIL : 0;
+    uint8_t d;
+
+    for (int i = 0; i < 4096; i++) {
+        d = 0;
+        switch (i) {
+            case inst_READDATA:
+                d |= DISP_READDATA;
+                break;
+            case inst_SELP9:                        // SELP9 and the printer status instructions after it
+            case SELP9_BUSY:
+            case SELP9_POWON:
+            case SELP9_VALID:
+            case SELP9_RDPTRN:
+                d |= prt;
+                break;
+            case inst_ENBANK1:
+            case inst_ENBANK2:
+            case inst_ENBANK3:
+            case inst_ENBANK4:
+                d |= DISP_ENBANK;
+                break;
+        }
+
+        // HP-IL SELP0..7, and C=HPIL_Cx, HPIL_Cx=literal and the 3rd instruction after SELP0..7
+        if (((i & 0xE3F) == 0x824) || ((i & 0x23A) == 0x03A) || ((i & 0x001) == 0x001)) {
+            d |= hpil;
+        }
+
+        // instructions handled at T32 after DATA D31..D0 is read
+        switch (i) {
+            case inst_WROM:
+            case SELP9_PRINTC:
+            case SELP9_RTNCPU:
+            case inst_RAMSLCT:
+            case inst_PRPHSLCT:
+            case inst_WRITDATA:
+                d |= DISP_T32;
+                break;
+        }
+        if (hpil && ((i & 0xE3F) == 0xE00)) {
+            d |= DISP_T32;                          // HPIL=C 0..7, write to the HP-IL registers
+        }
+
+        if (dispatch_linear) {
+            d |= prt | hpil | DISP_T32;
+        }
+
+        table[i] = d;
+    }
+}
+
+// Pages with an ENBANK in SIM_BANKED, Page 3 switches Page 5 and Pages 8..F switch the Port
+static const uint8_t sim_bank_pages[7] = { 0x3, 0x8, 0x9, 0xB, 0xC, 0xD, 0xF };
+static const uint16_t sim_enbank[4] = { inst_ENBANK1, inst_ENBANK2, inst_ENBANK3, inst_ENBANK4 };
+
+// fill one simulated bus cycle of a benchmark traffic mix, i is the cycle number
+static void sim_cycle(int mix, int i, struct SimCycle *c)
+{
+    int reg;
+    int pg;
+
+    memset(c, 0, sizeof(struct SimCycle));
+    c->frame_in = SIM_NOFRAME;
+    c->inst = 0x800;                                // NOP with SYNC
+    c->addr = ((i & 0x0F) << 12) | ((i >> 4) & PAGE_MASK);     // walk through all Pages
+
+    if (mix == SIM_MIXED) {
+        mix = (i / 12) % SIM_MIXED;                 // blocks of 12 cycles of each mix
+    }
+
+    switch (mix) {
+        case SIM_USERMEM:
+            // RAMSLCT, WRITDATA, READDATA and NOP, for all registers 0x040..0x3FF
+            reg = 0x040 + ((i / 4) * 7) % (USERMEM_REGS - 0x040);
+            switch (i % 4) {
+                case 0:
+                    c->inst = inst_RAMSLCT;
+                    c->data1 = reg;
+                    break;
+                case 1:
+                    c->inst = inst_WRITDATA;
+                    c->data1 = 0x12345678 ^ reg;            // D31..D00
+                    break;
+                case 2:
+                    c->inst = inst_READDATA;
+                    c->data2 = 0x00ABCDEF ^ reg;            // D55..D32 of the WRITDATA, arrives at T0
+                    break;
+                default:
+                    break;
+            }
+            break;
+
+        case SIM_PRPH:
+            // HP82143A printer status and output as done by the printer ROM
+            switch (i % 6) {
+                case 0:
+                case 2:
+                case 4:
+                    c->inst = inst_SELP9;
+                    break;
+                case 1:
+                    c->inst = SELP9_VALID;
+                    break;
+                case 3:
+                    c->inst = SELP9_RDPTRN;
+                    break;
+                case 5:
+                    c->inst = SELP9_PRINTC;
+                    c->data1 = 'A' + (i / 6) % 26;
+                    break;
+            }
+            break;
+
+        case SIM_BANKED:
+            // blocks of 8 cycles: an ENBANK, then fetches from the Page and the other Page it switches
+            // the Pages take turns, each Page gets all 4 Banks
+            pg = sim_bank_pages[(i / 8) % 7];
+            if ((i % 8) == 0) {
+                c->inst = sim_enbank[(i / 56) % 4];
+            } else if (i & 1) {
+                pg = (pg == 3) ? 5 : (pg ^ 1);
+            }
+            c->addr = (pg << 12) | ((i * 37) & PAGE_MASK);
+            break;
+
+        default:
+            break;
+    }
+}
+
+// fill n cycles with a benchmark traffic mix
+void sim_mix(int mix, struct SimCycle *in, int n)
+{
+    for (int i = 0; i < n; i++) {
+        sim_cycle(mix, i, &in[i]);
+    }
+}
+
+// registers at the boundaries of the memory ranges, including the ranges that are never ours
+const uint16_t usermem_probe[USERMEM_PROBES] = {
+    0x000, 0x03F,                           // status registers, in the HP41
+    0x040, 0x0BF, 0x0C0, 0x0FF,             // X-Functions, and the gap up to the Memory Modules
+    0x100, 0x13F, 0x140, 0x17F,             // Memory Module 1 and 2 or the Quad Memory
+    0x180, 0x1BF, 0x1C0, 0x1FF,             // Memory Module 3 and 4 or the Quad Memory
+    0x200, 0x201, 0x2EF, 0x2F0,             // Extended Memory module 1, 0x200 is in X-Functions
+    0x2FF, 0x300, 0x301, 0x3EF,             // Extended Memory module 2
+    0x3F0, 0x3FF };
+
+struct UsermemTest usermem_test;
+
+// per register: RAMSLCT, WRITDATA with D55..D32 at T0 of the READDATA, READDATA, NOP,
+// RAMSLCT of register 0x000, READDATA, RAMSLCT of the register again, READDATA
+// the fetches are from Page 0, TULIP does not answer these
+void usermem_test_cycles(struct SimCycle *in)
+{
+    struct SimCycle *c;
+    uint32_t reg;
+
+    for (int k = 0; k < USERMEM_TEST_CYCLES; k++) {
+        c = &in[k];
+        reg = usermem_probe[k / USERMEM_PROBE_CYCLES];
+        memset(c, 0, sizeof(struct SimCycle));
+        c->frame_in = SIM_NOFRAME;
+        c->inst = 0x800;                            // NOP with SYNC
+        c->addr = k & PAGE_MASK;
+        switch (k % USERMEM_PROBE_CYCLES) {
+            case 0:
+            case 6:
+                c->inst = inst_RAMSLCT;
+                c->data1 = reg;
+                break;
+            case 1:
+                c->inst = inst_WRITDATA;
+                c->data1 = 0x40410000 | reg;        // D31..D00
+                break;
+            case 2:
+                c->inst = inst_READDATA;
+                c->data2 = 0x00A50000 | reg;        // D55..D32 of the WRITDATA
+                break;
+            case 4:
+                c->inst = inst_RAMSLCT;
+                c->data1 = 0x000;
+                break;
+            case 5:
+            case 7:
+                c->inst = inst_READDATA;
+                break;
+        }
+    }
+}
+
+// check the DATA sent by a READDATA, the register must be sent when it exists and nothing otherwise
+void usermem_test_check(int k, const struct SimOut *res)
+{
+    int p = k / USERMEM_PROBE_CYCLES;
+    uint32_t reg = usermem_probe[p];
+    bool expect = usermem_test.exists[p];
+    char line[80];
+
+    switch (k % USERMEM_PROBE_CYCLES) {
+        case 2:
+        case 7:
+            break;
+        case 5:
+            expect = false;                         // register 0x000 is selected
+            break;
+        default:
+            return;
+    }
+    usermem_test.checks++;
+    if (expect && (res->ndata == 2) && (res->data[0] == (0x40410000 | reg)) &&
+        ((res->data[1] & 0x00FFFFFF) == (0x00A50000 | reg))) return;
+    if (!expect && (res->ndata == 0)) return;
+
+    usermem_test.fails++;
+    if (usermem_test.print == NULL) return;
+    if (!expect) {
+        snprintf(line, sizeof(line), "  FAIL READDATA %03X in cycle %d: sent, but the register does not exist", reg, k);
+    } else if (res->ndata != 2) {
+        snprintf(line, sizeof(line), "  FAIL READDATA %03X in cycle %d: %d words sent", reg, k, res->ndata);
+    } else {
+        snprintf(line, sizeof(line), "  FAIL READDATA %03X in cycle %d: %06X%08X sent", reg, k,
+                 res->data[1] & 0x00FFFFFF, res->data[0]);
+    }
+    usermem_test.print(line);
+}
+
+// clear the stage timing of the simulated cycles
+void sim_hist_reset()
+{
+    for (int i = 0; i < TIM_STAGES; i++) {
+        cyclehist_reset(&sim_hist[i]);
+        sim_hist[i].shift = timing_shift[i];
+    }
+}
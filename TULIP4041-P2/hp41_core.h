@@ -0,0 +1,1353 @@
+/*
+ * hp41_core.h
+ *
+ * This file is part of the TULIP4041 project.
+ * Copyright (C) 2024 Meindert Kuipers
+ *
+ * This is free software: you are free to change and redistribute it.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * USE AT YOUR OWN RISK
+ *
+ */
+
+// the core1 bus loop and the simulated bus, without any Pico SDK includes
+// core1_loop() is a template on the bus, the bus provides everything that needs the hardware:
+//   PioBus - the HP41 bus through the PIO state machines, in hp41_bus.h, run by core1
+//   SimBus - software FIFOs filled from a list of bus cycles, below, run by core0 for the
+//            system bench command and for replaying a trace, and by the host build
+// besides the bus inputs and outputs a bus has:
+//   pages()          the Page map used for the ROM fetch
+//   ticks()          a 24-bit down counter in clk_sys cycles for the stage timing, the SysTick
+//   adopt()          take over a new settings snapshot from core0, see emuconfig_publish()
+//   trace_blocked()  the trace filter of core0 blocks this trace line
+// in the firmware only to be included in emulation.cpp and hp41_core.cpp, the host build is in host/
+
+#ifndef __HP41_CORE_H__
+#define __HP41_CORE_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "hpinterface_hardware.h"
+#include "hp41_defs.h"
+#include "pagemap.h"
+#include "hp41_state.h"
+
+// SysTick value for the stage timing of simulated cycles, a 24-bit down counter in clk_sys cycles
+// in emulation.cpp for the firmware, in the host build for the host
+uint32_t sim_ticks();
+
+// true when the simulated cycles must stop, in the firmware when PWO went high
+bool sim_stop();
+
+// add one measurement to a cycle histogram, called from core1
+static inline void __not_in_flash_func(cyclehist_add)(struct CycleHist *h, uint32_t t)
+{
+    h->count++;
+    if (t > h->max) h->max = t;
+    if (t < h->min) h->min = t;
+    t = t >> h->shift;
+    if (t >= HIST_BINS) t = HIST_BINS - 1;
+    h->bins[t]++;
+}
+
+// add the idle time before a bus event, called from core1
+// late means the event was already there before core1 started waiting, the deadline was missed
+static inline void __not_in_flash_func(slack_add)(struct CycleHist *h, uint32_t t, bool late)
+{
+    cyclehist_add(h, t);
+    if (t < timing_margin) h->near++;
+    if (late) h->late++;
+}
+
+// add one ROM fetch measurement, called from core1
+static inline void __not_in_flash_func(fetch_timing_add)(struct FetchTiming *ft, uint32_t t)
+{
+    ft->count++;
+    ft->total += t;
+    if (t < ft->min) ft->min = t;
+    if (t > ft->max) ft->max = t;
+}
+
+// check if a usermemory address exists with the given settings snapshot
+// core1 uses its own copy emu_cfg
+static inline int exist_usermem(const struct EmuConfig *cfg, uint32_t address)
+{
+    int xmem_mods;
+    int rval = false;
+
+    if (address < 0x200) {
+        // main memory, X-Functions module or Memory Modules
+        if (cfg->xfun && (address >= 0x040) && (address < 0x0C0)) {
+            return true;
+        }
+        if ((address >= 0x100) && (cfg->mmods & (1 << ((address - 0x100) >> 6)))) {
+            // Memory Module 1..4, 64 registers each
+            return true;
+        }
+        return false;
+    }
+
+    xmem_mods = cfg->xmem_mods;                   // from the settings snapshot
+
+    if (xmem_mods == 0) {
+        // no XMEM modules plugged
+        return false;
+    }
+    if (((xmem_mods == 1) || (xmem_mods == 2)) && (address > 0x200) && (address < 0x2F0)) {
+        // 1 or 2 XMEM modules
+        return true;
+    }
+    if ((xmem_mods == 2) && (address > 0x300) && (address < 0x3F0)) {
+        // 2 XMEM modules
+        return true;
+    }
+    return rval;
+}
+
+// User Memory decoding, used by core1 for RAMSLCT, WRITDATA and READDATA
+// a register is written in two parts, D00..D31 at T32 and D32..D55 at T0 of the next cycle
+// READDATA sends the register in the same two parts
+
+// RAMSLCT, select a register with the given settings snapshot, 0 if the register is not ours
+static inline void usermem_select(const struct EmuConfig *cfg, uint32_t reg)
+{
+    ourselected = exist_usermem(cfg, reg) ? reg : 0;
+}
+
+// WRITDATA, D00..D31 of the selected register
+static inline void usermem_write_lo(uint32_t data)
+{
+    usermem_regs[ourselected][0] = data;
+}
+
+// WRITDATA, D32..D55 of the selected register, the register is complete and marked for write-back
+static inline void usermem_write_hi(uint32_t data)
+{
+    usermem_regs[ourselected][1] = data;
+    usermem_dirty[ourselected] = 1;
+    usermem_stats.writes++;
+}
+
+// READDATA, D00..D31 and D32..D55 of the selected register
+static inline uint32_t usermem_read_lo()
+{
+    return usermem_regs[ourselected][0];
+}
+
+static inline uint32_t usermem_read_hi()
+{
+    return usermem_regs[ourselected][1];
+}
+
+// write to an HP-IL register
+// modeled after hpil_rw in V41 (by Christoph Giesseling)
+//  reg - register number
+//  n   - value
+template <class Bus>
+static void __not_in_flash_func(HPIL_writereg)(Bus &bus, uint8_t reg, uint16_t n)
+{
+    n &= 0xFF; 
+    TraceLine.frame_out = 0xFFFF;               // default if no frame is sent
+    switch (reg)
+    {
+        case 0: // status reg.
+            if (n & 1)
+            {
+                // Master Clear bit
+                HPIL_REG[0] |=  0x80;               // SC=1
+                HPIL_REG[1] &=  0xE1;               // IFCR=SRQR=FRNS=FRAV=0
+                HPIL_REG[1] |=  0x01;               // ORAV=1
+                HPIL_REG[8] &= ~0x01;               // FLGENB=0
+                // update_flags();                  // flags are updated outside this routine
+                m_eMode = 0;                        // not in transfer any more
+            }
+            if (n & 2)
+            {
+                // CLIFCR Clear 'Interface Clear Received'
+                HPIL_REG[1] &= 0xEF;                // IFCR=0
+                // update_flags();                  // flags are updated outside this routine
+            }
+            HPIL_REG[0] = n & 0xF9;                 // SLRDY & CLIFCR are self clearing
+            break;
+
+        case 1: // control reg.
+            HPIL_REG[8] = n;                        // write to R1W
+            // update_flags();                      // flags are updated outside this routine
+            break;
+
+        case 2: // data register, build frame and send it
+            n |= (HPIL_REG[8] & 0xE0) << 3;         // get bits 8-10 from R1W
+            HPIL_REG[1] &= 0xF8;                    // FRAV=FRNS=ORAV=0
+            IL_lastframe = n;                       // remember the last sent frame
+            TraceLine.frame_out = n;                // HP-IL frame output
+            bus.send_frame(&n);                     // send frame (to HPIL_task in core0 for handling)
+                                                    // non-blocking but is OK here
+            break;
+
+        default:
+            // also valid for REG[3], parallel poll register. 
+            // case 3 in V41 handles AUTOIDY and creates a thread
+            // in TUP4041 the AUTOIDY bit is checked by the core0 HPIL_task, no further action here
+            HPIL_REG[reg] = n;
+    }
+}          
+
+
+// main engine to process HP41 bus traffic:
+//  -- trace address, instruction, data (triggers, addres range??)
+//  -- get address and decide if a response is needed (ROM/QRAM hit)
+//  -- track DATA for several parameters
+//  -- push instruction if there is an address match needed
+//  -- decode instruction and decide if a response is needed
+//      -- WROM
+//      -- HEPAX
+//      -- bankswitching
+//      -- peripheral emulation
+//      -- display tracking, better to do in the other core with the analyzer?
+//      -- carry drive
+//      -- FI drive/undrive
+//      -- data drive
+//
+// this code MUST run from RAM. Running from flash will occasionally result in delay
+// fetching code from FLASH at critical moments. Found this on READ instructions
+//
+// the bus loop is built for the real bus (PioBus in hp41_bus.h, run by core1) and for simulated
+// bus cycles (SimBus below, run by core0 with the HP41 off or by the host build)
+
+template <class Bus>
+static void __not_in_flash_func(core1_loop)(Bus &bus)
+{
+    uint32_t rx_addr = 0;
+    uint32_t rx_inst = 0;
+    uint32_t rx_inst_t = 0;  // for tracing
+    uint32_t rx_isa  = 0;
+    uint32_t rx_sync = 0;
+    uint32_t regdata = 0;
+
+    uint16_t wrom_addr = 0;  // for WROM instruction
+    uint16_t wrom_page = 0;
+    uint16_t *qrom_img;      // SRAM image of a QROM Page
+
+    uint32_t rx_data1 = 0;
+    uint32_t rx_data2 = 0;
+
+    uint32_t fi_data1 = 0;
+    uint32_t fi_data2 = 0;
+
+    uint16_t ptr_data = 0;                      // pinter data received to be printed
+
+    uint32_t rom_addr = 0;
+    uint32_t rom_pg = 0;
+
+    uint32_t isa_out_data = 0;
+    uint8_t  fram_res[15];              // for reading fram results efficiently
+
+    uint8_t traceoverflow = 0;          // to detect TraceBuffer overflow
+    uint16_t trace_skip = 0;            // cycles blocked by the trace filter since the last TraceLine
+
+    uint32_t isaout_sideset = 0;
+
+    uint16_t *page_img;                 // decoded Page in the SRAM page cache
+    uint32_t fetch_start;               // SysTick value at the start of the ROM fetch
+    uint32_t fetch_ticks;               // duration of the ROM fetch
+    uint32_t t54_start;                 // SysTick value after reading the instruction
+    uint32_t t0_start;                  // SysTick value after reading DATA at T0
+    uint32_t addr_start;                // SysTick value after reading the ADDRESS at T30
+    uint32_t isa_done;                  // SysTick value after pushing the ISA instruction
+    uint32_t t32_start;                 // SysTick value after reading DATA at T32
+    uint32_t wait_start;                // SysTick value before waiting for the next bus event
+    bool late;                          // the bus event was already there before waiting
+    uint8_t  disp = 0;                  // dispatch table entry for the current instruction
+    uint8_t  *dispatch;                 // dispatch table of the settings snapshot
+    bool     timed;                     // measure the timing of this cycle, simulated cycles always
+    CPageMap &pages = bus.pages();      // the Pages and the SRAM page cache
+
+    uint32_t pagetoswitch = 1;           // bank for ROM paging
+    uint32_t banktoswitch = 1;
+
+    int i = 0;
+    int var = 0;
+    int n = 0;
+
+    uint8_t ctrlReg;  // used for HP-IL FI flags
+
+    bool sendcarry = false;         // set to true if carry at D0_TIME must be sent
+    bool wake = true;               // the next cycle is the first one after PWO went high
+
+    // from now on core0 publishes settings snapshots and core1 adopts them
+    // simulated cycles run with the snapshot set up by sim_run()
+    dispatch = emu_cfg.dispatch;
+    timed = !Bus::live || emu_cfg.timing;
+    if (Bus::live) core1_running = true;
+
+    while (bus.running())
+    {
+        // between two bus cycles is the safe point to adopt new settings from core0
+        if (Bus::live && (emu_cfg_seq != emu_cfg.version)) {
+            bus.adopt();
+            dispatch = emu_cfg.dispatch;
+            timed = emu_cfg.timing;
+        }
+
+        // ==============================================================================
+        // T54  T54  T54  T54  T54  T54  T54  T54  T54  T54  T54  T54  T54  T54  T54  T54
+        //
+        // first read is always the ISA INSTRUCTION, this happens at T54,
+        // almost immediately after the last instruction bit was read on the rising edge at CLK01 
+        // and the extra read for getting the SYNC status
+        // from the state machine these are 12 bits, left justified in the 32-bit ISR FIFO from the sync_pio state machine
+        //   the two MSB's are the SYNC status and a copy of the instruction MSB
+        //   the 10 LSB's are the instruction
+        //     bits in instruction:   |11|10|09|08|07|06|05|04|03|02|01|00|
+        //                                  | <-      instruction ->      |
+        //                                bit 10: same as bit 09
+        //                                bit 11: SYNC status
+        // a WROM instruction (0x040) would show as 0x840, with the SYNC bit set
+        // this makes for a quick decision if it is a real instruction (SYNC high) or data (SYNC low)
+        // to get right justified INSTRUCTION bits simply shift 20 bits, the SYNC bit is in bit 11
+
+        rx_inst = bus.get_inst();                                   // first read is INSTRUCTION
+        if (wake) {
+            // the HP41 is running again, core1 may have to wait for core0 to give back the state
+            wake = false;
+            bus.powerup();
+        }
+        t54_start = bus.ticks();                                // for the T54 timing
+
+        // gpio_put(P_DEBUG, 1);
+        bus.debug(DBG_OUT0);
+
+        TraceLine.cycle_number = cycle_counter;
+        cycle_counter++;
+
+        // TraceLine.xq_instr = 0;
+        // TraceLine.xq_data = 0;
+
+        // gpio_pulse(P_DEBUG, 2);                                  // for debugging                                      
+
+        // for peripheral emulation this is the place where the instruction must be decoded and handled
+        // fast enough to be ready to send a carry at T0_TIME or data starting at T0_TIME
+        // other instructions may take more time to process
+        // instructions requiring immediate action:
+        //  - when carry must be sent at D0
+        //  - register data must be presented on DATA this is the case for the instructions:
+        //      - READDATA
+        //      - READ 1..15
+        //  - peripheral data to be presented on DATA
+
+        TraceLine.xq_instr = rx_inst_t;    
+        rx_inst_t = 0;
+
+        // TraceLine.xq_data1 = fi_out1;
+        // TraceLine.xq_data2 = fi_out2;
+
+        if ((fi_out1 != 0 ) || (fi_out2 != 0))
+        {
+            // if one of fi_out is not zero we have a flag to be output
+            // in case we have to drive FI for any flags present
+            // we only drive the FI_OE signal, this is an active high signal
+            // The FI_out is tied to GND, and FI itself is normally pulled high by the system
+            // of fi_outx is all zero's, nothing needs to be sent
+            // we could alssend fi_outx always ...
+            bus.put_fi(fi_out1, fi_out2);               // send the data
+        }
+
+        // the dispatch table tells which decoders must run for this instruction
+        // it is built from the settings by dispatch_build(), so no need to check them here
+        // when nothing needs to be done this is a single load and branch
+        disp = dispatch[rx_inst];
+        if (disp & DISP_T54)
+        {
+            if (disp & DISP_READDATA)
+            {
+                // respond to READDATA instruction, return the register pointed to by ramselected
+                // or the peripheral register in case of a valid PRPH selected register
+                // must handle here
+                // since we do not have the full data line complete here we can only handle part of the data
+                // especially when there was a WRIT DATA immediately before
+                // we do this as follows:
+                //   immediate action is to push the first half of the data D0..D31
+                //   delayed action to push the 2nd half of data
+                
+                // TraceLine.xq_instr = rx_inst;    
+                rx_inst_t = rx_inst;            
+                if (ourselected > 0) {
+                    regdata = usermem_read_lo();
+                    // TraceLine.xq_data1 = regdata;
+                    bus.put_data(regdata);  // send the data
+                    read_pending = true;
+                }              
+                else if (HP82153A_active && (prphselected == PRPH_wand))
+                {
+                    // Wand active and selected, so may need to send data
+                    // ROM has checked if data is actually in the buffer
+                    // that is already in the cached Wand data due to speed 
+                    regdata = WandCached;
+                    WandCached = 0xFFFF;          // mark as consumed
+                    // TraceLine.xq_data1 = regdata;
+                    bus.put_data(regdata);  // send the data
+                    bus.put_data(0);  // send the data
+                }
+            } 
+      
+            if (disp & DISP_SELP9)
+            {
+
+                // handling of HP82143A (Printer) specific instructions
+                switch (rx_inst) {
+
+                    case inst_SELP9:                // 0x264, SELP 9 NUT instruction, starts SELP9 mode, SYNC bit set!            
+                        rx_inst_t = rx_inst;     
+                        SLCT_PRPH = 9;              // selected peripheral is 9, the HP82143A printer
+                        break;
+                    case SELP9_BUSY:                // 0x003, set carry if printer busy, no SYNC bit!            
+                        if (SLCT_PRPH == 9) { 
+                            rx_inst_t = rx_inst; 
+                            // we report the printer as busy when the printbuffer is full and the printer is ON
+                            if (emu_cfg.prt_power) {
+                                SELP9_status_BUSY = bus.print_full();
+                                // SELP9_status_BUSY = false;      // never BUSY
+                                sendcarry = SELP9_status_BUSY;
+                            }
+                            SLCT_PRPH = -1;          // return control back to the NUT
+                        }
+                        break;
+                    case SELP9_POWON:               // 0x083, set carry if printer is ON, no SYNC bit!!
+                        if (SLCT_PRPH == 9) { 
+                            rx_inst_t = rx_inst;
+                            sendcarry = emu_cfg.prt_power;
+                            SLCT_PRPH = -1;          // return control back to the NUT                    
+                        }
+                        break;
+                    case SELP9_VALID:               // 0x043, set carry if status valid, no SYNC bit! 
+                        if (SLCT_PRPH == 9) { 
+                            rx_inst_t = rx_inst; 
+                            if (emu_cfg.prt_power) {
+                                // valid status only when the printer is ON
+                                sendcarry = SELP9_status_VALID;
+                            }
+                            SLCT_PRPH = -1;          // return control back to the NUT                      
+                        }
+                        break;           
+                                                                
+                    case SELP9_RDPTRN:              // 0x03A, transfer printer status word to C[10..13], no SYNC bit!
+                        if (SLCT_PRPH == 9) { 
+                            rx_inst_t = rx_inst; 
+                            rx_data1 = SELP9_status;
+                            // transfer printer status word to C[10..13], peripheral remains selected
+                            // start preparing to send out to DATA
+                            bus.put_data(0);                   // bits D00..D32 are always 0
+                            bus.put_data(SELP9_status << 8);   // bits D33..D55 contain status
+                            // after reading status the status bits for the PRINT and ADV key are reset
+                            // but the status is read multiple times, so keep track of the number of reads
+                            if (keycount_print == 0) {
+                                // SELP9_status = SELP9_status & 0xC0FF;
+                                SELP9_status = SELP9_status & (~prt_ADV_mask);
+                                SELP9_status = SELP9_status & (~prt_PRT_mask);
+                            }
+                            else
+                            {
+                                keycount_print--;
+                            }                                                       
+                        }
+                        break;
+                }   // switch
+            }
+
+            if (disp & DISP_HPIL)
+            {
+                // handling of HP82160A (HP-IL) specific instructions
+                // filter out SELP0..SELP9: 0x024 to 0x1E4, 
+                // this is a class 0 instruction PPPPIIII00, where IIII = 0b1001, PPPP = 0..7
+                // with the SYNC bit set this becomes 0b100PPPIIII00 or 0b100PPP100100, in hex: 0x824, mask: 0b111000111111 or 0xE3F
+                // only P = 0..7 is valid
+                // mask for selected peripheral is 0b000111000000 or 0x1C0
+
+                // this part needs to be changed, selection of the register is by the SELP instruction, 
+                // NOT by the bits in the READ/WRIT instruction, these are ignored (reaearch by Thomas and Mike)
+
+                if ((rx_inst & 0xE3F) == 0x824) {
+                    // check for SELP0 .. SELPx
+                    rx_inst_t = rx_inst; 
+                    SLCT_PRPH = (rx_inst & 0x1C0) >> 6;
+                    nextIL_inst = (rx_inst & 0b000111000000) | 0b000000111010;
+
+                    // after this the next instruction expected is C=HPIL_Cx
+                    // 0x824 -> 0x03A       0b100PPP100100  -> 0b0PPP111010
+                    IL_reg = (rx_inst & 0x1C0) >> 6;           // selected HP-IL register
+
+                }
+                else if ((SLCT_PRPH >= 0) && (SLCT_PRPH <= 7) && (rx_inst & 0x23A) == 0x03A)
+                {   
+                    // check for C=HPIL_Cx 
+                    // only after SELP0..7, SYNC not set
+                    // filter out 0x03A .. 0x1FA, 0b0000111010 .. 0b0111111010
+                    // format: 0b0ppp111010 or 0x03A as mask, 0b0111000000 or 0x1C0 as filter
+
+                    // HP-IL selected and instruction is 0x03A..0x1FA
+                    // Read HP-IL Register
+
+                    // if HP-IL register 2 is read (data input/output) do the following:
+                    //  - REG2 is filled when data arrives from the queue, checked after T0
+                    //  - check if FRAV and FRNS
+                    //  - if so, then new data is available
+                    //  - clear FRAV and FRNS flags (will also clear interrupt)
+                    //  - update R1W with C01..C03 from R1R
+                    rx_inst_t = rx_inst; 
+                    // IL_reg = (rx_inst & 0x1C0) >> 6;            // this can be commented out ??
+                    if (IL_reg == 2)
+                    {
+                        // Register 2, data input/output
+                        n = HPIL_REG[1] & 0x06;               // FRAV & FRNS
+                        HPIL_REG[1] &= 0xF9;                  // FRAV=FRNS=0
+                        if (n)      // FRAV or FRNS is set
+                        {
+                            // FRAV or FRNS is set, so we have a valid frame received
+                            HPIL_REG[8] &= ~0xE0;               // clear CO3-CO1
+                            HPIL_REG[8] |= HPIL_REG[1] & 0xE0;  // copy CO3-CO1 from R1R to R1W
+                        }
+                        // update_flags();                      // flags are updated elsewhere
+                    }
+
+                    // now return register value to C[0..1]
+                    regdata = HPIL_REG[IL_reg];
+
+                    // TraceLine.xq_data1 = regdata;
+                    bus.put_data(regdata);     // send the data
+                    bus.put_data(0);           // send the data
+
+                }
+                else if ((SLCT_PRPH >= 0) && (SLCT_PRPH <= 7) && ((rx_inst & 0x003) == 0x001))
+                {
+                    // check for HPIL_Cx = (literal), 0bcccccccc01, c = value to be placed in register
+                    // only after SELP0..7, SYNC not set
+                    // deselects peripheral
+                    rx_inst_t = rx_inst; 
+                    HPIL_writereg(bus, SLCT_PRPH, (rx_inst & 0x3FC) >> 2);
+                    SLCT_PRPH = -1;
+                }
+                else if ((SLCT_PRPH >= 0) && (SLCT_PRPH <= 7) && ((rx_inst & 0x003) == 0x003))
+                {
+                    // 
+                    rx_inst_t = rx_inst; 
+                    // this is the 3rd instruction of a 3-instruction sequence
+                    // always returns control back to the NUT
+                    // no further checks, accept all instructions ending with 2 1's
+                    SLCT_PRPH = -1;
+                }
+            }
+        }
+
+        // check for CLASS0 READ instruction
+        // read data from selected register and present on the DATA line
+        // register must be sent out to DATA now!
+        // if ((rx_inst & mask_CLASS0) == mask_READ) 
+        // {
+            
+        //     TraceLine.xq_instr = rx_inst;
+        // }
+
+        if (sendcarry != 0 ) {
+            // now send the carry, simply dump a '1' bit into the isaout state machine
+            // all the rest is handled by the isaout state machine
+            bus.put_carry();
+            sendcarry = false;
+            TraceLine.xq_carry = true;
+        } 
+        else {
+            TraceLine.xq_carry = false;
+        }
+  
+        // put instruction in TraceLine for the ISA instruction
+        TraceLine.isa_instruction = rx_inst;
+
+        // gpio_put(P_DEBUG, 0);
+        // gpio_pulse(P_DEBUG, 3);                                  // for debugging 
+        if (timed) cyclehist_add(&bus.hist[TIM_T54], (t54_start - bus.ticks()) & 0x00FFFFFF);
+        bus.debug(DBG_OUT1);
+     
+        // ========================================================================
+        // T0   T0   T0   T0   T0   T0   T0   T0   T0   T0   T0   T0   T0   T0   T0
+        //
+        // after reading ISA INSTRUCTION next should be the completion of the DATA
+        // the first part is autopushed after 32 bits, the 2nd part should be in the ISR at T0
+        // prior to D0 the DATA RX FIFO should be empty (this was read already)
+        // to keep in sync, ensure this is indeed empty
+        // this must be done BEFORE D0_TIME!
+
+        // blocking read for the 2nd part of DATA rx FIFO to get bits D55..D32
+        // this happens at T0_TIME
+        // consider doing 28 clok cycles in the datain state machine to get this data earlier for WROM handling
+        // figure out when to check for PWO otherwise we might stall here
+
+        // must wait until after T0_TIME, need to figure this out
+
+        // PWO check must be done here. If PWO is low (after SYNC) then HP41 is off
+        // and we must not stall in getting any data to prevent getting out of SYNC
+        // we could also check for the POWOFF instruction, but that does not work if HP41 is switched off
+        // for other reasons (power removal etc)
+        // PWO goes low a bit after SYNC, but there are not enough clocks to generate a real D0_TIME pulse
+        // if there are not enough clocks then there will be no data pushed when reading rx_data2 below
+        // if we have nothing else to do then is is probably best to sleep a few useconds (2 clocks = 3..4 us) 
+        // and check PWO prior to reading data
+
+        // at this point we have two options: PWO goes low (power down) or we receive new data
+
+        if ((HPIL_REG[8] & 0x01) == 0x01)   // if FLGENB set in R1W
+        {
+            ctrlReg = HPIL_REG[1];          // flags are in R1R
+            // HPIL Register 1 (write) bit 0 is the flag output enable
+            // when it is 1 the flags are enabled
+            if ((ctrlReg & 0x01) == 0x01) 
+            {
+                fi_out2 = fi_out2 | FI_10;        // ORAV
+            }
+            else
+            {
+                fi_out2 = fi_out2 & FI_10_off;
+            }
+        }
+
+        wait_start = bus.ticks();                               // slack until DATA arrives at T0
+        late = bus.data_ready();
+        while (bus.pwo() && !bus.data_ready())
+        {
+                // do nothing, just wait until PWO goes low or data arrives in the FIFO!
+        }
+
+        // when we get out of the previous loop we can continue if PWO is still high
+
+        // for debugging       
+        bus.debug(DBG_OUT2);
+
+        if (bus.pwo())
+        { 
+            // PWO is high, so we can read DATA at T0
+            rx_data2 = bus.get_data();                                  //  blocking read from datain state machine
+            t0_start = bus.ticks();
+            if (timed) slack_add(&bus.hist[TIM_SLACK_T0], (wait_start - t0_start) & 0x00FFFFFF, late);
+
+            // when we get here there is also data in the FI input state machine
+            // read both words, but at the first start there may be only one word in the RX FIFO
+
+            #if (TULIP_HARDWARE == T_DEVBOARD) 
+                if (bus.fi_ready()) {
+                    TraceLine.fi1 = bus.get_fi(); 
+                }
+
+                if (bus.fi_ready()) {
+                    TraceLine.fi2 = bus.get_fi(); 
+                }
+            #elif (TULIP_HARDWARE == T_MODULE)
+                TraceLine.fi1 = fi_out1;
+                TraceLine.fi2 = fi_out2;
+            #endif
+
+            TraceLine.data2 = rx_data2 >> 8;                            // get received data in TraceLine and align
+
+            // package for the TraceLine is now complete, send it to the TraceBuffer
+            // this is non-blocking to prevent going out of SYNC on a full trace bufer
+            // blocked cycles never enter the TraceBuffer, a run of them is counted in the next TraceLine
+            if ((trace_enabled) || (trace_outside == (rom_addr > 0x6000)))
+            {
+                if (bus.trace_blocked(&TraceLine)) {
+                    if (trace_skip != 0xFFFF) trace_skip++;
+                } else {
+                    TraceLine.skipped = trace_skip;
+                    traceoverflow = bus.trace(&TraceLine);                                  // add to internal trace buffer for handling by core0
+                    // traceoverflow = 0 (false) if the element was not added, this is an overflow
+                    // to be added to the next succesfull trace, the record is counted in trace_ring.dropped
+                    if (traceoverflow) trace_skip = 0;
+                }
+            }
+
+            // Traceline is sent, so clear HP-IL frameout for default value
+            TraceLine.frame_out = 0xFFFF;               // default if no frame is sent
+
+            // DATA is now fully complete after T0
+            // ready to check on instructions needing the data from the PREVIOUS cycle
+            // this would be a WRITDATA (or any of the other WRIT variations)
+            // this would be triggered by a delayed WRITE here
+
+            if (write_pending == true) 
+            {
+                // there was a pending write, captured data is now bits D32..55
+                // to be stored in selected register
+                // the lower bits have already been saved
+                if (ourselected > 0) {
+                    usermem_write_hi(rx_data2 >> 8);            // register complete, core0 writes it to FRAM
+                    // TraceLine.xq_data2 = (rx_data2 >> 8);
+                    write_pending = false;       
+                }
+            }
+
+            // now that any pending writes have been done, a possible pending read can be handled
+            // this is needed in case a READ immediately follows a WRITE
+
+            if (read_pending == true) 
+            {
+                // handle a pending READ of the higher data register bits D32..D55
+                // TODO: check alignment
+                if (ourselected > 0) {
+                    regdata = usermem_read_hi();
+                    // TraceLine.xq_data2 = regdata;
+                    bus.put_data(regdata);  // send the data
+                    read_pending = false;
+                }
+            }
+
+            // this is after the priority handling of DATA and ISA, and after T0
+            // and plenty of time to handle some other stuff, so check the ENBANK instructions here
+            // this must be done anyway before the next instruction fetch
+            // bankswitching currently only valid in Page 8 for the OSX ROM
+
+            if (HP82153A_active)
+            {
+                if (bus.wand_empty() && (WandCached == 0xFFFF))
+                {
+                    fi_out1 = fi_out1 & FI_00_off;
+                    fi_out1 = fi_out1 & FI_02_off;
+                }
+                else
+                {
+                    // cached Wand data is valid or data in the queue
+                    // now that data is available, set the flags
+                    // Wand sets flags 0 and 2 when it has data
+                    // Flag 0 is set when it wants attention
+                    fi_out1 = fi_out1 | FI_00 | FI_02;
+
+                    if (WandCached == 0xFFFF)
+                    {
+                        // our cache is available, so read from the buffer
+                        // otherwise cache may be filled but not read yet
+                        bus.wand_get(&WandCached);
+                    }
+                }
+            }
+
+            // check for incoming data from HP-IL
+            // if (HP82160A_active && !queue_is_empty(&HPIL_RecvBuffer))
+            if (emu_cfg.hpil && bus.frame_ready())
+            {
+                // HP-IL is active and there is data in the HP-IL receive queue
+                // this means that a valid frame has arrived
+                // process the frames according to V41 (Christoph Giesselink)
+                // RFC frames are handled by core0
+
+                // read the frame from the queue
+                bus.get_frame(&IL_inframe);
+                TraceLine.frame_in = IL_inframe;
+
+                // adjust flags according to received frame and state:
+                if ((IL_inframe & 0x400) == 0)              // DOE : 0xx
+                {
+                    if (HPIL_REG[0] & 0x10)                 // LA, Listener Active
+                    {
+                        HPIL_REG[1] |= 5;                   // FRAV=ORAV=1
+                    }
+                    else if (HPIL_REG[0] & 0x20)            // TA, Talker Active
+                    {
+                        if ((IL_lastframe & 0xff) != (IL_inframe & 0xff))
+                            // incoming and outgoing do not match
+                            // set FRNS
+                            HPIL_REG[1] |= 3;               // FRNS=ORAV=1
+                        else
+                            HPIL_REG[1] |= 1;               // ORAV=1
+                    }
+                    else
+                    {
+                        // SendFrame(IL_inframe);           // case LA=TA=0, retransmit DOE frames!
+                                                            // send frame (to HPIL_task in cor0 for handling)
+                        bus.send_frame(&IL_inframe);    
+                    }
+                    if ((IL_inframe & 0x100) != 0)
+                        HPIL_REG[1] |= 8;                   // SRQR=1
+                    else
+                        HPIL_REG[1] &= ~8;                  // SRQR=0
+                }
+
+                else if ((IL_inframe & 0x200) != 0)         // IDY : 11x
+                {
+                    if ((HPIL_REG[0] & 0x30) == 0x30)       // TA=LA=1 (scope mode)
+                        HPIL_REG[1] |= 5;                   // FRAV=ORAV=1
+                    else
+                        HPIL_REG[1] |= 1;                   // ORAV=1
+                    if ((IL_inframe & 0x100) != 0)
+                        HPIL_REG[1] |= 8;                   // SRQR=1
+                    else
+                        HPIL_REG[1] &= ~8;                  // SRQR=0
+                }
+
+                else if ((IL_inframe & 0x100) == 0)         // CMD : 100
+                {
+                    if ((HPIL_REG[0] & 0x30) == 0x30)       // TA=LA=1 (scope mode)
+                        HPIL_REG[1] |= 5;                   // FRAV=ORAV=1
+                    else if (IL_lastframe == IL_inframe)
+                        HPIL_REG[1] |= 1;                   // ORAV=1
+                    else
+                        HPIL_REG[1] |= 3;                   // FRNS=ORAV=1
+                    if (IL_inframe == 0x490)                // IFC
+                        HPIL_REG[1] |= 16;                  // IFCR=1
+                }
+
+                else                                        // RDY : 101
+                {
+                    if ((HPIL_REG[0] & 0x30) == 0x30)       // TA=LA=1 (scope mode)
+                        HPIL_REG[1] |= 5;                   // FRAV=ORAV=1
+                    else if ((IL_inframe & 0xc0) == 0x40)   // ARG
+                        HPIL_REG[1] |= 5;                   // FRAV=ORAV=1
+                    else
+                    {
+                        if (IL_lastframe == IL_inframe)
+                            HPIL_REG[1] |= 1;               // ORAV=1
+                        else
+                            HPIL_REG[1] |= 3;               // FRNS=ORAV=1
+                    }
+                }
+
+                if ((HPIL_REG[1] & 6) != 0)                 // if FRNS or FRAV, returned frame in R1R & R2R
+                {
+                    HPIL_REG[2] = (uint8_t)IL_inframe;        // returned frame
+                    HPIL_REG[1] &= 0x1f;
+                    HPIL_REG[1] |= (IL_inframe & 0x700) >> 3; // save received bits 8-10 to R1R
+                }
+                // flags are updated later in the cycle
+                // AUTO IDY check is done in core0
+            }
+            // end of incoming HP-IL handling
+
+
+
+
+            bus.debug(DBG_OUT3);
+
+            // =================================================================================
+            // T30   T30   T30   T30   T30   T30   T30   T30   T30   T30   T30   T30   T30   T30
+            // PWO is high, HP41 still running, get ISA ADDRESS
+
+            wait_start = bus.ticks();                               // slack until the ADDRESS arrives
+            late = bus.addr_ready();
+            rx_addr = bus.get_addr();                                   // 2nd read from SYNC/ISA state machine is ADDRESS
+            addr_start = bus.ticks();
+            if (timed) {
+                cyclehist_add(&bus.hist[TIM_T0_ADDR], (t0_start - addr_start) & 0x00FFFFFF);
+                slack_add(&bus.hist[TIM_SLACK_T30], (wait_start - addr_start) & 0x00FFFFFF, late);
+            }
+            rom_addr = rx_addr >> 16;                 
+                              // to get the current address
+            TraceLine.isa_address = rom_addr;
+            // at this point we have a valid address which is left justified in rx_addr and right justified in rom_addr
+            // this can be used to check for a ROM hit, read data and present it on the ISA output
+
+            // this is the place to handle the ROM mapping and bankswitching 
+
+            // handle ENBANK instructions, the active bank is used for tracing and 
+            // the ROM fetch uses the PageImage[] pointer selected here
+            // must isolate page for correct handling
+            // take care of the following:
+            //   HP41CX, ENBANK in Page 3 actually switched Page 5 active bank
+            //   for Port 8/9, A/B, C/D and E/F both banks are swichted
+            //   
+
+            rom_pg = (rom_addr & 0xF000) >> 12;                            // right aligned page number
+            if (disp & DISP_ENBANK) {
+                // only if there is an ENBANKx instruction
+                // bits 7..6 of the instruction encode the bank: 0x100, 0x180, 0x140, 0x1C0
+                banktoswitch = nBank[(rx_inst >> 6) & 0x03] + 1;
+                bank_switches++;
+                if (rom_pg == 3)
+                {
+                    // HP41CX, ENBANK in Page 3 actually switched Page 5 active bank
+                    if (pages.selectbank(5, banktoswitch)) active_bank[5] = banktoswitch;
+                }
+                else if ((rom_pg == 9) || (rom_pg == 0xB) || (rom_pg == 0xD) || (rom_pg == 0xF))
+                {
+                    // for Port 8/9, A/B, C/D and E/F both banks are swichted
+                    // a missing Bank in one of the two Pages leaves that Page in its current Bank
+                    if (pages.selectbank(rom_pg, banktoswitch)) active_bank[rom_pg] = banktoswitch;
+                    if (pages.selectbank(rom_pg - 1, banktoswitch)) active_bank[rom_pg - 1] = banktoswitch;
+                }
+                else if ((rom_pg == 8) || (rom_pg == 0xA) || (rom_pg == 0xC) || (rom_pg == 0xE))
+                {
+                    // for Port 8/9, A/B, C/D and E/F both banks are swichted
+                    if (pages.selectbank(rom_pg, banktoswitch)) active_bank[rom_pg] = banktoswitch;
+                    if (pages.selectbank(rom_pg + 1, banktoswitch)) active_bank[rom_pg + 1] = banktoswitch;
+                }
+                else
+                {
+                    if (pages.selectbank(rom_pg, banktoswitch)) active_bank[rom_pg] = banktoswitch;
+                }
+            }
+
+
+            // we should now add the Bank information to the Traceline
+            TraceLine.bank = active_bank[rom_pg];
+
+            // gpio_pulse(P_DEBUG, 6);                                  // for debugging 
+            bus.debug(DBG_OUT4);
+
+            // Read the ROM, embedded or from FLASH
+            isa_out_data = 0xffff;              // default if ROM is empty
+            fetch_start = bus.ticks();
+
+            page_img = pages.PageImage[rom_pg];           // already points to the active bank
+            if (page_img != NULL) {
+                // the Page is decoded in the SRAM page cache, just a single load
+                isa_out_data = page_img[rom_addr & PAGE_MASK];
+                if (Bus::live && timed) {
+                    fetch_ticks = (fetch_start - bus.ticks()) & 0x00FFFFFF;
+                    fetch_timing_add((active_bank[rom_pg] == 1) ? &fetch_sram : &fetch_banked, fetch_ticks);
+                }
+            }
+            else if (pages.isEnabled(rom_pg, active_bank[rom_pg])) {
+                // check if the page is enabled, if not then return empty data
+                // this is for the TULIP pages, which are not always enabled
+                // this is done in the TULIP_Pages class
+                // Page/Bank is not in the cache, read and decode from FLASH
+                isa_out_data = pages.getbankword(rom_pg, active_bank[rom_pg], rom_addr & PAGE_MASK);
+                if (Bus::live && timed) fetch_timing_add(&fetch_flash, (fetch_start - bus.ticks()) & 0x00FFFFFF);
+            }
+            
+            // old code to read from an Embedded ROM
+            /*
+            switch(rom_pg) {
+                  
+                case 0x6:                       // IL-PRINTER or HP82143A PRINTER
+                    // Printer or HP-IL Printer
+                    if (globsetting.get(ILPRINTER_plugged))
+                    {
+                        isa_out_data = embed_ILPRINTER_rom[rom_addr & 0x0FFF];
+                    }
+
+                    if (globsetting.get(HP82143A_enabled))
+                    {
+                        isa_out_data = embed_PRINTER_rom[rom_addr & 0x0FFF];
+                    }
+                    break;
+
+                case 0x7:                       // HP-IL module       
+                    if (globsetting.get(HPIL_plugged))
+                    {
+                        isa_out_data = embed_HPIL_rom[rom_addr & 0x0FFF];
+                    } 
+                    break;
+            }
+                    */
+
+            if (isa_out_data != 0xFFFF)
+            // not an empty page so return valid data
+            // otherwise nothing will be returned
+            {
+                // we must force the state machine to jump to the offset of the isa instruction out
+                // normally it is stalled waiting for data right before sending the carry out at D0_TIME
+                // this is for faster handling of the carry as we have only 2 clock cycles for that
+                // pio_encode_sideset(1, 1), to also use the sideset here (1 sideset bit, value 1), otherwise ISA_OE wil be forced low
+                // to be OR'ed with the encoded jump instruction
+                // then put the instruction in the TX FIFO, the rest is done by the PIO state machine
+                // the state machine will send out the ISA instruction at the right time, no need to worry about that here
+                // just make sure that this is done before the start of SYNC_TIME
+                // this is blocking, but the FIFO should  always be empty
+                // both are done by put_inst(), see PioBus in hp41_bus.h
+                bus.put_inst(isa_out_data); 
+                isa_done = bus.ticks();
+                if (timed) {
+                    cyclehist_add(&bus.hist[TIM_FETCH], (addr_start - isa_done) & 0x00FFFFFF);
+                    cyclehist_add(&bus.hist[TIM_T54_ISA], (t54_start - isa_done) & 0x00FFFFFF);
+                }
+            }
+
+            // gpio_pulse(P_DEBUG, 7);                                  // for debugging  
+            bus.debug(DBG_OUT5);
+
+            // =================================================================================
+            // T32   T32   T32   T32   T32   T32   T32   T32   T32   T32   T32   T32   T32   T32
+            // handling of ISA address now complete
+            // next up is capture the first part of DATA, D31..D0
+
+            wait_start = bus.ticks();                               // slack until DATA arrives at T32
+            late = bus.data_ready();
+            rx_data1 = bus.get_data();                                           // blocking read from datain state machine   
+            t32_start = bus.ticks();
+            if (timed) slack_add(&bus.hist[TIM_SLACK_T32], (wait_start - t32_start) & 0x00FFFFFF, late);
+            TraceLine.data1 = rx_data1;
+
+            // gpio_pulse(P_DEBUG, 8);                                  // for debugging             
+            bus.debug(DBG_OUT6);
+
+            
+            // we now have D31..D0 in rx_data1
+            // this is only D31..00. If more data bits are needed wait for the rest.
+            // only the instructions marked in the dispatch table need handling here
+            if (disp & DISP_T32)
+            {
+                switch (rx_inst) {
+                    case inst_WROM :                // WROM instruction
+
+                        // TraceLine.xq_data1 = rx_data1;
+                        // TraceLine.xq_instr = rx_inst;    
+
+                        // QROM, a single store in the SRAM image when the QROM Bank is active
+                        // the block is marked dirty and written to FRAM by core0 in QROM_task()
+                        // simulated cycles do not change the QROM
+                        rx_inst_t = rx_inst;
+                        wrom_addr = (rx_data1 & 0x0FFFF000) >> 12;   // isolate the WROM address from DATA
+                        wrom_page = (wrom_addr & 0xF000) >> 12;
+                        qrom_img = pages.QROMImage[wrom_page];
+                        if (Bus::live && (qrom_img != NULL) && (qrom_img == pages.PageImage[wrom_page])) {
+                            qrom_img[wrom_addr & PAGE_MASK] = rx_data1 & 0x03FF;    // WROM data from DATA
+                            pages.QROMDirty[wrom_page][(wrom_addr & PAGE_MASK) / QROM_BLOCK] = 1;
+                            qrom_stats.writes++;
+                        }
+                        break;
+
+                    case SELP9_PRINTC:              // 0x007, send byte on C[0..1] to the printbuffer, no SYNC bit!
+                        // if ((SLCT_PRPH == 9) && HP82143A_active) { 
+                        if ((SLCT_PRPH == 9) && emu_cfg.printer) {     
+                            // send C[0..1] to the printbuffer
+                            // can be handled only after C is available
+                            rx_inst_t = rx_inst; 
+                            ptr_data = rx_data1 & 0xFF;
+                            // TraceLine.xq_data1 = ptr_data;
+                            SLCT_PRPH = -1;          // return control back to the NUT after this instruction
+                            // handle printer emulation for control codes
+                            // note that the control codes immediately below are handled by the printer simulator and ignored here
+                            //      0xA0..0xB7: skip 0..23 characters, done by printer simulator
+                            //      0xB8..0xBF: skip 0..7 colum sin SCO mode, done by printer simulator
+                            switch (ptr_data) {
+                                // all characters are sent to the printbuffer anyway
+                                // some have a special meaning and must be handled here to set the printer status bits
+                                case 0xE0:                      // EOLL, left justified EOL
+                                                                // if in graphics mode, terminate SCO
+                                                                // set EOL status bit
+                                                                // clear TEO status bit
+                                            SELP9_status = SELP9_status & (~prt_SCO_mask);      // clear SCO bit
+                                            SELP9_status = SELP9_status & (~prt_TEO_mask);      // clear TEO bit
+                                            SELP9_status = SELP9_status | prt_EOL_mask;         // set EOL bit
+                                            break;
+
+                                case 0xE8:                      // EOLR, right justified EOL
+                                                                // if in graphics mode, terminate SCO
+                                                                // set EOL status bit
+                                                                // set TEO status bit
+                                            SELP9_status = SELP9_status & (~prt_SCO_mask);      // clear SCO bit
+                                            SELP9_status = SELP9_status | prt_TEO_mask;         // set TEO bit
+                                            SELP9_status = SELP9_status | prt_EOL_mask;         // set EOL bit
+                                            break;
+                                case 0xD0 ... 0xD7:             // set/clear DW, CO and LC mode (ptr_data bits 2, 1, 0 respectively)
+                                                                // DW, CO and LC bits are bit 7, 6 and 5
+                                            SELP9_status = SELP9_status & ~prt_DWM_mask & ~prt_SCO_mask & ~prt_LCA_mask;     // clear out the relevant bits
+                                            SELP9_status = SELP9_status | ((ptr_data & 0x07) << 5);                         // and set according to lsb's of received char
+                                            break;
+                                case 0xFE:                      // clear local paper Advance Ingnore
+                                            LocalAdvIgnore = false;
+                                            break;
+                                case 0xFF:                      // set local Paper Advance Ignore
+                                            LocalAdvIgnore = true;
+                                            break;
+                                default:
+                                            break;                        
+                            }
+                            // to be tested: P_BUSY status change on printbuffer full
+                            if (bus.print_full()) {
+                                SELP9_status_BUSY = true;
+                            }
+                            else
+                            {
+                                // send char to be printed to core0, non-blocking!
+                                // queue should not be full here, just in case
+                                SELP9_status_BUSY = false;
+                                bus.print(&ptr_data);    
+                            }
+                        }
+                        break;  // end of case for SELP9_PRINTC
+
+                    case SELP9_RTNCPU:              // 0x005, return control to the HP41 CPU, ends SELP mode, no SYNC bit!
+                                                    // does not need any data
+                        // TraceLine.xq_instr = rx_inst;    
+                        rx_inst_t = rx_inst; 
+                        // if ((SLCT_PRPH == 9) && HP82143A_active) { 
+                        if ((SLCT_PRPH == 9) && emu_cfg.printer) {  
+                            // return control to the NUT
+                            SLCT_PRPH = -1;          // return control back to the NUT                        
+                        }
+                        break;
+
+                    case inst_RAMSLCT:              // RAMSLCT, must wait for DATA[2..0] to become available
+                        // TraceLine.xq_instr = rx_inst;    
+                        rx_inst_t = rx_inst; 
+                        ramselected = rx_data1 & 0x03FF;
+                        prphselected = 0;           // deselect any peripheral when RAMSLCT appears
+                        // ourselected is the register address between 0x040 - 0x3FF when it is ours,
+                        // 0 when it does not exist or is not our register, the register is in SRAM
+                        usermem_select(&emu_cfg, ramselected);
+                        TraceLine.ramslct = ramselected;
+                        // TraceLine.xq_data1 = ramselected;
+                        break;
+
+                    case inst_PRPHSLCT:             // PRPHSLCT, select peripheral from DATA[2..0]
+                        rx_inst_t = rx_inst; 
+                        prphselected = (rx_data1 & 0x03FF);
+                        // should do a check if the selected peripheral is ours and active (plugged)
+                        // for now leave it, used only for the Wand in the test setup
+                        break;
+
+                    case inst_WRITDATA:             // WRITDATA, must wait for DATA to be complete and then store
+                                                    // in register pointed to by ramselected
+                        // TraceLine.xq_instr = rx_inst;    
+                        rx_inst_t = rx_inst; 
+                        if (ourselected > 0) {
+                            usermem_write_lo(rx_data1);                 // D32..D55 follow at T0
+                            // TraceLine.xq_data1 = rx_data1;
+                            write_pending = true;       // mark as pending to handle high bits when data arrives
+                        }
+                        break;
+                                                                      
+                    default:
+                        // TraceLine.xq_instr = 0;
+                        // TraceLine.xq_data = 0;
+
+                        // catch the HP-IL=C(0..7) instructions, copy C[0..1] to the HP-IL register
+                        // instructions 0x200..0x3C0, bit pattern: 0b1nnn000000, with SYNC bit set: 0b111nnn000000 0xE00
+                    
+                        // if (HP82160A_active && ((rx_inst & 0xE3F) == 0xE00))
+                        if (emu_cfg.hpil && ((rx_inst & 0xE3F) == 0xE00))
+                        // instruction to write C[0..1] to the selected IL register
+                        {
+                            rx_inst_t = rx_inst; 
+                            IL_reg = (rx_inst & 0x1C0) >> 6;            // mask register and bring in position
+                            HPIL_writereg(bus, IL_reg, rx_data1 & 0xFF);     // takes care of sending if needed
+                        }
+                        break;
+                }
+            }
+
+            for (i = 0; i < 9; i++)
+            {
+                TraceLine.HPILregs[i] = HPIL_REG[i];
+            }
+           
+            // gpio_pulse(P_DEBUG, 9);                                  // for debugging 
+            bus.debug(DBG_OUT7);
+
+            // at this time we can update the HP-IL flags
+            // simply set the FI flags according to the HP-IL register
+            // HP-IL uses the following flags:
+            //  FI_06   0x07000000      // FI_IFCR, checked with ?IFCR, Interface Clear Received (on fi_out1)
+            //  FI_07   0x70000000      // FI_SRQR, checked with ?SRQR, Service Request Received (on fi_out1)
+            //  FI_08   0x00000007      // FI_FRAV, checked with ?FRAV, Frame Available  (on fi_out2)
+            //  FI_09   0x00000070      // FI_FRNS, checked with ?FRNS, Frame Received Not as Sent (on fi_out2)
+            //  FI_10   0x00000700      // FI_ORAV, checked with ?ORAV, Output Register Available (on fi_out2)
+
+            if ((HPIL_REG[8] & 0x01) == 0x01)   // if FLGENB set in R1W
+            {
+                ctrlReg = HPIL_REG[1];          // flags are in R1R
+                // HPIL Register 1 (write) bit 0 is the flag output enable
+                // when it is 1 the flags are enabled
+                if ((ctrlReg & 0x01) == 0x01) 
+                {
+                    fi_out2 = fi_out2 | FI_10;        // ORAV
+                }
+                else
+                {
+                    fi_out2 = fi_out2 & FI_10_off;
+                }
+
+                if ((ctrlReg & 0x02) == 0x02)
+                {
+                    fi_out2 = fi_out2 | FI_09;        // FRNS
+                } 
+                else
+                {
+                    fi_out2 = fi_out2 & FI_09_off;
+                }
+                
+                if ((ctrlReg & 0x04) == 0x04)
+                {
+                    fi_out2 = fi_out2 | FI_08;        // FRAV
+                } 
+                else
+                {
+                    fi_out2 = fi_out2 & FI_08_off;
+                }
+                
+                if ((ctrlReg & 0x08) == 0x08)
+                {
+                    fi_out1 = fi_out1 | FI_07;        // SRQR
+                } 
+                else
+                {
+                    fi_out1 = fi_out1 & FI_07_off;
+                }
+                
+                if ((ctrlReg & 0x10) == 0x10)
+                {
+                    fi_out1 = fi_out1 | FI_06;        // IFCR
+                } 
+                else
+                {
+                    fi_out1 = fi_out1 & FI_06_off;
+                }
+            }
+            else
+            {
+                // HP-IL flags are disabled, so clear the relevant flags
+                fi_out1 = fi_out1 & FI_06_off;
+                fi_out1 = fi_out1 & FI_07_off;
+                fi_out2 = fi_out2 & FI_08_off;
+                fi_out2 = fi_out2 & FI_09_off;
+                fi_out2 = fi_out2 & FI_10_off;
+            }
+
+            // all work for this cycle is done, the wait for the next instruction is not measured
+            // because it includes the time the HP41 is in light sleep
+            if (timed) cyclehist_add(&bus.hist[TIM_T32], (t32_start - bus.ticks()) & 0x00FFFFFF);
+
+        } 
+        else {
+            // PWO is low, so HP41 is now in deep or light sleep
+            // try to empty the buffer but do not block
+
+            // also empty datain FIFO, best to reset state machine to also empty ISR
+            
+            if (bus.addr_ready())
+            {           
+                // read data if RX FIFO is not empty
+                rx_addr = bus.get_addr();
+            }
+            else
+            {
+                rx_addr = 0;
+            }
+            // in any case, update the Trace buffer with whatever we have
+            bus.trace(&TraceLine);                                      // add to internal trace buffer for handling by core0   
+            wake = true;
+
+            // gpio_pulse(P_DEBUG, 10);                                  // for debugging 
+            bus.debug(DBG_OUT7);
+        }        
+    }
+}                       // end of the core1 loop
+
+// decoder state before simulated cycles taken from a trace line, for the replay of traced cycles
+// the selected register, the HP-IL registers and the Bank of the Page of the address
+// the rest of the decoder state is not in a trace line, the first replayed cycle sets it up
+static inline void sim_start(CPageMap &pages, const struct TLine *start)
+{
+    int pg = (start->isa_address >> 12) & 0x0F;
+
+    TraceLine = *start;
+    ramselected = start->ramslct;
+    usermem_select(&emu_cfg, ramselected);
+    memcpy(HPIL_REG, start->HPILregs, sizeof(HPIL_REG));
+    if ((start->bank >= 1) && (start->bank <= 4)) {
+        if (pages.selectbank(pg, start->bank)) active_bank[pg] = start->bank;
+    }
+}
+
+// simulated bus, one SimCycle is one pass through the bus loop
+// inputs are taken from in[], when check is not NULL the responses of TULIP for a cycle
+// are collected in res and passed to check() when the cycle is complete
+// nothing is sent to the core0 queues, printer output and HP-IL frames are only recorded
+// the ROM fetch uses the Pages in map, TULIP_Pages in the firmware
+struct SimBus {
+    static constexpr bool live = false;                 // no fetch timing and no tracing
+    static constexpr struct CycleHist *hist = sim_hist;
+
+    CPageMap &map;
+    const struct SimCycle *in;
+    int n;                              // number of cycles in in[]
+    void (*check)(int k, const struct SimOut *res);
+    int pos = 0;                        // next cycle
+    const struct SimCycle *cur = NULL;  // cycle in progress
+    struct SimOut res;                  // responses in the cycle in progress
+    struct SimOut *o = NULL;            // &res when the responses are checked
+    bool t32 = false;                   // next DATA read is D31..D00 at T32
+    bool fi2 = false;                   // next FI read is the second word
+    uint32_t printed = 0;               // characters sent to the printer
+    uint32_t frames = 0;                // HP-IL frames sent
+
+    SimBus(CPageMap &m, const struct SimCycle *c, int num, void (*chk)(int k, const struct SimOut *res)) :
+        map(m), in(c), n(num), check(chk) { o = (check != NULL) ? &res : NULL; }
+
+    __force_inline bool running() { return (pos < n) && !sim_stop(); }
+    __force_inline bool stopped() { return pos < n; }   // not all cycles were run
+    __force_inline CPageMap &pages() { return map; }
+    __force_inline uint32_t ticks() { return sim_ticks(); }
+    __force_inline void adopt() { }                     // runs with the snapshot set up by the caller
+
+    // pass the responses of the last cycle to check()
+    void finish() {
+        if ((o != NULL) && (pos > 0)) check(pos - 1, o);
+    }
+
+    // HP41 inputs, every cycle runs with PWO high and data ready in the FIFOs
+    __force_inline bool pwo() { return true; }
+    __force_inline void powerup() { }
+    __force_inline uint32_t get_inst() {
+        if (o != NULL) {
+            finish();
+            memset(o, 0, sizeof(struct SimOut));
+            o->isa = 0xFFFF;
+            o->frame_out = SIM_NOFRAME;
+        }
+        cur = &in[pos];
+        pos++;
+        t32 = false;
+        fi2 = false;
+        return cur->inst;
+    }
+    __force_inline bool addr_ready() { return true; }
+    __force_inline uint32_t get_addr() { return (uint32_t)cur->addr << 16; }
+    __force_inline bool data_ready() { return true; }
+    __force_inline uint32_t get_data() {
+        // DATA D55..D32 at T0 is left justified in the datain FIFO, D31..D00 at T32
+        uint32_t d = t32 ? cur->data1 : (cur->data2 << 8);
+        t32 = true;
+        return d;
+    }
+    __force_inline bool fi_ready() { return true; }
+    __force_inline uint32_t get_fi() {
+        uint32_t f = fi2 ? cur->fi2 : cur->fi1;
+        fi2 = true;
+        return f;
+    }
+
+    // HP41 outputs
+    __force_inline void put_carry() { if (o != NULL) o->carry = true; }
+    __force_inline void put_inst(uint32_t inst) { if (o != NULL) o->isa = inst; }
+    __force_inline void put_data(uint32_t data) {
+        if ((o != NULL) && (o->ndata < 2)) o->data[o->ndata++] = data;
+    }
+    __force_inline void put_fi(uint32_t fi1, uint32_t fi2) {
+        if (o != NULL) {
+            o->fi1 = fi1;
+            o->fi2 = fi2;
+        }
+    }
+    __force_inline void debug(uint32_t) { }
+
+    // queues to core0
+    __force_inline bool trace_blocked(const struct TLine *) { return false; }
+    __force_inline bool trace(struct TLine *line) {
+        if (o != NULL) o->line = *line;                 // the trace line as core1 would have sent it
+        return true;
+    }
+    __force_inline bool print_full() { return false; }
+    __force_inline void print(uint16_t *) { printed++; }
+    __force_inline bool wand_empty() { return true; }
+    __force_inline void wand_get(uint16_t *) { }
+    __force_inline bool frame_ready() { return cur->frame_in != SIM_NOFRAME; }
+    __force_inline void get_frame(uint16_t *frame) { *frame = cur->frame_in; }
+    __force_inline void send_frame(uint16_t *frame) {
+        frames++;
+        if (o != NULL) o->frame_out = *frame;
+    }
+};
+
+#endif
@@ -0,0 +1,259 @@
+/*
+ * hp41_state.h
+ *
+ * This file is part of the TULIP4041 project.
+ * Copyright (C) 2024 Meindert Kuipers
+ *
+ * This is free software: you are free to change and redistribute it.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * 
+ * USE AT YOUR OWN RISK
+ *
+ */
+
+// the emulation state used by the core1 bus loop and its statistics, defined in hp41_core.cpp
+// has no Pico SDK includes, so that the bus loop can also be built on a host, see hp41_core.h
+
+#ifndef __HP41_STATE_H__
+#define __HP41_STATE_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// TLine  is for the maximum possible trace line structure with FI and HP-IL
+// in the TraceBuffer it is stored as a variable size record, see trace_put()
+struct TLine {
+    uint32_t    cycle_number;       // to count the cycles since the last PWO       4 bytes
+    uint16_t    isa_address;        // ISA address                                  2 bytes
+    uint16_t    isa_instruction;    // ISA instruction with SYNC status             2 bytes
+    uint8_t     bank;               // current selected bank                        1 byte
+    uint16_t    skipped;            // cycles blocked by the trace filter before    2 bytes
+                                    // this one, 0xFFFF for 0xFFFF or more
+    uint32_t    data1;              // DATA D31..D00                                4 bytes
+    uint32_t    data2;              // DATA D55..D32                                4 bytes
+    uint32_t    fi1;                // for FI line tracing                          4 bytes
+    uint32_t    fi2;                //                                              4 bytes
+    uint16_t    xq_instr;           // instruction decoded                          2 bytes
+    bool        xq_carry;           // when carry is sent                           1 byte
+    uint32_t    ramslct;            // selected RAM chip                            4 bytes
+    uint16_t    frame_in;           // HP-IL frame input                            2 bytes
+    uint16_t    frame_out;          // HP-IL frame output                           2 bytes
+    uint8_t     HPILregs[9];        // HP-IL registers                              9 bytes
+} ;
+
+// responses of TULIP in one simulated bus cycle, see SimBus in hp41_core.h
+struct SimOut {
+    uint16_t    isa;                // ISA instruction sent for the address, 0xFFFF if none
+    bool        carry;              // carry sent at T0
+    uint8_t     ndata;              // number of words sent on DATA
+    uint32_t    data[2];            // words sent on DATA, D31..D00 at T54 and D55..D32 right justified
+    uint32_t    fi1;                // FI output, 0 if not driven
+    uint32_t    fi2;
+    uint16_t    frame_out;          // HP-IL frame sent, SIM_NOFRAME if none
+    struct TLine line;              // trace line of the cycle, sent at T0
+};
+
+// timing of the ROM fetch in core1, measured with the core1 SysTick in clk_sys cycles
+// covers the code between the DBG_OUT4 and DBG_OUT5 markers
+struct FetchTiming {
+    uint32_t    count;              // number of fetches measured
+    uint32_t    min;                // shortest fetch
+    uint32_t    max;                // longest fetch
+    uint64_t    total;              // sum of all fetches, for the average
+};
+
+extern struct FetchTiming fetch_sram;       // ROM fetches from the SRAM page cache
+extern struct FetchTiming fetch_banked;     // ROM fetches from the SRAM page cache with Bank 2..4 active
+extern struct FetchTiming fetch_flash;      // ROM fetches decoded from FLASH with getbankword()
+extern uint32_t bank_switches;              // number of ENBANKx instructions
+extern uint8_t active_bank[16];             // active Bank of each Page
+
+// histogram of a cycle count measured in core1 with the SysTick, 1 << shift cycles per bin
+#define HIST_BINS       256
+struct CycleHist {
+    uint32_t    count;              // number of measurements
+    uint32_t    min;                // best case
+    uint32_t    max;                // worst case
+    uint32_t    near;               // slack only: less than timing_margin left
+    uint32_t    late;               // slack only: bus event was already there, deadline missed
+    uint8_t     shift;              // bin width
+    uint32_t    bins[HIST_BINS];    // last bin also counts everything longer
+};
+
+// stages of a bus cycle in core1, each with a histogram in timing_hist[]
+enum {
+    TIM_T54,                        // instruction read until the T54 work is done (DBG_OUT0 .. DBG_OUT1)
+    TIM_T54_ISA,                    // instruction read until the ISA instruction is pushed to isaout
+    TIM_T0_ADDR,                    // DATA read at T0 until the ADDRESS is read at T30
+    TIM_FETCH,                      // ADDRESS read until the ISA instruction is pushed, bank switch and ROM fetch
+    TIM_T32,                        // DATA read at T32 until all work for the cycle is done
+    TIM_SLACK_T0,                   // idle time before DATA arrives at T0
+    TIM_SLACK_T30,                  // idle time before the ADDRESS arrives
+    TIM_SLACK_T32,                  // idle time before DATA arrives at T32
+    TIM_STAGES
+};
+#define TIM_FIRST_SLACK TIM_SLACK_T0
+
+extern struct CycleHist timing_hist[TIM_STAGES];
+extern const char *timing_name[TIM_STAGES];
+extern uint32_t timing_margin_us;           // near miss margin in us
+extern bool timing_enabled;                 // core1 measures the bus cycle timing, off by default
+extern volatile uint32_t timing_margin;     // near miss margin in clk_sys cycles
+
+void cyclehist_reset(struct CycleHist *h);
+uint32_t cyclehist_percentile(struct CycleHist *h, int pct);
+void timing_reset();
+
+// simulated bus cycles, run through the core1 bus loop by core0 with the HP41 off, see hp41_core.h
+#define SIM_NOFRAME     0xFFFF      // no HP-IL frame in this cycle
+
+struct SimCycle {                   // inputs of one bus cycle, same meaning as in a TLine
+    uint16_t    inst;               // ISA instruction with the SYNC status in bit 11
+    uint16_t    addr;               // ISA address
+    uint32_t    data1;              // DATA D31..D00
+    uint32_t    data2;              // DATA D55..D32, right justified
+    uint32_t    fi1;                // FI input
+    uint32_t    fi2;
+    uint16_t    frame_in;           // HP-IL frame received, SIM_NOFRAME if none
+};
+
+enum {                              // traffic mixes for the bus loop benchmark
+    SIM_FETCH,                      // NOP instructions and ROM fetches across all Pages
+    SIM_USERMEM,                    // RAMSLCT, WRITDATA and READDATA across all registers
+    SIM_PRPH,                       // HP82143A printer status and print instructions
+    SIM_BANKED,                     // ENBANK1..4 and ROM fetches from the switched Pages
+    SIM_MIXED,                      // the above interleaved
+    SIM_MIXES
+};
+
+#define SIM_CYCLES      512         // size of sim_cycles[]
+#define SIM_BENCH_PASSES 32         // the benchmark runs sim_cycles[] this many times
+
+extern struct CycleHist sim_hist[TIM_STAGES];  // stage timing of simulated cycles
+extern const char *sim_mix_name[SIM_MIXES];
+extern struct SimCycle sim_cycles[SIM_CYCLES];
+extern volatile bool sim_active;            // core0 runs the bus loop, core1 waits at the first cycle after PWO rises
+
+void sim_mix(int mix, struct SimCycle *in, int n);
+void sim_hist_reset();
+
+// test of the User Memory decoding, RAMSLCT, WRITDATA and READDATA cycles for the registers at the
+// boundaries of all memory ranges, run through the bus loop with a SimBus and checked with usermem_test_check()
+// used by system usermem test in the firmware and by hp41sim usermem on the host
+#define USERMEM_PROBES      24      // number of registers tested
+#define USERMEM_PROBE_CYCLES 8      // cycles per register
+#define USERMEM_TEST_CYCLES (USERMEM_PROBES * USERMEM_PROBE_CYCLES)
+
+struct UsermemTest {
+    bool        exists[USERMEM_PROBES];     // the register must exist with the settings under test
+    int         checks;                     // READDATA cycles checked
+    int         fails;
+    void        (*print)(const char *line); // shows a failure
+};
+
+extern const uint16_t usermem_probe[USERMEM_PROBES];
+extern struct UsermemTest usermem_test;
+
+void usermem_test_cycles(struct SimCycle *in);
+void usermem_test_check(int k, const struct SimOut *res);
+
+// dispatch table for the core1 bus loop, one entry per 12-bit SYNC + instruction word
+// each bit marks a decoder that must run for the instruction, 0 means nothing to do
+#define DISP_READDATA   0x01        // T54: READDATA, register or Wand data to DATA
+#define DISP_SELP9      0x02        // T54: SELP9 and the HP82143A printer status instructions
+#define DISP_HPIL       0x04        // T54: HP-IL SELP0..7, C=HPIL_Cx and HPIL_Cx=literal
+#define DISP_ENBANK     0x08        // T30: ENBANK1..4
+#define DISP_T32        0x10        // T32: WROM, RAMSLCT, PRPHSLCT, WRITDATA, printer output, HP-IL writes
+#define DISP_T54        (DISP_READDATA | DISP_SELP9 | DISP_HPIL)
+
+extern uint8_t inst_dispatch[2][4096];     // two tables, one in use by core1 and one for building the next
+extern bool dispatch_linear;                // all enabled decoders for every instruction, for comparing
+
+void dispatch_build(uint8_t *table, bool printer, bool hpil);  // build a dispatch table for these settings
+
+// emulation settings used by core1, a snapshot of the global settings
+// core0 publishes a new snapshot with emuconfig_publish() when a setting changes,
+// core1 adopts it at the start of a bus cycle and only reads its own copy emu_cfg
+struct EmuConfig {
+    uint32_t    version;            // sequence number of the published snapshot, always even
+    uint8_t     *dispatch;          // dispatch table for these settings
+    bool        printer;            // HP82143A_enabled, printer emulation
+    bool        prt_power;          // PRT_power, printer is on
+    bool        hpil;               // HP82160A_enabled, HP-IL emulation
+    int         xmem_mods;          // xmem_pages, number of Extended Memory modules
+    bool        xfun;               // xfun_enabled, X-Functions module registers 0x040..0x0BF
+    uint8_t     mmods;              // mmod1..4_enabled and mmod_quad_enabled, bit 0..3 for Memory Module 1..4
+    bool        timing;             // timing_enabled, core1 measures the stage and ROM fetch timing
+};
+
+extern struct EmuConfig emu_cfg;            // the snapshot in use by core1
+extern struct EmuConfig emu_cfg_pub;        // the last published snapshot
+extern volatile uint32_t emu_cfg_seq;       // sequence lock, odd while core0 writes emu_cfg_pub
+extern uint32_t emu_cfg_published;          // number of snapshots published
+extern uint32_t emu_cfg_adopted;            // number of snapshots adopted by core1
+
+// User Memory registers 0x000..0x3FF in SRAM, written back to FRAM by core0
+#define USERMEM_REGS            0x400       // number of registers in the SRAM copy
+
+
+// statistics of a background write-back to FRAM, used for User Memory registers and QROM blocks
+struct WriteBackStats {
+    uint32_t    writes;             // registers or QROM words written by core1
+    uint32_t    flushed;            // registers or QROM blocks written back to FRAM
+    uint32_t    passes;             // write-back passes with at least one dirty register or block
+    uint32_t    last_pass_us;       // duration of the last pass
+    uint32_t    max_pass_us;        // longest pass
+    int         max_backlog;        // highest number of dirty registers or blocks seen
+    uint32_t    forced;             // number of complete write-backs at PWO low
+    uint32_t    last_forced_us;     // PWO falling edge until everything is in FRAM, last time
+    uint32_t    max_forced_us;      // same, worst case
+};
+
+extern uint32_t usermem_regs[USERMEM_REGS][2];     // [0] is D00..D31, [1] is D32..D55, same layout as FRAM
+extern volatile uint8_t usermem_dirty[USERMEM_REGS];
+extern struct WriteBackStats usermem_stats;
+extern struct WriteBackStats qrom_stats;
+
+// state of the bus loop, kept between bus cycles
+extern uint32_t cycle_counter;              // cycles since the last PWO
+extern struct TLine TraceLine;              // trace line of the cycle in progress
+extern uint32_t ramselected;                // register selected with RAMSLCT
+extern uint32_t ourselected;                // the same when it is ours, 0 if not
+extern uint32_t prphselected;               // peripheral selected with PRPHSLCT
+extern bool write_pending;                  // WRITDATA, D32..D55 follow at T0
+extern bool read_pending;                   // READDATA, D32..D55 are sent at T0
+extern uint32_t fi_out1;                    // FI output, 0 if not driven
+extern uint32_t fi_out2;
+extern uint16_t WandCached;                 // Wand data taken from the queue, 0xFFFF if none
+extern volatile bool core1_running;         // core1 has started the bus loop
+
+extern uint8_t HPIL_REG[9];                 // HP-IL registers, HPIL_REG[8] is R1W
+extern uint16_t IL_lastframe;               // last HP-IL frame sent
+extern uint16_t IL_inframe;                 // last HP-IL frame received
+extern uint16_t IL_reg;                     // selected HP-IL register
+extern uint16_t nextIL_inst;                // for detection of HP-IL instructions
+
+// settings and peripheral state used by the bus loop, defined with the code that owns them
+extern bool HP82153A_active;                // Wand active
+extern int16_t SLCT_PRPH;                   // selected peripheral, -1 if none
+extern bool SELP9_status_BUSY;
+extern bool SELP9_status_VALID;
+extern uint16_t SELP9_status;               // HP82143A printer status bits
+extern uint16_t LocalAdvIgnore;             // for ignoring local paper advance
+extern int keycount_print;
+extern int m_eMode;                         // HP-IL controller/device mode
+extern int trace_enabled;
+extern int trace_outside;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -39,6 +39,44 @@ void fram_rommap_init() {
     }
 
     TULIP_Pages.retrieve(); // retrieve the ROM map from FRAM
+
+    // the files may have been moved by a flash compact that was interrupted by a power loss
+    if (TULIP_Pages.relocate() > 0) {
+        TULIP_Pages.save();
+    }
+}
+
+// find the Banks plugged from the FLASH File System again after flash compact moved the files
+// the header at b_img_rom must still have the name of the plugged file, if not the file is 
+// searched by name and the Bank is plugged from the new offset, a file that is gone is unplugged
+// returns the number of Banks changed, the ROM map must then be saved
+int CModules::relocate() {
+    int n = 0;
+
+    for (int port = 0; port < NR_PAGES; port++) {
+        for (int bank = 1; bank <= 4; bank++) {
+            CBank *b = &Pages[port].m_banks[bank];
+            uint32_t data = (uint32_t)b->b_img_data;
+
+            // only images in the FLASH File System, not the embedded ROMs or a QROM in FRAM
+            if ((data < (uint32_t)FF_SYSTEM_BASE) || (data >= (uint32_t)FF_SYSTEM_BASE + FF_SYSTEM_SIZE)) continue;
+
+            ModuleMetaHeader_t *MetaH = (ModuleMetaHeader_t *)(FF_SYSTEM_BASE + b->b_img_rom);
+            if (strncmp(MetaH->FileName, b->b_img_name, sizeof(MetaH->FileName)) == 0) continue;
+
+            uint32_t offs = ff_findfile(b->b_img_name);
+            if (offs == NOTFOUND) {
+                cli_printf("  Page %X Bank %d: file %s not found, unplugged", port, bank, b->b_img_name);
+                unplug(port, bank);
+            } else {
+                b->b_img_rom = offs;
+                b->b_img_data = (uint16_t *)(FF_SYSTEM_BASE + offs + sizeof(ModuleMetaHeader_t));
+                cachePage(port, bank);
+            }
+            n++;
+        }
+    }
+    return n;
 }
 
 // end of file module.c
\ No newline at end of file
@@ -34,52 +34,7 @@ extern "C" {
 #include "ffmanager.h"	
 #include "modfile.h"
 #include "fram.h"
-
-
-// bit field for the Image flags, used for Banks
-enum {
-    PAGE_ACTIVE    = 0x0001,       // page is active (has a valid content)
-    PAGE_FLASH     = 0x0002,       // page is in FLASH or FRAM
-    PAGE_ROM       = 0x0004,       // page is ROM or not
-    PAGE_MOD       = 0x0008,       // page is MOD1 or MOD2
-    PAGE_ENABLED   = 0x0010,       // page is enabled for reading
-    PAGE_DIRTY     = 0x0020,       // page is dirty
-    PAGE_WRITEABLE = 0x0040,       // page is write enabled
-    PAGE_PHYS      = 0x0080,       // page reserved by a physical module
-    PAGE_EMBEDDED  = 0x0100,       // page is embedded in the firmware
-                                   // used for the HP-IL and Printer ROMs
-};
-
-
-#define PAGE_FLAGS  (PAGE_ACTIVE | PAGE_FLASH | PAGE_ROM | PAGE_MOD | PAGE_ENABLED | PAGE_DIRTY | PAGE_WRITEABLE)
-
-// bit field for the Bank flags, used for Banks
-// value 0 is always default
-enum {
-    BANK_none      = 0x0000,       // nothing plugged here
-    BANK_ACTIVE    = 0x0001,       // 1: bank is active (has a valid content)
-    BANK_FLASH     = 0x0002,       // 1: bank is in FLASH, 0: bank is in FRAM
-    BANK_ROM       = 0x0004,       // 1: bank is ROM, 0: not ROM (but MOD1 or MOD2)
-    BANK_MOD       = 0x0008,       // 1: bank is MOD1, 0: bank is MOD2
-    BANK_ENABLED   = 0x0010,       // 1: bank is enabled for reading, 0: not enabled for reading
-    BANK_DIRTY     = 0x0020,       // 1: bank is dirty (written to but not saved), 0: bank is OK
-                                   // remnant from Tiny41, not used in TULIP for now
-                                   // may be needed if Read-Modify-Write for QROm MOD files is too slow on FRAM
-    BANK_WRITEABLE = 0x0040,       // 1: bank is write enabled, 0: no writing possible
-    BANK_RESERVED  = 0x0080,       // 1: bank reserved by a physical module, 0: pluggable for TULIP
-    BANK_EMBEDDED  = 0x0100,       // page is embedded in the firmware
-                                   // used for the HP-IL and Printer ROMs
-                                   // other bits are reserved for future use
-};
-
-#define BANK_FLAGS  (BANK_ACTIVE | BANK_FLASH | BANK_ROM | BANK_MOD | BANK_ENABLED | BANK_DIRTY | BANK_WRITEABLE)
-
-// bit fields for quick access to the flags
-#define ACTIVE_ROM_FLASH   (BANK_ACTIVE | BANK_FLASH | BANK_ROM | PAGE_ENABLED)
-#define ACTIVE_MOD1_FLASH  (BANK_ACTIVE | BANK_FLASH | BANK_MOD | PAGE_ENABLED)
-#define ACTIVE_MOD2_FLASH  (BANK_ACTIVE | BANK_FLASH | BANK_MOD | PAGE_ENABLED)
-
-#define ACTIVE_EMBEDDED_ROM (BANK_ACTIVE | BANK_FLASH | BANK_ROM | PAGE_EMBEDDED | PAGE_ENABLED)
+#include "pagemap.h"
 
 
 // definition of ROM image sources
@@ -88,17 +43,22 @@ typedef enum {rom, qram, ram} ROM_TYPE;
 // #define EMBED_RAM
 
 // definitions for the Module and Page handling
-#define RAM_SIZE    0x1000
-#define PAGE_SIZE   0x1000
-#define PAGE_MASK   0x0FFF
-#define ADDR_MASK   0xFFFF
-// #define INST_MASK   (BIT_10-1)
-#define FIRST_PAGE  0x04
-#define NR_PAGES    0x10
-#define LAST_PAGE   (NR_PAGES - 1)
-
-#define PAGE(p)     (p>>12)
+#define FAT_MAX     64          // max number of functions in a FAT
+#define FAT_NAME_LEN 15         // max length of an MCODE function name
+
+// entry points of the functions in the FAT of a Page/Bank, sorted on the entry
+// built when a Bank is plugged, used to annotate trace lines, see findFunction()
+struct FATIndex {
+  uint8_t   n;                  // number of entries, 0 if there is no FAT
+  uint8_t   fn[FAT_MAX];        // function number in the FAT
+  uint16_t  entry[FAT_MAX];     // entry as offset in the Page
+};
+
 #define ISA_SHIFT   44
+
+// QROM Pages in FRAM, see pagemap.h for the image in the SRAM page cache
+#define QROM_FRAM(p)      (FRAM_QROM_START + (p) * PAGE_SIZE * 2)
+#define QROM_FLAGS        (BANK_ACTIVE | BANK_ROM | BANK_ENABLED | BANK_WRITEABLE)   // not BANK_FLASH, in FRAM
 //#define TRACE_ISA
 #define QUEUE_STATUS  
 
@@ -108,14 +68,6 @@ typedef enum {rom, qram, ram} ROM_TYPE;
 
 void fram_rommap_init(); 
 
-inline uint16_t swap16(uint16_t b)
-{
-  return __builtin_bswap16(b);
-}
-
-// Helper to decode the bank instruction
-static uint8_t nBank[4] = {0,2,1,3};
-
 static const char __in_flash("emb2")HPChar[] = "@ABCDEFGHIJKLMNOPQRSTUVWXYZ[\\]^_ |\"#$%&`()*+{-}/0123456789†,<=>?"; 
 
 static const char __in_flash("emb1")*PageText[] = 
@@ -147,26 +99,6 @@ static const char __in_flash("emb1")*EmbeddedText[] =
   "Embedded HP82143A Printer",               // For the HP82143A Printer ROM in Page 6
 };
 
-// define a single Bank in a Page
-struct CBank {
-  uint32_t  b_img_rom;      // Offset to current image in FLASH or FRAM
-  uint16_t  *b_img_data;    // hard address of the image in FLASH
-  uint16_t  b_img_flags;    // Flags, type and status of the Bank
-  char      b_img_name[32]; // Filename of the plugged module (in case of a ROM file usually)
-  uint32_t  b_img_file;     // Offset to the MOD or ROM file in FLASH or FRAM
-                            // in case more info is needed
-};
-
-// define a single Page with 4 Banks
-// used by the CModule class
-struct CPage{
-  CBank     m_banks[5];     // The four Banks in the Page, we use 5 because of the 1..4 range used
-                            // Bank 0 is used for generic information about the Page                      
-  uint8_t   m_bank;         // Current active bank in this page, when 0 this Page is not in use
-};
-
-// keep in mind that TULIP_Pages.mbanks[0] contains generic information about the Page
-// so the Banks are numbered 1..4 in the Page structure for Pages and Banks that are really plugged
 
 
 
@@ -191,22 +123,33 @@ struct CPage{
 // - selectbank() to select a bank (fast)
 // - getbank() to get the selected bank (fast)
 
-class CModules {
+class CModules : public CPageMap {
 // private:
   
 
 
 public:
   CModules() {
+    cache_enabled = true;         // SRAM page cache is used by default
+    cache_fills = 0;
+    cache_full = 0;
     clearAll();                   // initialize all modules
   }
 
-  CPage Pages[NR_PAGES];          // All pages in the HP41 system 
+  bool      cache_enabled;                            // false to bypass the cache, for measuring FLASH fetches
+  uint32_t  cache_fills;                              // number of Pages decoded since boot
+  uint32_t  cache_full;                               // number of times no free slot was found
+
+  // function entry points of each Page/Bank, rebuilt by cachePage()
+  // FATGen counts the rebuilds, users of a function name can check if it is still valid
+  struct FATIndex FATIdx[NR_PAGES][5];
+  uint32_t FATGen;
 
   // called on initialization
   // inititialize all memory space for the modules
   void clearAll() {
     memset(Pages, 0, sizeof(Pages));
+    memset(FATIdx, 0, sizeof(FATIdx));
 
     // set the initial values for the banks
 
@@ -237,8 +180,11 @@ public:
     // All other values are already initialized at 0, nothing to do there
     // the initialization routine will check if the FRAM copy is valid and initialized
     // and copy to FRAM if needed
+
+    // and nothing is cached anymore
+    clearCache();
   }
-  
+
   // plugs a module in a Page/Bank
   // the arguments are:
   //     port: the port number (0..15)
@@ -248,6 +194,7 @@ public:
   //     the filename and type handled by other functions
   // no check is done on validity of the parameters, should be done by the caller
   void plug(int port, int bank, uint16_t flags, uint32_t image_offs) {
+    if (bank == 1) flushQROM(port, QROM_BLOCKS);           // save what was written to a QROM
     Pages[port].m_banks[bank].b_img_flags = flags;
     Pages[port].m_banks[bank].b_img_rom   = image_offs;
     Pages[port].m_bank = 1; // set the active bank to 1, this is the default bank
@@ -264,6 +211,83 @@ public:
     strncpy(Pages[port].m_banks[bank].b_img_name, MetaH->FileName, sizeof(Pages[port].m_banks[bank].b_img_name) - 1);
     Pages[port].m_banks[bank].b_img_name[sizeof(Pages[port].m_banks[bank].b_img_name) - 1] = '\0'; // ensure null termination
 
+    // and decode the image in SRAM
+    cachePage(port, bank);
+  }
+
+  // plugs a writeable QROM Page in Bank 1, the image is in FRAM at QROM_FRAM(port)
+  // the arguments are:
+  //     port: the port number (4..15)
+  //     name: the name shown in the ROM map
+  //     rom: ROM image in FLASH (byte swapped) to copy to the QROM, NULL keeps the image in FRAM
+  // returns false if there is no free slot in the SRAM page cache, the Page is then unplugged
+  bool plugQROM(int port, const char *name, const uint16_t *rom) {
+    uint16_t buf[QROM_BLOCK];
+
+    flushQROM(port, QROM_BLOCKS);                         // previous QROM in this Page
+    Pages[port].m_banks[1].b_img_flags = QROM_FLAGS;
+    Pages[port].m_banks[1].b_img_rom   = QROM_FRAM(port);
+    Pages[port].m_banks[1].b_img_data  = NULL;            // not in FLASH
+    Pages[port].m_banks[1].b_img_file  = 0;
+    Pages[port].m_bank = 1;
+    strncpy(Pages[port].m_banks[1].b_img_name, name, sizeof(Pages[port].m_banks[1].b_img_name) - 1);
+    Pages[port].m_banks[1].b_img_name[sizeof(Pages[port].m_banks[1].b_img_name) - 1] = '\0';
+
+    if (rom != NULL) {
+      // copy the ROM to FRAM, one block at a time
+      for (int blk = 0; blk < QROM_BLOCKS; blk++) {
+        for (int i = 0; i < QROM_BLOCK; i++) buf[i] = swap16(rom[blk * QROM_BLOCK + i]);
+        fram_write(SPI_PORT_FRAM, PIN_SPI0_CS, QROM_FRAM(port) + blk * QROM_BLOCK * 2, (uint8_t*)buf, sizeof(buf));
+      }
+    }
+
+    if (!cachePage(port, 1)) {
+      unplug(port, 1);
+      return false;
+    }
+    return true;
+  }
+
+  // write the dirty blocks of a QROM Page to FRAM, at most max blocks
+  // adjacent dirty blocks are written with a single FRAM write
+  // the dirty flag is cleared before the copy, a block written by core1 during the copy
+  // is marked dirty again and written in a next call
+  // returns the number of blocks written
+  int flushQROM(int port, int max) {
+    uint16_t *img = QROMImage[port];
+    int n = 0;
+    int first;
+
+    if (img == NULL) return 0;
+    int blk = 0;
+    while ((blk < QROM_BLOCKS) && (n < max)) {
+      if (QROMDirty[port][blk] == 0) {
+        blk++;
+        continue;
+      }
+      // collect a run of dirty blocks
+      first = blk;
+      while ((blk < QROM_BLOCKS) && (QROMDirty[port][blk] != 0) && (n < max)) {
+        QROMDirty[port][blk] = 0;
+        blk++;
+        n++;
+      }
+      __dmb();
+      fram_write(SPI_PORT_FRAM, PIN_SPI0_CS, QROM_FRAM(port) + first * QROM_BLOCK * 2,
+                 (uint8_t*)&img[first * QROM_BLOCK], (blk - first) * QROM_BLOCK * 2);
+    }
+    return n;
+  }
+
+  // returns the number of dirty QROM blocks in all Pages
+  int dirtyQROM() {
+    int n = 0;
+    for (int p = 0; p < NR_PAGES; p++) {
+      for (int blk = 0; blk < QROM_BLOCKS; blk++) {
+        if (QROMDirty[p][blk] != 0) n++;
+      }
+    }
+    return n;
   }
 
   // plug one of the embedded modules in a Page
@@ -274,6 +298,7 @@ public:
   //     flags: the flags of the image. Image type is in the flags
   //     img_pointer: pointer to the embedded image in FLASH
   void plug_embedded(int port, int bank, uint16_t flags, const uint16_t *img_pointer) {
+    if (bank == 1) flushQROM(port, QROM_BLOCKS);           // save what was written to a QROM
     Pages[port].m_banks[bank].b_img_flags = flags;
     Pages[port].m_banks[bank].b_img_rom   = 0; // FLASH offset not applicable here
     Pages[port].m_bank = 1; // set the active bank to 1, this is the default bank
@@ -301,6 +326,9 @@ public:
     #ifdef DEBUG
     cli_printf("  Plugged embedded module in P %d, B %d, f: 0x%04X, img_pointer: %p", port, bank, flags, img_pointer);
     #endif
+
+    // and copy the image to SRAM
+    cachePage(port, bank);
   }
 
   // unplugs an image from a bank
@@ -312,103 +340,28 @@ public:
     if ((port == 0) || (port == 1) || (port == 2) || (port == 3)) {
       return; 
     }
+    if (bank == 1) flushQROM(port, QROM_BLOCKS);           // save what was written to a QROM
     Pages[port].m_banks[bank].b_img_rom = 0;
     Pages[port].m_banks[bank].b_img_flags = BANK_none;
 
-    // restore image file name to the original init value
-    strncpy(Pages[port].m_banks[1].b_img_name, PageText[port], sizeof(Pages[port].m_banks[1].b_img_name) - 1);
-    Pages[port].m_banks[1].b_img_name[sizeof(Pages[port].m_banks[1].b_img_name) - 1] = '\0'; // ensure null termination
+    // restore image file name to the original init value, only Bank 1 has the Page name
+    memset(Pages[port].m_banks[bank].b_img_name, 0, sizeof(Pages[port].m_banks[bank].b_img_name));
+    if (bank == 1) {
+      strncpy(Pages[port].m_banks[1].b_img_name, PageText[port], sizeof(Pages[port].m_banks[1].b_img_name) - 1);
+      Pages[port].m_banks[1].b_img_name[sizeof(Pages[port].m_banks[1].b_img_name) - 1] = '\0'; // ensure null termination
+    }
 
     // Pages[port].m_banks[bank].b_img_name[0] = 0;          // image file name
     Pages[port].m_banks[bank].b_img_file = 0;  
     Pages[port].m_banks[bank].b_img_data = NULL;          // clear the pointer to the image in FLASH
-  }
 
-  // read a ROM word given the address
-  // always reads from the active bank of the module
-  // Does check if a module is plugged
-  // the address is the address in the module space (0..0xFFFF)
-  // should not be called if a physical module is plugged
-  // returns 0 if there is no plugged ROM
-  uint16_t __not_in_flash() getword(uint16_t addr) {
-    // get the page and bank from the address
-    int port = PAGE(addr);            // work out the page from the address
-    int bank = 1;                     // get the active bank from the page
-    uint16_t word = 0;                // word to return
-    // we have the following options:
-    // embedded image in FLASH
-    // first check if the page is active and/or enabled
-
-    if ((Pages[port].m_banks[bank].b_img_flags & PAGE_ACTIVE) == 0) return 0;   // bank is not active
-    if ((Pages[port].m_banks[bank].b_img_flags & PAGE_ENABLED) == 0) return 0;  // bank is not enabled
-
-    // get the word if the page is an embedded page
-    if ((Pages[port].m_banks[bank].b_img_flags & PAGE_EMBEDDED) != 0) {
-      // this is an embedded module, so we can read the word directly from the image
-
-      word = Pages[port].m_banks[bank].b_img_data[addr & PAGE_MASK]; // get the word from the image in FLASH
-      return word; // return the word from the image
-    }
-
-    // get the word if the page is of the ROM type
-    if ((Pages[port].m_banks[bank].b_img_flags & PAGE_ROM) != 0) {
-      // this is a ROM module, so we can read the word directly from the image but byte swapping is needed
-      word = swap16(Pages[port].m_banks[bank].b_img_data[addr & PAGE_MASK]); // get the word from the image in FLASH
-      return word; // return the word from the image
-    }
-
-    // get the word if the page is of the MOD1 type
-    if ((Pages[port].m_banks[bank].b_img_flags & PAGE_MOD) != 0) {
-      // this is a MOD1 module, and the image data is compressed
-      // first get the relevant words from the image and decompress them
-      if (Pages[port].m_banks[bank].b_img_data == NULL) return 0; // no image data available
-        /*  The format of a packed ROM file (.BIN format) is as follows:
-            BIN - This format is used by Emu41 (J-F Garnier) and HP41EPC (HrastProgrammer).
-            Note: HP41EPC uses BIN format but names them .ROM files.
-            All bits are packed into 5120 bytes, 4 machine words are packed into 5 bytes:
-              Byte0=Word0[7-0]
-              Byte1=Word1[5-0]<<2 | Word0[9-8]
-              Byte2=Word2[3-0]<<4 | Word1[9-6]
-              Byte3=Word3[1-0]<<6 | Word2[9-4]
-              Byte4=Word3[9-2]
-        */
-        // the image is packed in 4 words per 5 bytes, so we need to unpack it
-        // need to evaluate the code below for speed and improve where possible
-        uint8_t *bin = (uint8_t*)Pages[port].m_banks[bank].b_img_data;
-        uint16_t res1, res2, result;
-        uint16_t offset = (addr * 5) / 4;            // offset in the packed ROM file of the first byte
-        int shift1 = (addr & 0x0003) * 2;
-        int shift2 = 8 - shift1;
-        uint16_t mask1 = 0xFF << shift1;
-        uint16_t mask2 = 0xFF >> (shift2 -2);
-        res1 = (bin[offset] & mask1) >> shift1;    // get the first part of the word
-        res2 = (bin[offset + 1] & mask2);
-        res2 = res2 << shift2; // get the second part of the word
-
-        result = res1 + res2;
-        return result;
-    }
-
-    // next check the code for a MOD2 image, but should be identical to the ROM image
-    // do not implement this yet, as we do not have MOD2 images in the system
-
-    // if we get here, we have no valid image in the bank
-    return 0;
+    // release the SRAM copy, the Bank is not active anymore so it will not be cached again
+    cachePage(port, bank);
   }
 
-  // read the flags from a Page given the address
-  // always reads from the active bank of the module
-  // Does not check if a module is plugged, this should be done by the caller
-  // the address is the address in the module space (0..0xFFFF)
-  uint16_t __not_in_flash() getflags(int port, int bank) {
-    // returnh the flags given port and bank
-    return (Pages[port].m_banks[bank].b_img_flags); // return the flags from the image
-  }
-
-  bool __not_in_flash() isEmbeddedROM(int Port, int Bank) {
-    // get the page and bank from the address
-    return (Pages[Port].m_banks[Bank].b_img_flags & BANK_EMBEDDED); // return true if the image is embedded
-  }
+  // find the Banks plugged from the FLASH File System again after flash compact moved the files
+  // in module.cpp, returns the number of Banks changed, the ROM map must then be saved
+  int relocate();
 
   bool isReserved(int port) {
     // check if the Page/Bank is reserved
@@ -465,17 +418,87 @@ public:
       #ifdef DEBUG
         cli_printf("  ROM map retrieved from FRAM, read %d bytes\n", sizeof(Pages));
       #endif
+
+      // the ROM map is new, so rebuild the SRAM page cache
+      cacheAll();
     }
   }
 
-  bool __not_in_flash()isPlugged(int port, int bank) {
-    // check if a module is plugged in the given Page/Bank
-    return (Pages[port].m_banks[bank].b_img_flags & PAGE_ACTIVE);
+  // decode a Page/Bank into a free slot of the SRAM page cache and rebuild its function index
+  // called for every change of a Page/Bank, also when it is unplugged
+  // any previous copy of the Page/Bank is released first
+  // must only be called when the HP41 is not running (PWO low) or before core1 is started,
+  // BankImage[] is set only after the complete Bank is decoded
+  // returns true if the Bank is now cached
+  bool cachePage(int port, int bank) {
+    bool cached = decodePage(port, bank);
+    buildFATIndex(port, bank);
+    return cached;
+  }
+
+  bool decodePage(int port, int bank) {
+    int slot;
+
+    if ((port < 0) || (port >= NR_PAGES)) return false;
+    if ((bank < 1) || (bank > 4)) return false;
+
+    // first release the slot in use by this Page/Bank
+    BankImage[port][bank] = NULL;
+    if (bank == 1) {
+      PageImage[port] = NULL;
+      QROMImage[port] = NULL;
+      memset((void*)QROMDirty[port], 0, QROM_BLOCKS);
+    }
+    for (slot = 0; slot < PAGE_CACHE_SLOTS; slot++) {
+      if (CacheOwner[slot] == ((port << 4) | bank)) CacheOwner[slot] = CACHE_FREE;
+    }
+
+    bool qrom = (Pages[port].m_banks[bank].b_img_flags & PAGE_WRITEABLE) != 0;
+
+    if (!cache_enabled && !qrom) return false;              // cache is bypassed, a QROM is always cached
+    if ((Pages[port].m_banks[bank].b_img_flags & PAGE_ACTIVE) == 0) return false;   // nothing plugged
+    if ((Pages[port].m_banks[bank].b_img_flags & PAGE_ENABLED) == 0) return false;  // not enabled
+    if (qrom && (bank != 1)) return false;                                          // QROM only in Bank 1
+    if (!qrom && (Pages[port].m_banks[bank].b_img_data == NULL)) return false;      // no image
+
+    // find a free slot
+    slot = 0;
+    while ((slot < PAGE_CACHE_SLOTS) && (CacheOwner[slot] != CACHE_FREE)) slot++;
+    if (slot == PAGE_CACHE_SLOTS) {
+      // no free slot, the Bank is read from FLASH by core1
+      cache_full++;
+      return false;
+    }
+
+    if (qrom) {
+      // QROM image is stored in FRAM without byte swapping
+      fram_read(SPI_PORT_FRAM, PIN_SPI0_CS, QROM_FRAM(port), (uint8_t*)PageCache[slot], PAGE_SIZE * 2);
+    } else {
+      // decode the complete image, this takes care of byte swapping and MOD unpacking
+      for (int i = 0; i < PAGE_SIZE; i++) {
+        PageCache[slot][i] = getbankword(port, bank, i);
+      }
+    }
+
+    CacheOwner[slot] = (port << 4) | bank;
+    cache_fills++;
+    BankImage[port][bank] = PageCache[slot];
+    if (bank == 1) PageImage[port] = PageCache[slot];      // core1 now uses the SRAM copy, Bank 1 is active after power on
+    if (qrom) QROMImage[port] = PageCache[slot];            // WROM enabled for this Page
+    return true;
   }
 
-  bool __not_in_flash()isEnabled(int port, int bank) {
-    // check if a module is enabled in the given Page/Bank
-    return (Pages[port].m_banks[bank].b_img_flags & PAGE_ENABLED);
+  // (re)build the SRAM page cache for all Pages and Banks
+  void cacheAll() {
+    for (int i = 0; i < NR_PAGES; i++) {
+      flushQROM(i, QROM_BLOCKS);          // QROM blocks still to be saved
+    }
+    clearCache();
+    for (int i = 0; i < NR_PAGES; i++) {
+      for (int b = 1; b <= 4; b++) {
+        cachePage(i, b);
+      }
+    }
   }
 
   
@@ -492,9 +515,94 @@ public:
     if ((port < 1) || (port >= NR_PAGES)) return 0;
     if ((bank < 1) || (bank > 4)) return 0;
     if (Pages[port].m_banks[bank].b_img_rom == 0) return 0;
+    if (Pages[port].m_banks[bank].b_img_data == NULL) return getbankword(port, bank, 0);   // QROM
     return swap16(Pages[port].m_banks[bank].b_img_data[0]);  // get the XROM number from the image
   }
 
+  // the function address table (FAT) of the plugged module
+  //   word 0         XROM number
+  //   word 1         number of functions, function 0 is the module header
+  //   word 2+2n      high byte of the entry of function n in bits 0..7, bit 9 set for a user code program
+  //   word 3+2n      low byte of the entry
+  // an MCODE function has its name in the words before the entry in reverse order, the first character
+  // is just before the entry and the last character has bit 7 set
+
+  // returns the number of functions in the FAT, 0 if there is no valid FAT
+  int getFATcount(int port, int bank) {
+    if (getXROM(port, bank) == 0) return 0;
+    int n = getbankword(port, bank, 1);
+    return (n <= FAT_MAX) ? n : 0;
+  }
+
+  // returns the entry of function n as the offset in the Page, focal is set for a user code program
+  uint16_t getFATentry(int port, int bank, int n, bool *focal) {
+    uint16_t hi = getbankword(port, bank, 2 + 2 * n);
+    uint16_t lo = getbankword(port, bank, 3 + 2 * n);
+    *focal = (hi & 0x200) != 0;
+    return (((hi & 0x0FF) << 8) | (lo & 0x0FF)) & PAGE_MASK;
+  }
+
+  // copies the name of MCODE function n to name, at least FAT_NAME_LEN + 1 chars
+  // a user code program has its name in a global label, XROM xx,yy is used for these
+  void getFATname(int port, int bank, int n, char *name) {
+    bool focal;
+    uint16_t entry = getFATentry(port, bank, n, &focal);
+    int len = 0;
+
+    if (!focal) {
+      for (uint16_t offs = entry - 1; (len < FAT_NAME_LEN) && (offs < entry); offs--) {
+        uint16_t w = getbankword(port, bank, offs);
+        name[len++] = HPChar[w & 0x3F];
+        if (w & 0x080) break;           // last character of the name
+      }
+    }
+    if (len == 0) len = sprintf(name, "XROM %02d,%02d", getXROM(port, bank), n);
+    name[len] = 0;
+  }
+
+  // build the sorted index of the function entry points of a Page/Bank
+  void buildFATIndex(int port, int bank) {
+    struct FATIndex *idx;
+    bool focal;
+
+    if ((port < 0) || (port >= NR_PAGES) || (bank < 1) || (bank > 4)) return;
+    idx = &FATIdx[port][bank];
+    idx->n = 0;
+    FATGen++;
+    int fc = getFATcount(port, bank);
+    for (int f = 0; f < fc; f++) {
+      // insertion sort, a FAT is mostly in order already
+      uint16_t e = getFATentry(port, bank, f, &focal);
+      int i = idx->n++;
+      while ((i > 0) && (idx->entry[i - 1] > e)) {
+        idx->entry[i] = idx->entry[i - 1];
+        idx->fn[i] = idx->fn[i - 1];
+        i--;
+      }
+      idx->entry[i] = e;
+      idx->fn[i] = f;
+    }
+  }
+
+  // the function that contains offset offs in a Page/Bank, a binary search in the function index
+  // returns the function number and its entry, -1 if there is no FAT or offs is before the first entry
+  int findFunction(int port, int bank, uint16_t offs, uint16_t *entry) {
+    const struct FATIndex *idx;
+    int lo = 0, hi;
+
+    if ((port < 0) || (port >= NR_PAGES) || (bank < 1) || (bank > 4)) return -1;
+    idx = &FATIdx[port][bank];
+    hi = idx->n;
+    if ((hi == 0) || (offs < idx->entry[0])) return -1;
+    while (hi - lo > 1) {
+      // entry[lo] <= offs < entry[hi]
+      int mid = (lo + hi) / 2;
+      if (idx->entry[mid] <= offs) lo = mid; else hi = mid;
+    }
+    *entry = idx->entry[lo];
+    return idx->fn[lo];
+  }
+
   // returns a pointer to the filename of the plugged module
 void getFileName(int port, int bank, char *filename) {
   for (int i = 0; i < 32; i++) {
@@ -521,6 +629,15 @@ void getFileName(int port, int bank, char *filename) {
       rev[4] = HPChar[(Pages[port].m_banks[bank].b_img_data[0xFFB]) & 0x3F];
       rev[5] = 0;    // end of string       
       return true; 
+    } else if (Pages[port].m_banks[bank].b_img_data == NULL) {
+      // QROM, read from the SRAM image
+      rev[0] = HPChar[getbankword(port, bank, 0xFFE) & 0x3F]; 
+      rev[1] = HPChar[getbankword(port, bank, 0xFFD) & 0x3F];
+      rev[2] = '-';
+      rev[3] = HPChar[getbankword(port, bank, 0xFFC) & 0x3F];
+      rev[4] = HPChar[getbankword(port, bank, 0xFFB) & 0x3F];
+      rev[5] = 0;    // end of string 
+      return true;
     } else {
       // this is not an embedded module, so we can read the revision from the image
       // but the words must be byte swapped
@@ -540,6 +657,7 @@ void getFileName(int port, int bank, char *filename) {
     if ((port < 1) || (port >= NR_PAGES)) return 0;
     if ((bank < 1) || (bank > 4)) return 0;
     if (Pages[port].m_banks[bank].b_img_rom == 0) return 0;
+    if (Pages[port].m_banks[bank].b_img_data == NULL) return getbankword(port, bank, 1);   // QROM
     return swap16(Pages[port].m_banks[bank].b_img_data[1]); // get the number of functions from the image
   }
 
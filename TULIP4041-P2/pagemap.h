@@ -0,0 +1,320 @@
+/*
+ * pagemap.h
+ *
+ * This file is part of the TULIP4041 project.
+ * Copyright (C) 2024 Meindert Kuipers
+ *
+ * This is free software: you are free to change and redistribute it.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * 
+ * USE AT YOUR OWN RISK
+ *
+ */
+
+// the Page and Bank map as seen by the core1 bus loop: the plugged Banks, the SRAM page cache
+// and the Bank selection, without the FLASH, FRAM and file handling of class CModules in module.h
+// has no Pico SDK includes, so that the bus loop can also be built on a host, see host/CMakeLists.txt
+
+#ifndef __PAGEMAP_H__
+#define __PAGEMAP_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+// in the firmware these come from pico/platform.h, the host build has no Pico SDK
+#ifndef __not_in_flash
+#define __not_in_flash(group)
+#endif
+#ifndef __not_in_flash_func
+#define __not_in_flash_func(func_name) func_name
+#endif
+#ifndef __force_inline
+#define __force_inline inline __attribute__((always_inline))
+#endif
+
+// bit field for the Image flags, used for Banks
+enum {
+    PAGE_ACTIVE    = 0x0001,       // page is active (has a valid content)
+    PAGE_FLASH     = 0x0002,       // page is in FLASH or FRAM
+    PAGE_ROM       = 0x0004,       // page is ROM or not
+    PAGE_MOD       = 0x0008,       // page is MOD1 or MOD2
+    PAGE_ENABLED   = 0x0010,       // page is enabled for reading
+    PAGE_DIRTY     = 0x0020,       // page is dirty
+    PAGE_WRITEABLE = 0x0040,       // page is write enabled
+    PAGE_PHYS      = 0x0080,       // page reserved by a physical module
+    PAGE_EMBEDDED  = 0x0100,       // page is embedded in the firmware
+                                   // used for the HP-IL and Printer ROMs
+};
+
+
+#define PAGE_FLAGS  (PAGE_ACTIVE | PAGE_FLASH | PAGE_ROM | PAGE_MOD | PAGE_ENABLED | PAGE_DIRTY | PAGE_WRITEABLE)
+
+// bit field for the Bank flags, used for Banks
+// value 0 is always default
+enum {
+    BANK_none      = 0x0000,       // nothing plugged here
+    BANK_ACTIVE    = 0x0001,       // 1: bank is active (has a valid content)
+    BANK_FLASH     = 0x0002,       // 1: bank is in FLASH, 0: bank is in FRAM
+    BANK_ROM       = 0x0004,       // 1: bank is ROM, 0: not ROM (but MOD1 or MOD2)
+    BANK_MOD       = 0x0008,       // 1: bank is MOD1, 0: bank is MOD2
+    BANK_ENABLED   = 0x0010,       // 1: bank is enabled for reading, 0: not enabled for reading
+    BANK_DIRTY     = 0x0020,       // 1: bank is dirty (written to but not saved), 0: bank is OK
+                                   // remnant from Tiny41, not used in TULIP for now
+                                   // may be needed if Read-Modify-Write for QROm MOD files is too slow on FRAM
+    BANK_WRITEABLE = 0x0040,       // 1: bank is write enabled, 0: no writing possible
+    BANK_RESERVED  = 0x0080,       // 1: bank reserved by a physical module, 0: pluggable for TULIP
+    BANK_EMBEDDED  = 0x0100,       // page is embedded in the firmware
+                                   // used for the HP-IL and Printer ROMs
+                                   // other bits are reserved for future use
+};
+
+#define BANK_FLAGS  (BANK_ACTIVE | BANK_FLASH | BANK_ROM | BANK_MOD | BANK_ENABLED | BANK_DIRTY | BANK_WRITEABLE)
+
+// bit fields for quick access to the flags
+#define ACTIVE_ROM_FLASH   (BANK_ACTIVE | BANK_FLASH | BANK_ROM | PAGE_ENABLED)
+#define ACTIVE_MOD1_FLASH  (BANK_ACTIVE | BANK_FLASH | BANK_MOD | PAGE_ENABLED)
+#define ACTIVE_MOD2_FLASH  (BANK_ACTIVE | BANK_FLASH | BANK_MOD | PAGE_ENABLED)
+
+#define ACTIVE_EMBEDDED_ROM (BANK_ACTIVE | BANK_FLASH | BANK_ROM | PAGE_EMBEDDED | PAGE_ENABLED)
+
+// definitions for the Page handling
+#define RAM_SIZE    0x1000
+#define PAGE_SIZE   0x1000
+#define PAGE_MASK   0x0FFF
+#define ADDR_MASK   0xFFFF
+// #define INST_MASK   (BIT_10-1)
+#define FIRST_PAGE  0x04
+#define NR_PAGES    0x10
+#define LAST_PAGE   (NR_PAGES - 1)
+
+#define PAGE(p)     (p>>12)
+
+// SRAM page cache, each plugged Page/Bank is decoded in SRAM 
+// so that core1 only has to do a single indexed load for a ROM fetch
+// one slot is 8 KByte, 12 slots covers all pluggable Pages 4..F with one Bank,
+// the slots are shared by all Banks, a Bank that does not fit is read from FLASH
+#define PAGE_CACHE_SLOTS  (NR_PAGES - FIRST_PAGE)
+#define CACHE_FREE        0x00      // slot owner value for an unused slot
+
+// QROM, a writeable Page in Bank 1 backed by FRAM at FRAM_QROM_START
+// the image is always in the SRAM page cache, core1 does a WROM with a single store
+// and marks the 256-word block as dirty, core0 writes the dirty blocks to FRAM
+#define QROM_BLOCK        0x100     // words per dirty block
+#define QROM_BLOCKS       (PAGE_SIZE / QROM_BLOCK)
+
+inline uint16_t swap16(uint16_t b)
+{
+  return __builtin_bswap16(b);
+}
+
+// Helper to decode the bank instruction
+static uint8_t nBank[4] = {0,2,1,3};
+
+// define a single Bank in a Page
+struct CBank {
+  uint32_t  b_img_rom;      // Offset to current image in FLASH or FRAM
+  uint16_t  *b_img_data;    // hard address of the image in FLASH
+  uint16_t  b_img_flags;    // Flags, type and status of the Bank
+  char      b_img_name[32]; // Filename of the plugged module (in case of a ROM file usually)
+  uint32_t  b_img_file;     // Offset to the MOD or ROM file in FLASH or FRAM
+                            // in case more info is needed
+};
+
+// define a single Page with 4 Banks
+// used by the CModule class
+struct CPage{
+  CBank     m_banks[5];     // The four Banks in the Page, we use 5 because of the 1..4 range used
+                            // Bank 0 is used for generic information about the Page                      
+  uint8_t   m_bank;         // Current active bank in this page, when 0 this Page is not in use
+};
+
+// keep in mind that TULIP_Pages.mbanks[0] contains generic information about the Page
+// so the Banks are numbered 1..4 in the Page structure for Pages and Banks that are really plugged
+
+
+// the Pages and the SRAM page cache, the base of class CModules
+// only the functions used by the core1 bus loop are here
+class CPageMap {
+
+public:
+  CPage Pages[NR_PAGES];          // All pages in the HP41 system 
+
+  // SRAM page cache, not part of the ROM map that is saved in FRAM
+  // PageImage[] is the table used by core1 for the ROM fetch, NULL if the Page is not cached
+  // core1 then falls back to getbankword() to read the image in FLASH
+  // BankImage[] has the decoded images of all Banks, an ENBANKx instruction only copies 
+  // BankImage[Page][x] to PageImage[Page], see selectbank()
+  uint16_t * volatile PageImage[NR_PAGES];            // decoded image of the active bank of each Page
+  uint16_t * BankImage[NR_PAGES][5];                  // decoded image of each bank 1..4, NULL if not cached
+  uint16_t  PageCache[PAGE_CACHE_SLOTS][PAGE_SIZE];   // the decoded images, 8 KByte per slot
+  uint8_t   CacheOwner[PAGE_CACHE_SLOTS];             // (Page << 4) | Bank using the slot, CACHE_FREE if unused
+
+  // QROM Pages, QROMImage[] is the SRAM image of a writeable Page, NULL if the Page is not QROM
+  // QROMDirty[] is set by core1 for each written block, cleared by core0 before writing the block to FRAM
+  uint16_t * volatile QROMImage[NR_PAGES];
+  volatile uint8_t QROMDirty[NR_PAGES][QROM_BLOCKS];
+
+  // drop all cached Pages
+  // any written QROM blocks must be saved with flushQROM() first
+  void clearCache() {
+    for (int i = 0; i < NR_PAGES; i++) {
+      PageImage[i] = NULL;                                                    // core1 uses getbankword()
+      QROMImage[i] = NULL;
+      for (int b = 0; b < 5; b++) BankImage[i][b] = NULL;
+    }
+    memset(CacheOwner, CACHE_FREE, sizeof(CacheOwner));
+    memset((void*)QROMDirty, 0, sizeof(QROMDirty));
+  }
+  
+  // read a ROM word given the address
+  // always reads from Bank 1 of the module, core1 uses getbankword() with the active bank
+  // Does check if a module is plugged
+  // the address is the address in the module space (0..0xFFFF)
+  // should not be called if a physical module is plugged
+  // returns 0 if there is no plugged ROM
+  uint16_t __not_in_flash() getword(uint16_t addr) {
+    // get the page and bank from the address
+    int port = PAGE(addr);            // work out the page from the address
+    int bank = 1;                     // Bank 1 is the default after power on
+
+    return getbankword(port, bank, addr & PAGE_MASK);
+  }
+
+  // read a ROM word from the image in FLASH given the Page, Bank and offset in the Page
+  // this does all decoding needed for the image type, also used for filling the SRAM page cache
+  // returns 0 if there is no plugged ROM
+  uint16_t __not_in_flash() getbankword(int port, int bank, uint16_t offs) {
+    uint16_t word = 0;                // word to return
+    // we have the following options:
+    // embedded image in FLASH
+    // first check if the page is active and/or enabled
+
+    if ((Pages[port].m_banks[bank].b_img_flags & PAGE_ACTIVE) == 0) return 0;   // bank is not active
+    if ((Pages[port].m_banks[bank].b_img_flags & PAGE_ENABLED) == 0) return 0;  // bank is not enabled
+
+    // a QROM is in FRAM and always in the SRAM page cache
+    if ((Pages[port].m_banks[bank].b_img_flags & PAGE_FLASH) == 0) {
+      if (BankImage[port][bank] == NULL) return 0;
+      return BankImage[port][bank][offs];
+    }
+
+    // get the word if the page is an embedded page
+    if ((Pages[port].m_banks[bank].b_img_flags & PAGE_EMBEDDED) != 0) {
+      // this is an embedded module, so we can read the word directly from the image
+
+      word = Pages[port].m_banks[bank].b_img_data[offs]; // get the word from the image in FLASH
+      return word; // return the word from the image
+    }
+
+    // get the word if the page is of the ROM type
+    if ((Pages[port].m_banks[bank].b_img_flags & PAGE_ROM) != 0) {
+      // this is a ROM module, so we can read the word directly from the image but byte swapping is needed
+      word = swap16(Pages[port].m_banks[bank].b_img_data[offs]); // get the word from the image in FLASH
+      return word; // return the word from the image
+    }
+
+    // get the word if the page is of the MOD1 type
+    if ((Pages[port].m_banks[bank].b_img_flags & PAGE_MOD) != 0) {
+      // this is a MOD1 module, and the image data is compressed
+      // first get the relevant words from the image and decompress them
+      if (Pages[port].m_banks[bank].b_img_data == NULL) return 0; // no image data available
+        /*  The format of a packed ROM file (.BIN format) is as follows:
+            BIN - This format is used by Emu41 (J-F Garnier) and HP41EPC (HrastProgrammer).
+            Note: HP41EPC uses BIN format but names them .ROM files.
+            All bits are packed into 5120 bytes, 4 machine words are packed into 5 bytes:
+              Byte0=Word0[7-0]
+              Byte1=Word1[5-0]<<2 | Word0[9-8]
+              Byte2=Word2[3-0]<<4 | Word1[9-6]
+              Byte3=Word3[1-0]<<6 | Word2[9-4]
+              Byte4=Word3[9-2]
+        */
+        // the image is packed in 4 words per 5 bytes, so we need to unpack it
+        // need to evaluate the code below for speed and improve where possible
+        uint8_t *bin = (uint8_t*)Pages[port].m_banks[bank].b_img_data;
+        uint16_t res1, res2, result;
+        uint16_t offset = (offs * 5) / 4;            // offset in the packed ROM file of the first byte
+        int shift1 = (offs & 0x0003) * 2;
+        int shift2 = 8 - shift1;
+        uint16_t mask1 = 0xFF << shift1;
+        uint16_t mask2 = 0xFF >> (shift2 -2);
+        res1 = (bin[offset] & mask1) >> shift1;    // get the first part of the word
+        res2 = (bin[offset + 1] & mask2);
+        res2 = res2 << shift2; // get the second part of the word
+
+        result = res1 + res2;
+        return result;
+    }
+
+    // next check the code for a MOD2 image, but should be identical to the ROM image
+    // do not implement this yet, as we do not have MOD2 images in the system
+
+    // if we get here, we have no valid image in the bank
+    return 0;
+  }
+
+  // read the flags from a Page given the address
+  // always reads from the active bank of the module
+  // Does not check if a module is plugged, this should be done by the caller
+  // the address is the address in the module space (0..0xFFFF)
+  uint16_t __not_in_flash() getflags(int port, int bank) {
+    // returnh the flags given port and bank
+    return (Pages[port].m_banks[bank].b_img_flags); // return the flags from the image
+  }
+
+  bool __not_in_flash() isEmbeddedROM(int Port, int Bank) {
+    // get the page and bank from the address
+    return (Pages[Port].m_banks[Bank].b_img_flags & BANK_EMBEDDED); // return true if the image is embedded
+  }
+
+  // select the active Bank of a Page for the ROM fetch in core1
+  // this is only a single store, called for the ENBANKx instructions
+  // an ENBANKx to a Bank that does not exist is ignored, like the real HP41 modules
+  // a Bank that is enabled but not cached switches to the FLASH read (PageImage NULL)
+  // returns false if the Bank was not switched, active_bank[] must then be left alone
+  bool __not_in_flash() selectbank(int port, int bank) {
+    if ((BankImage[port][bank] == NULL) && !isEnabled(port, bank)) return false;
+    PageImage[port] = BankImage[port][bank];
+    return true;
+  }
+
+  // back to Bank 1 for all Pages, done at every PWO edge
+  void resetbanks() {
+    for (int i = 0; i < NR_PAGES; i++) {
+      PageImage[i] = BankImage[i][1];
+    }
+  }
+
+  // returns the number of slots in use in the SRAM page cache
+  int cacheUsed() {
+    int n = 0;
+    for (int slot = 0; slot < PAGE_CACHE_SLOTS; slot++) {
+      if (CacheOwner[slot] != CACHE_FREE) n++;
+    }
+    return n;
+  }
+
+  // returns the slot used by a Page/Bank, -1 if the Bank is not cached
+  int cacheSlot(int port, int bank) {
+    for (int slot = 0; slot < PAGE_CACHE_SLOTS; slot++) {
+      if (CacheOwner[slot] == ((port << 4) | bank)) return slot;
+    }
+    return -1;
+  }
+
+  bool __not_in_flash()isPlugged(int port, int bank) {
+    // check if a module is plugged in the given Page/Bank
+    return (Pages[port].m_banks[bank].b_img_flags & PAGE_ACTIVE);
+  }
+
+  bool __not_in_flash()isEnabled(int port, int bank) {
+    // check if a module is enabled in the given Page/Bank
+    return (Pages[port].m_banks[bank].b_img_flags & PAGE_ENABLED);
+  }
+};
+
+#endif
@@ -87,68 +87,7 @@ void HPIL_SendFrame(uint16_t wFrame);
 char  ILScopePrint[200];
 int   ILScopePrintLen = 0;
 
-struct ILScope_struct {
-    int16_t ILcode;
-    int16_t ILmask;
-    const char* ILmnemonic;
-} ; 
-
-
-// const ILScope_struct __in_flash() IL_mnemonics[] = 
-const ILScope_struct IL_mnemonics[] = 
-// list of HP-IL mnemonics
-// forced in FLASH to maximize SRAM
-{   // opcode, mask, mnemonic
-    {0x000, 0x700, "DAB"},      // DATA frame        // element #0
-    {0x100, 0x700, "DSR"},
-    {0x200, 0x700, "END"},      // End Byte
-    {0x300, 0x700, "ESR"},
-    {0x400, 0x7FF, "NUL"},      // NULL
-    {0x401, 0x7FF, "GTL"},      // Go To Local
-    {0x404, 0x7FF, "SDC"},      // Selected Device Clear
-    {0x405, 0x7FF, "PPD"},      // Parellel Poll Disable
-    {0x408, 0x7FF, "GET"},      // Group Execute Trigger
-    {0x40F, 0x7FF, "ELN"},      // Enable Listener Not Readey For Data
-    {0x410, 0x7FF, "NOP"},      // No Operation        // element #10
-    {0x411, 0x7FF, "LLO"},      // Local Lock Out
-    {0x414, 0x7FF, "DCL"},      // Device Clear
-    {0x415, 0x7FF, "PPU"},      // Parallel Poll Unconfigure
-    {0x418, 0x7FF, "EAR"},      // Enable Asynchronous Request
-    {0x43F, 0x7FF, "UNL"},      // Unlisten
-    {0x420, 0x7E0, "LAD"},      // Listener Address
-    {0x45F, 0x7FF, "UNT"},      // Untalk
-    {0x440, 0x7E0, "TAD"},      // Talker Address
-    {0x460, 0x7E0, "SAD"},      // Seconday Address
-    {0x480, 0x7F0, "PPE"},      // Parellel Poll Enable        // element #20
-    {0x490, 0x7FF, "IFC"},      // Interface Clear
-    {0x492, 0x7FF, "REN"},      // Remote Enable
-    {0x493, 0x7FF, "NRE"},      // Not Remote Enable
-    {0x494, 0x7FF, "*TDIS"},    // PILBox Translator Disable
-    {0x495, 0x7FF, "*COFI"},    // PILBox Controller
-    {0x496, 0x7FF, "*CON"},     // PILBox Controller On
-    {0x497, 0x7FF, "*COFF"},    // PILBox Controller Off with IDY
-    {0x49A, 0x7FF, "AAU"},      // Auto Address Unconfigure
-    {0x49B, 0x7FF, "LPD"},      // Loop Power Down
-    {0x4A0, 0x7E0, "DDL"},      // Device Dependent Listener Command         // element #30
-    {0x4C0, 0x7E0, "DDT"},      // Device Dependent Talker Command
-    {0x400, 0x700, "CMD"},      // All commands filter 0x400-0x4C0
-    {0x500, 0x7FF, "RFC"},      // Ready For Command
-    {0x540, 0x7FF, "ETO"},      // End Of Transmission, OK
-    {0x541, 0x7FF, "ETE"},      // End Of Transmission, Error
-    {0x542, 0x7FF, "NRD"},      // Not Ready For Data
-    {0x560, 0x7FF, "SDA"},      // Send Data
-    {0x561, 0x7FF, "SST"},      // SSP, Send Serial Poll ??
-    {0x562, 0x7FF, "SDI"},      // Send Device ID
-    {0x563, 0x7FF, "SAI"},      // Send Accessory ID        // element #40
-    {0x564, 0x7FF, "TCT"},      // Take Control
-    {0x580, 0x7E0, "AAD"},      // Auto Address 0-30
-    {0x5A0, 0x7E0, "AEP"},      // Auto Extended Primary
-    {0x5C0, 0x7E0, "AES"},      // Auto Extended Secondary
-    {0x5E0, 0x7E0, "AMP"},      // Auto Multiple Primary
-    {0x500, 0x700, "RDY"},      // Ready
-    {0x600, 0x700, "IDY"},      // Identify
-    {0x700, 0x700, "ISR"},      //                          //  element #48
-    };
+// the HP-IL mnemonics IL_mnemonics[] and getIL_mnemonic() are in tracefmt.c
 
 
 
@@ -449,18 +388,6 @@ void PrintIRchar(uint8_t c)
 
 // HP-IL tasks and PIL-box emulation
 
-// function to get the HP-IL menmonic from a given frame
-void getIL_mnemonic(uint16_t wFrame, char *mnem)
-{
-    // char mnem[5];
-    // first find the mnemonic
-    int i = 0;
-    while (i < numILmnemonics) {   
-        if ((wFrame & IL_mnemonics[i].ILmask) == IL_mnemonics[i].ILcode) break;
-        i++;
-    }
-    sprintf(mnem, "%s", IL_mnemonics[i].ILmnemonic);
-}
 
 void HPIL_scope(uint16_t wFrame, bool out, bool traceIDY)
 {
@@ -62,7 +62,6 @@ void bus_init();
 void WandBuffer_init();
 void Print_task();
 void PrintBuffer_init();
-void getIL_mnemonic(uint16_t wFrame, char *mnem);
 void HPIL_init();
 void HPIL_task();
 
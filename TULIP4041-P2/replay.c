@@ -0,0 +1,179 @@
+/*
+ * replay.c
+ *
+ * This file is part of the TULIP4041 project.
+ * Copyright (C) 2024 Meindert Kuipers
+ *
+ * This is free software: you are free to change and redistribute it.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * 
+ * USE AT YOUR OWN RISK
+ *
+ */
+
+// replay of traced bus cycles, built in the firmware and in the host build
+// the traced HP41 inputs are fed through the bus loop with a SimBus and the responses of TULIP
+// are compared with what was traced, see replay_run() in tracer.cpp and hp41sim replay
+
+#include <stdio.h>
+#include <string.h>
+
+#include "replay.h"
+
+struct ReplayStats replay_stats;            // results of the last replay
+
+static const struct TLine *replay_ref;      // the traced lines of the replay in progress
+static int replay_n;
+
+// the inputs of the traced lines, the lines are kept for replay_check()
+// core1 sends a trace line at T0, after reading the instruction and D55..D32 of the cycle and before
+// reading the next address and D31..D00 at T32, these are in the trace line of the next cycle
+// the same holds for an HP-IL frame received
+void replay_setup(const struct TLine *lines, int n, struct SimCycle *in)
+{
+    for (int k = 0; k < n; k++) {
+        in[k].inst = lines[k].isa_instruction;
+        in[k].addr = (k + 1 < n) ? lines[k + 1].isa_address : lines[k].isa_address + 1;
+        in[k].data1 = (k + 1 < n) ? lines[k + 1].data1 : 0;
+        in[k].data2 = lines[k].data2;
+        in[k].fi1 = lines[k].fi1;
+        in[k].fi2 = lines[k].fi2;
+        in[k].frame_in = SIM_NOFRAME;
+        if ((k + 1 < n) && (lines[k + 1].frame_in != lines[k].frame_in)) {
+            in[k].frame_in = lines[k + 1].frame_in;
+        }
+    }
+    replay_ref = lines;
+    replay_n = n;
+}
+
+uint32_t replay_mismatches()
+{
+    return replay_stats.isa + replay_stats.carry + replay_stats.data +
+           replay_stats.fi + replay_stats.frame + replay_stats.state;
+}
+
+// show a mismatch, only the first REPLAY_SHOW are shown
+static void replay_show(int k, const char *what, uint32_t expected, uint32_t got)
+{
+    char line[100];
+
+    if (replay_mismatches() > REPLAY_SHOW) return;
+    snprintf(line, sizeof(line), "  cycle %6u  %04X  %03X  %-10s captured %08X  replay %08X",
+             (unsigned)replay_ref[k].cycle_number, replay_ref[k].isa_address, replay_ref[k].isa_instruction,
+             what, (unsigned)expected, (unsigned)got);
+    replay_print(line);
+}
+
+// compare the responses of one replayed cycle with the trace
+// the DATA word sent in cycle k is read back at T32 of cycle k (D31..D00) and at T0 of cycle k + 1 (D55..D32)
+// and the ISA instruction sent for the address is read at T54 of cycle k + 1, all in trace line k + 1
+void replay_check(int k, const struct SimOut *res)
+{
+    const struct TLine *c = &replay_ref[k];
+    const struct TLine *next = (k + 1 < replay_n) ? &replay_ref[k + 1] : NULL;
+    bool state = false;
+
+    if (k == 0) return;             // the decoder state before the first cycle is not known
+    replay_stats.checked++;
+
+    if ((res->isa != 0xFFFF) && (next != NULL) && (res->isa != (next->isa_instruction & 0x03FF))) {
+        replay_stats.isa++;
+        replay_show(k, "ISA", next->isa_instruction & 0x03FF, res->isa);
+    }
+    if (res->carry != c->xq_carry) {
+        replay_stats.carry++;
+        replay_show(k, "carry", c->xq_carry, res->carry);
+    }
+    if ((res->ndata > 0) && (next != NULL) && (res->data[0] != next->data1)) {
+        replay_stats.data++;
+        replay_show(k, "DATA lo", next->data1, res->data[0]);
+    }
+    if ((res->ndata > 1) && (next != NULL) && ((res->data[1] & 0x00FFFFFF) != next->data2)) {
+        replay_stats.data++;
+        replay_show(k, "DATA hi", next->data2, res->data[1] & 0x00FFFFFF);
+    }
+    if (((c->fi1 & res->fi1) != res->fi1) || ((c->fi2 & res->fi2) != res->fi2)) {
+        // the flags driven by TULIP must be seen on FI
+        replay_stats.fi++;
+        replay_show(k, "FI", c->fi1, res->fi1);
+    }
+    if (res->line.frame_out != c->frame_out) {
+        replay_stats.frame++;
+        replay_show(k, "HP-IL out", c->frame_out, res->line.frame_out);
+    }
+    if (res->line.xq_instr != c->xq_instr) {
+        replay_show(k, "decoded", c->xq_instr, res->line.xq_instr);
+        state = true;
+    }
+    if (res->line.ramslct != c->ramslct) {
+        replay_show(k, "RAMSLCT", c->ramslct, res->line.ramslct);
+        state = true;
+    }
+    if (res->line.bank != c->bank) {
+        replay_show(k, "Bank", c->bank, res->line.bank);
+        state = true;
+    }
+    if (memcmp(res->line.HPILregs, c->HPILregs, sizeof(c->HPILregs)) != 0) {
+        replay_show(k, "HP-IL regs", c->HPILregs[1], res->line.HPILregs[1]);
+        state = true;
+    }
+    if (state) replay_stats.state++;
+}
+
+void replay_load_init(struct ReplayLoad *ld, struct TLine *lines, int max)
+{
+    memset(ld, 0, sizeof(struct ReplayLoad));
+    ld->lines = lines;
+    ld->max = max;
+}
+
+// decode the records in buf[0..len-1] into lines[], returns the number of bytes used
+// stops when lines[] is full or at a gap in the cycle numbers, the line after the gap is kept
+// in next and is the first line when the caller has emptied lines[] by setting count to 0
+// an incomplete record at the end is not used, pass it again with the following bytes
+int replay_load(struct ReplayLoad *ld, const uint8_t *buf, int len)
+{
+    struct TLine s;
+    int pos = 0, n;
+
+    if (ld->gap && (ld->count == 0)) {
+        ld->lines[ld->count++] = ld->next;
+        ld->gap = false;
+    }
+    while (!ld->gap && (ld->count < ld->max)) {
+        if (!ld->synced) {
+            // the first record, or after an error, is a key record after a TBIN_MARK
+            n = tbin_sync(buf + pos, len - pos);
+            if (n < 0) {
+                n = (len - pos > 3) ? len - pos - 3 : 0;     // keep what can be the start of a TBIN_MARK
+                ld->lost += n;
+                return pos + n;
+            }
+            ld->lost += n;
+            pos += n;
+            ld->synced = true;
+        }
+        n = tbin_decode(buf + pos, len - pos, &s, &ld->ref);
+        if (n == 0) break;
+        if (n < 0) {
+            ld->lost++;
+            ld->synced = false;
+            pos++;
+            continue;
+        }
+        pos += n;
+        ld->records++;
+        if ((ld->count > 0) && (s.cycle_number != ld->lines[ld->count - 1].cycle_number + 1)) {
+            // a gap because of the trace filter, a TraceBuffer overflow or PWO
+            ld->next = s;
+            ld->gap = true;
+            break;
+        }
+        ld->lines[ld->count++] = s;
+    }
+    return pos;
+}
@@ -0,0 +1,78 @@
+/*
+ * replay.h
+ *
+ * This file is part of the TULIP4041 project.
+ * Copyright (C) 2024 Meindert Kuipers
+ *
+ * This is free software: you are free to change and redistribute it.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * 
+ * USE AT YOUR OWN RISK
+ *
+ */
+
+// replay of traced bus cycles through the bus loop, without any Pico SDK includes
+// the comparison of the responses with the trace and the loader of a binary trace stream
+// used by tracer replay in the firmware and by hp41sim replay in the host build
+
+#ifndef __REPLAY_H__
+#define __REPLAY_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "hp41_state.h"
+#include "tbin.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define REPLAY_SHOW         8       // number of mismatches shown in detail
+
+struct ReplayStats {
+    uint32_t    cycles;             // cycles replayed
+    uint32_t    us;                 // duration of the replay, without the checks
+    uint32_t    checked;            // cycles compared with the capture
+    uint32_t    isa;                // ISA instruction is not the next captured instruction
+    uint32_t    carry;              // carry differs
+    uint32_t    data;               // DATA sent is not the captured DATA
+    uint32_t    fi;                 // flag driven by TULIP not seen on FI
+    uint32_t    frame;              // HP-IL frame sent differs
+    uint32_t    state;              // decoded instruction, selected register, Bank or HP-IL registers differ
+    uint32_t    restarts;           // capture restarted after a gap in the cycle numbers
+};
+
+extern struct ReplayStats replay_stats;
+
+// one line of replay output, cli_printf() in the firmware and stdout on the host
+void replay_print(const char *line);
+
+void replay_setup(const struct TLine *lines, int n, struct SimCycle *in);
+void replay_check(int k, const struct SimOut *res);
+uint32_t replay_mismatches();
+
+// consecutive trace lines decoded from a binary trace stream, a capture of the tracer port
+// in binary mode or a file written with tracer sd
+struct ReplayLoad {
+    struct TLine    *lines;         // the decoded lines
+    int             max;            // size of lines[]
+    int             count;          // consecutive lines in lines[]
+    struct TLine    ref;            // reference of the decoder
+    struct TLine    next;           // first line after a gap, the start of the next run
+    bool            gap;            // next is waiting for an empty lines[]
+    bool            synced;         // a key record was found
+    uint32_t        records;        // records decoded
+    uint32_t        lost;           // bytes that are not a record
+};
+
+void replay_load_init(struct ReplayLoad *ld, struct TLine *lines, int max);
+int replay_load(struct ReplayLoad *ld, const uint8_t *buf, int len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
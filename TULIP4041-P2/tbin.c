@@ -0,0 +1,215 @@
+/*
+ * tbin.c
+ *
+ * This file is part of the TULIP4041 project.
+ * Copyright (C) 2024 Meindert Kuipers
+ *
+ * This is free software: you are free to change and redistribute it.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * 
+ * USE AT YOUR OWN RISK
+ *
+ */
+
+// binary trace records, the record format is described in tbin.h
+// the encoder is used by the tracer for the tracer CDC port and the uSD capture, the decoder
+// by the self test and by tools/tbin2txt.c on the host
+
+#include <string.h>
+
+#include "tbin.h"
+
+static const uint8_t tbin_mark[4] = {TBIN_MARK0, TBIN_MARK1, TBIN_MARK2, TBIN_MARK3};
+
+// little endian fields and unsigned LEB128 varints
+static uint8_t *tbin_put(uint8_t *p, uint32_t v, int n)
+{
+    for (int i = 0; i < n; i++) {
+        *p++ = v & 0xFF;
+        v >>= 8;
+    }
+    return p;
+}
+
+static uint8_t *tbin_put_var(uint8_t *p, uint32_t v)
+{
+    while (v >= 0x80) {
+        *p++ = (v & 0x7F) | 0x80;
+        v >>= 7;
+    }
+    *p++ = v;
+    return p;
+}
+
+static const uint8_t *tbin_get(const uint8_t *p, uint32_t *v, int n)
+{
+    *v = 0;
+    for (int i = 0; i < n; i++) {
+        *v |= (uint32_t)p[i] << (8 * i);
+    }
+    return p + n;
+}
+
+static const uint8_t *tbin_get_var(const uint8_t *p, const uint8_t *end, uint32_t *v)
+{
+    int shift = 0;
+
+    *v = 0;
+    while ((p < end) && (shift < 35)) {
+        *v |= (uint32_t)(*p & 0x7F) << shift;
+        if ((*p++ & 0x80) == 0) return p;
+        shift += 7;
+    }
+    return NULL;                // incomplete
+}
+
+// signed deltas as zigzag, small positive and negative jumps both fit in one byte
+static uint32_t tbin_zigzag(int32_t d)  { return ((uint32_t)d << 1) ^ (uint32_t)(d >> 31); }
+static int32_t tbin_unzigzag(uint32_t z) { return (int32_t)(z >> 1) ^ -(int32_t)(z & 1); }
+
+// encode sample s as a record in out, relative to ref, returns the number of bytes
+// a key record has all fields absolute and is preceded by the four byte TBIN_MARK, a decoder synchronizes on it
+int tbin_encode(uint8_t *out, const struct TLine *s, const struct TLine *ref, bool key)
+{
+    uint8_t *p = out;
+    uint8_t hdr = 0;
+
+    if (key) {
+        memcpy(p, tbin_mark, sizeof(tbin_mark));
+        p += sizeof(tbin_mark);
+        hdr = TBIN_KEY | TBIN_CYCLE | TBIN_ADDR | TBIN_DATA | TBIN_FI | TBIN_STATE | TBIN_HPIL;
+    } else {
+        if (s->cycle_number != ref->cycle_number + 1 + s->skipped) hdr |= TBIN_CYCLE;
+        if (s->isa_address != (uint16_t)(ref->isa_address + 1)) hdr |= TBIN_ADDR;
+        if ((s->data1 != ref->data1) || (s->data2 != ref->data2)) hdr |= TBIN_DATA;
+        if ((s->fi1 != ref->fi1) || (s->fi2 != ref->fi2)) hdr |= TBIN_FI;
+        if ((s->bank != ref->bank) || (s->xq_instr != ref->xq_instr) || 
+            (s->xq_carry != ref->xq_carry) || (s->ramslct != ref->ramslct)) hdr |= TBIN_STATE;
+        if ((s->frame_in != ref->frame_in) || (s->frame_out != ref->frame_out) ||
+            (memcmp(s->HPILregs, ref->HPILregs, sizeof(s->HPILregs)) != 0)) hdr |= TBIN_HPIL;
+    }
+    if (s->skipped != 0) hdr |= TBIN_SKIP;
+
+    *p++ = hdr;
+    p = tbin_put(p, s->isa_instruction, 2);
+    if (hdr & TBIN_SKIP) {
+        p = tbin_put_var(p, s->skipped);
+    }
+    if (hdr & TBIN_CYCLE) {
+        p = tbin_put_var(p, key ? s->cycle_number : tbin_zigzag((int32_t)(s->cycle_number - ref->cycle_number - 1 - s->skipped)));
+    }
+    if (hdr & TBIN_ADDR) {
+        if (key) {
+            p = tbin_put(p, s->isa_address, 2);
+        } else {
+            p = tbin_put_var(p, tbin_zigzag((int16_t)(s->isa_address - ref->isa_address - 1)));
+        }
+    }
+    if (hdr & TBIN_DATA) {
+        p = tbin_put(p, s->data1, 4);
+        p = tbin_put(p, s->data2, 3);
+    }
+    if (hdr & TBIN_FI) {
+        p = tbin_put(p, s->fi1, 4);
+        p = tbin_put(p, s->fi2, 4);
+    }
+    if (hdr & TBIN_STATE) {
+        *p++ = s->bank;
+        p = tbin_put(p, s->xq_instr, 2);
+        *p++ = s->xq_carry;
+        p = tbin_put_var(p, s->ramslct);
+    }
+    if (hdr & TBIN_HPIL) {
+        p = tbin_put(p, s->frame_in, 2);
+        p = tbin_put(p, s->frame_out, 2);
+        memcpy(p, s->HPILregs, sizeof(s->HPILregs));
+        p += sizeof(s->HPILregs);
+    }
+    return p - out;
+}
+
+// decode one record from in[0..len-1], ref is the previous decoded sample and is updated
+// returns the number of bytes used, 0 if the record is not complete yet, -1 if this is not a record
+// without a valid ref the decoder must first skip to a TBIN_MARK, the record after it is a key record
+// tools/tbin2txt.c uses it with trace_format() to render a stream as the same text trace
+int tbin_decode(const uint8_t *in, int len, struct TLine *s, struct TLine *ref)
+{
+    const uint8_t *p = in;
+    const uint8_t *end = in + len;
+    uint32_t v;
+    uint8_t hdr;
+
+    if ((len >= (int)sizeof(tbin_mark)) && (memcmp(p, tbin_mark, sizeof(tbin_mark)) == 0)) {
+        p += sizeof(tbin_mark);
+    }
+    if (end - p < 3) return 0;
+    hdr = *p++;
+    if ((p - in > 1) != ((hdr & TBIN_KEY) != 0)) return -1;     // key records only after the mark
+
+    *s = *ref;
+    p = tbin_get(p, &v, 2);
+    s->isa_instruction = v;
+    s->skipped = 0;
+    if (hdr & TBIN_SKIP) {
+        if ((p = tbin_get_var(p, end, &v)) == NULL) return 0;
+        s->skipped = v;
+    }
+    s->cycle_number = ref->cycle_number + 1 + s->skipped;
+    s->isa_address = ref->isa_address + 1;
+    if (hdr & TBIN_CYCLE) {
+        if ((p = tbin_get_var(p, end, &v)) == NULL) return 0;
+        s->cycle_number = (hdr & TBIN_KEY) ? v : s->cycle_number + tbin_unzigzag(v);
+    }
+    if (hdr & TBIN_ADDR) {
+        if (hdr & TBIN_KEY) {
+            if (end - p < 2) return 0;
+            p = tbin_get(p, &v, 2);
+            s->isa_address = v;
+        } else {
+            if ((p = tbin_get_var(p, end, &v)) == NULL) return 0;
+            s->isa_address = ref->isa_address + 1 + tbin_unzigzag(v);
+        }
+    }
+    if (hdr & TBIN_DATA) {
+        if (end - p < 7) return 0;
+        p = tbin_get(p, &s->data1, 4);
+        p = tbin_get(p, &s->data2, 3);
+    }
+    if (hdr & TBIN_FI) {
+        if (end - p < 8) return 0;
+        p = tbin_get(p, &s->fi1, 4);
+        p = tbin_get(p, &s->fi2, 4);
+    }
+    if (hdr & TBIN_STATE) {
+        if (end - p < 4) return 0;
+        s->bank = *p++;
+        p = tbin_get(p, &v, 2);
+        s->xq_instr = v;
+        s->xq_carry = *p++;
+        if ((p = tbin_get_var(p, end, &s->ramslct)) == NULL) return 0;
+    }
+    if (hdr & TBIN_HPIL) {
+        if (end - p < 13) return 0;
+        p = tbin_get(p, &v, 2);
+        s->frame_in = v;
+        p = tbin_get(p, &v, 2);
+        s->frame_out = v;
+        memcpy(s->HPILregs, p, sizeof(s->HPILregs));
+        p += sizeof(s->HPILregs);
+    }
+    *ref = *s;
+    return p - in;
+}
+
+// offset of the next TBIN_MARK in in[0..len-1], -1 if there is none
+// the last 3 bytes can be the start of a TBIN_MARK and must be kept for the next search
+int tbin_sync(const uint8_t *in, int len)
+{
+    for (int i = 0; i + (int)sizeof(tbin_mark) <= len; i++) {
+        if ((in[i] == TBIN_MARK0) && (memcmp(&in[i], tbin_mark, sizeof(tbin_mark)) == 0)) return i;
+    }
+    return -1;
+}
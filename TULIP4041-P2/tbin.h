@@ -0,0 +1,71 @@
+/*
+ * tbin.h
+ *
+ * This file is part of the TULIP4041 project.
+ * Copyright (C) 2024 Meindert Kuipers
+ *
+ * This is free software: you are free to change and redistribute it.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * 
+ * USE AT YOUR OWN RISK
+ *
+ */
+
+// binary trace records, without any Pico SDK includes
+// built in the firmware and in the host tools, tools/tbin2txt.c renders a stream as the text trace
+
+#ifndef __TBIN_H__
+#define __TBIN_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "hp41_state.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// binary trace stream, used on the tracer CDC port, for the uSD capture and the snapshot dump
+// each traced sample is one record, fields that are the same as in the previous record are left out:
+//   [TBIN_MARK]        4 bytes A5 54 34 31, only before a key record
+//   header             1 byte, TBIN_xx flags below
+//   isa_instruction    2 bytes, with the SYNC status in bit 11
+//   TBIN_SKIP          varint, cycles blocked by the trace filter before this one
+//   TBIN_CYCLE         varint, cycle_number, zigzag delta to previous + 1 + skipped, absolute in a key record
+//   TBIN_ADDR          varint, isa_address, zigzag delta to previous + 1, 2 bytes absolute in a key record
+//   TBIN_DATA          4 bytes data1, 3 bytes data2
+//   TBIN_FI            4 bytes fi1, 4 bytes fi2
+//   TBIN_STATE         1 byte bank, 2 bytes xq_instr, 1 byte xq_carry, varint ramslct
+//   TBIN_HPIL          2 bytes frame_in, 2 bytes frame_out, 9 bytes HPILregs
+// all multi-byte fields are little endian, a varint is unsigned LEB128
+// a sequential fetch without DATA is 3 bytes, a key record with all fields is sent every TBIN_KEY_INTERVAL records
+#define TBIN_CYCLE          0x01    // cycle number is not the previous + 1
+#define TBIN_ADDR           0x02    // address is not the previous + 1
+#define TBIN_DATA           0x04    // DATA changed
+#define TBIN_FI             0x08    // FI changed
+#define TBIN_STATE          0x10    // bank, decoded instruction, carry or selected RAM changed
+#define TBIN_HPIL           0x20    // HP-IL frames or registers changed
+#define TBIN_SKIP           0x40    // cycles were blocked before this one
+#define TBIN_KEY            0x80    // key record, all fields present and absolute
+
+#define TBIN_MARK0          0xA5
+#define TBIN_MARK1          'T'
+#define TBIN_MARK2          '4'
+#define TBIN_MARK3          '1'
+
+#define TBIN_MAXREC         56      // largest record including the mark
+#define TBIN_KEY_INTERVAL   256     // records between key records
+
+int tbin_encode(uint8_t *out, const struct TLine *s, const struct TLine *ref, bool key);
+int tbin_decode(const uint8_t *in, int len, struct TLine *s, struct TLine *ref);
+int tbin_sync(const uint8_t *in, int len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
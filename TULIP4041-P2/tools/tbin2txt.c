@@ -0,0 +1,127 @@
+/*
+ * tbin2txt.c
+ *
+ * This file is part of the TULIP4041 project.
+ * Copyright (C) 2024 Meindert Kuipers
+ *
+ * This is free software: you are free to change and redistribute it.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * 
+ * USE AT YOUR OWN RISK
+ *
+ */
+
+// host decoder for the binary trace stream, renders the records as the text trace of the tracer port
+// reads a capture of the tracer port in binary mode or a file from tracer sd or tracer snap sd
+//   tbin2txt [-i] in.tbin [out.txt]
+//   -i   show the HP-IL frames and registers, as with tracer_ilregs_on and the HP-IL module plugged
+// the decoder and the formatter are the same sources as in the firmware, see tbin.c and tracefmt.c
+// function names are not shown, they need the function index of the plugged modules
+// built with the host build in host/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tbin.h"
+#include "tracefmt.h"
+
+#define TBIN_BUFSIZE    65536           // read buffer, many records
+
+static uint8_t buf[TBIN_BUFSIZE];
+
+int main(int argc, char *argv[])
+{
+    FILE *in, *out = stdout;
+    struct TLine s, ref;
+    const char *fin = NULL, *fout = NULL;
+    int len = 0, pos = 0, n, k;
+    bool synced = false;
+    bool first = true;
+    bool eof = false;
+    uint32_t prev = 0;
+    uint32_t records = 0, lost = 0;
+    char marker;
+
+    for (k = 1; k < argc; k++) {
+        if (strcmp(argv[k], "-i") == 0) {
+            trace_fmt_opts.ilregs = true;
+        } else if (fin == NULL) {
+            fin = argv[k];
+        } else if (fout == NULL) {
+            fout = argv[k];
+        } else {
+            fin = NULL;
+            break;
+        }
+    }
+    if (fin == NULL) {
+        fprintf(stderr, "usage: tbin2txt [-i] in.tbin [out.txt]\n");
+        return 2;
+    }
+    if ((in = fopen(fin, "rb")) == NULL) {
+        perror(fin);
+        return 2;
+    }
+    if ((fout != NULL) && ((out = fopen(fout, "wb")) == NULL)) {
+        perror(fout);
+        return 2;
+    }
+
+    trace_mnem_init();
+    memset(&ref, 0, sizeof(ref));
+
+    while (true) {
+        // keep the unused bytes and fill the buffer
+        if (!eof && (pos > len - TBIN_MAXREC)) {
+            memmove(buf, buf + pos, len - pos);
+            len -= pos;
+            pos = 0;
+            n = fread(buf + len, 1, TBIN_BUFSIZE - len, in);
+            if (n <= 0) eof = true;
+            len += (n > 0) ? n : 0;
+        }
+        if (!synced) {
+            // the first record, or after an error, is a key record after a TBIN_MARK
+            n = tbin_sync(buf + pos, len - pos);
+            if (n < 0) {
+                if (len - pos > 3) pos = len - 3;       // keep what can be the start of a TBIN_MARK
+                if (eof) break;
+                continue;
+            }
+            pos += n;
+            synced = true;
+        }
+
+        n = tbin_decode(buf + pos, len - pos, &s, &ref);
+        if (n == 0) {
+            if (eof) break;             // the last record is not complete
+            continue;
+        }
+        if (n < 0) {
+            lost++;
+            synced = false;
+            pos++;
+            continue;
+        }
+        pos += n;
+        records++;
+
+        // a gap in the cycle numbers is marked with O, like a TraceBuffer overflow in the text trace
+        marker = ' ';
+        if (!first && (s.cycle_number != prev + 1 + s.skipped) && (s.skipped != 0xFFFF)) marker = 'O';
+        first = false;
+        prev = s.cycle_number;
+
+        trace_format(&s, marker);
+        fwrite(TracePrint, 1, TracePrintLen, out);
+    }
+
+    if (out != stdout) fclose(out);
+    fclose(in);
+    fprintf(stderr, "%u records, %u bytes not decoded, %d bytes at the end\n", records, lost, len - pos);
+    return (lost == 0) ? 0 : 1;
+}
@@ -0,0 +1,1691 @@
+/*
+ * tracefmt.c
+ *
+ * This file is part of the TULIP4041 project.
+ * Copyright (C) 2024 Meindert Kuipers
+ *
+ * This is free software: you are free to change and redistribute it.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * 
+ * USE AT YOUR OWN RISK
+ *
+ */
+
+// trace line formatter, see tracefmt.h
+// trace_format() is the fast formatter used by the tracer, trace_format_ref() is the original sprintf
+// based code that it is checked against
+
+#include <stdio.h>
+#include <string.h>
+
+#include "tracefmt.h"
+
+// list of HP41 mnemonics, JDA style
+// const, so it stays in FLASH
+const char *const mnemonics[] = 
+{
+"NOP",                  // 000
+"GO/XQ",        
+"A=0 @R",       
+"JNC +0",       
+"CLRF 3",       
+"GO/XQ",        
+"A=0 S&X",      
+"JC 0",     
+"SETF 3",       
+"GO/XQ",        
+"A=0 R<-",      
+"JNC +1",       
+"?FSET 3",      
+"GO/XQ",        
+"A=0 ALL",      
+"JC 1",         
+"LD@R 0",               // 010
+"GO/XQ",        
+"A=0 P-Q",      
+"JNC +2",       
+"?R= 3",        
+"GO/XQ ",       
+"A=0 XS",       
+"JC 2",
+"UNUSED ",      
+"GO/XQ ",       
+"A=0 M",        
+"JNC +3",       
+"R= 3",         
+"GO/XQ ",       
+"A=0 MS",       
+"JC 3",
+"XQ>GO ",       
+"GO/XQ ",       
+"B=0 @R",       
+"JNC +4",       
+"SELP 0",       
+"GO/XQ ",       
+"B=0 S&X",      
+"JC 4",
+"WRIT 0(T)",    
+"GO/XQ ",       
+"B=0 R<-",      
+"JNC +5",       
+"?FI 3",        
+"GO/XQ ",       
+"B=0 ALL",      
+"JC 5",
+"ROMBLK ",      
+"GO/XQ ",       
+"B=0 P-Q",      
+"JNC +6",       
+"UNUSED ",      
+"GO/XQ ",       
+"B=0 XS",       
+"JC 6",
+"READ 0(T)",   
+"GO/XQ ",       
+"B=0 M",        
+"JNC +7",       
+"RCR 3",        
+"GO/XQ ",       
+"B=0 MS",       
+"JC 7",
+"WROM ",        // 040   
+"GO/XQ ",       
+"C=0 @R",       
+"JNC +8",       
+"CLRF 4",       
+"GO/XQ ",       
+"C=0 S&X",      
+"JC 8",
+"SETF 4",       
+"GO/XQ ",       
+"C=0 R<-",      
+"JNC +9",       
+"?FSET 4",      
+"GO/XQ ",       
+"C=0 ALL",      
+"JC 9",
+"LD@R 1",       
+"GO/XQ ",       
+"C=0 P-Q",      
+"JNC +10",      
+"?R= 4",        
+"GO/XQ ",       
+"C=0 XS",       
+"JC 10",
+"G=C ",         
+"GO/XQ ",       
+"C=0 M",        
+"JNC +11",      
+"R= 4",         
+"GO/XQ ",       
+"C=0 MS",       
+"JC 11",        
+"POWOFF ",      
+"GO/XQ ",       
+"A<>B @R",      
+"JNC +12",      
+"SELP 1",       
+"GO/XQ ",       
+"A<>B S&X",     
+"JC 12",
+"WRIT 1(Z)",    
+"GO/XQ ",       
+"A<>B R<-",     
+"JNC +13",      
+"?FI 4",        
+"GO/XQ ",       
+"A<>B ALL",     
+"JC 13",
+"N=C ",         
+"GO/XQ ",       
+"A<>B P-Q",     
+"JNC +14",      
+"UNUSED ",      
+"GO/XQ ",       
+"A<>B XS",      
+"JC 14",
+"READ 1(Z)",    
+"GO/XQ ",       
+"A<>B M",       
+"JNC +15",      
+"RCR 4",        
+"GO/XQ ",       
+"A<>B MS",      
+"JC 15",
+"UNUSED ",      
+"GO/XQ ",       
+"B=A @R",       
+"JNC +16",      
+"CLRF 5",       
+"GO/XQ ",       
+"B=A S&X",      
+"JC 16",
+"SETF 5",       
+"GO/XQ ",       
+"B=A R<-",      
+"JNC +17",      
+"?FSET 5",      
+"GO/XQ ",       
+"B=A ALL",      
+"JC 17",
+"LD@R 2",       
+"GO/XQ ",       
+"B=A P-Q",      
+"JNC +18",      
+"?R= 5",        
+"GO/XQ ",       
+"B=A XS",       
+"JC 18",
+"C=G ",         
+"GO/XQ ",       
+"B=A M",        
+"JNC +19",      
+"R= 5",         
+"GO/XQ ",       
+"B=A MS",       
+"JC 19",
+"SLCTP ",       
+"GO/XQ ",       
+"A<>C @R",      
+"JNC +20",      
+"SELP 2",       
+"GO/XQ ",       
+"A<>C S&X",     
+"JC 20",
+"WRIT 2(Y)",    
+"GO/XQ ",       
+"A<>C R<-",     
+"JNC +21",      
+"?FI 5 ?EDAV",  
+"GO/XQ ",       
+"A<>C ALL",     
+"JC 21",
+"C=N ",         
+"GO/XQ ",       
+"A<>C P-Q",     
+"JNC +22",      
+"UNUSED ",      
+"GO/XQ ",       
+"A<>C XS",      
+"JC 22",
+"READ 2(Y)",    
+"GO/XQ ",       
+"A<>C M",       
+"JNC +23",      
+"RCR 5",        
+"GO/XQ ",       
+"A<>C MS",      
+"JC 23",
+"EADD=C MAXX",      // 0C0, MAXX Expanded Memory Select
+"GO/XQ ",       
+"C=B @R",       
+"JNC +24",      
+"CLRF 10",      
+"GO/XQ ",       
+"C=B S&X",      
+"JC 24",
+"SETF 10",      
+"GO/XQ ",       
+"C=B R<-",      
+"JNC +25",      
+"?FSET 10",     
+"GO/XQ ",       
+"C=B ALL",      
+"JC 25",
+"LD@R 3",       
+"GO/XQ ",       
+"C=B P-Q",      
+"JNC +26",      
+"?R= 10",       
+"GO/XQ ",       
+"C=B XS",       
+"JC 26",
+"C<>G ",        
+"GO/XQ ",       
+"C=B M",        
+"JNC +27",      
+"R= 10",        
+"GO/XQ ",       
+"C=B MS",       
+"JC 27",
+"SLCTQ ",       
+"GO/XQ ",       
+"B<>C @R",      
+"JNC +28",      
+"SELP 3",       
+"GO/XQ ",       
+"B<>C S&X",     
+"JC 28",
+"WRIT 3(X)",    
+"GO/XQ ",       
+"B<>C R<-",     
+"JNC +29",      
+"?FI 10 ?ORAV", 
+"GO/XQ ",       
+"B<>C ALL",     
+"JC 29",
+"C<>N ",        
+"GO/XQ ",       
+"B<>C P-Q",     
+"JNC +30",      
+"UNUSED ",      
+"GO/XQ ",       
+"B<>C XS",      
+"JC 30",
+"READ 3(X)",    
+"GO/XQ ",       
+"B<>C M",       
+"JNC +31",      
+"RCR 10",       
+"GO/XQ ",       
+"B<>C MS",      
+"JC 31",
+"ENBANK1 ",     
+"GO/XQ ",       
+"A=C @R",       
+"JNC +32",      
+"CLRF 8",       
+"GO/XQ ",       
+"A=C S&X",      
+"JC 32",
+"SETF 8",       
+"GO/XQ ",       
+"A=C R<-",      
+"JNC +33",      
+"?FSET 8",      
+"GO/XQ ",       
+"A=C ALL",      
+"JC 33",
+"LD@R 4",       
+"GO/XQ ",       
+"A=C P-Q",      
+"JNC +34",      
+"?R= 8",        
+"GO/XQ ",       
+"A=C XS",       
+"JC 34",
+"UNUSED ",      
+"GO/XQ ",       
+"A=C M",        
+"JNC +35",      
+"R= 8",         
+"GO/XQ ",       
+"A=C MS",       
+"JC 35",
+"?P=Q ",        
+"GO/XQ ",       
+"A=A+B @R",     
+"JNC +36",      
+"SELP 4",       
+"GO/XQ ",       
+"A=A+B S&X",    
+"JC 36",
+"WRIT 4(L)",    
+"GO/XQ ",       
+"A=A+B R<-",    
+"JNC +37",      
+"?FI 8 ?FRAV",  
+"GO/XQ ",       
+"A=A+B ALL",    
+"JC 37",
+"LDI ",         
+"GO/XQ ",       
+"A=A+B P-Q",    
+"JNC +38",      
+"UNUSED ",      
+"GO/XQ ",       
+"A=A+B XS",     
+"JC 38",
+"READ 4(L)",    
+"GO/XQ ",       
+"A=A+B M",      
+"JNC +39",      
+"RCR 8",        
+"GO/XQ ",       
+"A=A+B MS",     
+"JC 39",
+"ENBANK3 ",     
+"GO/XQ ",       
+"A=A+C @R",     
+"JNC +40",      
+"CLRF 6",       
+"GO/XQ ",       
+"A=A+C S&X",    
+"JC 40",
+"SETF 6",       
+"GO/XQ ",       
+"A=A+C R<-",    
+"JNC +41",      
+"?FSET 6",      
+"GO/XQ ",       
+"A=A+C ALL",    
+"JC 41",
+"LD@R 5",       
+"GO/XQ ",       
+"A=A+C P-Q",    
+"JNC +42",      
+"?R= 6",        
+"GO/XQ ",       
+"A=A+C XS",     
+"JC 42",
+"M=C ",         
+"GO/XQ ",       
+"A=A+C M",      
+"JNC +43",      
+"R= 6",         
+"GO/XQ ",       
+"A=A+C MS",     
+"JC 43",
+"?LOWBAT ",     
+"GO/XQ ",       
+"A=A+1 @R",     
+"JNC +44",      
+"SELP 5",       
+"GO/XQ ",       
+"A=A+1 S&X",    
+"JC 44",
+"WRIT 5(M)",    
+"GO/XQ ",       
+"A=A+1 R<-",    
+"JNC +45",      
+"?FI 6 ?IFCR",  
+"GO/XQ ",       
+"A=A+1 ALL",    
+"JC 45",
+"PUSHADR ",
+"GO/XQ ",
+"A=A+1 P-Q",
+"JNC +46",
+"UNUSED ",
+"GO/XQ ",
+"A=A+1 XS",
+"JC 46",
+"READ 5(M)",
+"GO/XQ ",
+"A=A+1 M",
+"JNC +47",
+"RCR 6",
+"GO/XQ ",
+"A=A+1 MS",
+"JC 47",
+"ENBANK2 ",
+"GO/XQ ",
+"A=A-B @R",
+"JNC +48",
+"CLRF 11",
+"GO/XQ ",
+"A=A-B S&X",
+"JC 48",
+"SETF 11",
+"GO/XQ ",
+"A=A-B R<-",
+"JNC +49",
+"?FSET 11",
+"GO/XQ ",
+"A=A-B ALL",
+"JC 49",
+"LD@R 6",
+"GO/XQ ",
+"A=A-B P-Q",
+"JNC +50",
+"?R= 11",
+"GO/XQ ",
+"A=A-B XS",
+"JC 50",
+"C=M ",
+"GO/XQ ",
+"A=A-B M",
+"JNC +51",
+"R= 11",
+"GO/XQ ",
+"A=A-B MS",
+"JC 51",
+"A=B=C=0 ",
+"GO/XQ ",
+"A=A-1 @R",
+"JNC +52",
+"SELP 6",
+"GO/XQ ",
+"A=A-1 S&X",
+"JC 52",
+"WRIT 6(N)",
+"GO/XQ ",
+"A=A-1 R<-",
+"JNC +53",
+"?FI 11 ?TFAIL",
+"GO/XQ ",
+"A=A-1 ALL",
+"JC 53",
+"POPADR ",
+"GO/XQ ",
+"A=A-1 P-Q",
+"JNC +54",
+"UNUSED ",
+"GO/XQ ",
+"A=A-1 XS",
+"JC 54",
+"READ 6(N)",
+"GO/XQ ",
+"A=A-1 M",
+"JNC +55",
+"RCR 11",
+"GO/XQ ",
+"A=A-1 MS",
+"JC 55",
+"ENBANK4 ",
+"GO/XQ ",
+"A=A-C @R",
+"JNC +56",
+"UNUSED ",
+"GO/XQ ",
+"A=A-C S&X",
+"JC 56",
+"UNUSED ",
+"GO/XQ ",
+"A=A-C R<-",
+"JNC +57",
+"UNUSED ",
+"GO/XQ ",
+"A=A-C ALL",
+"JC 57",
+"LD@R 7",
+"GO/XQ ",
+"A=A-C P-Q",
+"JNC +58",
+"UNUSED ",
+"GO/XQ ",
+"A=A-C XS",
+"JC 58",
+"C<>M ",
+"GO/XQ ",
+"A=A-C M",
+"JNC +59",
+"UNUSED ",
+"GO/XQ ",
+"A=A-C MS",
+"JC 59",
+"GOTOADR ",
+"GO/XQ ",
+"C=C+C @R",
+"JNC +60",
+"SELP 7",
+"GO/XQ ",
+"C=C+C S&X",
+"JC 60",
+"WRIT 7(O)",
+"GO/XQ ",
+"C=C+C R<-",
+"JNC +61",
+"UNUSED ",
+"GO/XQ ",
+"C=C+C ALL",
+"JC 61",
+"WPTOG ",
+"GO/XQ ",
+"C=C+C P-Q",
+"JNC +62",
+"UNUSED ",
+"GO/XQ ",
+"C=C+C XS",
+"JC 62",
+"READ 7(O)",
+"GO/XQ ",
+"C=C+C M",
+"JNC +63",
+"WCMD ",
+"GO/XQ ",
+"C=C+C MS",
+"JC 63",
+"HPIL=C 0",
+"GO/XQ ",
+"C=C+A @R",
+"JNC -64",
+"CLRF 2",
+"GO/XQ ",
+"C=C+A S&X",
+"JC -64",
+"SETF 2",
+"GO/XQ ",
+"C=C+A R<-",
+"JNC -63",
+"?FSET 2",
+"GO/XQ ",
+"C=C+A ALL",
+"JC -63",
+"LD@R 8",
+"GO/XQ ",
+"C=C+A P-Q",
+"JNC -62",
+"?R= 2",
+"GO/XQ ",
+"C=C+A XS",
+"JC -62",
+"UNUSED ",
+"GO/XQ ",
+"C=C+A M",
+"JNC -61",
+"R= 2",
+"GO/XQ ",
+"C=C+A MS",
+"JC -61",
+"C=KEY ",
+"GO/XQ ",
+"C=C+1 @R",
+"JNC -60",
+"SELP 8",
+"GO/XQ ",
+"C=C+1 S&X",
+"JC -60",
+"WRIT 8(P)",
+"GO/XQ ",
+"C=C+1 R<-",
+"JNC -59",
+"?FI 2 ?WNDB",
+"GO/XQ ",
+"C=C+1 ALL",
+"JC -59",
+"GTOKEY ",
+"GO/XQ ",
+"C=C+1 P-Q",
+"JNC -58",
+"UNUSED ",
+"GO/XQ ",
+"C=C+1 XS",
+"JC -58",
+"READ 8(P)",
+"GO/XQ ",
+"C=C+1 M",
+"JNC -57",
+"RCR 2",
+"GO/XQ ",
+"C=C+1 MS",
+"JC -57",
+"HPIL=C 1",
+"GO/XQ ",
+"C=A-C @R",
+"JNC -56",
+"CLRF 9",
+"GO/XQ ",
+"C=A-C S&X",
+"JC -56",
+"SETF 9",
+"GO/XQ ",
+"C=A-C R<-",
+"JNC -55",
+"?FSET 9",
+"GO/XQ ",
+"C=A-C ALL",
+"JC -55",
+"LD@R 9",
+"GO/XQ ",
+"C=A-C P-Q",
+"JNC -54",
+"?R= 9",
+"GO/XQ ",
+"C=A-C XS",
+"JC -54",
+"T=ST ",
+"GO/XQ ",
+"C=A-C M",
+"JNC -53",
+"R= 9",
+"GO/XQ ",
+"C=A-C MS",
+"JC -53",
+"SETHEX ",
+"GO/XQ ",
+"C=C-1 @R",
+"JNC -52",
+"SELP 9",
+"GO/XQ ",
+"C=C-1 S&X",
+"JC -52",
+"WRIT 9(Q)",
+"GO/XQ ",
+"C=C-1 R<-",
+"JNC -51",
+"?FI 9 ?FRNS",
+"GO/XQ ",
+"C=C-1 ALL",
+"JC -51",
+"RAMSLCT ",
+"GO/XQ ",
+"C=C-1 P-Q",
+"JNC -50",
+"UNUSED ",
+"GO/XQ ",
+"C=C-1 XS",
+"JC -50",
+"READ 9(Q)",
+"GO/XQ ",
+"C=C-1 M",
+"JNC -49",
+"RCR 9",
+"GO/XQ ",
+"C=C-1 MS",
+"JC -49",
+"HPIL=C 2",
+"GO/XQ ",
+"C=0-C @R",
+"JNC -48",
+"CLRF 7",
+"GO/XQ ",
+"C=0-C S&X",
+"JC -48",
+"SETF 7",
+"GO/XQ ",
+"C=0-C R<-",
+"JNC -47",
+"?FSET 7",
+"GO/XQ ",
+"C=0-C ALL",
+"JC -47",
+"LD@R A",
+"GO/XQ ",
+"C=0-C P-Q",
+"JNC -46",
+"?R= 7",
+"GO/XQ ",
+"C=0-C XS",
+"JC -46",
+"ST=T ",
+"GO/XQ ",
+"C=0-C M",
+"JNC -45",
+"R= 7",
+"GO/XQ ",
+"C=0-C MS",
+"JC -45",
+"SETDEC ",
+"GO/XQ ",
+"C=-C-1 @R",
+"JNC -44",
+"SELP A",
+"GO/XQ ",
+"C=-C-1 S&X",
+"JC -44",
+"WRIT 10(+)",
+"GO/XQ ",
+"C=-C-1 R<-",
+"JNC -43",
+"?FI 7 ?SRQR",
+"GO/XQ ",
+"C=-C-1 ALL",
+"JC -43",
+"UNUSED ",
+"GO/XQ ",
+"C=-C-1 P-Q",
+"JNC -42",
+"UNUSED ",
+"GO/XQ ",
+"C=-C-1 XS",
+"JC -42",
+"READ 10(+)",
+"GO/XQ ",
+"C=-C-1 M",
+"JNC -41",
+"RCR 7",
+"GO/XQ ",
+"C=-C-1 MS",
+"JC -41",
+"HPIL=C 3",
+"GO/XQ ",
+"?B#0 @R",
+"JNC -40",
+"CLRF 13",
+"GO/XQ ",
+"?B#0 S&X",
+"JC -40",
+"SETF 13",
+"GO/XQ ",
+"?B#0 R<-",
+"JNC -39",
+"?FSET 13",
+"GO/XQ ",
+"?B#0 ALL",
+"JC -39",
+"LD@R B",
+"GO/XQ ",
+"?B#0 P-Q",
+"JNC -38",
+"?R= 13",
+"GO/XQ ",
+"?B#0 XS",
+"JC -38",
+"ST<>T ",
+"GO/XQ ",
+"?B#0 M",
+"JNC -37",
+"R= 13",
+"GO/XQ ",
+"?B#0 MS",
+"JC -37",
+"DSPOFF ",
+"GO/XQ ",
+"?C#0 @R",
+"JNC -36",
+"SELP B",
+"GO/XQ ",
+"?C#0 S&X",
+"JC -36",
+"WRIT 11(a)",
+"GO/XQ ",
+"?C#0 R<-",
+"JNC -35",
+"?FI 13 ?SERV",
+"GO/XQ ",
+"?C#0 ALL",
+"JC -35",
+"WRITDAT ",
+"GO/XQ ",
+"?C#0 P-Q",
+"JNC -34",
+"UNUSED ",
+"GO/XQ ",
+"?C#0 XS",
+"JC -34",
+"READ 11(a)",
+"GO/XQ ",
+"?C#0 M",
+"JNC -33",
+"RCR 13",
+"GO/XQ ",
+"?C#0 MS",
+"JC -33",
+"HPIL=C 4",
+"GO/XQ ",
+"?A<C @R",
+"JNC -32",
+"CLRF 1",
+"GO/XQ ",
+"?A<C S&X",
+"JC -32",
+"SETF 1",
+"GO/XQ ",
+"?A<C R<-",
+"JNC -31",
+"?FSET 1",
+"GO/XQ ",
+"?A<C ALL",
+"JC -31",
+"LD@R C",
+"GO/XQ ",
+"?A<C P-Q",
+"JNC -30",
+"?R= 1",
+"GO/XQ ",
+"?A<C XS",
+"JC -30",
+"UNUSED ",
+"GO/XQ ",
+"?A<C M",
+"JNC -29",
+"R= 1",
+"GO/XQ ",
+"?A<C MS",
+"JC -29",
+"DSPTOG ",
+"GO/XQ ",
+"?A<B @R",
+"JNC -28",
+"SELP C",
+"GO/XQ ",
+"?A<B S&X",
+"JC -28",
+"WRIT 12(b)",
+"GO/XQ ",
+"?A<B R<-",
+"JNC -27",
+"?FI 1 ?CRDR",
+"GO/XQ ",
+"?A<B ALL",
+"JC -27",
+"FETCH S&X ",
+"GO/XQ ",
+"?A<B P-Q",
+"JNC -26",
+"UNUSED ",
+"GO/XQ ",
+"?A<B XS",
+"JC -26",
+"READ 12(b)",
+"GO/XQ ",
+"?A<B M",
+"JNC -25",
+"RCR 1",
+"GO/XQ ",
+"?A<B MS",
+"JC -25",
+"HPIL=C 5",
+"GO/XQ ",
+"?A#0 @R",
+"JNC -24",
+"CLRF 12",
+"GO/XQ ",
+"?A#0 S&X",
+"JC -24",
+"SETF 12",
+"GO/XQ ",
+"?A#0 R<-",
+"JNC -23",
+"?FSET 12",
+"GO/XQ ",
+"?A#0 ALL",
+"JC -23",
+"LD@R D",
+"GO/XQ ",
+"?A#0 P-Q",
+"JNC -22",
+"?R= 12",
+"GO/XQ ",
+"?A#0 XS",
+"JC -22",
+"ST=C ",
+"GO/XQ ",
+"?A#0 M",
+"JNC -21",
+"R= 12",
+"GO/XQ ",
+"?A#0 MS",
+"JC -21",
+"?C RTN ",
+"GO/XQ ",
+"?A#C @R",
+"JNC -20",
+"SELP D",
+"GO/XQ ",
+"?A#C S&X",
+"JC -20",
+"WRIT 13(c)",
+"GO/XQ ",
+"?A#C R<-",
+"JNC -19",
+"?FI 12 ?ALM",
+"GO/XQ ",
+"?A#C ALL",
+"JC -19",
+"C=C O RA ",
+"GO/XQ ",
+"?A#C P-Q",
+"JNC -18",
+"UNUSED ",
+"GO/XQ ",
+"?A#C XS",
+"JC -18",
+"READ 13(c)",
+"GO/XQ ",
+"?A#C M",
+"JNC -17",
+"RCR 12",
+"GO/XQ ",
+"?A#C MS",
+"JC -17",
+"HPIL=C 6",
+"GO/XQ ",
+"RSHFA @R",
+"JNC -16",
+"CLRF 0",
+"GO/XQ ",
+"RSHFA S&X",
+"JC -16",
+"SETF 0",
+"GO/XQ ",
+"RSHFA R<-",
+"JNC -15",
+"?FSET 0",
+"GO/XQ ",
+"RSHFA ALL",
+"JC -15",
+"LD@R E",
+"GO/XQ ",
+"RSHFA P-Q",
+"JNC -14",
+"?R= 0",
+"GO/XQ ",
+"RSHFA XS",
+"JC -14",
+"C=ST ",
+"GO/XQ ",
+"RSHFA M",
+"JNC -13",
+"R= 0",
+"GO/XQ ",
+"RSHFA MS",
+"JC -13",
+"?NC RTN ",
+"GO/XQ ",
+"RSHFB @R",
+"JNC -12",
+"SELP E",
+"GO/XQ ",
+"RSHFB S&X",
+"JC -12",
+"WRIT 14(d)",
+"GO/XQ ",
+"RSHFB R<-",
+"JNC -11",
+"?FI 0 ?PBSY",
+"GO/XQ ",
+"RSHFB ALL",
+"JC -11",
+"C=C AND A ",
+"GO/XQ ",
+"RSHFB P-Q",
+"JNC -10",
+"UNUSED ",
+"GO/XQ ",
+"RSHFB XS",
+"JC -10",
+"READ 14(d)",
+"GO/XQ ",
+"RSHFB M",
+"JNC -9",
+"RCR 0",
+"GO/XQ ",
+"RSHFB MS",
+"JC -9",
+"HPIL=C 7",
+"GO/XQ ",
+"RSHFC @R",
+"JNC -8",
+"ST=0 ",
+"GO/XQ ",
+"RSHFC S&X",
+"JC -8",
+"CLRKEY ",
+"GO/XQ ",
+"RSHFC R<-",
+"JNC -7",
+"?KEY ",
+"GO/XQ ",
+"RSHFC ALL",
+"JC -7",
+"LD@R F",
+"GO/XQ ",
+"RSHFC P-Q",
+"JNC -6",
+"R=R-1 ",
+"GO/XQ ",
+"RSHFC XS",
+"JC -6",
+"C<>ST ",
+"GO/XQ ",
+"RSHFC M",
+"JNC -5",
+"R=R+1 ",
+"GO/XQ ",
+"RSHFC MS",
+"JC -5",
+"RTN ",
+"GO/XQ ",
+"LSHFA @R",
+"JNC -4",
+"SELP F",
+"GO/XQ ",
+"LSHFA S&X",
+"JC -4",
+"WRIT 15(e)",
+"GO/XQ ",
+"LSHFA R<-",
+"JNC -3",
+"?FI ",
+"GO/XQ ",
+"LSHFA ALL",
+"JC -3",
+"PRPHSLCT ",
+"GO/XQ ",
+"LSHFA P-Q",
+"JNC -2",
+"UNUSED ",
+"GO/XQ ",
+"LSHFA XS",
+"JC -2",
+"READ 15(e)",
+"GO/XQ ",
+"LSHFA M",
+"JNC -1",
+"UNUSED ",
+"GO/XQ ",
+"LSHFA MS",
+"JC -1",                    // 3FF
+};
+
+// list of HP-IL mnemonics
+// const, so it stays in FLASH
+const struct ILScope_struct IL_mnemonics[] = 
+{   // opcode, mask, mnemonic
+    {0x000, 0x700, "DAB"},      // DATA frame        // element #0
+    {0x100, 0x700, "DSR"},
+    {0x200, 0x700, "END"},      // End Byte
+    {0x300, 0x700, "ESR"},
+    {0x400, 0x7FF, "NUL"},      // NULL
+    {0x401, 0x7FF, "GTL"},      // Go To Local
+    {0x404, 0x7FF, "SDC"},      // Selected Device Clear
+    {0x405, 0x7FF, "PPD"},      // Parellel Poll Disable
+    {0x408, 0x7FF, "GET"},      // Group Execute Trigger
+    {0x40F, 0x7FF, "ELN"},      // Enable Listener Not Readey For Data
+    {0x410, 0x7FF, "NOP"},      // No Operation        // element #10
+    {0x411, 0x7FF, "LLO"},      // Local Lock Out
+    {0x414, 0x7FF, "DCL"},      // Device Clear
+    {0x415, 0x7FF, "PPU"},      // Parallel Poll Unconfigure
+    {0x418, 0x7FF, "EAR"},      // Enable Asynchronous Request
+    {0x43F, 0x7FF, "UNL"},      // Unlisten
+    {0x420, 0x7E0, "LAD"},      // Listener Address
+    {0x45F, 0x7FF, "UNT"},      // Untalk
+    {0x440, 0x7E0, "TAD"},      // Talker Address
+    {0x460, 0x7E0, "SAD"},      // Seconday Address
+    {0x480, 0x7F0, "PPE"},      // Parellel Poll Enable        // element #20
+    {0x490, 0x7FF, "IFC"},      // Interface Clear
+    {0x492, 0x7FF, "REN"},      // Remote Enable
+    {0x493, 0x7FF, "NRE"},      // Not Remote Enable
+    {0x494, 0x7FF, "*TDIS"},    // PILBox Translator Disable
+    {0x495, 0x7FF, "*COFI"},    // PILBox Controller
+    {0x496, 0x7FF, "*CON"},     // PILBox Controller On
+    {0x497, 0x7FF, "*COFF"},    // PILBox Controller Off with IDY
+    {0x49A, 0x7FF, "AAU"},      // Auto Address Unconfigure
+    {0x49B, 0x7FF, "LPD"},      // Loop Power Down
+    {0x4A0, 0x7E0, "DDL"},      // Device Dependent Listener Command         // element #30
+    {0x4C0, 0x7E0, "DDT"},      // Device Dependent Talker Command
+    {0x400, 0x700, "CMD"},      // All commands filter 0x400-0x4C0
+    {0x500, 0x7FF, "RFC"},      // Ready For Command
+    {0x540, 0x7FF, "ETO"},      // End Of Transmission, OK
+    {0x541, 0x7FF, "ETE"},      // End Of Transmission, Error
+    {0x542, 0x7FF, "NRD"},      // Not Ready For Data
+    {0x560, 0x7FF, "SDA"},      // Send Data
+    {0x561, 0x7FF, "SST"},      // SSP, Send Serial Poll ??
+    {0x562, 0x7FF, "SDI"},      // Send Device ID
+    {0x563, 0x7FF, "SAI"},      // Send Accessory ID        // element #40
+    {0x564, 0x7FF, "TCT"},      // Take Control
+    {0x580, 0x7E0, "AAD"},      // Auto Address 0-30
+    {0x5A0, 0x7E0, "AEP"},      // Auto Extended Primary
+    {0x5C0, 0x7E0, "AES"},      // Auto Extended Secondary
+    {0x5E0, 0x7E0, "AMP"},      // Auto Multiple Primary
+    {0x500, 0x700, "RDY"},      // Ready
+    {0x600, 0x700, "IDY"},      // Identify
+    {0x700, 0x700, "ISR"},      //                          //  element #48
+    };
+
+struct TraceFmtOpts trace_fmt_opts;         // no HP-IL and no symbols until the tracer sets them
+
+char  TracePrint[300];
+int   TracePrintLen = 0;
+
+// disassembly state, kept between lines
+uint32_t delayed_dis;
+int16_t activeSELP = -1;    // for disassembling peripheral instructions
+uint16_t ILframe_in = 0;
+uint8_t HPIL_REG_copy[9] = {0, 0, 0, 0, 0, 0, 0, 0, 0};
+
+// work variables of the formatters
+static uint32_t addr;
+static uint32_t instr, sinstr;
+static uint32_t sync;
+static uint32_t cycle;
+static uint8_t  bank;
+static uint16_t type_GOXQ;
+static uint32_t fi1, fi2;
+static uint64_t fi;
+static uint32_t DATAsample1;
+static uint32_t DATAsample2;
+static uint32_t data_x;        // DATA exponent, 2 digits
+static uint32_t data_xs;       // DATA exponent sign, 1 digit
+static uint32_t data_m1;       // DATA mantissa, 5 digits, D12..D31
+static uint32_t data_m2;       // DATA mantissa, 5 digits, D28..D51
+static uint32_t data_s;        // DATA sign, D52..D55
+static bool ILchanged = false;
+static uint16_t wframe;
+static char ILmnem[10];
+
+// function to get the HP-IL menmonic from a given frame
+void getIL_mnemonic(uint16_t wFrame, char *mnem)
+{
+    // char mnem[5];
+    // first find the mnemonic
+    int i = 0;
+    while (i < numILmnemonics) {   
+        if ((wFrame & IL_mnemonics[i].ILmask) == IL_mnemonics[i].ILcode) break;
+        i++;
+    }
+    sprintf(mnem, "%s", IL_mnemonics[i].ILmnemonic);
+}
+
+void HPIL_instr(uint16_t instr)
+// disassemble HP-IL specific instruction for SELP = 0..7
+// activeSELP indicates the selected register
+{
+    uint16_t i_type = instr & 0x003;         // isolate last two bits
+
+    switch (i_type)
+    {
+    case 1:         // copy literal to selected HP-IL register
+        TracePrintLen += sprintf(TracePrint + TracePrintLen, "  reg %d=%02X", activeSELP, (instr & 0x3FC) >> 2); 
+        break;
+    case 2:         // copies HP-IL register n to C[0..1]
+        TracePrintLen += sprintf(TracePrint + TracePrintLen, "  C[0.1]=reg %d", (instr & 0x1C0) >> 6); 
+        break;
+    case 3:         // return control to CPU - ?PFSET
+        TracePrintLen += sprintf(TracePrint + TracePrintLen, "  ?PFSET"); 
+        break;
+    default:
+        TracePrintLen += sprintf(TracePrint + TracePrintLen, "  oops, unknown?"); 
+        // should never get here
+        break;
+    }
+}
+
+
+// fast trace line formatter
+// a trace line is built with direct writes from the tables below, sprintf is only used for the rare
+// HP-IL literal decoding in HPIL_instr()
+// the mnemonics table is in FLASH, trace_mnem_init() makes a packed copy in SRAM with the lengths
+
+static char trace_hex[17] = "0123456789ABCDEF";
+static char trace_hex2[256][2];                 // two hex digits for each byte value
+static char trace_mnem[TRACE_MNEM_POOL];        // mnemonics, packed without terminating zero
+static uint16_t trace_mnem_ofs[1024];           // offset of each mnemonic in trace_mnem[]
+static uint8_t trace_mnem_len[1024];            // length of each mnemonic
+
+// build the hex digit table and the SRAM copy of the mnemonics
+void trace_mnem_init()
+{
+    int ofs = 0;
+
+    for (int i = 0; i < 256; i++) {
+        trace_hex2[i][0] = trace_hex[i >> 4];
+        trace_hex2[i][1] = trace_hex[i & 0x0F];
+    }
+    for (int i = 0; i < 1024; i++) {
+        int len = strlen(mnemonics[i]);
+        if (ofs + len > TRACE_MNEM_POOL) len = TRACE_MNEM_POOL - ofs;     // does not happen with the current table
+        memcpy(trace_mnem + ofs, mnemonics[i], len);
+        trace_mnem_ofs[i] = ofs;
+        trace_mnem_len[i] = len;
+        ofs += len;
+    }
+}
+
+// write v as exactly n hex digits
+static inline char *fmt_hex(char *p, uint32_t v, int n)
+{
+    p += n;
+    for (int i = 1; i <= n; i++) {
+        p[-i] = trace_hex[v & 0x0F];
+        v >>= 4;
+    }
+    return p;
+}
+
+// write v in hex with at least n digits, like %0nX
+static inline char *fmt_hexw(char *p, uint32_t v, int n)
+{
+    int d = n;
+    while ((d < 8) && ((v >> (d * 4)) != 0)) d++;
+    return fmt_hex(p, v, d);
+}
+
+// write two hex digits
+static inline char *fmt_hex2(char *p, uint8_t v)
+{
+    p[0] = trace_hex2[v][0];
+    p[1] = trace_hex2[v][1];
+    return p + 2;
+}
+
+// write v in decimal, right aligned with spaces to at least n characters, like %nd
+static inline char *fmt_dec(char *p, int32_t v, int n)
+{
+    char d[12];
+    int k = 0;
+    uint32_t u = (v < 0) ? -(uint32_t)v : (uint32_t)v;
+
+    do {
+        d[k++] = '0' + (u % 10);
+        u /= 10;
+    } while (u != 0);
+    if (v < 0) d[k++] = '-';
+    while (n-- > k) *p++ = ' ';
+    while (k > 0) *p++ = d[--k];
+    return p;
+}
+
+static inline char *fmt_str(char *p, const char *s, int len)
+{
+    memcpy(p, s, len);
+    return p + len;
+}
+
+#define FMT_LIT(p, s)   fmt_str(p, s, sizeof(s) - 1)
+
+// the function of an address as "  ; NAME+off", found with trace_fmt_opts.symbol
+// only written when there is a lookup and the address is in a function
+static char *fmt_symbol(char *p, uint16_t addr, uint8_t bank)
+{
+    const char *name;
+    uint16_t entry;
+    int len;
+
+    if (trace_fmt_opts.symbol == NULL) return p;
+    name = trace_fmt_opts.symbol(addr, bank, &entry, &len);
+    if (name == NULL) return p;
+    p = FMT_LIT(p, "  ; ");
+    p = fmt_str(p, name, len);
+    if ((addr & 0x0FFF) != entry) {
+        *p++ = '+';
+        p = fmt_hexw(p, (addr & 0x0FFF) - entry, 1);
+    }
+    return p;
+}
+
+// build the trace/disassembly string of a sample in TracePrint
+// marker is the first character of the line: ' ' or 'O' after a buffer overflow
+// cycles blocked by the trace filter before this sample are shown as one line before it
+// this is used for the text trace and for rendering decoded binary trace records, see tbin_decode()
+// the output is the same as trace_format_ref(), tracer fmtbench and host/fmtbench.c compare the two
+void trace_format(const struct TLine *s, char marker)
+{
+    char *p = TracePrint;
+
+    sinstr = s->isa_instruction;                // sync is still in here
+    instr = sinstr & 0x03FF;
+    sync  = s->isa_instruction >> 11;
+
+    addr  = s->isa_address;
+    cycle = s->cycle_number;
+    bank = s->bank;
+
+    if (s->skipped != 0) {
+        p = FMT_LIT(p, "=  ");
+        p = fmt_dec(p, s->skipped, 6);
+        p = FMT_LIT(p, " cycles skipped");
+        if (s->skipped == 0xFFFF) p = FMT_LIT(p, " or more");
+        p = FMT_LIT(p, "\n\r");
+    }
+
+    // cycle, address, bank, sync and instruction
+    *p++ = marker;
+    p = FMT_LIT(p, "  ");
+    p = fmt_dec(p, cycle, 6);
+    p = FMT_LIT(p, "  ");
+    p = fmt_hexw(p, addr, 4);
+    *p++ = '-';
+    p = fmt_dec(p, bank, 1);
+    p = FMT_LIT(p, "  ");
+    p = fmt_hexw(p, sync, 1);
+    p = FMT_LIT(p, "  ");
+    p = fmt_hex(p, instr, 3);
+    p = FMT_LIT(p, "  ");
+
+    // DATA as S.MMMMMMMMMM.XS.XX
+    p = fmt_hex(p, s->data2 >> 20, 1);
+    *p++ = '.';
+    p = fmt_hex(p, s->data2, 5);
+    p = fmt_hex(p, s->data1 >> 12, 5);
+    *p++ = '.';
+    p = fmt_hex(p, s->data1 >> 8, 1);
+    *p++ = '.';
+    p = fmt_hex2(p, s->data1);
+    p = FMT_LIT(p, "  ");
+
+    // instruction decoded by TULIP, selected RAM and carry
+    if (s->xq_instr == 0) {
+        p = FMT_LIT(p, "...  ");
+    } else {
+        p = fmt_hex(p, s->xq_instr & 0x3FF, 3);
+        p = FMT_LIT(p, "  ");
+    }
+    *p++ = 'R';
+    p = fmt_hexw(p, s->ramslct, 3);
+    p = FMT_LIT(p, "  C");
+    p = fmt_hex(p, s->xq_carry, 1);
+    p = FMT_LIT(p, "  ");
+
+    // FI flags, one position for each of the 14 digits
+    fi1 = s->fi1;
+    fi2 = s->fi2;
+    p = FMT_LIT(p, "FI");
+    #if (TULIP_HARDWARE == T_DEVBOARD)
+        // fi1 is D31..D00, fi2 is D55..D32, a flag is set when one of the bits of its digit is low
+        uint64_t f = ((uint64_t)s->fi2 << 24) + s->fi1;
+        fi = f;
+        for (int i = 0; i < 14; i++) {
+            p[i] = ((f & 0x0F) != 0x0F) ? trace_hex[i] : '-';
+            f >>= 4;
+        }
+        p += 14;
+    #elif (TULIP_HARDWARE == T_MODULE)
+        // the module only has the flags as driven by the TULIP, see trace_format_ref()
+        uint64_t f = ((uint64_t)s->fi2 << 32) | s->fi1;
+        fi = f;
+        p = FMT_LIT(p, " fi1:");
+        p = fmt_hex(p, s->fi1, 8);
+        p = FMT_LIT(p, " fi2:");
+        p = fmt_hex(p, s->fi2, 8);
+        for (int i = 0; i < 14; i++) {
+            p[i] = ((f & 0x7) == 0x7) ? trace_hex[i] : '-';
+            f >>= 4;
+        }
+        p += 14;
+    #endif
+
+    // the disassembly text is padded to 20 characters for the alignment of the HP-IL frames
+    char *dis_end = p + 20;
+
+    if (sync == 1) {
+        // valid instruction
+        if ((instr & 0x003) == 0x001) {
+            // class 1 is 2-word GO/XQ, handled in the next disassembly line
+            delayed_dis = instr;
+            p = FMT_LIT(p, "  ...");
+        } else {
+            p = FMT_LIT(p, "  ");
+            p = fmt_str(p, trace_mnem + trace_mnem_ofs[instr], trace_mnem_len[instr]);
+            delayed_dis = 0;
+            // SELPn is a class 0 instruction PPPP100100
+            if ((instr & 0x03F) == 0x024) {
+                activeSELP = (instr & 0x3C0) >> 6;
+            } else {
+                activeSELP = -1;            // reset after any instruction with a SYNC
+            }
+        }
+    } else if ((delayed_dis & 0x003) == 0x001) {
+        // second word of a class 1 instruction XQ/GO
+        static const char goxq[4][7] = {"?NC XQ", "?C XQ ", "?NC GO", "?C GO "};
+        type_GOXQ = instr & 0x003;
+        p = FMT_LIT(p, "  ");
+        p = fmt_str(p, goxq[type_GOXQ], 6);
+        *p++ = ' ';
+        p = fmt_hex2(p, (instr & 0x3FC) >> 2);
+        p = fmt_hex2(p, (delayed_dis & 0x3FC) >> 2);
+        delayed_dis = 0;
+    } else {
+        // literal from LDI, under peripheral control or FETCH S&X
+        p = FMT_LIT(p, "  ");
+        p = fmt_hex(p, instr, 3);
+        if ((activeSELP >= 0) && (activeSELP <= 7)) {
+            // there is an active peripheral, decode the literal for HP-IL
+            TracePrintLen = p - TracePrint;
+            HPIL_instr(instr);
+            p = TracePrint + TracePrintLen;
+        }
+    }
+    if (p < dis_end) {
+        memset(p, ' ', dis_end - p);
+        p = dis_end;
+    }
+
+    // HP-IL frames and registers if enabled and the HP-IL module is plugged
+    if (trace_fmt_opts.ilregs) {
+        wframe = s->frame_out;
+        if (wframe != 0xFFFF) {
+            // 0xFFFF is in the tracebuffer when nothing was sent
+            getIL_mnemonic(wframe, ILmnem);
+            p = FMT_LIT(p, "  IL> ");
+            p = fmt_hexw(p, wframe, 3);
+            *p++ = ' ';
+            p = fmt_str(p, ILmnem, strlen(ILmnem));
+        } else {
+            wframe = s->frame_in;
+            if (ILframe_in != wframe) {
+                getIL_mnemonic(wframe, ILmnem);
+                p = FMT_LIT(p, "  IL< ");
+                p = fmt_hexw(p, wframe, 3);
+                *p++ = ' ';
+                p = fmt_str(p, ILmnem, strlen(ILmnem));
+                ILframe_in = wframe;
+            } else {
+                p = FMT_LIT(p, "             ");
+            }
+        }
+
+        // the registers only when one of them changed, a changed register is marked with a *
+        ILchanged = false;
+        for (int i = 0; i < 9; i++) {
+            if (HPIL_REG_copy[i] != s->HPILregs[i]) ILchanged = true;
+        }
+        if (ILchanged) {
+            p = FMT_LIT(p, "  Reg ");
+            for (int i = 0; i < 9; i++) {
+                p = fmt_hex2(p, s->HPILregs[i]);
+                *p++ = (HPIL_REG_copy[i] != s->HPILregs[i]) ? '*' : ' ';
+                *p++ = ' ';
+                HPIL_REG_copy[i] = s->HPILregs[i];
+            }
+        }
+    }
+
+    // end of the traceline, with the function of the address
+    p = fmt_symbol(p, addr, bank);
+    p = FMT_LIT(p, "\n\r");
+    *p = 0;
+    TracePrintLen = p - TracePrint;
+}
+
+
+// reference for trace_format() with the original sprintf based code, only used for checking and
+// measuring trace_format()
+void trace_format_ref(const struct TLine *s, char marker)
+{
+    sinstr = s->isa_instruction;                // sync is still in here
+    instr = sinstr & 0x03FF;
+    sync  = s->isa_instruction >> 11;
+
+    addr  = s->isa_address;
+    cycle = s->cycle_number;
+    
+    DATAsample1 = s->data1;                     // D31..D00
+    DATAsample2 = s->data2;                     // D55..D32, right justified 0xfeffffff
+
+    bank = s->bank;
+
+    data_x  =  DATAsample1 & 0x000000FF;                // DATA exponent, 2 digits
+    data_xs = (DATAsample1 & 0x00000F00) >>  8;         // DATA exponent sign, 1 digit
+    data_m1 = (DATAsample1 & 0xFFFFF000) >> 12;         // DATA mantissa, 5 digits, D12..D31
+    data_m2 =  DATAsample2 & 0x000FFFFF;                // DATA mantissa, 5 digits, D28..D51
+    data_s  = (DATAsample2 & 0x00F00000) >> 20;         // DATA sign, D52..D55
+
+    // build the trace/disassembly string
+    TracePrintLen = 0;
+    if (s->skipped != 0) {
+        TracePrintLen += sprintf(TracePrint + TracePrintLen,"=  %6d cycles skipped%s\n\r", s->skipped, (s->skipped == 0xFFFF) ? " or more" : "");
+    }
+    TracePrintLen += sprintf(TracePrint + TracePrintLen,"%c  %6d  %04X-%1d  %01X  %03X  ", marker, cycle, addr, bank, sync, instr);
+    TracePrintLen += sprintf(TracePrint + TracePrintLen,"%01X.%05X%05X.%01X.%02X  ", data_s, data_m2, data_m1, data_xs, data_x);
+    if (s->xq_instr == 0) {
+        // print .... if no instruction was executed by TULIP
+        TracePrintLen += sprintf(TracePrint + TracePrintLen,"...  ", s->xq_instr);  // instruction decoded by TULIP
+    } else {
+        // decoded instruction, print it
+        TracePrintLen += sprintf(TracePrint + TracePrintLen,"%03X  ", s->xq_instr & 0x3FF);  // instruction decoded by TULIP
+    }
+    TracePrintLen += sprintf(TracePrint + TracePrintLen,"R%03X  ", s->ramslct);
+    TracePrintLen += sprintf(TracePrint + TracePrintLen,"C%01X  ", s->xq_carry);    
+
+    // work out the FI bits
+    // if one of the bits is low, we count this as a valid flag
+
+    #if (TULIP_HARDWARE == T_DEVBOARD)
+        // for the DevBoard we have real FI tracing
+        // handle FI signal
+        fi1 = s->fi1;
+        fi2 = s->fi2;                   // need to shift
+        fi = fi2;
+        fi = fi << 24;
+        fi = fi + fi1;
+        // fi1 is D31..D00, fi2 is D55..D32
+
+        TracePrintLen += sprintf(TracePrint + TracePrintLen,"FI"); 
+        for (int i = 0; i < 14; i++) {      // all 14 digits
+            if (((fi >> (i * 4)) & 0b1111) != 0b1111 ) {
+                TracePrintLen += sprintf(TracePrint + TracePrintLen,"%01X", i); 
+            } else {
+                TracePrintLen += sprintf(TracePrint + TracePrintLen,"-"); 
+            }
+        }
+
+    #elif (TULIP_HARDWARE == T_MODULE)
+    // the module does not have FI tracing, here we get only the flags as driven by the TULIP
+    // and the pattern is that of FI_OUT1 and FI_OUT2
+    /*
+            #define FI_00           0x00000007      // FI_PBSY, checked with ?PBSY (Wand, Printer(not used))
+            #define FI_01           0x00000070      // FI_CRDR, checked with ?CRDR (Cardreader)
+            #define FI_02           0x00000700      // FI_WNDB, checked with ?WNDB (Wand)
+            #define FI_03           0x00007000      // 
+            #define FI_04           0x00070000      // 
+            #define FI_05           0x00700000      // FI_EDAV, checked with ?EDAV, IR Emitter Diode Available (Blinky)
+            #define FI_06           0x07000000      // FI_IFCR, checked with ?IFCR, Interface Clear Received (HP-IL)
+            #define FI_07           0x70000000      // FI_SRQR, checked with ?SRQR, Service Request Received (HP-IL)
+
+            // sent on T32..T55
+            #define FI_08           0x00000007      // FI_FRAV, checked with ?FRAV, Frame Available (HP-IL)
+            #define FI_09           0x00000070      // FI_FRNS, checked with ?FRNS, Frame Received Not as Sent (HP-IL)
+            #define FI_10           0x00000700      // FI_ORAV, checked with ?ORAV, Output Register Available (HP-IL) 
+            #define FI_11           0x00007000      //
+            #define FI_12           0x00070000      // FI_ALM, checked with ?ALM, Alarm (Timer)
+            #define FI_13           0x00700000      // FI_SER, checked with ?SER, Service Request (all peripherals)
+        */
+
+        TracePrintLen += sprintf(TracePrint + TracePrintLen,"FI"); 
+        // for the module we have the FI_OUT1 and FI_OUT2 bits as output by the TULIP
+        fi1 = s->fi1;           // D31..D00
+        fi2 = s->fi2;           // D55..D32
+        fi = fi2;
+        fi = fi << 32;
+        fi = fi | fi1;                 // combine the two parts, shift to the left to get D55..D32
+
+        // for testing print the complete fi word
+        TracePrintLen += sprintf(TracePrint + TracePrintLen," fi1:%08X fi2:%08X", fi1, fi2);
+
+        // now print the FI bits
+         for (int i = 0; i < 14; i++) {   
+            if (((fi >> (i * 4)) & 0x7) == 0x7 ) {
+                TracePrintLen += sprintf(TracePrint + TracePrintLen,"%01X", i); 
+            } else {
+                TracePrintLen += sprintf(TracePrint + TracePrintLen,"-"); 
+            }
+        }
+
+    #endif
+
+    // printf(" %08x", s->xq_data1) in case emulator internals are needed
+
+    // keep track of the length of the disassembly line for alignment of any text after it
+    int dis_len = TracePrintLen + 20;       // allow 20 chars for the disassembly text
+
+    // disassembly of the traceline
+    if (sync == 1) {
+        // valid instruction
+        if ((instr & 0x003) == 0x001) {     // class 1 instruction
+            // Class 1 is 2-word GO/XQ, so handle in the next disassembly line
+            delayed_dis = instr;
+            TracePrintLen += sprintf(TracePrint + TracePrintLen,"  ..."); 
+        } else 
+        {
+            TracePrintLen += sprintf(TracePrint + TracePrintLen,"  %s", mnemonics[instr]); 
+            delayed_dis = 0;
+            // isolate SELPn instruction, this is a CLASS 0 instruction
+            // bit pattern PPPPIIII00,. where I = 1001 (0x9) and P is the peripheral selected
+            // mask is 0b0000111111 (0x03F), test is 0b0000100100 (0x024)
+            if ((instr & 0x03F) == 0x024) 
+            {
+                // SELPF Found
+                activeSELP = (instr & 0x3C0) >> 6;
+            }
+            else activeSELP = -1;           // reset after any instruction with a SYNC
+        }
+    } else     
+    {
+        // no SYNC, so the 2nd word of a multi-byte instruction
+        // or under peripheral control, or FETCH S&X
+        if ((delayed_dis & 0x003) == 0x001)
+        {
+            // class 1 instruction XQ/GO
+            type_GOXQ = instr & 0x003;
+            char goxq_str[10];
+            switch (type_GOXQ)
+            {
+                case 0x000: sprintf(goxq_str, "?NC XQ"); break;
+                case 0x001: sprintf(goxq_str, "?C XQ "); break;
+                case 0x002: sprintf(goxq_str, "?NC GO"); break;
+                case 0x003: sprintf(goxq_str, "?C GO ");  break;
+                default: break;
+            }
+            TracePrintLen += sprintf(TracePrint + TracePrintLen,"  %s", goxq_str); 
+            TracePrintLen += sprintf(TracePrint + TracePrintLen," %02X%02X", (instr & 0x3FC) >>2, (delayed_dis & 0x3FC) >> 2);
+            delayed_dis = 0;
+        } else {
+            // not a class 1 instruction so treat as literal
+            // could be from LDI, under peripheral control or FETCH S&X
+            // implement in disassembler (maybe) later
+            TracePrintLen += sprintf(TracePrint + TracePrintLen,"  %03X", instr);
+            if ((activeSELP >= 0) && (activeSELP <= 7)) 
+            {
+                // there is an active peripheral, decode the literal
+                // for now for HP-IL
+                HPIL_instr(instr);
+            }
+        }
+    }
+
+    // file the traceline with spaces until the disassembly text is 20 chars long
+    // for alligment of the IL frame and registers after this
+    //  1BA  C[0.1]=reg 6 is 17 chars   
+    while (TracePrintLen < dis_len) {
+        TracePrintLen += sprintf(TracePrint + TracePrintLen," ");
+    }
+
+    // add tracing for the HP-IL frames and registers if enabled and the HP-IL module is plugged            
+    if (trace_fmt_opts.ilregs) {
+        // list the HP-IL registers and the frames
+        // only list when a frame is sent or received
+        wframe = s->frame_out;
+
+        // find out the frame if any and print if there was an incoming or outgoing frame
+        if ( wframe != 0xFFFF) {
+            // 0xFFFF is the value in the tracebuffer is nothing was sent
+            getIL_mnemonic(wframe, ILmnem);
+            TracePrintLen += sprintf(TracePrint + TracePrintLen,"  IL> %03X %s", wframe, ILmnem); 
+        } else {
+            wframe = s->frame_in;
+            if (ILframe_in != wframe) {
+                // packet received
+                getIL_mnemonic(wframe, ILmnem);
+                TracePrintLen += sprintf(TracePrint + TracePrintLen,"  IL< %03X %s", wframe, ILmnem); 
+                ILframe_in = wframe;
+            } else {
+                // no packet received of sent
+                TracePrintLen += sprintf(TracePrint + TracePrintLen,"             "); 
+            }
+        }
+                      
+        // now print the HP-IL registers only if there was a change in one of the registers
+        ILchanged = false;
+        for (int i = 0; i < 9; i++) {
+            if (HPIL_REG_copy[i] != s->HPILregs[i]) {
+                ILchanged = true;
+            }
+        }
+
+        if (ILchanged) {
+             // only print the registers if there was a change
+            TracePrintLen += sprintf(TracePrint + TracePrintLen,"  Reg "); 
+            for (int i = 0; i < 9; i++) {   
+                TracePrintLen += sprintf(TracePrint + TracePrintLen,"%02X", s->HPILregs[i]);
+
+                // a changed register is indicated with a *
+                if (HPIL_REG_copy[i] != s->HPILregs[i]) {
+                    TracePrintLen += sprintf(TracePrint + TracePrintLen,"* ");
+                } else {
+                    TracePrintLen += sprintf(TracePrint + TracePrintLen,"  ");
+                }
+                HPIL_REG_copy[i] = s->HPILregs[i];
+            }
+        }
+    }
+
+    // end of the traceline, finish it
+    TracePrintLen = fmt_symbol(TracePrint + TracePrintLen, addr, bank) - TracePrint;
+    TracePrintLen += sprintf(TracePrint + TracePrintLen,"\n\r");
+}
@@ -0,0 +1,72 @@
+/*
+ * tracefmt.h
+ *
+ * This file is part of the TULIP4041 project.
+ * Copyright (C) 2024 Meindert Kuipers
+ *
+ * This is free software: you are free to change and redistribute it.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * 
+ * USE AT YOUR OWN RISK
+ *
+ */
+
+// trace line formatter and the HP41 and HP-IL mnemonics, without any Pico SDK includes
+// built in the firmware and in the host tools, tools/tbin2txt.c renders a binary trace with it
+
+#ifndef __TRACEFMT_H__
+#define __TRACEFMT_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "hpinterface_hardware.h"
+#include "hp41_state.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TRACE_MNEM_POOL     8192    // bytes for the SRAM copy of the mnemonics
+#define numILmnemonics      49      // number of elements in IL_mnemonics 0.. 48, PILBox commands now included
+
+struct ILScope_struct {
+    int16_t ILcode;
+    int16_t ILmask;
+    const char* ILmnemonic;
+} ; 
+
+extern const char *const mnemonics[];
+extern const struct ILScope_struct IL_mnemonics[];
+
+// settings of the formatter, the tracer takes these from the global settings before formatting
+struct TraceFmtOpts {
+    bool        ilregs;             // HP-IL frames and registers, tracer_ilregs_on and HPIL_plugged
+    // function of an address for "  ; NAME+off", returns the name and its length and the entry address
+    // in entry, NULL if the address is not in a function, the whole lookup is NULL for no symbols
+    const char  *(*symbol)(uint16_t addr, uint8_t bank, uint16_t *entry, int *len);
+};
+
+extern struct TraceFmtOpts trace_fmt_opts;
+
+// the formatted line, and the disassembly state kept between lines
+extern char TracePrint[300];
+extern int TracePrintLen;
+extern uint32_t delayed_dis;                // first word of a 2-word GO/XQ
+extern int16_t activeSELP;                  // selected peripheral, for the HP-IL literals
+extern uint16_t ILframe_in;                 // last HP-IL frame received that was shown
+extern uint8_t HPIL_REG_copy[9];            // HP-IL registers last shown
+
+void trace_mnem_init();
+void trace_format(const struct TLine *s, char marker);
+void trace_format_ref(const struct TLine *s, char marker);
+void getIL_mnemonic(uint16_t wFrame, char *mnem);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
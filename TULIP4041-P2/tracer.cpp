@@ -16,1049 +16,13 @@
 
 #include "tracer.h"
 
-
-const char __in_flash()*mnemonics[] = 
-// const char *mnemonics[] = 
-// list of HP41 mnemonics, JDA style
-// forced in FLASH to maximize SRAM
-{
-"NOP",                  // 000
-"GO/XQ",        
-"A=0 @R",       
-"JNC +0",       
-"CLRF 3",       
-"GO/XQ",        
-"A=0 S&X",      
-"JC 0",     
-"SETF 3",       
-"GO/XQ",        
-"A=0 R<-",      
-"JNC +1",       
-"?FSET 3",      
-"GO/XQ",        
-"A=0 ALL",      
-"JC 1",         
-"LD@R 0",               // 010
-"GO/XQ",        
-"A=0 P-Q",      
-"JNC +2",       
-"?R= 3",        
-"GO/XQ ",       
-"A=0 XS",       
-"JC 2",
-"UNUSED ",      
-"GO/XQ ",       
-"A=0 M",        
-"JNC +3",       
-"R= 3",         
-"GO/XQ ",       
-"A=0 MS",       
-"JC 3",
-"XQ>GO ",       
-"GO/XQ ",       
-"B=0 @R",       
-"JNC +4",       
-"SELP 0",       
-"GO/XQ ",       
-"B=0 S&X",      
-"JC 4",
-"WRIT 0(T)",    
-"GO/XQ ",       
-"B=0 R<-",      
-"JNC +5",       
-"?FI 3",        
-"GO/XQ ",       
-"B=0 ALL",      
-"JC 5",
-"ROMBLK ",      
-"GO/XQ ",       
-"B=0 P-Q",      
-"JNC +6",       
-"UNUSED ",      
-"GO/XQ ",       
-"B=0 XS",       
-"JC 6",
-"READ 0(T)",   
-"GO/XQ ",       
-"B=0 M",        
-"JNC +7",       
-"RCR 3",        
-"GO/XQ ",       
-"B=0 MS",       
-"JC 7",
-"WROM ",        // 040   
-"GO/XQ ",       
-"C=0 @R",       
-"JNC +8",       
-"CLRF 4",       
-"GO/XQ ",       
-"C=0 S&X",      
-"JC 8",
-"SETF 4",       
-"GO/XQ ",       
-"C=0 R<-",      
-"JNC +9",       
-"?FSET 4",      
-"GO/XQ ",       
-"C=0 ALL",      
-"JC 9",
-"LD@R 1",       
-"GO/XQ ",       
-"C=0 P-Q",      
-"JNC +10",      
-"?R= 4",        
-"GO/XQ ",       
-"C=0 XS",       
-"JC 10",
-"G=C ",         
-"GO/XQ ",       
-"C=0 M",        
-"JNC +11",      
-"R= 4",         
-"GO/XQ ",       
-"C=0 MS",       
-"JC 11",        
-"POWOFF ",      
-"GO/XQ ",       
-"A<>B @R",      
-"JNC +12",      
-"SELP 1",       
-"GO/XQ ",       
-"A<>B S&X",     
-"JC 12",
-"WRIT 1(Z)",    
-"GO/XQ ",       
-"A<>B R<-",     
-"JNC +13",      
-"?FI 4",        
-"GO/XQ ",       
-"A<>B ALL",     
-"JC 13",
-"N=C ",         
-"GO/XQ ",       
-"A<>B P-Q",     
-"JNC +14",      
-"UNUSED ",      
-"GO/XQ ",       
-"A<>B XS",      
-"JC 14",
-"READ 1(Z)",    
-"GO/XQ ",       
-"A<>B M",       
-"JNC +15",      
-"RCR 4",        
-"GO/XQ ",       
-"A<>B MS",      
-"JC 15",
-"UNUSED ",      
-"GO/XQ ",       
-"B=A @R",       
-"JNC +16",      
-"CLRF 5",       
-"GO/XQ ",       
-"B=A S&X",      
-"JC 16",
-"SETF 5",       
-"GO/XQ ",       
-"B=A R<-",      
-"JNC +17",      
-"?FSET 5",      
-"GO/XQ ",       
-"B=A ALL",      
-"JC 17",
-"LD@R 2",       
-"GO/XQ ",       
-"B=A P-Q",      
-"JNC +18",      
-"?R= 5",        
-"GO/XQ ",       
-"B=A XS",       
-"JC 18",
-"C=G ",         
-"GO/XQ ",       
-"B=A M",        
-"JNC +19",      
-"R= 5",         
-"GO/XQ ",       
-"B=A MS",       
-"JC 19",
-"SLCTP ",       
-"GO/XQ ",       
-"A<>C @R",      
-"JNC +20",      
-"SELP 2",       
-"GO/XQ ",       
-"A<>C S&X",     
-"JC 20",
-"WRIT 2(Y)",    
-"GO/XQ ",       
-"A<>C R<-",     
-"JNC +21",      
-"?FI 5 ?EDAV",  
-"GO/XQ ",       
-"A<>C ALL",     
-"JC 21",
-"C=N ",         
-"GO/XQ ",       
-"A<>C P-Q",     
-"JNC +22",      
-"UNUSED ",      
-"GO/XQ ",       
-"A<>C XS",      
-"JC 22",
-"READ 2(Y)",    
-"GO/XQ ",       
-"A<>C M",       
-"JNC +23",      
-"RCR 5",        
-"GO/XQ ",       
-"A<>C MS",      
-"JC 23",
-"EADD=C MAXX",      // 0C0, MAXX Expanded Memory Select
-"GO/XQ ",       
-"C=B @R",       
-"JNC +24",      
-"CLRF 10",      
-"GO/XQ ",       
-"C=B S&X",      
-"JC 24",
-"SETF 10",      
-"GO/XQ ",       
-"C=B R<-",      
-"JNC +25",      
-"?FSET 10",     
-"GO/XQ ",       
-"C=B ALL",      
-"JC 25",
-"LD@R 3",       
-"GO/XQ ",       
-"C=B P-Q",      
-"JNC +26",      
-"?R= 10",       
-"GO/XQ ",       
-"C=B XS",       
-"JC 26",
-"C<>G ",        
-"GO/XQ ",       
-"C=B M",        
-"JNC +27",      
-"R= 10",        
-"GO/XQ ",       
-"C=B MS",       
-"JC 27",
-"SLCTQ ",       
-"GO/XQ ",       
-"B<>C @R",      
-"JNC +28",      
-"SELP 3",       
-"GO/XQ ",       
-"B<>C S&X",     
-"JC 28",
-"WRIT 3(X)",    
-"GO/XQ ",       
-"B<>C R<-",     
-"JNC +29",      
-"?FI 10 ?ORAV", 
-"GO/XQ ",       
-"B<>C ALL",     
-"JC 29",
-"C<>N ",        
-"GO/XQ ",       
-"B<>C P-Q",     
-"JNC +30",      
-"UNUSED ",      
-"GO/XQ ",       
-"B<>C XS",      
-"JC 30",
-"READ 3(X)",    
-"GO/XQ ",       
-"B<>C M",       
-"JNC +31",      
-"RCR 10",       
-"GO/XQ ",       
-"B<>C MS",      
-"JC 31",
-"ENBANK1 ",     
-"GO/XQ ",       
-"A=C @R",       
-"JNC +32",      
-"CLRF 8",       
-"GO/XQ ",       
-"A=C S&X",      
-"JC 32",
-"SETF 8",       
-"GO/XQ ",       
-"A=C R<-",      
-"JNC +33",      
-"?FSET 8",      
-"GO/XQ ",       
-"A=C ALL",      
-"JC 33",
-"LD@R 4",       
-"GO/XQ ",       
-"A=C P-Q",      
-"JNC +34",      
-"?R= 8",        
-"GO/XQ ",       
-"A=C XS",       
-"JC 34",
-"UNUSED ",      
-"GO/XQ ",       
-"A=C M",        
-"JNC +35",      
-"R= 8",         
-"GO/XQ ",       
-"A=C MS",       
-"JC 35",
-"?P=Q ",        
-"GO/XQ ",       
-"A=A+B @R",     
-"JNC +36",      
-"SELP 4",       
-"GO/XQ ",       
-"A=A+B S&X",    
-"JC 36",
-"WRIT 4(L)",    
-"GO/XQ ",       
-"A=A+B R<-",    
-"JNC +37",      
-"?FI 8 ?FRAV",  
-"GO/XQ ",       
-"A=A+B ALL",    
-"JC 37",
-"LDI ",         
-"GO/XQ ",       
-"A=A+B P-Q",    
-"JNC +38",      
-"UNUSED ",      
-"GO/XQ ",       
-"A=A+B XS",     
-"JC 38",
-"READ 4(L)",    
-"GO/XQ ",       
-"A=A+B M",      
-"JNC +39",      
-"RCR 8",        
-"GO/XQ ",       
-"A=A+B MS",     
-"JC 39",
-"ENBANK3 ",     
-"GO/XQ ",       
-"A=A+C @R",     
-"JNC +40",      
-"CLRF 6",       
-"GO/XQ ",       
-"A=A+C S&X",    
-"JC 40",
-"SETF 6",       
-"GO/XQ ",       
-"A=A+C R<-",    
-"JNC +41",      
-"?FSET 6",      
-"GO/XQ ",       
-"A=A+C ALL",    
-"JC 41",
-"LD@R 5",       
-"GO/XQ ",       
-"A=A+C P-Q",    
-"JNC +42",      
-"?R= 6",        
-"GO/XQ ",       
-"A=A+C XS",     
-"JC 42",
-"M=C ",         
-"GO/XQ ",       
-"A=A+C M",      
-"JNC +43",      
-"R= 6",         
-"GO/XQ ",       
-"A=A+C MS",     
-"JC 43",
-"?LOWBAT ",     
-"GO/XQ ",       
-"A=A+1 @R",     
-"JNC +44",      
-"SELP 5",       
-"GO/XQ ",       
-"A=A+1 S&X",    
-"JC 44",
-"WRIT 5(M)",    
-"GO/XQ ",       
-"A=A+1 R<-",    
-"JNC +45",      
-"?FI 6 ?IFCR",  
-"GO/XQ ",       
-"A=A+1 ALL",    
-"JC 45",
-"PUSHADR ",
-"GO/XQ ",
-"A=A+1 P-Q",
-"JNC +46",
-"UNUSED ",
-"GO/XQ ",
-"A=A+1 XS",
-"JC 46",
-"READ 5(M)",
-"GO/XQ ",
-"A=A+1 M",
-"JNC +47",
-"RCR 6",
-"GO/XQ ",
-"A=A+1 MS",
-"JC 47",
-"ENBANK2 ",
-"GO/XQ ",
-"A=A-B @R",
-"JNC +48",
-"CLRF 11",
-"GO/XQ ",
-"A=A-B S&X",
-"JC 48",
-"SETF 11",
-"GO/XQ ",
-"A=A-B R<-",
-"JNC +49",
-"?FSET 11",
-"GO/XQ ",
-"A=A-B ALL",
-"JC 49",
-"LD@R 6",
-"GO/XQ ",
-"A=A-B P-Q",
-"JNC +50",
-"?R= 11",
-"GO/XQ ",
-"A=A-B XS",
-"JC 50",
-"C=M ",
-"GO/XQ ",
-"A=A-B M",
-"JNC +51",
-"R= 11",
-"GO/XQ ",
-"A=A-B MS",
-"JC 51",
-"A=B=C=0 ",
-"GO/XQ ",
-"A=A-1 @R",
-"JNC +52",
-"SELP 6",
-"GO/XQ ",
-"A=A-1 S&X",
-"JC 52",
-"WRIT 6(N)",
-"GO/XQ ",
-"A=A-1 R<-",
-"JNC +53",
-"?FI 11 ?TFAIL",
-"GO/XQ ",
-"A=A-1 ALL",
-"JC 53",
-"POPADR ",
-"GO/XQ ",
-"A=A-1 P-Q",
-"JNC +54",
-"UNUSED ",
-"GO/XQ ",
-"A=A-1 XS",
-"JC 54",
-"READ 6(N)",
-"GO/XQ ",
-"A=A-1 M",
-"JNC +55",
-"RCR 11",
-"GO/XQ ",
-"A=A-1 MS",
-"JC 55",
-"ENBANK4 ",
-"GO/XQ ",
-"A=A-C @R",
-"JNC +56",
-"UNUSED ",
-"GO/XQ ",
-"A=A-C S&X",
-"JC 56",
-"UNUSED ",
-"GO/XQ ",
-"A=A-C R<-",
-"JNC +57",
-"UNUSED ",
-"GO/XQ ",
-"A=A-C ALL",
-"JC 57",
-"LD@R 7",
-"GO/XQ ",
-"A=A-C P-Q",
-"JNC +58",
-"UNUSED ",
-"GO/XQ ",
-"A=A-C XS",
-"JC 58",
-"C<>M ",
-"GO/XQ ",
-"A=A-C M",
-"JNC +59",
-"UNUSED ",
-"GO/XQ ",
-"A=A-C MS",
-"JC 59",
-"GOTOADR ",
-"GO/XQ ",
-"C=C+C @R",
-"JNC +60",
-"SELP 7",
-"GO/XQ ",
-"C=C+C S&X",
-"JC 60",
-"WRIT 7(O)",
-"GO/XQ ",
-"C=C+C R<-",
-"JNC +61",
-"UNUSED ",
-"GO/XQ ",
-"C=C+C ALL",
-"JC 61",
-"WPTOG ",
-"GO/XQ ",
-"C=C+C P-Q",
-"JNC +62",
-"UNUSED ",
-"GO/XQ ",
-"C=C+C XS",
-"JC 62",
-"READ 7(O)",
-"GO/XQ ",
-"C=C+C M",
-"JNC +63",
-"WCMD ",
-"GO/XQ ",
-"C=C+C MS",
-"JC 63",
-"HPIL=C 0",
-"GO/XQ ",
-"C=C+A @R",
-"JNC -64",
-"CLRF 2",
-"GO/XQ ",
-"C=C+A S&X",
-"JC -64",
-"SETF 2",
-"GO/XQ ",
-"C=C+A R<-",
-"JNC -63",
-"?FSET 2",
-"GO/XQ ",
-"C=C+A ALL",
-"JC -63",
-"LD@R 8",
-"GO/XQ ",
-"C=C+A P-Q",
-"JNC -62",
-"?R= 2",
-"GO/XQ ",
-"C=C+A XS",
-"JC -62",
-"UNUSED ",
-"GO/XQ ",
-"C=C+A M",
-"JNC -61",
-"R= 2",
-"GO/XQ ",
-"C=C+A MS",
-"JC -61",
-"C=KEY ",
-"GO/XQ ",
-"C=C+1 @R",
-"JNC -60",
-"SELP 8",
-"GO/XQ ",
-"C=C+1 S&X",
-"JC -60",
-"WRIT 8(P)",
-"GO/XQ ",
-"C=C+1 R<-",
-"JNC -59",
-"?FI 2 ?WNDB",
-"GO/XQ ",
-"C=C+1 ALL",
-"JC -59",
-"GTOKEY ",
-"GO/XQ ",
-"C=C+1 P-Q",
-"JNC -58",
-"UNUSED ",
-"GO/XQ ",
-"C=C+1 XS",
-"JC -58",
-"READ 8(P)",
-"GO/XQ ",
-"C=C+1 M",
-"JNC -57",
-"RCR 2",
-"GO/XQ ",
-"C=C+1 MS",
-"JC -57",
-"HPIL=C 1",
-"GO/XQ ",
-"C=A-C @R",
-"JNC -56",
-"CLRF 9",
-"GO/XQ ",
-"C=A-C S&X",
-"JC -56",
-"SETF 9",
-"GO/XQ ",
-"C=A-C R<-",
-"JNC -55",
-"?FSET 9",
-"GO/XQ ",
-"C=A-C ALL",
-"JC -55",
-"LD@R 9",
-"GO/XQ ",
-"C=A-C P-Q",
-"JNC -54",
-"?R= 9",
-"GO/XQ ",
-"C=A-C XS",
-"JC -54",
-"T=ST ",
-"GO/XQ ",
-"C=A-C M",
-"JNC -53",
-"R= 9",
-"GO/XQ ",
-"C=A-C MS",
-"JC -53",
-"SETHEX ",
-"GO/XQ ",
-"C=C-1 @R",
-"JNC -52",
-"SELP 9",
-"GO/XQ ",
-"C=C-1 S&X",
-"JC -52",
-"WRIT 9(Q)",
-"GO/XQ ",
-"C=C-1 R<-",
-"JNC -51",
-"?FI 9 ?FRNS",
-"GO/XQ ",
-"C=C-1 ALL",
-"JC -51",
-"RAMSLCT ",
-"GO/XQ ",
-"C=C-1 P-Q",
-"JNC -50",
-"UNUSED ",
-"GO/XQ ",
-"C=C-1 XS",
-"JC -50",
-"READ 9(Q)",
-"GO/XQ ",
-"C=C-1 M",
-"JNC -49",
-"RCR 9",
-"GO/XQ ",
-"C=C-1 MS",
-"JC -49",
-"HPIL=C 2",
-"GO/XQ ",
-"C=0-C @R",
-"JNC -48",
-"CLRF 7",
-"GO/XQ ",
-"C=0-C S&X",
-"JC -48",
-"SETF 7",
-"GO/XQ ",
-"C=0-C R<-",
-"JNC -47",
-"?FSET 7",
-"GO/XQ ",
-"C=0-C ALL",
-"JC -47",
-"LD@R A",
-"GO/XQ ",
-"C=0-C P-Q",
-"JNC -46",
-"?R= 7",
-"GO/XQ ",
-"C=0-C XS",
-"JC -46",
-"ST=T ",
-"GO/XQ ",
-"C=0-C M",
-"JNC -45",
-"R= 7",
-"GO/XQ ",
-"C=0-C MS",
-"JC -45",
-"SETDEC ",
-"GO/XQ ",
-"C=-C-1 @R",
-"JNC -44",
-"SELP A",
-"GO/XQ ",
-"C=-C-1 S&X",
-"JC -44",
-"WRIT 10(+)",
-"GO/XQ ",
-"C=-C-1 R<-",
-"JNC -43",
-"?FI 7 ?SRQR",
-"GO/XQ ",
-"C=-C-1 ALL",
-"JC -43",
-"UNUSED ",
-"GO/XQ ",
-"C=-C-1 P-Q",
-"JNC -42",
-"UNUSED ",
-"GO/XQ ",
-"C=-C-1 XS",
-"JC -42",
-"READ 10(+)",
-"GO/XQ ",
-"C=-C-1 M",
-"JNC -41",
-"RCR 7",
-"GO/XQ ",
-"C=-C-1 MS",
-"JC -41",
-"HPIL=C 3",
-"GO/XQ ",
-"?B#0 @R",
-"JNC -40",
-"CLRF 13",
-"GO/XQ ",
-"?B#0 S&X",
-"JC -40",
-"SETF 13",
-"GO/XQ ",
-"?B#0 R<-",
-"JNC -39",
-"?FSET 13",
-"GO/XQ ",
-"?B#0 ALL",
-"JC -39",
-"LD@R B",
-"GO/XQ ",
-"?B#0 P-Q",
-"JNC -38",
-"?R= 13",
-"GO/XQ ",
-"?B#0 XS",
-"JC -38",
-"ST<>T ",
-"GO/XQ ",
-"?B#0 M",
-"JNC -37",
-"R= 13",
-"GO/XQ ",
-"?B#0 MS",
-"JC -37",
-"DSPOFF ",
-"GO/XQ ",
-"?C#0 @R",
-"JNC -36",
-"SELP B",
-"GO/XQ ",
-"?C#0 S&X",
-"JC -36",
-"WRIT 11(a)",
-"GO/XQ ",
-"?C#0 R<-",
-"JNC -35",
-"?FI 13 ?SERV",
-"GO/XQ ",
-"?C#0 ALL",
-"JC -35",
-"WRITDAT ",
-"GO/XQ ",
-"?C#0 P-Q",
-"JNC -34",
-"UNUSED ",
-"GO/XQ ",
-"?C#0 XS",
-"JC -34",
-"READ 11(a)",
-"GO/XQ ",
-"?C#0 M",
-"JNC -33",
-"RCR 13",
-"GO/XQ ",
-"?C#0 MS",
-"JC -33",
-"HPIL=C 4",
-"GO/XQ ",
-"?A<C @R",
-"JNC -32",
-"CLRF 1",
-"GO/XQ ",
-"?A<C S&X",
-"JC -32",
-"SETF 1",
-"GO/XQ ",
-"?A<C R<-",
-"JNC -31",
-"?FSET 1",
-"GO/XQ ",
-"?A<C ALL",
-"JC -31",
-"LD@R C",
-"GO/XQ ",
-"?A<C P-Q",
-"JNC -30",
-"?R= 1",
-"GO/XQ ",
-"?A<C XS",
-"JC -30",
-"UNUSED ",
-"GO/XQ ",
-"?A<C M",
-"JNC -29",
-"R= 1",
-"GO/XQ ",
-"?A<C MS",
-"JC -29",
-"DSPTOG ",
-"GO/XQ ",
-"?A<B @R",
-"JNC -28",
-"SELP C",
-"GO/XQ ",
-"?A<B S&X",
-"JC -28",
-"WRIT 12(b)",
-"GO/XQ ",
-"?A<B R<-",
-"JNC -27",
-"?FI 1 ?CRDR",
-"GO/XQ ",
-"?A<B ALL",
-"JC -27",
-"FETCH S&X ",
-"GO/XQ ",
-"?A<B P-Q",
-"JNC -26",
-"UNUSED ",
-"GO/XQ ",
-"?A<B XS",
-"JC -26",
-"READ 12(b)",
-"GO/XQ ",
-"?A<B M",
-"JNC -25",
-"RCR 1",
-"GO/XQ ",
-"?A<B MS",
-"JC -25",
-"HPIL=C 5",
-"GO/XQ ",
-"?A#0 @R",
-"JNC -24",
-"CLRF 12",
-"GO/XQ ",
-"?A#0 S&X",
-"JC -24",
-"SETF 12",
-"GO/XQ ",
-"?A#0 R<-",
-"JNC -23",
-"?FSET 12",
-"GO/XQ ",
-"?A#0 ALL",
-"JC -23",
-"LD@R D",
-"GO/XQ ",
-"?A#0 P-Q",
-"JNC -22",
-"?R= 12",
-"GO/XQ ",
-"?A#0 XS",
-"JC -22",
-"ST=C ",
-"GO/XQ ",
-"?A#0 M",
-"JNC -21",
-"R= 12",
-"GO/XQ ",
-"?A#0 MS",
-"JC -21",
-"?C RTN ",
-"GO/XQ ",
-"?A#C @R",
-"JNC -20",
-"SELP D",
-"GO/XQ ",
-"?A#C S&X",
-"JC -20",
-"WRIT 13(c)",
-"GO/XQ ",
-"?A#C R<-",
-"JNC -19",
-"?FI 12 ?ALM",
-"GO/XQ ",
-"?A#C ALL",
-"JC -19",
-"C=C O RA ",
-"GO/XQ ",
-"?A#C P-Q",
-"JNC -18",
-"UNUSED ",
-"GO/XQ ",
-"?A#C XS",
-"JC -18",
-"READ 13(c)",
-"GO/XQ ",
-"?A#C M",
-"JNC -17",
-"RCR 12",
-"GO/XQ ",
-"?A#C MS",
-"JC -17",
-"HPIL=C 6",
-"GO/XQ ",
-"RSHFA @R",
-"JNC -16",
-"CLRF 0",
-"GO/XQ ",
-"RSHFA S&X",
-"JC -16",
-"SETF 0",
-"GO/XQ ",
-"RSHFA R<-",
-"JNC -15",
-"?FSET 0",
-"GO/XQ ",
-"RSHFA ALL",
-"JC -15",
-"LD@R E",
-"GO/XQ ",
-"RSHFA P-Q",
-"JNC -14",
-"?R= 0",
-"GO/XQ ",
-"RSHFA XS",
-"JC -14",
-"C=ST ",
-"GO/XQ ",
-"RSHFA M",
-"JNC -13",
-"R= 0",
-"GO/XQ ",
-"RSHFA MS",
-"JC -13",
-"?NC RTN ",
-"GO/XQ ",
-"RSHFB @R",
-"JNC -12",
-"SELP E",
-"GO/XQ ",
-"RSHFB S&X",
-"JC -12",
-"WRIT 14(d)",
-"GO/XQ ",
-"RSHFB R<-",
-"JNC -11",
-"?FI 0 ?PBSY",
-"GO/XQ ",
-"RSHFB ALL",
-"JC -11",
-"C=C AND A ",
-"GO/XQ ",
-"RSHFB P-Q",
-"JNC -10",
-"UNUSED ",
-"GO/XQ ",
-"RSHFB XS",
-"JC -10",
-"READ 14(d)",
-"GO/XQ ",
-"RSHFB M",
-"JNC -9",
-"RCR 0",
-"GO/XQ ",
-"RSHFB MS",
-"JC -9",
-"HPIL=C 7",
-"GO/XQ ",
-"RSHFC @R",
-"JNC -8",
-"ST=0 ",
-"GO/XQ ",
-"RSHFC S&X",
-"JC -8",
-"CLRKEY ",
-"GO/XQ ",
-"RSHFC R<-",
-"JNC -7",
-"?KEY ",
-"GO/XQ ",
-"RSHFC ALL",
-"JC -7",
-"LD@R F",
-"GO/XQ ",
-"RSHFC P-Q",
-"JNC -6",
-"R=R-1 ",
-"GO/XQ ",
-"RSHFC XS",
-"JC -6",
-"C<>ST ",
-"GO/XQ ",
-"RSHFC M",
-"JNC -5",
-"R=R+1 ",
-"GO/XQ ",
-"RSHFC MS",
-"JC -5",
-"RTN ",
-"GO/XQ ",
-"LSHFA @R",
-"JNC -4",
-"SELP F",
-"GO/XQ ",
-"LSHFA S&X",
-"JC -4",
-"WRIT 15(e)",
-"GO/XQ ",
-"LSHFA R<-",
-"JNC -3",
-"?FI ",
-"GO/XQ ",
-"LSHFA ALL",
-"JC -3",
-"PRPHSLCT ",
-"GO/XQ ",
-"LSHFA P-Q",
-"JNC -2",
-"UNUSED ",
-"GO/XQ ",
-"LSHFA XS",
-"JC -2",
-"READ 15(e)",
-"GO/XQ ",
-"LSHFA M",
-"JNC -1",
-"UNUSED ",
-"GO/XQ ",
-"LSHFA MS",
-"JC -1",                    // 3FF
-};
-
-
+// the trace line formatter and the mnemonics are in tracefmt.c, the binary record format is in tbin.c
 
 struct TLine TraceSample;                   // Trace Buffer definition, default (maximum info)
 
-struct TLine_FI TraceSample_FI;             // Trace Buffer definition, no HP-IL , with FI
-struct TLine_basic Tracesample_basic;       // basic Tracebuffer
 
 uint32_t ISAsample;
 uint64_t DATAsample;
-uint32_t DATAsample1;
-uint32_t DATAsample2;
 uint32_t xq1 = 0;
 uint32_t xq2 = 0;
 
@@ -1066,48 +30,54 @@ static volatile uint32_t fi1 = 0;
 static volatile uint32_t fi2 = 0;
 static volatile uint64_t fi = 0;
  
-uint32_t addr;
-uint32_t instr, sinstr;
-uint32_t delayed_dis;
-uint32_t sync;
 uint32_t cycle;
 uint32_t cycle_prev;
 uint8_t  bank;
 
-uint16_t type_GOXQ;
-
 char overflow = '.';
 char prev_overflow = ' ';
 bool sample_skipped = false;
+uint32_t trace_gaps = 0;        // number of gaps in the cycle numbers, overflows of the TraceBuffer or PWO
+uint32_t trace_skipped = 0;     // number of cycles blocked by the trace filter
+
+// trigger engine
+int trig_state = TRIG_OFF;
+uint32_t trig_fired = 0;
+static const filter *trig_active;                   // the trigger that fired
+static uint32_t trig_left;                          // samples left for a count trigger or after the end
+static uint32_t trig_dropped;                       // samples not traced since the last traced one
+static uint32_t trig_map[2048];                     // one bit for each trigger start or end address
+static struct TLine trig_pre[TRACE_PRE_MAX];        // samples before the trigger
+static char trig_pre_marker[TRACE_PRE_MAX];
+static int trig_pre_first;
+static int trig_pre_n;
 
 uint32_t data0;
 uint32_t data1;
 
-uint32_t data_x;        // DATA exponent, 2 digits
-uint32_t data_xs;       // DATA exponent sign, 1 digit
-uint32_t data_m1;       // DATA mantissa, 5 digits, D12..D31
-uint32_t data_m2;       // DATA mantissa, 5 digits, D28..D51
-uint32_t data_s;        // DATA sign, D52..D55
-
-int16_t activeSELP = -1;    // for disassembling peripheral instructions
-
 bool Tracer_firstconnect = false;   // to detect the first connect to a CDC host
                                     // to display a welcome message
 
 uint16_t ILframe_out = 0;
-uint16_t ILframe_in = 0;
-uint8_t HPIL_REG_copy[9] = {0, 0, 0, 0, 0, 0, 0, 0, 0};
-bool ILchanged = false;
-uint16_t wframe;
-char ILmnem[10];
 
+struct TraceRing trace_ring;                // TraceBuffer between core1 and core0
+struct TraceRingStats trace_ring_stats;
+
+// the upper half of the TraceBuffer when it is lent, see trace_ring_lend()
+struct TraceLent {
+    uint8_t             sd_buf[2][TRACE_SD_BUFSIZE];    // uSD capture buffers
+    struct TLine        replay[REPLAY_LINES];           // replay capture
+};
+static_assert(sizeof(struct TraceLent) <= sizeof(trace_ring.buf) / 2, "the lent buffers must fit in the upper half of the TraceBuffer");
+#define TRACE_LENT          ((struct TraceLent *)&trace_ring.buf[TRACE_RING_WORDS / 2])
 
-queue_t TraceBuffer;
+static struct TLine trace_wref;             // last record written by core1, the reference for the next
+static struct TLine trace_rref;             // last record read by core0
+static bool trace_wkey = true;              // next record is written with all fields
 
 queue_t PowerEventBuffer;           // buffer for power events
 
-char  TracePrint[250];
-int   TracePrintLen = 0;
+extern CModules TULIP_Pages;
 
 volatile int level;
 volatile int prev_level;
@@ -1118,10 +88,7 @@ bool ALD_block = false;
 int test = 0;
 bool blocking = false;
 
-bool prev_block = false;
-bool block = false;
     
-// extern queue_t TraceBuffer;
 extern struct TLine TraceLine;             // the variable with the TraceLine
 
 extern int sample_break;
@@ -1130,31 +97,1471 @@ extern int sample_break;
 // initialize the trace buffer
 void TraceBuffer_init()
 {
-    queue_init(&TraceBuffer, sizeof(TraceLine), TRACELENGTH);        // define trace buffer 
+    trace_ring.head = 0;
+    trace_ring.tail = 0;
+    trace_ring.dropped = 0;
+    trace_ring.records = 0;
+    trace_ring.filtered = 0;
+    trace_ring.mask = TRACE_RING_MASK;
+    trace_wkey = true;
+    memset(&trace_ring_stats, 0, sizeof(trace_ring_stats));
+    trace_mnem_init();
+    trace_stats_reset();
+}
+
+// add a TraceLine to the TraceBuffer, called by core1 for every traced cycle
+// only the fields that changed since the previous record are written, see tracer.h
+// returns false if there is no room, the record is then dropped
+// in the snapshot capture the oldest records are removed instead, and the trigger is checked here
+bool __not_in_flash_func(trace_put)(const struct TLine *l)
+{
+    struct TLine *r = &trace_wref;
+    uint32_t *b = trace_ring.buf;
+    uint32_t m = trace_ring.mask;
+    uint32_t h = trace_ring.head;
+    uint32_t flags = 0;
+    uint32_t n = 3;
+    bool regs = false;
+    int snap = trace_snap.state;
+    bool frame_new = (l->frame_in != r->frame_in);
+
+    if (trace_prof.state != PROF_OFF) {
+        // profiler, only count the fetch
+        if (trace_prof.state == PROF_RUN) {
+            uint16_t *c = (uint16_t *)b + l->isa_address;
+            if (*c != PROF_SAT) (*c)++;
+            trace_prof.bank[l->isa_address >> 12][l->bank & 0x07]++;
+        }
+        return true;
+    }
+    if (snap == SNAP_FROZEN) return true;           // the snapshot is kept, nothing is added
+    if ((snap != SNAP_OFF) && ((trace_snap.records % TRACE_SNAP_KEY) == 0)) trace_wkey = true;
+
+    for (int i = 0; i < 9; i++) {
+        if (l->HPILregs[i] != r->HPILregs[i]) regs = true;
+    }
+
+    if (trace_wkey || (l->cycle_number != r->cycle_number + 1 + l->skipped)) {
+        flags |= TREC_CYCLE;
+        n++;
+    }
+    if (l->skipped != 0) {
+        flags |= TREC_SKIP;
+        n++;
+    }
+    if (trace_wkey || (l->fi1 != r->fi1) || (l->fi2 != r->fi2)) {
+        flags |= TREC_FI;
+        n += 2;
+    }
+    if (trace_wkey || (l->ramslct != r->ramslct)) {
+        flags |= TREC_RAM;
+        n++;
+    }
+    if (trace_wkey || (l->xq_instr != r->xq_instr) || (l->xq_carry != r->xq_carry) || (l->bank != r->bank)) {
+        flags |= TREC_XQ;
+        n++;
+    }
+    if (trace_wkey || regs || (l->frame_in != r->frame_in) || (l->frame_out != r->frame_out)) {
+        flags |= TREC_HPIL;
+        n += 4;
+    }
+
+    if (m + 1 - (h - trace_ring.tail) < n) {
+        if (snap == SNAP_OFF) {
+            // no room, core0 is behind
+            trace_ring.dropped++;
+            return false;
+        }
+        // snapshot, remove the oldest records
+        uint32_t t = trace_ring.tail;
+        while (m + 1 - (h - t) < n) t += trec_len(b[(t + 2) & m] >> 24);
+        trace_ring.tail = t;
+    }
+    uint32_t pos = h;
+
+    b[h++ & m] = l->isa_address | ((uint32_t)l->isa_instruction << 16);
+    b[h++ & m] = l->data1;
+    b[h++ & m] = (l->data2 & 0x00FFFFFF) | (flags << 24);
+    if (flags & TREC_CYCLE) b[h++ & m] = l->cycle_number;
+    if (flags & TREC_SKIP) b[h++ & m] = l->skipped;
+    if (flags & TREC_FI) {
+        b[h++ & m] = l->fi1;
+        b[h++ & m] = l->fi2;
+        r->fi1 = l->fi1;
+        r->fi2 = l->fi2;
+    }
+    if (flags & TREC_RAM) {
+        b[h++ & m] = l->ramslct;
+        r->ramslct = l->ramslct;
+    }
+    if (flags & TREC_XQ) {
+        b[h++ & m] = l->xq_instr | ((uint32_t)l->xq_carry << 16) | ((uint32_t)l->bank << 24);
+        r->xq_instr = l->xq_instr;
+        r->xq_carry = l->xq_carry;
+        r->bank = l->bank;
+    }
+    if (flags & TREC_HPIL) {
+        b[h++ & m] = l->frame_in | ((uint32_t)l->frame_out << 16);
+        for (int i = 0; i < 9; i += 4) {
+            uint32_t w = 0;
+            for (int j = i; (j < i + 4) && (j < 9); j++) {
+                w |= (uint32_t)l->HPILregs[j] << (8 * (j - i));
+                r->HPILregs[j] = l->HPILregs[j];
+            }
+            b[h++ & m] = w;
+        }
+        r->frame_in = l->frame_in;
+        r->frame_out = l->frame_out;
+    }
+    r->cycle_number = l->cycle_number;
+    trace_wkey = false;
+
+    __dmb();                                // the record is complete before core0 can see it
+    trace_ring.head = h;
+    trace_ring.records++;
+
+    if (snap != SNAP_OFF) {
+        trace_snap.records++;
+        if (snap == SNAP_POST) {
+            if (--trace_snap.left == 0) trace_snap.state = SNAP_FROZEN;
+        } else if (((trace_snap.trig == SNAP_TRIG_ADDR) && (l->isa_address == trace_snap.value)) ||
+                   ((trace_snap.trig == SNAP_TRIG_INST) && ((l->isa_instruction & 0x0BFF) == (trace_snap.value | 0x0800))) ||
+                   ((trace_snap.trig == SNAP_TRIG_FRAME) && ((l->frame_out == trace_snap.value) ||
+                                                             (frame_new && (l->frame_in == trace_snap.value))))) {
+            trace_snap.trig_pos = pos;
+            trace_snap.trig_cycle = l->cycle_number;
+            trace_snap.triggered = true;
+            trace_snap.left = trace_snap.post;
+            trace_snap.state = (trace_snap.post == 0) ? SNAP_FROZEN : SNAP_POST;
+        }
+    }
+    return true;
+}
+
+// take the next record from the TraceBuffer and expand it to a full TLine, called by core0
+// returns false if the TraceBuffer is empty
+bool trace_get(struct TLine *l)
+{
+    struct TLine *r = &trace_rref;
+    const uint32_t *b = trace_ring.buf;
+    uint32_t m = trace_ring.mask;
+    uint32_t t0 = trace_ring.tail;
+    uint32_t t = t0;
+    uint32_t fill = trace_ring.head - t;
+    uint32_t w, flags, cyc = 0;
+
+    if (fill == 0) return false;
+    __dmb();                                // read the record after seeing the new head
+
+    w = b[t++ & m];
+    r->isa_address = w & 0xFFFF;
+    r->isa_instruction = w >> 16;
+    r->data1 = b[t++ & m];
+    w = b[t++ & m];
+    r->data2 = w & 0x00FFFFFF;
+    flags = w >> 24;
+    if (flags & TREC_CYCLE) cyc = b[t++ & m];
+    r->skipped = (flags & TREC_SKIP) ? b[t++ & m] : 0;
+    r->cycle_number = (flags & TREC_CYCLE) ? cyc : r->cycle_number + 1 + r->skipped;
+    if (flags & TREC_FI) {
+        r->fi1 = b[t++ & m];
+        r->fi2 = b[t++ & m];
+    }
+    if (flags & TREC_RAM) r->ramslct = b[t++ & m];
+    if (flags & TREC_XQ) {
+        w = b[t++ & m];
+        r->xq_instr = w & 0xFFFF;
+        r->xq_carry = (w >> 16) & 1;
+        r->bank = w >> 24;
+    }
+    if (flags & TREC_HPIL) {
+        w = b[t++ & m];
+        r->frame_in = w & 0xFFFF;
+        r->frame_out = w >> 16;
+        for (int i = 0; i < 9; i += 4) {
+            w = b[t++ & m];
+            for (int j = i; (j < i + 4) && (j < 9); j++) {
+                r->HPILregs[j] = w >> (8 * (j - i));
+            }
+        }
+    }
+    __dmb();                                // done reading before core1 may overwrite
+    trace_ring.tail = t;
+
+    trace_ring_stats.records++;
+    trace_ring_stats.words += t - t0;
+    if (fill > trace_ring_stats.max_fill) trace_ring_stats.max_fill = fill;
+
+    *l = *r;
+    return true;
+}
+
+// true if there is nothing in the TraceBuffer
+bool trace_empty()
+{
+    return trace_ring.head == trace_ring.tail;
+}
+
+// the function of an address for the trace line, from the function index of the plugged Page/Bank
+// the name of the last function is kept, getFATname() is only used when the function changes
+static const char *trace_symbol(uint16_t addr, uint8_t bank, uint16_t *entry, int *len)
+{
+    static int sym_page = -1;
+    static int sym_bank, sym_fn;
+    static uint16_t sym_entry;
+    static uint32_t sym_gen;
+    static char sym_name[FAT_NAME_LEN + 12];
+    static int sym_len;
+    int page = addr >> 12;
+
+    int fn = TULIP_Pages.findFunction(page, bank, addr & PAGE_MASK, entry);
+    if (fn < 0) return NULL;
+    if ((page != sym_page) || (bank != sym_bank) || (fn != sym_fn) || (*entry != sym_entry) || (sym_gen != TULIP_Pages.FATGen)) {
+        TULIP_Pages.getFATname(page, bank, fn, sym_name);
+        sym_len = strlen(sym_name);
+        sym_page = page;
+        sym_bank = bank;
+        sym_fn = fn;
+        sym_entry = *entry;
+        sym_gen = TULIP_Pages.FATGen;
+    }
+    *len = sym_len;
+    return sym_name;
+}
+
+// take the settings of the trace line formatter from the global settings
+// done before formatting a batch of lines, not for every line
+static void trace_fmt_update()
+{
+    trace_fmt_opts.ilregs = globsetting.get(tracer_ilregs_on) && globsetting.get(HPIL_plugged);
+    trace_fmt_opts.symbol = globsetting.get(tracer_symbols) ? trace_symbol : NULL;
+}
+
+// compare trace_format() with trace_format_ref() and measure both
+// uses the replay capture when there is one, otherwise FMT_BENCH_LINES generated lines
+// that cover all instructions
+void trace_format_bench()
+{
+    static char ref[sizeof(TracePrint)];
+    const struct TLine *lines = replay_lines;
+    int n = replay_count;
+    int diffs = 0;
+    uint64_t t_ref, t_new;
+
+    // the formatters keep disassembly state, it is restored before every run
+    uint32_t s_delayed = delayed_dis;
+    int16_t s_selp = activeSELP;
+    uint16_t s_frame = ILframe_in;
+    uint8_t s_regs[9];
+    memcpy(s_regs, HPIL_REG_copy, sizeof(s_regs));
+
+    trace_fmt_update();
+
+    if (n == 0) {
+        // no capture, the generated lines are built in replay_lines[] and cleared again afterwards
+        trace_ring_lend();
+        n = REPLAY_LINES;
+        for (int k = 0; k < n; k++) {
+            struct TLine *l = &replay_lines[k];
+            uint32_t r = k * 2654435761u;
+            memset(l, 0, sizeof(struct TLine));
+            l->cycle_number = k * 37;
+            l->isa_address = r >> 16;
+            l->isa_instruction = ((k * 2) & 0x3FF) | (((k & 3) != 3) ? 0x0800 : 0);
+            l->bank = 1 + (k & 3);
+            l->data1 = r;
+            l->data2 = (r >> 5) & 0x00FFFFFF;
+            l->fi1 = ((k % 5) == 0) ? 0 : 0xFFFFFFFF;
+            l->fi2 = 0xFFFFFFFF;
+            l->xq_instr = ((k % 7) == 0) ? 0 : (r & 0x3FF);
+            l->xq_carry = k & 1;
+            l->ramslct = k & 0x1FF;
+            l->skipped = ((k % 50) == 0) ? k : 0;
+            l->frame_out = 0xFFFF;
+        }
+        cli_printf("  no replay capture, using %d generated lines", n);
+    }
+
+    // check the output line by line
+    for (int k = 0; k < n; k++) {
+        uint32_t d = delayed_dis;
+        int16_t selp = activeSELP;
+        uint16_t frame = ILframe_in;
+        uint8_t regs[9];
+        memcpy(regs, HPIL_REG_copy, sizeof(regs));
+
+        trace_format_ref(&lines[k], ' ');
+        memcpy(ref, TracePrint, TracePrintLen + 1);
+        int ref_len = TracePrintLen;
+
+        delayed_dis = d;
+        activeSELP = selp;
+        ILframe_in = frame;
+        memcpy(HPIL_REG_copy, regs, sizeof(regs));
+        trace_format(&lines[k], ' ');
+        if ((TracePrintLen != ref_len) || (memcmp(ref, TracePrint, ref_len) != 0)) {
+            if (diffs++ < 2) {
+                cli_printf("  line %d differs", k);
+                cli_printf("  ref  %s", ref);
+                cli_printf("  new  %s", TracePrint);
+            }
+        }
+    }
+
+    // and the time for all lines
+    uint64_t start = time_us_64();
+    for (int r = 0; r < FMT_BENCH_REPEAT; r++) {
+        for (int k = 0; k < n; k++) trace_format_ref(&lines[k], ' ');
+    }
+    t_ref = time_us_64() - start;
+    start = time_us_64();
+    for (int r = 0; r < FMT_BENCH_REPEAT; r++) {
+        for (int k = 0; k < n; k++) trace_format(&lines[k], ' ');
+    }
+    t_new = time_us_64() - start;
+
+    delayed_dis = s_delayed;
+    activeSELP = s_selp;
+    ILframe_in = s_frame;
+    memcpy(HPIL_REG_copy, s_regs, sizeof(s_regs));
+    if (replay_count == 0) {
+        memset(replay_lines, 0, sizeof(struct TLine) * REPLAY_LINES);
+        trace_ring_return();
+    }
+
+    uint32_t total = n * FMT_BENCH_REPEAT;
+    cli_printf("  trace format, %d lines: %d differences", n, diffs);
+    cli_printf("    sprintf   %6d ns/line  %7d lines/s", (uint32_t)(t_ref * 1000 / total), (uint32_t)(total * 1000000ull / (t_ref + 1)));
+    cli_printf("    tables    %6d ns/line  %7d lines/s", (uint32_t)(t_new * 1000 / total), (uint32_t)(total * 1000000ull / (t_new + 1)));
+}
+
+
+// staging buffer for the tracer CDC port
+// sending every traceline on its own costs a USB packet per line and keeps the main loop busy,
+// the output is collected here and sent when the buffer is full or after TRACE_OUT_TIMEOUT
+static uint8_t trace_out[TRACE_OUT_SIZE];
+static int trace_out_len = 0;
+static uint64_t trace_out_first;            // time the oldest byte was staged
+struct TraceOutStats trace_out_stats;
+static uint64_t trace_rate_start;           // start of the current second for the rates
+static uint32_t trace_rate_lines;
+static uint32_t trace_rate_bytes;
+
+// send the staged output, timeout is true when the buffer was not full
+static void trace_out_flush(bool timeout)
+{
+    if (trace_out_len == 0) return;
+    if (cdc_connected(ITF_TRACE)) {
+        cdc_sendbuf(ITF_TRACE, (char *)trace_out, trace_out_len);
+        cdc_flush(ITF_TRACE);
+        trace_out_stats.bytes += trace_out_len;
+        trace_out_stats.blocks++;
+        if (timeout) trace_out_stats.timeouts++;
+    } else {
+        trace_out_stats.dropped += trace_out_len;
+    }
+    trace_out_len = 0;
+}
+
+// add len bytes to the staging buffer, sends the buffer first when there is no room
+static void trace_out_put(const char *buf, int len)
+{
+    if (trace_out_len + len > TRACE_OUT_SIZE) trace_out_flush(false);
+    if (trace_out_len == 0) trace_out_first = time_us_64();
+    memcpy(trace_out + trace_out_len, buf, len);
+    trace_out_len += len;
+}
+
+// pipeline telemetry, see struct TraceStats
+static struct TraceStats trace_stats_base;      // counters at the last tracer stats reset
+static struct TraceStats trace_stats_last;      // counters at the last periodic status line
+static int trace_stats_secs = 0;                // seconds between the periodic status lines, 0 is off
+static uint64_t trace_stats_next;               // time of the next periodic status line
+
+// the current value of all counters
+void trace_stats_get(struct TraceStats *s)
+{
+    s->time = time_us_64();
+    s->filtered = trace_ring.filtered;
+    s->enqueued = trace_ring.records;
+    s->dropped = trace_ring.dropped;
+    s->produced = s->filtered + s->enqueued + s->dropped;
+    s->read = trace_ring_stats.records;
+    s->traced = trace_ring_stats.traced;
+    s->lines = trace_out_stats.lines;
+    s->bytes = trace_out_stats.bytes;
+    s->unsent = trace_out_stats.dropped;
+    s->budget = trace_out_stats.budget;
+    s->stalls = cdc_stall[ITF_TRACE].count;
+    s->stall_us = cdc_stall[ITF_TRACE].us;
+}
+
+// start counting from 0, also for the high water marks
+void trace_stats_reset()
+{
+    trace_stats_get(&trace_stats_base);
+    trace_stats_last = trace_stats_base;
+    trace_ring_stats.max_fill = 0;
+    cdc_stall[ITF_TRACE].max_us = 0;
+}
+
+// show the counters since the last reset
+void trace_stats_show()
+{
+    struct TraceStats s;
+    const struct TraceStats *b = &trace_stats_base;
+
+    trace_stats_get(&s);
+    uint32_t ms = (s.time - b->time) / 1000;
+    uint32_t produced = s.produced - b->produced;
+    uint32_t dropped = s.dropped - b->dropped;
+    uint32_t read = s.read - b->read;
+    uint32_t bytes = s.bytes - b->bytes;
+    uint32_t fill = trace_ring.head - trace_ring.tail;
+
+    cli_printf("  tracer stats, last %d.%01d s", ms / 1000, (ms % 1000) / 100);
+    cli_printf("  core1   produced    %10d cycles", produced);
+    cli_printf("          filtered    %10d blocked by the trace filter", s.filtered - b->filtered);
+    cli_printf("          enqueued    %10d records", s.enqueued - b->enqueued);
+    cli_printf("          dropped     %10d records, %d.%02d%% (TraceBuffer full)", dropped,
+                (produced > 0) ? (uint32_t)((uint64_t)dropped * 100 / produced) : 0,
+                (produced > 0) ? (uint32_t)((uint64_t)dropped * 10000 / produced % 100) : 0);
+    cli_printf("  buffer  high water  %10d words, %d%% of %d, now %d words", trace_ring_stats.max_fill,
+                (int)((uint64_t)trace_ring_stats.max_fill * 100 / (trace_ring.mask + 1)), trace_ring.mask + 1, fill);
+    cli_printf("  core0   read        %10d records", read);
+    cli_printf("          rendered    %10d records, %d not traced (tracer disabled or triggers)",
+                s.traced - b->traced, read - (s.traced - b->traced));
+    cli_printf("          out of time %10d calls of Trace_task()", s.budget - b->budget);
+    cli_printf("  port    staged      %10d lines or binary records", s.lines - b->lines);
+    cli_printf("          sent        %10d bytes, %d bytes/s", bytes, (ms > 0) ? (uint32_t)((uint64_t)bytes * 1000 / ms) : 0);
+    cli_printf("          not sent    %10d bytes (no host)", s.unsent - b->unsent);
+    cli_printf("          USB stalls  %10d, %d ms total, longest %d us", s.stalls - b->stalls,
+                (uint32_t)((s.stall_us - b->stall_us) / 1000), cdc_stall[ITF_TRACE].max_us);
+    if (trace_snap.state != SNAP_OFF) cli_printf("  snapshot capture is active, core0 does not read the TraceBuffer");
+    if (trace_prof.state != PROF_OFF) cli_printf("  profiler is active, nothing is traced");
+}
+
+// a status line on the console every secs seconds, 0 to stop
+void trace_stats_period(int secs)
+{
+    trace_stats_secs = secs;
+    trace_stats_get(&trace_stats_last);
+    trace_stats_next = trace_stats_last.time + (uint64_t)secs * 1000000;
+}
+
+// the periodic status line with the counts since the previous line, checked once per second
+static void trace_stats_tick(uint64_t now)
+{
+    struct TraceStats s;
+    const struct TraceStats *l = &trace_stats_last;
+
+    if ((trace_stats_secs == 0) || (now < trace_stats_next)) return;
+    trace_stats_get(&s);
+    cli_printf("  trace: %d cycles, %d filtered, %d dropped, %d rendered, %d bytes, fill %d%%, %d stalls %d us",
+                s.produced - l->produced, s.filtered - l->filtered, s.dropped - l->dropped, s.traced - l->traced,
+                s.bytes - l->bytes, (int)((uint64_t)(trace_ring.head - trace_ring.tail) * 100 / (trace_ring.mask + 1)),
+                s.stalls - l->stalls, (uint32_t)(s.stall_us - l->stall_us));
+    trace_stats_last = s;
+    trace_stats_next = now + (uint64_t)trace_stats_secs * 1000000;
+}
+
+// send the staged output when it has waited long enough, and update the rates once per second
+static void trace_out_check()
+{
+    uint64_t now = time_us_64();
+
+    if ((trace_out_len > 0) && (now - trace_out_first >= TRACE_OUT_TIMEOUT)) trace_out_flush(true);
+
+    if (now - trace_rate_start >= 1000000) {
+        uint32_t secs = (now - trace_rate_start) / 1000000;
+        trace_out_stats.lines_s = (trace_out_stats.lines - trace_rate_lines) / secs;
+        trace_out_stats.bytes_s = (trace_out_stats.bytes - trace_rate_bytes) / secs;
+        trace_rate_lines = trace_out_stats.lines;
+        trace_rate_bytes = trace_out_stats.bytes;
+        trace_rate_start = now;
+        trace_stats_tick(now);
+    }
+}
+
+
+// binary trace stream, the record format is described in tbin.h
+
+struct TBinStats tbin_stats;                // binary stream counters
+static struct TLine tbin_ref;               // last record sent, the reference for the next one
+static int tbin_since_key = TBIN_KEY_INTERVAL;  // records since the last key record, start with a key
+
+// add a sample to the binary stream, encoded straight into the staging buffer
+static void tbin_add(const struct TLine *s)
+{
+    bool key = (tbin_since_key >= TBIN_KEY_INTERVAL);
+    int n;
+
+    if (trace_out_len > TRACE_OUT_SIZE - TBIN_MAXREC) trace_out_flush(false);
+    n = tbin_encode(trace_out + trace_out_len, s, &tbin_ref, key);
+    trace_out_len += n;
+    trace_out_stats.lines++;
+
+    tbin_ref = *s;
+    tbin_since_key = key ? 1 : tbin_since_key + 1;
+    tbin_stats.records++;
+    tbin_stats.bytes += n;
+    if (key) tbin_stats.keys++;
+}
+
+// restart the binary stream with a key record, when the mode changes or a host connects
+// staged output was meant for the previous host or mode and is discarded
+void tbin_restart()
+{
+    trace_out_len = 0;
+    tbin_since_key = TBIN_KEY_INTERVAL;
+}
+
+// encode the samples in the replay capture and decode them again, compares all fields
+void tbin_selftest()
+{
+    static uint8_t buf[TBIN_MAXREC];
+    struct TLine ref, dec, dref;
+    uint32_t bytes = 0;
+    int errors = 0;
+
+    if (replay_count == 0) {
+        cli_printf("  no samples, capture some first with tracer replay capture");
+        return;
+    }
+    memset(&ref, 0, sizeof(ref));
+    memset(&dref, 0, sizeof(dref));
+    for (int k = 0; k < replay_count; k++) {
+        const struct TLine *s = &replay_lines[k];
+        int n = tbin_encode(buf, s, &ref, (k % TBIN_KEY_INTERVAL) == 0);
+        int m = tbin_decode(buf, n, &dec, &dref);
+        ref = *s;
+        bytes += n;
+        if ((m != n) || (dec.skipped != s->skipped) ||
+            (dec.cycle_number != s->cycle_number) || (dec.isa_address != s->isa_address) ||
+            (dec.isa_instruction != s->isa_instruction) || (dec.bank != s->bank) ||
+            (dec.data1 != s->data1) || (dec.data2 != s->data2) || (dec.fi1 != s->fi1) || (dec.fi2 != s->fi2) ||
+            (dec.xq_instr != s->xq_instr) || (dec.xq_carry != s->xq_carry) || (dec.ramslct != s->ramslct) ||
+            (dec.frame_in != s->frame_in) || (dec.frame_out != s->frame_out) ||
+            (memcmp(dec.HPILregs, s->HPILregs, sizeof(s->HPILregs)) != 0)) {
+            if (errors++ < 4) {
+                cli_printf("  sample %d cycle %d: encoded %d bytes, decoded %d, fields differ", k, s->cycle_number, n, m);
+            }
+            dref = *s;
+        }
+    }
+    cli_printf("  binary trace self test: %d samples, %d bytes, %.2f bytes/sample, %d errors",
+                replay_count, bytes, (float)bytes / replay_count, errors);
+}
+
+// trace capture to a file on the uSD card
+// the records are the binary trace stream as described in tracer.h, starting with a key record
+// records are encoded in one of two buffers, a full buffer is written by Trace_task() outside the
+// sample loop while the other one is being filled
+// the buffers are a multiple of the cluster size or the other way around, so every write starts on a
+// cluster boundary and FatFS transfers the sectors directly from the buffer
+// a record that does not fit in a buffer continues in the next one, the file is the plain stream
+// records are dropped when both buffers are waiting for the uSD card, the next record is then a key record
+// the buffers are in the upper half of the TraceBuffer, it is lent for the time of the capture
+
+static uint8_t (*const trace_sd_buf)[TRACE_SD_BUFSIZE] = TRACE_LENT->sd_buf;
+static int trace_sd_cur;                    // buffer being filled
+static int trace_sd_len;                    // bytes in the buffer being filled
+static bool trace_sd_full[2];               // buffer waiting to be written
+static bool trace_sd_resync;                // records were dropped
+static FIL trace_sd_fil;
+static struct TLine trace_sd_ref;           // reference for the next record
+static int trace_sd_since_key;
+struct TraceSDStats trace_sd_stats;
+bool trace_sd_active = false;
+
+// add a sample to the file buffers
+static void trace_sd_add(const struct TLine *s)
+{
+    uint8_t rec[TBIN_MAXREC];
+    bool key = trace_sd_resync || (trace_sd_since_key >= TBIN_KEY_INTERVAL);
+    int room = TRACE_SD_BUFSIZE - trace_sd_len;
+    int n, n1;
+
+    if (trace_sd_full[trace_sd_cur] || ((room < TBIN_MAXREC) && trace_sd_full[trace_sd_cur ^ 1])) {
+        // no room, both buffers are waiting for the uSD card
+        trace_sd_stats.dropped++;
+        trace_sd_resync = true;
+        return;
+    }
+
+    n = tbin_encode(rec, s, &trace_sd_ref, key);
+    trace_sd_ref = *s;
+    trace_sd_since_key = key ? 1 : trace_sd_since_key + 1;
+    trace_sd_resync = false;
+    trace_sd_stats.records++;
+
+    n1 = (n > room) ? room : n;
+    memcpy(trace_sd_buf[trace_sd_cur] + trace_sd_len, rec, n1);
+    trace_sd_len += n1;
+    if (trace_sd_len == TRACE_SD_BUFSIZE) {
+        // buffer complete, the rest of the record goes in the other one
+        trace_sd_full[trace_sd_cur] = true;
+        trace_sd_cur ^= 1;
+        memcpy(trace_sd_buf[trace_sd_cur], rec + n1, n - n1);
+        trace_sd_len = n - n1;
+    }
+}
+
+// the full buffer that is to be written first, -1 if none
+static int trace_sd_next()
+{
+    if (trace_sd_full[trace_sd_cur]) return trace_sd_cur;       // both are full, filling stopped here
+    if (trace_sd_full[trace_sd_cur ^ 1]) return trace_sd_cur ^ 1;
+    return -1;
+}
+
+// write one full buffer to the file, called from Trace_task()
+static void trace_sd_write(int b)
+{
+    UINT bw;
+    uint64_t start = time_us_64();
+    FRESULT fr = f_write(&trace_sd_fil, trace_sd_buf[b], TRACE_SD_BUFSIZE, &bw);
+    uint32_t us = time_us_64() - start;
+
+    trace_sd_full[b] = false;
+    trace_sd_stats.write_us += us;
+    if (us > trace_sd_stats.max_us) trace_sd_stats.max_us = us;
+    trace_sd_stats.bytes += bw;
+    trace_sd_stats.writes++;
+    if ((FR_OK != fr) || (bw != TRACE_SD_BUFSIZE)) {
+        cli_printf("  tracer sd: write error %s (%d), capture stopped", FRESULT_str(fr), fr);
+        trace_sd_stop();
+        return;
+    }
+    if ((trace_sd_stats.writes % TRACE_SD_SYNC) == 0) f_sync(&trace_sd_fil);   // limit the loss when the power fails
+}
+
+// start the capture to a new file
+void trace_sd_start(const char *fname)
+{
+    if (trace_sd_active) {
+        cli_printf("  tracer sd: capture already running, use tracer sd stop first");
+        return;
+    }
+    if (!sd_mount_s()) return;
+
+    FRESULT fr = f_open(&trace_sd_fil, fname, FA_WRITE | FA_CREATE_ALWAYS);
+    if (FR_OK != fr) {
+        cli_printf("  tracer sd: cannot create file %s: %s (%d)", fname, FRESULT_str(fr), fr);
+        return;
+    }
+
+    trace_ring_lend();
+    memset(&trace_sd_stats, 0, sizeof(trace_sd_stats));
+    strncpy(trace_sd_stats.fname, fname, sizeof(trace_sd_stats.fname) - 1);
+    trace_sd_cur = 0;
+    trace_sd_len = 0;
+    trace_sd_full[0] = false;
+    trace_sd_full[1] = false;
+    trace_sd_resync = false;
+    trace_sd_since_key = TBIN_KEY_INTERVAL;
+    trace_sd_stats.start = time_us_64();
+    trace_sd_active = true;
+    cli_printf("  tracer sd: capture to %s started, %d KByte buffers", fname, TRACE_SD_BUFSIZE / 1024);
+}
+
+// stop the capture, writes what is left and closes the file
+void trace_sd_stop()
+{
+    UINT bw;
+
+    if (!trace_sd_active) return;
+    trace_sd_active = false;
+    for (int b = trace_sd_next(); b >= 0; b = trace_sd_next()) {
+        f_write(&trace_sd_fil, trace_sd_buf[b], TRACE_SD_BUFSIZE, &bw);
+        trace_sd_stats.bytes += bw;
+        trace_sd_full[b] = false;
+    }
+    if (trace_sd_len > 0) {
+        f_write(&trace_sd_fil, trace_sd_buf[trace_sd_cur], trace_sd_len, &bw);
+        trace_sd_stats.bytes += bw;
+        trace_sd_len = 0;
+    }
+    trace_sd_stats.stop = time_us_64();
+    f_close(&trace_sd_fil);
+    trace_ring_return();
+    trace_sd_status();
+}
+
+// show the progress or the result of the last capture
+void trace_sd_status()
+{
+    if (trace_sd_stats.start == 0) {
+        cli_printf("  tracer sd: no capture, use tracer sd [file]");
+        return;
+    }
+    uint64_t end = trace_sd_active ? time_us_64() : trace_sd_stats.stop;
+    uint32_t secs = (end - trace_sd_stats.start) / 1000000;
+
+    cli_printf("  tracer sd: %s %s, %d s", trace_sd_active ? "capturing to" : "captured in", trace_sd_stats.fname, secs);
+    cli_printf("  records             %d, %d bytes written, %d records dropped",
+                trace_sd_stats.records, trace_sd_stats.bytes, trace_sd_stats.dropped);
+    if (trace_sd_stats.writes > 0) {
+        cli_printf("  uSD writes          %d of %d KByte, %d KByte/s while writing, max %d ms for one write",
+                    trace_sd_stats.writes, TRACE_SD_BUFSIZE / 1024,
+                    (uint32_t)((uint64_t)trace_sd_stats.writes * TRACE_SD_BUFSIZE * 1000 / 1024 / (trace_sd_stats.write_us + 1)),
+                    trace_sd_stats.max_us / 1000);
+    }
+    if (secs > 0) {
+        cli_printf("  average             %d records/s, %d bytes/s", trace_sd_stats.records / secs, trace_sd_stats.bytes / secs);
+    }
+    cli_printf("  TraceBuffer         %d records dropped by core1", trace_ring.dropped);
+}
+
+
+// snapshot capture, the TraceBuffer is used as a logic analyser memory
+// core1 keeps writing and removes the oldest records when there is no room, core0 does not read
+// the capture freezes on the trigger after the post trigger records, or with tracer snap stop
+// a dump reads the records again without removing them
+
+struct TraceSnap trace_snap;
+
+// the first complete record in the snapshot, the records before it have no reference
+static uint32_t trace_snap_first()
+{
+    uint32_t t = trace_ring.tail;
+    while (t != trace_ring.head) {
+        uint32_t flags = trace_ring.buf[(t + 2) & trace_ring.mask] >> 24;
+        if ((flags & TREC_COMPLETE) == TREC_COMPLETE) break;
+        t += trec_len(flags);
+    }
+    return t;
+}
+
+// start a capture, trig is SNAP_TRIG_xx
+void trace_snap_start(int trig, uint32_t value, uint32_t post)
+{
+    if (trace_prof.state != PROF_OFF) trace_prof_off();
+    if (trace_snap.state != SNAP_OFF) trace_snap_off();
+    memset(&trace_snap, 0, sizeof(trace_snap));
+    trace_snap.trig = trig;
+    trace_snap.value = value;
+    trace_snap.post = (post > TRACE_SNAP_POST_MAX) ? TRACE_SNAP_POST_MAX : post;
+    trace_ring.tail = trace_ring.head;          // live samples that were not read are discarded
+    __dmb();
+    trace_snap.state = SNAP_RUN;                // core1 takes over the TraceBuffer
+}
+
+// freeze the capture now
+void trace_snap_freeze()
+{
+    if ((trace_snap.state == SNAP_RUN) || (trace_snap.state == SNAP_POST)) {
+        trace_snap.state = SNAP_FROZEN;
+        busy_wait_us(100);                      // let core1 finish a record it was writing
+    }
+}
+
+// leave the snapshot mode and continue live tracing
+void trace_snap_off()
+{
+    if (trace_snap.state == SNAP_OFF) return;   // core0 owns the TraceBuffer only when core1 is frozen
+    trace_snap_freeze();
+    trace_ring.tail = trace_ring.head;
+    trace_wkey = true;                          // core0 needs a complete record to continue
+    __dmb();
+    trace_snap.state = SNAP_OFF;
+}
+
+// show the state of the capture
+void trace_snap_status()
+{
+    static const char *states[] = {"off", "capturing, trigger armed", "triggered, capturing post trigger records", "frozen"};
+    static const char *trigs[] = {"none", "address", "instruction", "HP-IL frame"};
+    uint32_t n = 0, before = 0;
+
+    cli_printf("  snapshot            %s", states[trace_snap.state]);
+    if (trace_snap.state == SNAP_OFF) return;
+    cli_printf("  trigger             %s %03X, %d records after the trigger", trigs[trace_snap.trig], trace_snap.value, trace_snap.post);
+    if (trace_snap.state != SNAP_FROZEN) {
+        cli_printf("  records             %d written, %d KByte", trace_snap.records, (trace_ring.mask + 1) * 4 / 1024);
+        return;
+    }
+
+    // count the records that can be dumped
+    for (uint32_t t = trace_snap_first(); t != trace_ring.head; n++) {
+        if (t == trace_snap.trig_pos) before = n;
+        t += trec_len(trace_ring.buf[(t + 2) & trace_ring.mask] >> 24);
+    }
+    cli_printf("  records             %d written, %d in the snapshot (%d bytes/record)", trace_snap.records, n,
+                (n > 0) ? (trace_ring.head - trace_snap_first()) * 4 / n : 0);
+    if (trace_snap.triggered) {
+        cli_printf("  trigger at cycle    %d, %d records before and %d after", trace_snap.trig_cycle, before, n - before - 1);
+    }
+}
+
+// dump the frozen snapshot as text on the tracer port, the trigger record is marked with T
+void trace_snap_dump()
+{
+    uint32_t t0 = trace_ring.tail;
+    uint32_t pos, n = 0;
+
+    if (trace_snap.state != SNAP_FROZEN) {
+        cli_printf("  tracer snap: the snapshot is not frozen, use tracer snap stop first");
+        return;
+    }
+    if (!cdc_connected(ITF_TRACE)) {
+        cli_printf("  tracer snap: the tracer port is not connected");
+        return;
+    }
+
+    trace_out_flush(false);
+    trace_fmt_update();
+    trace_ring.tail = trace_snap_first();
+    while (pos = trace_ring.tail, trace_get(&TraceSample)) {
+        bool trig = trace_snap.triggered && (pos == trace_snap.trig_pos);
+        trace_format(&TraceSample, trig ? 'T' : ' ');
+        trace_out_put(TracePrint, TracePrintLen);
+        n++;
+    }
+    trace_out_flush(false);
+    trace_ring.tail = t0;                       // the snapshot is kept for another dump
+    cli_printf("  tracer snap: %d records sent to the tracer port", n);
+}
+
+// dump the frozen snapshot to a file on the uSD card in the binary trace format
+// the snapshot may fill the whole TraceBuffer, the records are encoded in a small buffer of their own
+void trace_snap_sd(const char *fname)
+{
+    static uint8_t buf[TRACE_SNAP_SDBUF] __attribute__((aligned(4)));
+    uint32_t t0 = trace_ring.tail;
+    struct TLine ref;
+    int len = 0;
+    uint32_t n = 0, bytes = 0;
+    UINT bw;
+
+    if (trace_snap.state != SNAP_FROZEN) {
+        cli_printf("  tracer snap: the snapshot is not frozen, use tracer snap stop first");
+        return;
+    }
+    if (trace_sd_active) {
+        cli_printf("  tracer snap: tracer sd capture is running, use tracer sd stop first");
+        return;
+    }
+    if (!sd_mount_s()) return;
+
+    FIL fil;
+    FRESULT fr = f_open(&fil, fname, FA_WRITE | FA_CREATE_ALWAYS);
+    if (FR_OK != fr) {
+        cli_printf("  tracer snap: cannot create file %s: %s (%d)", fname, FRESULT_str(fr), fr);
+        return;
+    }
+
+    uint64_t start = time_us_64();
+    memset(&ref, 0, sizeof(ref));
+    trace_ring.tail = trace_snap_first();
+    while (trace_get(&TraceSample)) {
+        len += tbin_encode(buf + len, &TraceSample, &ref, (n % TBIN_KEY_INTERVAL) == 0);
+        ref = TraceSample;
+        n++;
+        if (len > TRACE_SNAP_SDBUF - TBIN_MAXREC) {
+            fr = f_write(&fil, buf, len, &bw);
+            bytes += bw;
+            len = 0;
+            if (FR_OK != fr) break;
+        }
+    }
+    if ((FR_OK == fr) && (len > 0)) {
+        fr = f_write(&fil, buf, len, &bw);
+        bytes += bw;
+    }
+    f_close(&fil);
+    trace_ring.tail = t0;
+    uint32_t us = time_us_64() - start;
+
+    if (FR_OK != fr) {
+        cli_printf("  tracer snap: write error %s (%d)", FRESULT_str(fr), fr);
+    }
+    cli_printf("  tracer snap: %d records, %d bytes in %s, %d ms", n, bytes, fname, us / 1000);
+}
+
+
+// profiler, counts the fetches of every address in core1 without tracing them
+// the TraceBuffer is used as 65536 counters of 16 bits, one for each ISA address, so live tracing stops
+// a counter stops at PROF_SAT, a one instruction loop gets there in about 10 s, the report marks these addresses
+// the profiler needs the whole TraceBuffer, a uSD capture is stopped and a replay capture is discarded
+// Banks of a Page share the address counters, the totals for each Page and Bank are kept apart
+// the tracer filters still apply, a pass filter limits the profile to a range
+
+static_assert(sizeof(trace_ring.buf) >= 0x10000 * sizeof(uint16_t), "the profiler needs a counter for every address");
+
+struct TraceProf trace_prof;
+
+// start a new profile, all counters are cleared
+void trace_prof_start()
+{
+    if (trace_snap.state != SNAP_OFF) trace_snap_off();
+    if (trace_sd_active) trace_sd_stop();
+    if (replay_armed || (replay_count > 0)) {
+        cli_printf("  replay capture discarded, the profiler needs the whole TraceBuffer");
+        replay_count = 0;
+        replay_armed = false;
+        trace_filter_build();                   // block cycles again as set
+    }
+    trace_prof.state = PROF_STOP;               // core1 stops writing in the TraceBuffer
+    busy_wait_us(100);
+    trace_ring.mask = TRACE_RING_MASK;
+    memset(trace_ring.buf, 0, sizeof(trace_ring.buf));
+    memset(trace_prof.bank, 0, sizeof(trace_prof.bank));
+    trace_prof.start = time_us_64();
+    __dmb();
+    trace_prof.state = PROF_RUN;
+}
+
+// stop counting, the results are kept
+void trace_prof_stop()
+{
+    if (trace_prof.state != PROF_RUN) return;
+    trace_prof.state = PROF_STOP;
+    trace_prof.stop = time_us_64();
+}
+
+// back to live tracing, the results are gone
+void trace_prof_off()
+{
+    if (trace_prof.state == PROF_OFF) return;
+    trace_prof_stop();
+    busy_wait_us(100);
+    trace_ring.head = 0;
+    trace_ring.tail = 0;
+    trace_wkey = true;
+    __dmb();
+    trace_prof.state = PROF_OFF;
+}
+
+// change the size of the TraceBuffer for live tracing and the snapshot
+// core1 is held off like in trace_prof_start() while the mask changes, the samples that were not read are lost
+static void trace_ring_resize(uint32_t words)
+{
+    if (trace_ring.mask == words - 1) return;
+    if (trace_snap.state != SNAP_OFF) trace_snap_off();
+    trace_prof.state = PROF_STOP;               // core1 stops writing in the TraceBuffer
+    busy_wait_us(100);
+    trace_ring.mask = words - 1;
+    trace_ring.tail = trace_ring.head;
+    trace_wkey = true;                          // core0 needs a complete record to continue
+    __dmb();
+    trace_prof.state = PROF_OFF;
+}
+
+// lend the upper half of the TraceBuffer to the uSD capture or the replay capture, a profile is stopped
+void trace_ring_lend()
+{
+    if (trace_prof.state != PROF_OFF) trace_prof_off();
+    trace_ring_resize(TRACE_RING_WORDS / 2);
+}
+
+// give the upper half back to live tracing when nothing uses it anymore
+void trace_ring_return()
+{
+    if (trace_sd_active || replay_armed || (replay_count > 0) || (trace_prof.state != PROF_OFF)) return;
+    trace_ring_resize(TRACE_RING_WORDS);
+}
+
+// the Bank with the most fetches in a Page, used to resolve the addresses in that Page
+static int prof_bank(int page, bool *mixed)
+{
+    int best = 1, used = 0;
+
+    for (int b = 1; b <= 4; b++) {
+        if (trace_prof.bank[page][b] != 0) used++;
+        if (trace_prof.bank[page][b] > trace_prof.bank[page][best]) best = b;
+    }
+    if (mixed != NULL) *mixed = (used > 1);
+    return best;
+}
+
+// the FAT entries of a Page, loaded once for looking up many addresses
+struct ProfFAT {
+    int         fc;                     // number of functions, 0 if there is no FAT
+    uint16_t    entry[FAT_MAX];
+};
+
+static void prof_fat_load(struct ProfFAT *fat, int page, int bank)
+{
+    bool focal;
+
+    fat->fc = TULIP_Pages.getFATcount(page, bank);
+    for (int n = 1; n < fat->fc; n++) fat->entry[n] = TULIP_Pages.getFATentry(page, bank, n, &focal);
+}
+
+// the function that contains offset offs in the Page, -1 if there is no FAT or offs is before the first entry
+static int prof_fat_find(const struct ProfFAT *fat, uint16_t offs, uint16_t *entry)
+{
+    int found = -1;
+
+    *entry = 0;
+    for (int n = 1; n < fat->fc; n++) {
+        if ((fat->entry[n] <= offs) && ((found < 0) || (fat->entry[n] > *entry))) {
+            found = n;
+            *entry = fat->entry[n];
+        }
+    }
+    return found;
+}
+
+// the address with the function name and the offset from the entry, or only the address
+static void prof_symbol(uint16_t adr, int bank, char *out)
+{
+    static struct ProfFAT fat;
+    char name[FAT_NAME_LEN + 1];
+    uint16_t entry;
+    int n;
+
+    prof_fat_load(&fat, adr >> 12, bank);
+    n = prof_fat_find(&fat, adr & PAGE_MASK, &entry);
+    if (n < 0) {
+        sprintf(out, "%04X", adr);
+        return;
+    }
+    TULIP_Pages.getFATname(adr >> 12, bank, n, name);
+    sprintf(out, "%04X  %s+%03X", adr, name, (adr & PAGE_MASK) - entry);
+}
+
+// keep the n highest values in top[], v[] and k[] sorted from high to low
+static void prof_top(uint32_t *v, uint32_t *k, int n, uint32_t value, uint32_t key)
+{
+    if (value <= v[n - 1]) return;
+    int i = n - 1;
+    while ((i > 0) && (v[i - 1] < value)) {
+        v[i] = v[i - 1];
+        k[i] = k[i - 1];
+        i--;
+    }
+    v[i] = value;
+    k[i] = key;
+}
+
+// report the hottest addresses, 256 word blocks and functions, and the totals for each Page and Bank
+void trace_prof_report(int n)
+{
+    static uint32_t v[PROF_TOP_MAX], k[PROF_TOP_MAX];
+    const uint16_t *cnt = (const uint16_t *)trace_ring.buf;
+    char sym[40];
+    uint64_t total = 0;
+
+    if (trace_prof.state == PROF_OFF) {
+        cli_printf("  profiler is off, start it with tracer prof start");
+        return;
+    }
+    if ((n <= 0) || (n > PROF_TOP_MAX)) n = PROF_TOP;
+
+    uint64_t end = (trace_prof.state == PROF_RUN) ? time_us_64() : trace_prof.stop;
+    for (int p = 0; p < 16; p++) {
+        for (int b = 1; b <= 4; b++) total += trace_prof.bank[p][b];
+    }
+    cli_printf("  profiler %s, %d s, %llu fetches", (trace_prof.state == PROF_RUN) ? "running" : "stopped",
+                (uint32_t)((end - trace_prof.start) / 1000000), total);
+    if (total == 0) return;
+
+    // Pages and Banks
+    cli_printf("  Page Bank  fetches      %%   module");
+    for (int p = 0; p < 16; p++) {
+        for (int b = 1; b <= 4; b++) {
+            if (trace_prof.bank[p][b] == 0) continue;
+            char fname[33];
+            TULIP_Pages.getFileName(p, b, fname);
+            fname[32] = 0;
+            cli_printf("    %X    %d  %10d  %5.1f  %s", p, b, trace_prof.bank[p][b],
+                        100.0 * trace_prof.bank[p][b] / total, TULIP_Pages.isPlugged(p, b) ? fname : "");
+        }
+    }
+
+    // addresses
+    uint32_t sat = 0;
+    memset(v, 0, sizeof(v));
+    for (uint32_t a = 0; a < 0x10000; a++) {
+        if (cnt[a] != 0) prof_top(v, k, n, cnt[a], a);
+        if (cnt[a] == PROF_SAT) sat++;
+    }
+    cli_printf("  top %d addresses", n);
+    for (int i = 0; (i < n) && (v[i] != 0); i++) {
+        bool mixed;
+        int bank = prof_bank(k[i] >> 12, &mixed);
+        prof_symbol(k[i], bank, sym);
+        cli_printf("  %10d  %5.1f  %s%s%s", v[i], 100.0 * v[i] / total, sym, mixed ? "  (Banks mixed)" : "",
+                    (v[i] == PROF_SAT) ? "  (saturated)" : "");
+    }
+    if (sat > 0) {
+        cli_printf("  %d addresses reached %d fetches and stopped counting, the ranges and functions are too low", sat, PROF_SAT);
+    }
+
+    // 256 word blocks
+    memset(v, 0, sizeof(v));
+    for (uint32_t blk = 0; blk < 0x100; blk++) {
+        uint32_t sum = 0;
+        for (uint32_t a = blk << 8; a < ((blk + 1) << 8); a++) sum += cnt[a];
+        if (sum != 0) prof_top(v, k, n, sum, blk);
+    }
+    cli_printf("  top %d ranges", n);
+    for (int i = 0; (i < n) && (v[i] != 0); i++) {
+        cli_printf("  %10d  %5.1f  %04X-%04X", v[i], 100.0 * v[i] / total, k[i] << 8, (k[i] << 8) + 0xFF);
+    }
+
+    // functions in the FAT of each plugged module
+    memset(v, 0, sizeof(v));
+    for (int p = 3; p < 16; p++) {
+        static struct ProfFAT fat;
+        static uint32_t fsum[FAT_MAX];
+        int bank = prof_bank(p, NULL);
+        prof_fat_load(&fat, p, bank);
+        if (fat.fc == 0) continue;
+        memset(fsum, 0, sizeof(fsum));
+        for (uint32_t a = p << 12; a < ((p + 1) << 12); a++) {
+            uint16_t entry;
+            int f;
+            if (cnt[a] == 0) continue;
+            f = prof_fat_find(&fat, a & PAGE_MASK, &entry);
+            if (f > 0) fsum[f] += cnt[a];
+        }
+        for (int f = 1; f < fat.fc; f++) {
+            if (fsum[f] != 0) prof_top(v, k, n, fsum[f], (p << 12) | (bank << 8) | f);
+        }
+    }
+    if (v[0] != 0) {
+        cli_printf("  top %d functions", n);
+        for (int i = 0; (i < n) && (v[i] != 0); i++) {
+            char name[FAT_NAME_LEN + 1];
+            TULIP_Pages.getFATname(k[i] >> 12, (k[i] >> 8) & 0x0F, k[i] & 0xFF, name);
+            cli_printf("  %10d  %5.1f  Page %X Bank %d  %s", v[i], 100.0 * v[i] / total, k[i] >> 12, (k[i] >> 8) & 0x0F, name);
+        }
+    }
+}
+
+// write all counted addresses to a CSV file on the uSD card
+void trace_prof_csv(const char *fname)
+{
+    const uint16_t *cnt = (const uint16_t *)trace_ring.buf;
+    char sym[40];
+    uint32_t lines = 0;
+    FIL fil;
+
+    if (trace_prof.state == PROF_OFF) {
+        cli_printf("  profiler is off, start it with tracer prof start");
+        return;
+    }
+    if (!sd_mount_s()) return;
+    FRESULT fr = f_open(&fil, fname, FA_WRITE | FA_CREATE_ALWAYS);
+    if (FR_OK != fr) {
+        cli_printf("  tracer prof: cannot create file %s: %s (%d)", fname, FRESULT_str(fr), fr);
+        return;
+    }
+
+    f_printf(&fil, "address,page,bank,fetches,function,offset\n");
+    for (int p = 0; p < 16; p++) {
+        static struct ProfFAT fat;
+        int bank = prof_bank(p, NULL);
+        prof_fat_load(&fat, p, bank);
+        for (uint32_t a = p << 12; a < ((p + 1) << 12); a++) {
+            uint16_t entry;
+            int f;
+            if (cnt[a] == 0) continue;
+            f = prof_fat_find(&fat, a & PAGE_MASK, &entry);
+            if (f > 0) {
+                TULIP_Pages.getFATname(p, bank, f, sym);
+                f_printf(&fil, "%04X,%X,%d,%u,%s,%u\n", a, p, bank, cnt[a], sym, (a & PAGE_MASK) - entry);
+            } else {
+                f_printf(&fil, "%04X,%X,%d,%u,,\n", a, p, bank, cnt[a]);
+            }
+            lines++;
+        }
+        tud_task();                             // keep the USB ports alive
+    }
+    fr = f_close(&fil);
+    if (FR_OK != fr) {
+        cli_printf("  tracer prof: write error %s (%d)", FRESULT_str(fr), fr);
+        return;
+    }
+    cli_printf("  tracer prof: %d addresses written to %s", lines, fname);
+}
+
+
+
+// send sample s as a text line or binary record
+// samples held back by the trigger engine are added to the skipped cycles of the next one
+static void trace_emit(const struct TLine *s, char marker)
+{
+    const struct TLine *out = s;
+    static struct TLine line;
+
+    if (trig_dropped != 0) {
+        line = *s;
+        line.skipped = ((uint32_t)s->skipped + trig_dropped > 0xFFFF) ? 0xFFFF : s->skipped + trig_dropped;
+        trig_dropped = 0;
+        out = &line;
+    }
+    trace_ring_stats.traced++;
+
+    if (trace_sd_active) {
+        // the capture to the uSD card replaces the output on the tracer port
+        trace_sd_add(out);
+        return;
+    }
+
+    if (globsetting.get(tracer_binary)) {
+        tbin_add(out);
+        return;
+    }
+
+    trace_format(out, marker);
+    trace_out_put(TracePrint, TracePrintLen);
+    trace_out_stats.lines++;
+}
+
+
+// trace filter, one bit per address, checked by core1 before a TraceLine is queued
+// a bit set means the address is blocked, trace_filter[table][block] has the 16 addresses of a block
+uint16_t trace_filter[TRACE_FILTER_TABLES][256];
+uint8_t trace_filter_map[4][16];            // table for each bank and Page
+uint32_t trace_filter_full = 0;             // bank qualified filters that did not get a table
+static int trace_filter_tables;             // tables in use
+
+class Tracer tracesetting;                  // block, pass and trigger filters
+
+// known system loops that can be blocked
+static const uint16_t __in_flash() trace_sysloops[][2] = {
+    {0x0098, 0x00A1},           // RSTKB and RST05
+    {0x0177, 0x0178},           // delay for debounce
+    {0x089C, 0x089D},           // BLINK01
+    {0x0E9A, 0x0E9E},           // NLT10 wait for key to NULL
+    {0x0EC9, 0x0ECE},           // NULTST NULL timer
+};
+
+// block (blk true) or pass the addresses lo..hi in the tables for bank, 0 is any bank
+static void trace_filter_range(uint16_t lo, uint16_t hi, uint8_t bank, bool blk)
+{
+    for (uint32_t adr = lo; adr <= hi; adr++) {
+        uint16_t bit = 1 << (adr & 0x0F);
+        for (int b = 0; b < 4; b++) {
+            if ((bank != 0) && (b != bank - 1)) continue;
+            uint16_t *t = &trace_filter[trace_filter_map[b][adr >> 12]][(adr >> 4) & 0xFF];
+            if (blk) {
+                *t |= bit;
+            } else {
+                *t &= ~bit;
+            }
+        }
+    }
+}
+
+// give the Pages of lo..hi their own table for bank, returns false if there are not enough tables
+static bool trace_filter_split(uint16_t lo, uint16_t hi, uint8_t bank)
+{
+    for (int pg = lo >> 12; pg <= (hi >> 12); pg++) {
+        if (trace_filter_map[bank - 1][pg] != pg) continue;         // already split
+        if (trace_filter_tables == TRACE_FILTER_TABLES) return false;
+        trace_filter_map[bank - 1][pg] = trace_filter_tables++;
+    }
+    return true;
+}
+
+// build the trace filter from the tracer settings and filters, called by emuconfig_publish() when a setting
+// changes and after the filters are changed
+// block filters have priority over pass filters, with an active pass filter only its range is traced
+// core1 may see a partly built table for a few cycles, that only affects which cycles are traced
+// nothing is blocked during a replay capture, the replay needs consecutive cycles
+void trace_filter_build()
+{
+    const filter *f = tracesetting.filters;
+    bool pass = false;
+    bool trig = false;
+    bool ok[NUMFILTERS];
+
+    for (int b = 0; b < 4; b++) {
+        for (int pg = 0; pg < 16; pg++) trace_filter_map[b][pg] = pg;
+    }
+    trace_filter_tables = 16;
+    trace_filter_full = 0;
+
+    // bank qualified ranges first get their own tables
+    for (int i = 0; i < NUMFILTERS; i++) {
+        ok[i] = (f[i].type == filter_act_block) || (f[i].type == filter_act_pass);
+        if (ok[i] && (f[i].end_adr < f[i].start_adr)) ok[i] = false;
+        if (ok[i] && (f[i].bank >= 1) && (f[i].bank <= 4) && !trace_filter_split(f[i].start_adr, f[i].end_adr, f[i].bank)) {
+            ok[i] = false;
+            trace_filter_full++;
+        }
+        if (ok[i] && (f[i].type == filter_act_pass)) pass = true;
+        if ((f[i].type == filter_act_trig_a) || (f[i].type == filter_act_trig_c)) trig = true;
+    }
+
+    // with a pass filter everything else is blocked
+    memset(trace_filter, pass ? 0xFF : 0x00, sizeof(trace_filter));
+
+    // the trigger engine starts again
+    trig_state = trig ? TRIG_ARMED : TRIG_OFF;
+    trig_pre_first = 0;
+    trig_pre_n = 0;
+    trig_dropped = 0;
+
+    if (replay_armed) {
+        memset(trace_filter, 0, sizeof(trace_filter));
+        return;
+    }
+
+    for (int i = 0; i < NUMFILTERS; i++) {
+        if (ok[i] && (f[i].type == filter_act_pass)) trace_filter_range(f[i].start_adr, f[i].end_adr, f[i].bank, false);
+    }
+    for (int i = 0; i < NUMFILTERS; i++) {
+        if (ok[i] && (f[i].type == filter_act_block)) trace_filter_range(f[i].start_adr, f[i].end_adr, f[i].bank, true);
+    }
+
+    // SYSTEM ROM, pages 0..5
+    if (!globsetting.get(tracer_sysrom_on)) trace_filter_range(0x0000, 0x5FFF, 0, true);
+
+    // IL ROMs, pages 6, 7
+    if (!globsetting.get(tracer_ilroms_on)) trace_filter_range(0x6000, 0x7FFF, 0, true);
+
+    // block some known system loops
+    if (!globsetting.get(tracer_sysloop_on)) {
+        for (int i = 0; i < (int)(sizeof(trace_sysloops) / sizeof(trace_sysloops[0])); i++) {
+            trace_filter_range(trace_sysloops[i][0], trace_sysloops[i][1], 0, true);
+        }
+    }
+
+    // start and end addresses of the triggers, only these need a look at the trigger filters
+    memset(trig_map, 0, sizeof(trig_map));
+    for (int i = 0; i < NUMFILTERS; i++) {
+        if ((f[i].type == filter_act_trig_a) || (f[i].type == filter_act_trig_c)) {
+            trig_map[f[i].start_adr >> 5] |= 1u << (f[i].start_adr & 0x1F);
+            trig_map[f[i].end_adr >> 5] |= 1u << (f[i].end_adr & 0x1F);
+        }
+    }
+}
+
+// find the trigger with start (or end) address adr for bank, NULL if none
+static const filter *trig_find(uint16_t adr, uint8_t bnk, bool end)
+{
+    const filter *f = tracesetting.filters;
+
+    if ((trig_map[adr >> 5] & (1u << (adr & 0x1F))) == 0) return NULL;     // the usual case
+    for (int i = 0; i < NUMFILTERS; i++) {
+        if ((f[i].type != filter_act_trig_a) && (f[i].type != filter_act_trig_c)) continue;
+        if ((f[i].bank != 0) && (f[i].bank != bnk)) continue;
+        if (end ? (f[i].end_adr == adr) : (f[i].start_adr == adr)) return &f[i];
+    }
+    return NULL;
+}
+
+// trigger engine, decides if sample s is traced now
+// while armed the last pre_depth samples are kept, these are traced first when the trigger fires
+// returns false if the sample is held back or dropped
+static bool trace_trigger(const struct TLine *s, char marker)
+{
+    const filter *f;
+
+    switch (trig_state) {
+        case TRIG_ARMED:
+            f = trig_find(s->isa_address, s->bank, false);
+            if (f == NULL) {
+                // keep the sample for the pre-trigger depth
+                int depth = tracesetting.pre_depth;
+                if (depth == 0) {
+                    trig_dropped += 1 + s->skipped;
+                    return false;
+                }
+                if (trig_pre_n == depth) {
+                    // drop the oldest
+                    trig_dropped += 1 + trig_pre[trig_pre_first].skipped;
+                    trig_pre_first = (trig_pre_first + 1) % depth;
+                    trig_pre_n--;
+                }
+                int k = (trig_pre_first + trig_pre_n) % depth;
+                trig_pre[k] = *s;
+                trig_pre_marker[k] = marker;
+                trig_pre_n++;
+                return false;
+            }
+            // trigger found, trace the samples before it
+            trig_fired++;
+            trig_active = f;
+            trig_state = TRIG_ON;
+            if (!globsetting.get(tracer_binary) && cdc_connected(ITF_TRACE)) {
+                TracePrintLen = sprintf(TracePrint, "T  trigger %d at %04X, %d samples before\n\r",
+                                        (int)(f - tracesetting.filters), s->isa_address, trig_pre_n);
+                trace_out_put(TracePrint, TracePrintLen);
+            }
+            for (int n = 0; n < trig_pre_n; n++) {
+                int k = (trig_pre_first + n) % tracesetting.pre_depth;
+                trace_emit(&trig_pre[k], trig_pre_marker[k]);
+            }
+            trig_pre_n = 0;
+            trig_pre_first = 0;
+            if (f->type == filter_act_trig_c) {
+                trig_left = (f->count_adr > 1) ? f->count_adr - 1 : 0;     // this sample is the first
+                if (trig_left == 0) {
+                    trig_state = TRIG_POST;
+                    trig_left = tracesetting.post_depth;
+                }
+            } else if (s->isa_address == f->end_adr) {
+                trig_state = TRIG_POST;
+                trig_left = tracesetting.post_depth;
+            }
+            break;
+        case TRIG_ON:
+            if (trig_active->type == filter_act_trig_c) {
+                if (--trig_left == 0) {
+                    trig_state = TRIG_POST;
+                    trig_left = tracesetting.post_depth;
+                }
+            } else if (trig_find(s->isa_address, s->bank, true) == trig_active) {
+                trig_state = TRIG_POST;
+                trig_left = tracesetting.post_depth;
+            }
+            break;
+        case TRIG_POST:
+            if (trig_left == 0) {
+                // trigger complete, arm again
+                trig_state = TRIG_ARMED;
+                return trace_trigger(s, marker);
+            }
+            trig_left--;
+            break;
+        default:
+            break;
+    }
+    return true;
 }
 
-void HPIL_instr(uint16_t instr)
-// disassemble HP-IL specific instruction for SELP = 0..7
-// activeSELP indicates the selected register
+
+// handle one sample from the Trace Buffer in TraceSample
+static void Trace_sample()
 {
-    uint16_t i_type = instr & 0x003;         // isolate last two bits
-
-    switch (i_type)
-    {
-    case 1:         // copy literal to selected HP-IL register
-        TracePrintLen += sprintf(TracePrint + TracePrintLen, "  reg %d=%02X", activeSELP, (instr & 0x3FC) >> 2); 
-        break;
-    case 2:         // copies HP-IL register n to C[0..1]
-        TracePrintLen += sprintf(TracePrint + TracePrintLen, "  C[0.1]=reg %d", (instr & 0x1C0) >> 6); 
-        break;
-    case 3:         // return control to CPU - ?PFSET
-        TracePrintLen += sprintf(TracePrint + TracePrintLen, "  ?PFSET"); 
-        break;
-    default:
-        TracePrintLen += sprintf(TracePrint + TracePrintLen, "  oops, unknown?"); 
-        // should never get here
-        break;
+    if (replay_armed) replay_add(&TraceSample);         // capture for tracer replay
+
+    if (!globsetting.get(tracer_enabled)) return;        // tracer is disabled
+    if (!trace_enabled) return;
+
+    // we could get out here if there is no CDC port connected for the tracer
+    // but we must keep emptying the buffer
+    // if (!cdc_connected(ITF_TRACE)) return;
+
+    // now start analyzing the trace sample
+    cycle_prev = cycle;
+    cycle = TraceSample.cycle_number;
+
+    // blocked cycles are already left out by core1 and counted in TraceSample.skipped
+    // a traceline starting with O marks a buffer overflow
+    if ((cycle != (cycle_prev + 1 + TraceSample.skipped)) && (TraceSample.skipped != 0xFFFF)) {
+        overflow = 'O' ;
+        trace_gaps++;
+    } else {
+        overflow = ' ';
     }
+    if (TraceSample.skipped != 0) {
+        trace_skipped += TraceSample.skipped;
+        sample_skipped = true;
+    }
+
+    // triggers decide if the sample is traced
+    if ((trig_state != TRIG_OFF) && !trace_trigger(&TraceSample, overflow)) return;
+
+    // now build the trace string or the binary record
+    trace_emit(&TraceSample, overflow);
 }
 
 
@@ -1172,6 +1579,7 @@ void Trace_task()
         if (!Tracer_firstconnect) {
             // Tracer_firstconnect was false, so this is now a new CDC connection
             Tracer_firstconnect = true;
+            tbin_restart();         // a binary stream starts with a key record for the new host
             TracePrintLen = 0;
             cli_printf("  CDC Port 2 [tracer] connected");
             TracePrintLen += sprintf(TracePrint + TracePrintLen, "TRACER CDC PORT connected, trace is %s\n\r", trace_enabled ? "enabled":"disabled");
@@ -1202,309 +1610,181 @@ void Trace_task()
     // but we must keep emptying the buffer
     /*
     if ((!cdc_connected(ITF_TRACE)) || (!trace_enabled)) {
-        if (!queue_is_empty(&TraceBuffer)) {
+        if (!trace_empty()) {
             // only do something if there is something in the tracebuffer
             tud_task();             // must keep the USB port updated
-            queue_remove_blocking(&TraceBuffer, &TraceSample); // read from the Trace Buffer
+            trace_get(&TraceSample);    // read from the Trace Buffer
         } 
         return;
     } 
         */
 
-    if (!queue_is_empty(&TraceBuffer)) {
+    if (!trace_empty() && (trace_snap.state == SNAP_OFF) && (trace_prof.state == PROF_OFF)) {
         // only do something if there is something in the tracebuffer
+        // in a snapshot or with the profiler core0 does not read
         tud_task();             // must keep the USB port updated
-
-        // read from the Trace Buffer
-        queue_remove_blocking(&TraceBuffer, &TraceSample);
-
-        if (!globsetting.get(tracer_enabled)) return;        // tracer is disabled
-        if (!trace_enabled) return;
-
-        // we could get out here if there is no CDC port connected for the tracer
-        // but we must keep emptying the buffer
-        // if (!cdc_connected(ITF_TRACE)) return;
-
-        // now start analyzing the trace sample
-
-        sinstr = TraceSample.isa_instruction;       // sync is still in here
-        instr = sinstr & 0x03FF;
-        sync  = TraceSample.isa_instruction >> 11;
-
-        addr  = TraceSample.isa_address;
-        cycle_prev = cycle;
-        cycle = TraceSample.cycle_number;
-        
-        DATAsample1 = TraceSample.data1;        // D31..D00
-        DATAsample2 = TraceSample.data2;        // D55..D32, right justified 0xfeffffff
-
-        bank = TraceSample.bank;
-
-
-
-        data_x  =  DATAsample1 & 0x000000FF;                // DATA exponent, 2 digits
-        data_xs = (DATAsample1 & 0x00000F00) >>  8;         // DATA exponent sign, 1 digit
-        data_m1 = (DATAsample1 & 0xFFFFF000) >> 12;         // DATA mantissa, 5 digits, D12..D31
-        data_m2 =  DATAsample2 & 0x000FFFFF;                // DATA mantissa, 5 digits, D28..D51
-        data_s  = (DATAsample2 & 0x00F00000) >> 20;         // DATA sign, D52..D55
-
-        // a traceline starting with O marks a buffer overflow
-        if (cycle != (cycle_prev + 1)) {
-            overflow = 'O' ;
-        } else {
-            overflow = ' ';
+        trace_fmt_update();
+
+        // drain the Trace Buffer into the staging buffer, but leave time for the other tasks
+        uint64_t start = time_us_64();
+        int n = 0;
+        while (trace_get(&TraceSample)) {
+            Trace_sample();
+            if ((++n % TRACE_TASK_CHECK == 0) && (time_us_64() - start >= TRACE_TASK_BUDGET)) {
+                trace_out_stats.budget++;
+                break;
+            }
         }
+    }
 
-        // first check for all ranges to be filtered out
+    if (trace_sd_active) {
+        // write one full buffer to the uSD card per call
+        int b = trace_sd_next();
+        if (b >= 0) trace_sd_write(b);
+    }
+    trace_out_check();
+}
 
-        // SYSTEM ROM, pages 0..5
-        bool sysrom_trace = (addr >= 0x0000) && (addr < 0x6000);
 
-        // IL ROMs, pages 6, 7
-        bool ilrom_trace = (addr >= 0x6000) && (addr < 0x8000);
+// Replay of captured trace lines through the bus loop
+// tracer replay capture takes the next REPLAY_LINES consecutive trace lines from the TraceBuffer
+// tracer replay load takes them from a binary trace file on the uSD card
+// tracer replay run feeds the captured HP41 inputs through the bus loop on core0 with sim_run()
+// and compares the responses of TULIP with what was captured, see replay.c
+// the capture is kept in the upper half of the TraceBuffer until tracer replay clear
 
-        // block some known system loops
-        //   0x0098 - 0x00A1       RSTKB and RST05
-        //   0x0177 - 0x0178       delay for debounce
-        //   0x089C - 0x089D       BLINK01
-        //   0x0E9A - 0x0E9E       NLT10 wait for key to NULL
-        //   0x0EC9 - 0x0ECE       NULTST NULL timer
-        bool sysloop_trace = ((addr >= 0x0098) && (addr <= 0x00A1)) || 
-                             ((addr >= 0x0177) && (addr <= 0x0178)) || 
-                             ((addr >= 0x089C) && (addr <= 0x089D)) ||
-                             ((addr >= 0x0E9A) && (addr <= 0x0E9E)) ||
-                             ((addr >= 0x0EC9) && (addr <= 0x0ECE));
+static_assert(REPLAY_LINES <= SIM_CYCLES, "the replay uses sim_cycles[] for the inputs");
 
-        // now check if sample should be blocked 
-        block = !globsetting.get(tracer_sysloop_on) && sysloop_trace;
-        block |= block || !globsetting.get(tracer_sysrom_on) && sysrom_trace;
-        block |= block || !globsetting.get(tracer_ilroms_on) && ilrom_trace;
+struct TLine *const replay_lines = TRACE_LENT->replay;   // captured trace lines, the TraceBuffer is lent
+int replay_count = 0;                       // number of captured trace lines
+bool replay_armed = false;                  // capture in progress
 
-        // if block is true then we have to block this sample, also set marker for previous block
-        if (block) prev_block = true;
+// add a trace line to the capture, called from Trace_task() for every sample
+void replay_add(const struct TLine *line)
+{
+    if ((replay_count > 0) && (line->cycle_number != replay_lines[replay_count - 1].cycle_number + 1)) {
+        // a gap because of a TraceBuffer overflow or PWO, the replay needs consecutive cycles
+        replay_count = 0;
+        replay_stats.restarts++;
+    }
+    replay_lines[replay_count++] = *line;
+    if (replay_count == REPLAY_LINES) {
+        replay_armed = false;
+        trace_filter_build();           // block cycles again as set
+        cli_printf("  replay capture complete, %d cycles", replay_count);
+    }
+}
 
-        if (!block) {
-            // sample not to be blocked, now build the trace string 
+// replay output goes to the CLI, see replay.c
+void replay_print(const char *line)
+{
+    cli_printf("%s", line);
+}
 
-            if (prev_block) {
-                // there was a previous block, indicate skipped lines
-                prev_block = false;
-                overflow = '=' ;
-            } 
+// load the first REPLAY_LINES consecutive cycles from a binary trace file on the uSD card
+// written with tracer sd, or a capture of the tracer port in binary mode copied to the card
+// uses the uSD capture buffers to read the file, so not while a uSD capture runs
+void replay_file(const char *fname)
+{
+    struct ReplayLoad ld;
+    uint8_t *buf = trace_sd_buf[0];
+    int len = 0, pos;
+    UINT br = 0;
+    bool eof = false;
+
+    if (trace_sd_active) {
+        cli_printf("  tracer replay load: stop the uSD capture first");
+        return;
+    }
+    if (!sd_mount_s()) return;
 
-            // build the trace/disassembly string
-            TracePrintLen = 0;
-            TracePrintLen += sprintf(TracePrint + TracePrintLen,"%c  %6d  %04X-%1d  %01X  %03X  ", overflow, cycle, addr, bank, sync, instr);
-            TracePrintLen += sprintf(TracePrint + TracePrintLen,"%01X.%05X%05X.%01X.%02X  ", data_s, data_m2, data_m1, data_xs, data_x);
-            if (TraceSample.xq_instr == 0) {
-                // print .... if no instruction was executed by TULIP
-                TracePrintLen += sprintf(TracePrint + TracePrintLen,"...  ", TraceSample.xq_instr);  // instruction decoded by TULIP
-            } else {
-                // decoded instruction, print it
-                TracePrintLen += sprintf(TracePrint + TracePrintLen,"%03X  ", TraceSample.xq_instr & 0x3FF);  // instruction decoded by TULIP
-            }
-            TracePrintLen += sprintf(TracePrint + TracePrintLen,"R%03X  ", TraceSample.ramslct);
-            TracePrintLen += sprintf(TracePrint + TracePrintLen,"C%01X  ", TraceSample.xq_carry);    
-
-            // work out the FI bits
-            // if one of the bits is low, we count this as a valid flag
-
-            #if (TULIP_HARDWARE == T_DEVBOARD)
-                // for the DevBoard we have real FI tracing
-                // handle FI signal
-                fi1 = TraceSample.fi1;
-                fi2 = TraceSample.fi2;                  // need to shift
-                fi = fi2;
-                fi = fi << 24;
-                fi = fi + fi1;
-                // fi1 is D31..D00, fi2 is D55..D32
-
-                TracePrintLen += sprintf(TracePrint + TracePrintLen,"FI"); 
-                for (int i = 0; i < 14; i++) {      // all 14 digits
-                    if (((fi >> (i * 4)) & 0b1111) != 0b1111 ) {
-                        TracePrintLen += sprintf(TracePrint + TracePrintLen,"%01X", i); 
-                    } else {
-                        TracePrintLen += sprintf(TracePrint + TracePrintLen,"-"); 
-                    }
-                }
+    FIL fil;
+    FRESULT fr = f_open(&fil, fname, FA_READ);
+    if (FR_OK != fr) {
+        cli_printf("  tracer replay load: cannot open file %s: %s (%d)", fname, FRESULT_str(fr), fr);
+        return;
+    }
 
-            #elif (TULIP_HARDWARE == T_MODULE)
-            // the module does not have FI tracing, here we get only the flags as driven by the TULIP
-            // and the pattern is that of FI_OUT1 and FI_OUT2
-            /*
-                    #define FI_00           0x00000007      // FI_PBSY, checked with ?PBSY (Wand, Printer(not used))
-                    #define FI_01           0x00000070      // FI_CRDR, checked with ?CRDR (Cardreader)
-                    #define FI_02           0x00000700      // FI_WNDB, checked with ?WNDB (Wand)
-                    #define FI_03           0x00007000      // 
-                    #define FI_04           0x00070000      // 
-                    #define FI_05           0x00700000      // FI_EDAV, checked with ?EDAV, IR Emitter Diode Available (Blinky)
-                    #define FI_06           0x07000000      // FI_IFCR, checked with ?IFCR, Interface Clear Received (HP-IL)
-                    #define FI_07           0x70000000      // FI_SRQR, checked with ?SRQR, Service Request Received (HP-IL)
-
-                    // sent on T32..T55
-                    #define FI_08           0x00000007      // FI_FRAV, checked with ?FRAV, Frame Available (HP-IL)
-                    #define FI_09           0x00000070      // FI_FRNS, checked with ?FRNS, Frame Received Not as Sent (HP-IL)
-                    #define FI_10           0x00000700      // FI_ORAV, checked with ?ORAV, Output Register Available (HP-IL) 
-                    #define FI_11           0x00007000      //
-                    #define FI_12           0x00070000      // FI_ALM, checked with ?ALM, Alarm (Timer)
-                    #define FI_13           0x00700000      // FI_SER, checked with ?SER, Service Request (all peripherals)
-                */
-
-                TracePrintLen += sprintf(TracePrint + TracePrintLen,"FI"); 
-                // for the module we have the FI_OUT1 and FI_OUT2 bits as output by the TULIP
-                fi1 = TraceSample.fi1;          // D31..D00
-                fi2 = TraceSample.fi2;          // D55..D32
-                fi = fi2;
-                fi = fi << 32;
-                fi = fi | fi1;                 // combine the two parts, shift to the left to get D55..D32
-
-                // for testing print the complete fi word
-                TracePrintLen += sprintf(TracePrint + TracePrintLen," fi1:%08X fi2:%08X", fi1, fi2);
-
-                // now print the FI bits
-                 for (int i = 0; i < 14; i++) {   
-                    if (((fi >> (i * 4)) & 0x7) == 0x7 ) {
-                        TracePrintLen += sprintf(TracePrint + TracePrintLen,"%01X", i); 
-                    } else {
-                        TracePrintLen += sprintf(TracePrint + TracePrintLen,"-"); 
-                    }
-                }
+    trace_ring_lend();                  // the lines are kept in the upper half of the TraceBuffer
+    if (replay_armed) {
+        replay_armed = false;           // a capture in progress is replaced
+        trace_filter_build();
+    }
+    memset(&replay_stats, 0, sizeof(replay_stats));
+    replay_load_init(&ld, replay_lines, REPLAY_LINES);
+
+    while (ld.count < REPLAY_LINES) {
+        if (!eof && (len < TRACE_SD_BUFSIZE)) {
+            fr = f_read(&fil, buf + len, TRACE_SD_BUFSIZE - len, &br);
+            if ((FR_OK != fr) || (br == 0)) eof = true;
+            len += br;
+        }
+        pos = replay_load(&ld, buf, len);
+        memmove(buf, buf + pos, len - pos);
+        len -= pos;
+        if (ld.gap) {
+            // the replay needs consecutive cycles, start again after the gap
+            ld.count = 0;
+            replay_stats.restarts++;
+            continue;
+        }
+        if (eof && (pos == 0)) break;
+    }
+    f_close(&fil);
+
+    replay_count = ld.count;
+    cli_printf("  loaded %d consecutive cycles from %s, %d records, %d bytes not decoded, %d restarts",
+                replay_count, fname, ld.records, ld.lost, replay_stats.restarts);
+    if (replay_count < 2) {
+        replay_count = 0;
+        trace_ring_return();
+    }
+}
 
-            #endif
-
-            // printf(" %08x", TraceSample.xq_data1) in case emulator internals are needed
-
-            // keep track of the length of the disassembly line for alignment of any text after it
-            int dis_len = TracePrintLen + 20;       // allow 20 chars for the disassembly text
-
-            // disassembly of the traceline
-            if (sync == 1) {
-                // valid instruction
-                if ((instr & 0x003) == 0x001) {     // class 1 instruction
-                    // Class 1 is 2-word GO/XQ, so handle in the next disassembly line
-                    delayed_dis = instr;
-                    TracePrintLen += sprintf(TracePrint + TracePrintLen,"  ..."); 
-                } else 
-                {
-                    TracePrintLen += sprintf(TracePrint + TracePrintLen,"  %s", mnemonics[instr]); 
-                    delayed_dis = 0;
-                    // isolate SELPn instruction, this is a CLASS 0 instruction
-                    // bit pattern PPPPIIII00,. where I = 1001 (0x9) and P is the peripheral selected
-                    // mask is 0b0000111111 (0x03F), test is 0b0000100100 (0x024)
-                    if ((instr & 0x03F) == 0x024) 
-                    {
-                        // SELPF Found
-                        activeSELP = (instr & 0x3C0) >> 6;
-                    }
-                    else activeSELP = -1;           // reset after any instruction with a SYNC
-                }
-            } else     
-            {
-                // no SYNC, so the 2nd word of a multi-byte instruction
-                // or under peripheral control, or FETCH S&X
-                if ((delayed_dis & 0x003) == 0x001)
-                {
-                    // class 1 instruction XQ/GO
-                    type_GOXQ = instr & 0x003;
-                    char goxq_str[10];
-                    switch (type_GOXQ)
-                    {
-                        case 0x000: sprintf(goxq_str, "?NC XQ"); break;
-                        case 0x001: sprintf(goxq_str, "?C XQ "); break;
-                        case 0x002: sprintf(goxq_str, "?NC GO"); break;
-                        case 0x003: sprintf(goxq_str, "?C GO ");  break;
-                        default: break;
-                    }
-                    TracePrintLen += sprintf(TracePrint + TracePrintLen,"  %s", goxq_str); 
-                    TracePrintLen += sprintf(TracePrint + TracePrintLen," %02X%02X", (instr & 0x3FC) >>2, (delayed_dis & 0x3FC) >> 2);
-                    delayed_dis = 0;
-                } else {
-                    // not a class 1 instruction so treat as literal
-                    // could be from LDI, under peripheral control or FETCH S&X
-                    // implement in disassembler (maybe) later
-                    TracePrintLen += sprintf(TracePrint + TracePrintLen,"  %03X", instr);
-                    if ((activeSELP >= 0) && (activeSELP <= 7)) 
-                    {
-                        // there is an active peripheral, decode the literal
-                        // for now for HP-IL
-                        HPIL_instr(instr);
-                    }
-                }
-            }
+// replay the captured cycles, the HP41 must be off
+void replay_run()
+{
+    uint32_t mismatches;
 
-            // file the traceline with spaces until the disassembly text is 20 chars long
-            // for alligment of the IL frame and registers after this
-            //  1BA  C[0.1]=reg 6 is 17 chars   
-            while (TracePrintLen < dis_len) {
-                TracePrintLen += sprintf(TracePrint + TracePrintLen," ");
-            }
+    if (replay_count < 2) {
+        cli_printf("  nothing captured, use tracer replay capture or tracer replay load first");
+        return;
+    }
 
-            // add tracing for the HP-IL frames and registers if enabled and the HP-IL module is plugged            
-            if (globsetting.get(tracer_ilregs_on) && globsetting.get(HPIL_plugged)) {
-                // list the HP-IL registers and the frames
-                // only list when a frame is sent or received
-                wframe = TraceSample.frame_out;
-
-                // find out the frame if any and print if there was an incoming or outgoing frame
-                if ( wframe != 0xFFFF) {
-                    // 0xFFFF is the value in the tracebuffer is nothing was sent
-                    getIL_mnemonic(wframe, ILmnem);
-                    TracePrintLen += sprintf(TracePrint + TracePrintLen,"  IL> %03X %s", wframe, ILmnem); 
-                } else {
-                    wframe = TraceSample.frame_in;
-                    if (ILframe_in != wframe) {
-                        // packet received
-                        getIL_mnemonic(wframe, ILmnem);
-                        TracePrintLen += sprintf(TracePrint + TracePrintLen,"  IL< %03X %s", wframe, ILmnem); 
-                        ILframe_in = wframe;
-                    } else {
-                        // no packet received of sent
-                        TracePrintLen += sprintf(TracePrint + TracePrintLen,"             "); 
-                    }
-                }
-                              
-                // now print the HP-IL registers only if there was a change in one of the registers
-                ILchanged = false;
-                for (int i = 0; i < 9; i++) {
-                    if (HPIL_REG_copy[i] != TraceSample.HPILregs[i]) {
-                        ILchanged = true;
-                    }
-                }
+    // the captured inputs
+    replay_setup(replay_lines, replay_count, sim_cycles);
 
-                if (ILchanged) {
-                     // only print the registers if there was a change
-                    TracePrintLen += sprintf(TracePrint + TracePrintLen,"  Reg "); 
-                    for (int i = 0; i < 9; i++) {   
-                        TracePrintLen += sprintf(TracePrint + TracePrintLen,"%02X", TraceSample.HPILregs[i]);
-
-                        // a changed register is indicated with a *
-                        if (HPIL_REG_copy[i] != TraceSample.HPILregs[i]) {
-                            TracePrintLen += sprintf(TracePrint + TracePrintLen,"* ");
-                        } else {
-                            TracePrintLen += sprintf(TracePrint + TracePrintLen,"  ");
-                        }
-                        HPIL_REG_copy[i] = TraceSample.HPILregs[i];
-                    }
-                }
-            }
+    memset(&replay_stats, 0, sizeof(replay_stats));
+    replay_stats.cycles = replay_count;
 
-            // end of the traceline, finish it
-            TracePrintLen += sprintf(TracePrint + TracePrintLen,"\n\r");
+    // first for the throughput, then again with the checks
+    sim_hist_reset();
+    replay_stats.us = sim_run(sim_cycles, replay_count, &replay_lines[0], NULL);
+    if (!sim_stopped) sim_run(sim_cycles, replay_count, &replay_lines[0], replay_check);
+    if (sim_stopped) {
+        memset(&replay_stats, 0, sizeof(replay_stats));
+        cli_printf("  replay stopped, the HP41 was switched on");
+        return;
+    }
+    if (replay_stats.us == 0) replay_stats.us = 1;
 
-            if (cdc_connected(ITF_TRACE))
-            // only send if something is connected, otherwise this will stall
-            // better move this test to earlier in the tracer task for performance
-            {
-                cdc_sendbuf(ITF_TRACE, TracePrint, TracePrintLen);
-                cdc_flush(ITF_TRACE);
-                tud_task();             // must keep the USB port updated
-            }
-             
-        } 
-        else
-        {
-            // sample skipped
-            sample_skipped = true;
-        }
+    mismatches = replay_mismatches();
+    if (mismatches > REPLAY_SHOW) {
+        cli_printf("  ... %d more", mismatches - REPLAY_SHOW);
     }
+    replay_status();
+}
+
+// show the capture and the results of the last replay
+void replay_status()
+{
+    cli_printf("  replay capture: %d of %d cycles%s", replay_count, REPLAY_LINES, replay_armed ? ", capturing" : "");
+    if (replay_stats.cycles == 0) return;
+    cli_printf("  last replay: %d cycles in %d us, %d cycles/s, %.2f us/cycle",
+                replay_stats.cycles, replay_stats.us,
+                (uint32_t)((uint64_t)replay_stats.cycles * 1000000 / replay_stats.us),
+                (float)replay_stats.us / replay_stats.cycles);
+    cli_printf("  %d cycles compared, mismatches: ISA %d, carry %d, DATA %d, FI %d, HP-IL out %d, decoder state %d",
+                replay_stats.checked, replay_stats.isa, replay_stats.carry, replay_stats.data,
+                replay_stats.fi, replay_stats.frame, replay_stats.state);
 }
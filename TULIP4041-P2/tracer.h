@@ -31,8 +31,12 @@ extern "C" {
 // #include "disassembler.h"
 #include "cdc_helper.h"
 #include "emulation.h"
+#include "tbin.h"
+#include "tracefmt.h"
+#include "replay.h"
 #include "userinterface.h"
 #include "fram.h"
+#include "sdcard.h"
 // #include "module.h"
 
 
@@ -41,79 +45,6 @@ extern "C" {
 // #include "peripherals.h"
 
 // definition of the structure for the analyzer functions
-// different variations to support dynamic sizing of the tracebuffer
-
-// TLine  is for the maximum possible trace line structure with FI and HP-IL
-// TODO: add line for current bank
-struct TLine {
-    uint32_t    cycle_number;       // to count the cycles since the last PWO       4 bytes
-    uint16_t    isa_address;        // ISA address                                  2 bytes
-    uint16_t    isa_instruction;    // ISA instruction with SYNC status             2 bytes
-    uint8_t     bank;               // current selected bank                        1 byte
-    uint32_t    data1;              // DATA D31..D00                                4 bytes
-    uint32_t    data2;              // DATA D55..D32                                4 bytes
-    uint32_t    fi1;                // for FI line tracing                          4 bytes
-    uint32_t    fi2;                //                                              4 bytes
-    uint16_t    xq_instr;           // instruction decoded                          2 bytes
-    bool        xq_carry;           // when carry is sent                           1 byte
-    uint32_t    ramslct;            // selected RAM chip                            4 bytes
-    uint16_t    frame_in;           // HP-IL frame input                            2 bytes
-    uint16_t    frame_out;          // HP-IL frame output                           2 bytes
-    uint8_t     HPILregs[9];        // HP-IL registers                              9 bytes
-} ;
-
-// TLine  is for basic tracing with FI
-struct TLine_FI {
-    uint32_t    cycle_number;       // to count the cycles since the last PWO
-    uint16_t    isa_address;        // ISA address
-    uint16_t    isa_instruction;    // ISA instruction with SYNC status
-    uint32_t    data1;              // DATA D31..D00
-    uint32_t    data2;              // DATA D55..D32
-    uint32_t    fi1;                // for FI line tracing
-    uint32_t    fi2;     
-    // uint16_t    xq_instr;           // instruction decoded              
-    // bool        xq_carry;           // when carry is sent
-    uint32_t    ramslct;            // selected RAM chip
-    // uint16_t    frame_in;           // HP-IL frame input
-    // uint16_t    frame_out;          // HP-IL frame output
-    // uint8_t     HPILregs[9];        // HP-IL registers
-} ;
-
-
-// TLine basic is for the smallest possible trace line structure
-struct TLine_basic {
-    uint32_t    cycle_number;       // to count the cycles since the last PWO
-    uint16_t    isa_address;        // ISA address
-    uint16_t    isa_instruction;    // ISA instruction with SYNC status
-    uint32_t    data1;              // DATA D31..D00
-    uint32_t    data2;              // DATA D55..D32
-    // uint32_t    fi1;                // for FI line tracing
-    // uint32_t    fi2;   
-    // uint16_t    xq_instr;           // instruction decoded                
-    // bool        xq_carry;           // when carry is sent
-    // uint32_t    ramslct;            // selected RAM chip
-    // uint16_t    frame_in;           // HP-IL frame input
-    // uint16_t    frame_out;          // HP-IL frame output
-    // uint8_t     HPILregs[9];        // HP-IL registers
-};
-
-// TLine basic is for the basic trace with HP-IL registers
-struct TLine_IL {
-    uint32_t    cycle_number;       // to count the cycles since the last PWO
-    uint16_t    isa_address;        // ISA address
-    uint16_t    isa_instruction;    // ISA instruction with SYNC status
-    uint32_t    data1;              // DATA D31..D00
-    uint32_t    data2;              // DATA D55..D32
-    // uint32_t    fi1;                // for FI line tracing
-    // uint32_t    fi2;                
-    // uint16_t    xq_instr;           // instruction decoded   
-    // bool        xq_carry;           // when carry is sent
-    uint32_t    ramslct;            // selected RAM chip
-    uint16_t    frame_in;           // HP-IL frame input
-    uint16_t    frame_out;          // HP-IL frame output
-    uint8_t     HPILregs[9];        // HP-IL registers
-};
-
 
 // TraceLine definition for PWO events to correctly show in the Tracer
 struct TLine_PowerEvent 
@@ -127,14 +58,245 @@ struct TLine_PowerEvent
 
 
 
-extern const char *mnemonics[];
+// TraceBuffer between core1 and core0, a ring of 32-bit words with variable size records
+// a basic record is 3 words, extension words follow only for fields that changed since the previous record
+//   word 0         isa_address | isa_instruction << 16
+//   word 1         data1
+//   word 2         data2 | flags << 24, TREC_xx flags below
+//   TREC_CYCLE     cycle_number, only when it is not the previous + 1 + skipped
+//   TREC_SKIP      skipped
+//   TREC_FI        fi1, fi2
+//   TREC_RAM       ramslct
+//   TREC_XQ        xq_instr | xq_carry << 16 | bank << 24
+//   TREC_HPIL      frame_in | frame_out << 16, HPILregs[0..8] in 3 words
+#define TREC_CYCLE          0x01
+#define TREC_SKIP           0x02
+#define TREC_FI             0x04
+#define TREC_RAM            0x08
+#define TREC_XQ             0x10
+#define TREC_HPIL           0x20
+#define TREC_COMPLETE       (TREC_CYCLE | TREC_FI | TREC_RAM | TREC_XQ | TREC_HPIL)    // no reference needed
+
+#define TRACE_RING_WORDS    32768   // 128 KByte, must be a power of 2
+#define TRACE_RING_MASK     (TRACE_RING_WORDS - 1)
+
+// the upper half of the TraceBuffer is lent to the uSD capture and the replay capture while they are used
+// live tracing and the snapshot then use the lower half, see trace_ring_lend()
+struct TraceRing {
+    uint32_t            buf[TRACE_RING_WORDS];
+    volatile uint32_t   mask;       // TRACE_RING_MASK, or the mask of the lower half when the upper half is lent
+    volatile uint32_t   head;       // next word written by core1
+    volatile uint32_t   tail;       // next word read by core0
+    volatile uint32_t   dropped;    // records dropped by core1 because the ring was full
+    volatile uint32_t   records;    // records added by core1
+    volatile uint32_t   filtered;   // cycles blocked by the trace filter in core1
+};
+
+struct TraceRingStats {             // kept by core0
+    uint32_t    records;            // records read
+    uint32_t    words;              // words read
+    uint32_t    max_fill;           // highest number of words waiting
+    uint32_t    traced;             // records passed to the output, after the tracer enable and the triggers
+};
+
+extern struct TraceRing trace_ring;
+extern struct TraceRingStats trace_ring_stats;
+
+// number of words of a record with these TREC_xx flags
+static inline uint32_t trec_len(uint32_t flags)
+{
+    return 3 + ((flags & TREC_CYCLE) ? 1 : 0) + ((flags & TREC_SKIP) ? 1 : 0) + ((flags & TREC_FI) ? 2 : 0) +
+               ((flags & TREC_RAM) ? 1 : 0) + ((flags & TREC_XQ) ? 1 : 0) + ((flags & TREC_HPIL) ? 4 : 0);
+}
+
+// snapshot capture in the TraceBuffer, see trace_snap_start()
+#define SNAP_OFF            0       // live tracing
+#define SNAP_RUN            1       // capturing, waiting for the trigger
+#define SNAP_POST           2       // triggered, capturing the records after the trigger
+#define SNAP_FROZEN         3       // capture complete, nothing is added
+
+#define SNAP_TRIG_NONE      0       // only frozen with tracer snap stop
+#define SNAP_TRIG_ADDR      1       // ISA address
+#define SNAP_TRIG_INST      2       // ISA instruction with SYNC
+#define SNAP_TRIG_FRAME     3       // HP-IL frame sent or received
+
+#define TRACE_SNAP_KEY      64      // a complete record every 64 records, the oldest are lost when removed
+#define TRACE_SNAP_POST     1000    // default records after the trigger
+#define TRACE_SNAP_POST_MAX 4096    // the trigger record must stay in the lower half of the TraceBuffer
+#define TRACE_SNAP_SDBUF    4096    // bytes encoded per f_write() in tracer snap sd
+
+struct TraceSnap {
+    volatile int        state;      // SNAP_xx
+    int                 trig;       // SNAP_TRIG_xx
+    uint32_t            value;      // address, instruction or frame to trigger on
+    uint32_t            post;       // records after the trigger
+    uint32_t            left;       // records still to capture after the trigger
+    volatile bool       triggered;
+    uint32_t            trig_pos;   // TraceBuffer position of the trigger record
+    uint32_t            trig_cycle; // cycle number of the trigger
+    uint32_t            records;    // records written since the start
+};
+
+extern struct TraceSnap trace_snap;
+
+void trace_snap_start(int trig, uint32_t value, uint32_t post);
+void trace_snap_freeze();
+void trace_snap_off();
+void trace_snap_status();
+void trace_snap_dump();
+void trace_snap_sd(const char *fname);
+
+// profiler, the TraceBuffer holds a 16 bit fetch counter for each address, see trace_prof_start()
+#define PROF_OFF            0       // live tracing
+#define PROF_RUN            1       // core1 counts fetches
+#define PROF_STOP           2       // counting stopped, the results are kept
+
+#define PROF_TOP            10      // default length of the lists in the report
+#define PROF_TOP_MAX        32
+#define PROF_SAT            0xFFFF  // an address counter stops here, the Page and Bank totals keep counting
+
+struct TraceProf {
+    volatile int        state;      // PROF_xx
+    uint64_t            start;      // time_us_64() at the start
+    uint64_t            stop;       // and when it was stopped
+    uint32_t            bank[16][8];    // fetches for each Page and Bank 1..4, 8 keeps core1 in bounds
+};
+
+extern struct TraceProf trace_prof;
+
+void trace_prof_start();
+void trace_prof_stop();
+void trace_prof_off();
+void trace_prof_report(int n);
+void trace_prof_csv(const char *fname);
 
 void TraceBuffer_init();
+void trace_ring_lend();
+void trace_ring_return();
+bool trace_put(const struct TLine *line);
+bool trace_get(struct TLine *line);
+bool trace_empty();
 void Trace_task();
 
-const int TRACELENGTH = 5000;       //Trace Buffer length
+extern uint32_t trace_gaps;
+extern uint32_t trace_skipped;
+
+// trace filter, built by core0 from the tracer settings and filters and checked by core1 before queueing a TraceLine
+// one bit per address in a table per Page, trace_filter_map[bank - 1][page] selects the table
+// Pages with bank qualified block or pass filters get their own table for that bank
+#define TRACE_FILTER_TABLES 24      // 16 shared tables, one per Page, and 8 for bank qualified filters
+
+extern uint16_t trace_filter[TRACE_FILTER_TABLES][256];
+extern uint8_t trace_filter_map[4][16];
+extern uint32_t trace_filter_full;  // bank qualified filters not compiled, no free tables
 
-#define numILmnemonics      49      // number of elements in IL_mnemonics 0.. 48, PILBox commands now included
+void trace_filter_build();
+
+static inline bool trace_filter_blocked(uint16_t adr, uint8_t bank)
+{
+    return (trace_filter[trace_filter_map[(bank - 1) & 3][adr >> 12]][(adr >> 4) & 0xFF] >> (adr & 0x0F)) & 1;
+}
+
+// trigger state in core0, triggers are evaluated on the samples passed by the trace filter
+enum { TRIG_OFF, TRIG_ARMED, TRIG_ON, TRIG_POST };
+
+extern int trig_state;
+extern uint32_t trig_fired;         // number of triggers
+
+// binary trace stream on the tracer CDC port, selected with the tracer_binary setting
+// the record format, the encoder and the decoder are in tbin.h
+struct TBinStats {
+    uint32_t    records;            // records sent
+    uint32_t    bytes;              // bytes sent
+    uint32_t    keys;               // key records sent
+};
+
+extern struct TBinStats tbin_stats;
+
+void tbin_restart();
+void tbin_selftest();
+
+// trace line formatter, see tracefmt.h
+#define FMT_BENCH_REPEAT    20      // passes over the lines in tracer fmtbench
+
+void trace_format_bench();
+
+// trace capture to a file on the uSD card, the file has the binary trace stream described in tbin.h
+#define TRACE_SD_BUFSIZE    16384   // two of these, a multiple or a fraction of the cluster size
+#define TRACE_SD_SYNC       64      // buffers written between f_sync() calls
+
+struct TraceSDStats {
+    char        fname[32];
+    uint64_t    start;              // time_us_64() at the start of the capture
+    uint64_t    stop;               // and when it was stopped
+    uint32_t    records;            // records written
+    uint32_t    bytes;              // bytes written
+    uint32_t    dropped;            // records dropped because both buffers were waiting for the uSD card
+    uint32_t    writes;             // buffers written
+    uint64_t    write_us;           // time spent in f_write()
+    uint32_t    max_us;             // longest f_write()
+};
+
+extern struct TraceSDStats trace_sd_stats;
+extern bool trace_sd_active;
+
+void trace_sd_start(const char *fname);
+void trace_sd_stop();
+void trace_sd_status();
+
+// trace output, text lines and binary records are staged and sent to the tracer CDC port in blocks
+#define TRACE_OUT_SIZE      512     // half the CDC TX FIFO in tusb_config.h, one block is staged while
+                                    // the previous one is going out
+#define TRACE_OUT_TIMEOUT   2000    // us, max time output waits in the staging buffer
+#define TRACE_TASK_BUDGET   1000    // us, max time for one call of Trace_task()
+#define TRACE_TASK_CHECK    16      // samples between checks of the time budget
+
+struct TraceOutStats {
+    uint32_t    lines;              // text lines or binary records staged
+    uint32_t    bytes;              // bytes sent
+    uint32_t    blocks;             // blocks sent
+    uint32_t    timeouts;           // blocks sent before they were full
+    uint32_t    budget;             // calls of Trace_task() that ran out of time
+    uint32_t    dropped;            // bytes not sent because no host was connected
+    uint32_t    lines_s;            // lines per second, last second
+    uint32_t    bytes_s;            // bytes per second, last second
+};
+
+extern struct TraceOutStats trace_out_stats;
+
+// pipeline telemetry for tracer stats, from the cycles in core1 to the bytes on the tracer port
+// all counters only go up, tracer stats reset keeps a copy and the differences are shown
+struct TraceStats {
+    uint64_t    time;               // time_us_64()
+    uint32_t    produced;           // cycles offered to the TraceBuffer by core1
+    uint32_t    filtered;           // blocked by the trace filter in core1
+    uint32_t    enqueued;           // records added to the TraceBuffer
+    uint32_t    dropped;            // records dropped because the TraceBuffer was full
+    uint32_t    read;               // records read by core0
+    uint32_t    traced;             // records passed to the output
+    uint32_t    lines;              // text lines or binary records staged for the tracer port
+    uint32_t    bytes;              // bytes sent on the tracer port
+    uint32_t    unsent;             // bytes not sent, no host connected
+    uint32_t    budget;             // calls of Trace_task() that ran out of time
+    uint32_t    stalls;             // writes on the tracer port that waited for room in the USB buffer
+    uint64_t    stall_us;           // time waited
+};
+
+void trace_stats_get(struct TraceStats *s);
+void trace_stats_show();
+void trace_stats_reset();
+void trace_stats_period(int secs);
+
+// replay of captured trace lines through the bus loop, the comparison is in replay.h
+#define REPLAY_LINES        512     // max number of captured trace lines, not more than SIM_CYCLES
+extern struct TLine *const replay_lines;      // in the upper half of the TraceBuffer
+extern int replay_count;
+extern bool replay_armed;
+
+void replay_add(const struct TLine *line);
+void replay_file(const char *fname);
+void replay_run();
+void replay_status();
 
 #define NUMFILTERS          16      // number of entries for filters
 
@@ -142,8 +304,7 @@ struct filter {
     uint16_t start_adr;             // start of the range to be filtered
     uint16_t end_adr;               // end of the range to be filtered
     uint16_t count_adr;             // counter in case of a trigger with sample counter
-    uint8_t bank;                   // not yet supported
-                                    // 0    - any bank
+    uint8_t bank;                   // 0    - any bank
                                     // 1..4 - specific bank
     uint8_t type;                   // type of filter
 };
@@ -166,108 +327,28 @@ struct filter {
 // bit 7 of type defines if a filter is active or inactive
 // when set the filter is active, otherwise inactive
 
-#define BLOCK_THIS 1
-#define PASS_THIS  2
-#define TRIG_START 3
-#define TRIG_END   4
+#define TRACE_PRE_MAX       64      // max samples kept before a trigger
+#define TRACE_SET_INIT      0x4041  // marks valid tracer settings in FRAM
 
 class Tracer {
 
     public:
 
-    filter block_filter[NUMFILTERS];
-    filter pass_filter[NUMFILTERS];
-    filter trig_filter[NUMFILTERS];
-
-    filter filters[NUMFILTERS];
+    filter filters[NUMFILTERS];     // block, pass and trigger filters, compiled by trace_filter_build()
+    uint16_t pre_depth;             // samples traced before a trigger, max TRACE_PRE_MAX
+    uint16_t post_depth;            // samples traced after the end of a trigger
+    uint16_t init;                  // TRACE_SET_INIT when retrieved from FRAM
 
     Tracer() {
         // initialize to default settings
-
-        // clear all filter arrays
-        for (int i = 0; i < NUMFILTERS; i++) 
-        {
-            block_filter[i].start_adr = 0;
-            block_filter[i].end_adr = 0;
-            block_filter[i].count_adr = 0;
-            block_filter[i].bank = 0;          // default is any bank, but not supported in BETA
-            block_filter[i].type = 0;
-
-            pass_filter[i].start_adr = 0;
-            pass_filter[i].end_adr = 0;
-            pass_filter[i].count_adr = 0;
-            pass_filter[i].bank = 0;          // default is any bank, but not supported in BETA
-            pass_filter[i].type = 0;
-
-            trig_filter[i].start_adr = 0;
-            trig_filter[i].end_adr = 0;
-            trig_filter[i].count_adr = 0;
-            trig_filter[i].bank = 0;          // default is any bank, but not supported in BETA
-            trig_filter[i].type = 0;                        
-        }
-    }
-
-
-    // apply the filter, should we pass or block the current address
-    // this is called for every sample by the tracer main loop
-    // returns 1 if sample should be blocked
-    //         2 if sample can be passed
-    //         3 if this is a start trigger address
-    //         4 if this is an end trigger address
-
-    int apply(uint16_t adr) {
-        bool pass_active = false;
-        bool pass_potential = false;        // possible pass address
-        bool trig_s_potential = false;      // possible trigger start address
-        bool trig_e_potential = false;      // possible trigger end address
-
-        for (int i = 0; i < NUMFILTERS; i++) {
-
-            // test block
-            if ((filters[i].type == filter_act_block) &&
-                (adr >= filters[i].start_adr) &&
-                (adr <= filters[i].end_adr)) {         
-                    // block takes priority, so always block this sample and get out   
-                    return BLOCK_THIS;         
-            }
-            // test pass
-            if ((filters[i].type == filter_act_pass) &&
-                (adr >= filters[i].start_adr) &&
-                (adr <= filters[i].end_adr)) {         
-                    // this may be a pass, if there is no later block
-                    pass_potential = true;
-            }
-
-            // now check for start trigger
-            if (((filters[i].type == filter_act_trig_a) || (filters[i].type == filter_act_trig_c)) && 
-                (adr == filters[i].start_adr)) {
-                    // trigger start address found, if there is no later block
-                    trig_s_potential = true;
-            }
-
-            // now check for end trigger
-            if ((filters[i].type == filter_act_trig_a) && (adr == filters[i].end_adr)) {
-                    // trigger end address found, if there is no later block
-                    trig_e_potential = true;
-            }           
-        }                  
-
-        // if we get here it is because:
-        //      - there was a pass potential, which is not blocked
-        //      - there was a trig potential, which is not blocked
-        //      - there was no block or potential, which is a pass
-
-        if (pass_potential) return PASS_THIS;
-        if (trig_s_potential) return TRIG_START;
-        if (trig_e_potential) return TRIG_END;
-        return PASS_THIS;
+        clear_filters();
     }
 
     // add a new filter
     // parameters:
-    // tp - filter type, 0-block, 1-pass, 2-trig
-    // start_adr, end_adr: start and end addresses (or count)
-    // bank (not used yet)
+    // tp - filter type, filter_block, filter_pass, filter_trig_a or filter_trig_c
+    // start_adr, end_adr: start and end addresses, for filter_trig_c end_adr is the number of samples
+    // bank - 0 for any bank, 1..4 for a specific bank
     // a new filter is enabled by default
     // returns the entry number, if -1 then no free entry found
     
@@ -276,133 +357,76 @@ class Tracer {
         // first find a free entry in the array
         int entry = 0; 
 
-        while ((entry < NUMFILTERS) && (block_filter[entry].type != filter_none)) {
+        while ((entry < NUMFILTERS) && (filters[entry].type != filter_none)) {
             entry++;
         }
 
-        if (entry > NUMFILTERS) return -1;              // no free netries found
+        if (entry >= NUMFILTERS) return -1;             // no free entries found
 
         // we have a valid entry, add parameters
-        filters[entry].type = tp;
+        filters[entry].type = tp | 0x80;                // active
         filters[entry].start_adr = start_adr;
         filters[entry].end_adr = end_adr;
+        filters[entry].count_adr = 0;
+        if (tp == filter_trig_c) {
+            filters[entry].end_adr = start_adr;
+            filters[entry].count_adr = end_adr;
+        }
         filters[entry].bank = bank;
 
         return entry;
     }
 
     // remove a filter by entry number
-    // returns -1 if not succesful, otehrwise returns the entry number
+    // returns -1 if not succesful, otherwise returns the entry number
     int del_filter(int entry)
     {
-        int result = -1;
-
-        if ((entry < 5) || (entry > NUMFILTERS)) return -1;  // invalid entry number
+        if ((entry < 0) || (entry >= NUMFILTERS)) return -1;  // invalid entry number
+        if (filters[entry].type == filter_none) return -1;
 
-        filters[entry].type = 0;        // invalidate entry
+        filters[entry].type = filter_none;      // invalidate entry
         return entry;
     }
 
-    // set the status of a filter to active or inactive
-    // returns the new status of the filter
-    uint8_t set_filter(int entry)
-    {
-
-        return 0;
-    }
-
     // toggle the status of a filter
+    // returns the new type of the filter, filter_none if the entry is not used
     uint8_t toggle_filter(int entry)
     {
-        return 0;
+        if ((entry < 0) || (entry >= NUMFILTERS)) return filter_none;
+        if (filters[entry].type != filter_none) filters[entry].type ^= 0x80;
+        return filters[entry].type;
     }
 
-
     uint8_t get_filter(int entry)
     {
-        return 0;
+        if ((entry < 0) || (entry >= NUMFILTERS)) return filter_none;
+        return filters[entry].type;
     }
 
-
     void clear_filters()
     {
-        // clear all filter arrays
+        // clear the filter array
         for (int i = 0; i < NUMFILTERS; i++) 
         {
-            block_filter[i].start_adr = 0;
-            block_filter[i].end_adr = 0;
-            block_filter[i].count_adr = 0;
-            block_filter[i].bank = 0;          // default is any bank, but not supported in BETA
-            block_filter[i].type = 0;
-
-            pass_filter[i].start_adr = 0;
-            pass_filter[i].end_adr = 0;
-            pass_filter[i].count_adr = 0;
-            pass_filter[i].bank = 0;          // default is any bank, but not supported in BETA
-            pass_filter[i].type = 0;
-
-            trig_filter[i].start_adr = 0;
-            trig_filter[i].end_adr = 0;
-            trig_filter[i].count_adr = 0;
-            trig_filter[i].bank = 0;          // default is any bank, but not supported in BETA
-            trig_filter[i].type = 0;                        
-        }
-    }
-
-    // set items to the default value and save in fram
-    int set_default() {
-        // set all addresses to NULL 
-        // initialize all filters, then set defaults values
-
-        clear_filters();
-
-        // now initialize block_filters
-        block_filter[0].start_adr = 0x0098;         // 0x0098 - 0x00A1       RSTKB and RST05
-        block_filter[0].end_adr   = 0x00A1;
-        block_filter[0].type      = filter_valid;   // valid but not active
-
-        block_filter[1].start_adr = 0x0177;         // 0x0177 - 0x0178       delay for debounce
-        block_filter[1].end_adr   = 0x0178;
-        block_filter[1].type      = filter_valid;   // valid but not active
-
-        block_filter[2].start_adr = 0x089C;         // 0x089C - 0x089D       BLINK01
-        block_filter[2].end_adr   = 0x089D;                
-        block_filter[2].type      = filter_valid;   // valid but not active
-
-        block_filter[3].start_adr = 0x0000;         // 0x0000 - 0x5FFF       system ROMS (inlcuding Page 4!)  
-        block_filter[3].end_adr   = 0x4FFF;
-        block_filter[3].type      = filter_valid;   // valid but not active
-
-        block_filter[4].start_adr = 0x6000;         // 0x6000 - 0x7FFF       HP-IL ROMs (including the printer!)
-        block_filter[4].end_adr   = 0x7FFF;
-        block_filter[4].type      = filter_valid;   // valid but not active
-
-        if (gpio_get(P_PWO) == 0)
-        {
-            // when PWO = low we can write to FRAM
-            fram_write(SPI_PORT_FRAM, PIN_SPI0_CS, FRAM_tracer_start, (uint8_t*)block_filter, sizeof(block_filter));
-            fram_write(SPI_PORT_FRAM, PIN_SPI0_CS, FRAM_tracer_start + sizeof(block_filter), (uint8_t*)pass_filter, sizeof(pass_filter));
-            fram_write(SPI_PORT_FRAM, PIN_SPI0_CS, FRAM_tracer_start + sizeof(block_filter) + sizeof(pass_filter), (uint8_t*)trig_filter, sizeof(trig_filter));
-            return 1;
-        }
-        else
-        {
-            // PWO was high, calculator is running and cannot write to FRAM
-            return 0;
+            filters[i].start_adr = 0;
+            filters[i].end_adr = 0;
+            filters[i].count_adr = 0;
+            filters[i].bank = 0;
+            filters[i].type = filter_none;
         }
+        pre_depth = 0;
+        post_depth = 0;
     }
 
-
     // save all settings in FRAM, can only be done when PWO is low!!
-    // is done automatically when HP41 power goes down
     // returns 1 (true) if succesful
     int save() {
         if (gpio_get(P_PWO) == 0)
         {
             // when PWO = low we can write to FRAM
-            fram_write(SPI_PORT_FRAM, PIN_SPI0_CS, FRAM_tracer_start, (uint8_t*)block_filter, sizeof(block_filter));
-            fram_write(SPI_PORT_FRAM, PIN_SPI0_CS, FRAM_tracer_start + sizeof(block_filter), (uint8_t*)pass_filter, sizeof(pass_filter));
-            fram_write(SPI_PORT_FRAM, PIN_SPI0_CS, FRAM_tracer_start + sizeof(block_filter) + sizeof(pass_filter), (uint8_t*)trig_filter, sizeof(trig_filter));
+            init = TRACE_SET_INIT;
+            fram_write(SPI_PORT_FRAM, PIN_SPI0_CS, FRAM_tracer_start, (uint8_t*)filters, sizeof(filters));
+            fram_write(SPI_PORT_FRAM, PIN_SPI0_CS, FRAM_tracer_start + sizeof(filters), (uint8_t*)&pre_depth, 3 * sizeof(uint16_t));
             return 1;
         }
         else
@@ -413,27 +437,28 @@ class Tracer {
     }
 
     // retrieve settings from FRAM in array for use, can only be done when PWO is low!!
-    // is done automatically upon device power up
+    // is done automatically upon device power up, uninitialized FRAM gives an empty filter list
     // returns 1 (true) if succesful
     int retrieve() {
         if (gpio_get(P_PWO) == 0)
         {
-            // when PWO = low we can write to FRAM
-            // fram_write(SPI_PORT_FRAM, PIN_SPI0_CS, FRAM_gsettings_start, gsettings, sizeof(gsettings));
             // when PWO = low we can read from FRAM
-            fram_write(SPI_PORT_FRAM, PIN_SPI0_CS, FRAM_tracer_start, (uint8_t*)block_filter, sizeof(block_filter));
-            fram_write(SPI_PORT_FRAM, PIN_SPI0_CS, FRAM_tracer_start + sizeof(block_filter), (uint8_t*)pass_filter, sizeof(pass_filter));
-            fram_write(SPI_PORT_FRAM, PIN_SPI0_CS, FRAM_tracer_start + sizeof(block_filter) + sizeof(pass_filter), (uint8_t*)trig_filter, sizeof(trig_filter));
+            fram_read(SPI_PORT_FRAM, PIN_SPI0_CS, FRAM_tracer_start, (uint8_t*)filters, sizeof(filters));
+            fram_read(SPI_PORT_FRAM, PIN_SPI0_CS, FRAM_tracer_start + sizeof(filters), (uint8_t*)&pre_depth, 3 * sizeof(uint16_t));
+            if (init != TRACE_SET_INIT) clear_filters();
+            if (pre_depth > TRACE_PRE_MAX) pre_depth = TRACE_PRE_MAX;
             return 1;
         }
         else
         {
-            // PWO was high, calculator is running and cannot write to FRAM
+            // PWO was high, calculator is running and cannot read from FRAM
             return 0;
         }
     }
 
-} ; // end of class GSettings
+} ; // end of class Tracer
+
+extern class Tracer tracesetting;
 
 #ifdef __cplusplus
 }
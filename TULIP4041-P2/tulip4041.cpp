@@ -66,6 +66,18 @@
 #include "cdc_helper.h"
 #include "module.h"
 
+extern CModules TULIP_Pages;
+
+// SRAM budget, the RP2350 has 512 KByte for .data, .bss and the heap (getTotalHeap() is what is left)
+// the large buffers are checked here, all other variables and buffers together take about 112 KByte
+// FatFS, TinyUSB and printf need at least 32 KByte of heap, the linker map has the exact numbers
+#define SRAM_SIZE           (512 * 1024)
+#define SRAM_OTHER          (112 * 1024)
+#define SRAM_HEAP_MIN       (32 * 1024)
+static_assert(sizeof(trace_ring) + sizeof(TULIP_Pages) + sizeof(ff_index) + sizeof(trace_filter) +
+              sizeof(sim_cycles) + sizeof(sim_hist) + sizeof(timing_hist) + sizeof(usermem_regs) +
+              sizeof(inst_dispatch) <= SRAM_SIZE - SRAM_OTHER - SRAM_HEAP_MIN, "the large buffers do not fit in SRAM");
+
 
 int main() {
 
@@ -107,6 +119,8 @@ int main() {
     #endif
 
     sdcard_init();     // initialize the FatFS system and uSD card SPI interface
+    ff_compact_resume();  // finish a flash compact that was interrupted by a power loss
+    ff_index_build();  // SRAM index of the FLASH File System, reported in welcome()
 
     // initialize trace and printbuffers 
     TraceBuffer_init();     // only if used, do this dynamic in the future
@@ -124,6 +138,7 @@ int main() {
         globsetting.set_default();
         globsetting.save();
     }
+    tracesetting.retrieve();        // tracer filters and triggers
 
     // for a test version HPIL and the HP-IL printer are plugged
     globsetting.set(HPIL_plugged, 1);               // set the HPIL plugged flag  
@@ -164,6 +179,10 @@ int main() {
         
         PowerMode_task();           // Verify the HP41 power mode
 
+        UserMem_task();             // write back changed User Memory registers to FRAM
+
+        QROM_task();                // write back changed QROM blocks to FRAM
+
         tud_task();                 // process the USB interfaces required by TinyUSB
 
         runCLI();                   // process the 'new' embedded CLI
@@ -365,7 +365,7 @@ void uif_status()
       // clk_sys)/1000000;
     float totalheap = getTotalHeap() / 1024;
     float freeheap = getFreeHeap() / 1024;
-    float tracebytes = (sizeof(TraceLine) * TRACELENGTH) / 1024;
+    float tracebytes = sizeof(trace_ring.buf) / 1024;
 
     pico_unique_board_id_t board_id;
     pico_get_unique_board_id(&board_id);
@@ -416,7 +416,7 @@ void uif_status()
     cli_printf("*    Total RAM  : %7.2lf KBytes", 520);
     cli_printf("*    Total heap : %7.2lf KBytes", totalheap);
     cli_printf("*    Free heap  : %7.2lf KBytes", freeheap);
-    cli_printf("*    Tracebuffer: %7.2lf KBytes, %d samples = %d bytes/traceline", tracebytes, TRACELENGTH, sizeof(TraceLine));
+    cli_printf("*    Tracebuffer: %7.2lf KBytes, variable size records of 12..52 bytes/traceline", tracebytes);
     cli_printf("*");    
     cli_printf("****************************************************************************");
 }
@@ -571,6 +571,226 @@ void uif_configlist() {
     }
 }
 
+// print one line of ROM fetch timing, cycles are converted to ns with the current clk_sys
+void show_fetch_timing(const char *src, struct FetchTiming *ft)
+{
+  float ns = 1.0e9f / clock_get_hz(clk_sys);     // ns per clk_sys cycle
+
+  if (ft->count == 0) {
+    cli_printf("    %-9s  no fetches measured", src);
+    return;
+  }
+  uint32_t avg = ft->total / ft->count;
+  cli_printf("    %-9s  %10d  %4d / %4d / %4d cycles   %6.1f / %6.1f / %6.1f ns", src, ft->count,
+                ft->min, avg, ft->max, ft->min * ns, avg * ns, ft->max * ns);
+}
+
+// SRAM page cache status and control
+void uif_cache(int i) {
+  char FileNm[32];
+  int slot;
+
+  switch (i) {
+    case cache_status:
+            cli_printf("  SRAM page cache %s, %d of %d slots used, %d KBytes",
+                        TULIP_Pages.cache_enabled ? "enabled":"disabled",
+                        TULIP_Pages.cacheUsed(), PAGE_CACHE_SLOTS, TULIP_Pages.cacheUsed() * PAGE_SIZE * 2 / 1024);
+            cli_printf("  Pages decoded since boot: %d, no free slot: %d", TULIP_Pages.cache_fills, TULIP_Pages.cache_full);
+            cli_printf("  Page - Bank - Slot - Source");
+            cli_printf("  ----   ----   ----   ---------------------");
+            for (int p = FIRST_PAGE; p < NR_PAGES; p++) {
+              for (int b = 1; b <= 4; b++) {
+                if (!TULIP_Pages.isPlugged(p, b)) continue;
+                slot = TULIP_Pages.cacheSlot(p, b);
+                TULIP_Pages.getFileName(p, b, FileNm);
+                if ((slot >= 0) && (TULIP_Pages.getflags(p, b) & PAGE_WRITEABLE)) {
+                  cli_printf("  %3X      %d     %2d    %s (QROM)", p, b, slot, FileNm);
+                } else if (slot >= 0) {
+                  cli_printf("  %3X      %d     %2d    %s", p, b, slot, FileNm);
+                } else {
+                  cli_printf("  %3X      %d      -    %s (read from FLASH)", p, b, FileNm);
+                }
+              }
+            }
+            cli_printf("");
+            cli_printf("  ROM fetch timing (DBG_OUT4 .. DBG_OUT5), min / avg / max%s",
+                        timing_enabled ? "" : ", not measured, use system timing toggle");
+            cli_printf("    source          count");
+            show_fetch_timing("SRAM", &fetch_sram);
+            show_fetch_timing("SRAM b2-4", &fetch_banked);
+            show_fetch_timing("FLASH", &fetch_flash);
+            cli_printf("    ENBANKx instructions: %d", bank_switches);
+            if ((fetch_sram.count != 0) && (fetch_flash.count != 0) && (fetch_flash.total >= fetch_flash.count)) {
+              cli_printf("    average fetch from SRAM is %d%% of FLASH",
+                          (int)((100 * (fetch_sram.total / fetch_sram.count)) / (fetch_flash.total / fetch_flash.count)));
+            }
+            cli_printf("");
+            cli_printf("  QROM write-back to FRAM every %d ms, max %d blocks of %d words per pass",
+                          QROM_FLUSH_INTERVAL, QROM_FLUSH_MAX, QROM_BLOCK);
+            cli_printf("    WROM instructions   %10lu", qrom_stats.writes);
+            cli_printf("    dirty blocks        now %5d   max %5d", TULIP_Pages.dirtyQROM(), qrom_stats.max_backlog);
+            cli_printf("    written back        %10lu blocks in %lu passes", qrom_stats.flushed, qrom_stats.passes);
+            cli_printf("    pass time           last %6lu us   max %6lu us", qrom_stats.last_pass_us, qrom_stats.max_pass_us);
+            cli_printf("    PWO low latency     last %6lu us   max %6lu us", qrom_stats.last_forced_us, qrom_stats.max_forced_us);
+            break;
+
+    case cache_reset:
+            if (!uif_pwo_low()) return;   // core1 updates the timing when the HP41 is running
+            fetch_timing_reset();
+            cli_printf("  ROM fetch timing cleared");
+            break;
+
+    case cache_toggle:
+            if (!uif_pwo_low()) return;   // only do this when calc is not running
+            TULIP_Pages.cache_enabled = !TULIP_Pages.cache_enabled;
+            TULIP_Pages.cacheAll();       // decode all Pages, or release them when disabled
+            cli_printf("  SRAM page cache %s", TULIP_Pages.cache_enabled ? "enabled":"disabled");
+            break;
+
+    default:
+            break;
+  }
+}
+
+// core1 instruction dispatch table status and control
+void uif_dispatch(int i) {
+  int n_t54 = 0;
+  int n_t32 = 0;
+  float ns = 1.0e9f / clock_get_hz(clk_sys);     // ns per clk_sys cycle
+  struct CycleHist *h = &timing_hist[TIM_T54];
+
+  switch (i) {
+    case dispatch_status:
+            for (int j = 0; j < 4096; j++) {
+              if (emu_cfg_pub.dispatch[j] & DISP_T54) n_t54++;
+              if (emu_cfg_pub.dispatch[j] & DISP_T32) n_t32++;
+            }
+            cli_printf("  dispatch table %s", dispatch_linear ? "disabled, all enabled decoders run for every instruction" : "enabled");
+            cli_printf("  settings snapshot %d published, %d in use by core1, %d published, %d adopted",
+                        emu_cfg_pub.version, emu_cfg.version, emu_cfg_published, emu_cfg_adopted);
+            cli_printf("    printer %d, printer power %d, HP-IL %d, XMEM modules %d",
+                        emu_cfg.printer, emu_cfg.prt_power, emu_cfg.hpil, emu_cfg.xmem_mods);
+            cli_printf("  instructions decoded at T54: %4d of 4096", n_t54);
+            cli_printf("  instructions decoded at T32: %4d of 4096", n_t32);
+            cli_printf("  cycles spent at T54 before T0 (DBG_OUT0 .. DBG_OUT1)");
+            if (h->count == 0) {
+              cli_printf("    no instructions measured");
+              break;
+            }
+            cli_printf("    measured %d instructions", h->count);
+            cli_printf("    min    %4d cycles  %6.1f ns", h->min, h->min * ns);
+            cli_printf("    median %4d cycles  %6.1f ns", cyclehist_percentile(h, 50), cyclehist_percentile(h, 50) * ns);
+            cli_printf("    max    %4d cycles  %6.1f ns", h->max, h->max * ns);
+            break;
+
+    case dispatch_reset:
+            if (!uif_pwo_low()) return;   // core1 updates the timing when the HP41 is running
+            cyclehist_reset(h);
+            cli_printf("  T54 timing cleared");
+            break;
+
+    case dispatch_toggle:
+            if (!uif_pwo_low()) return;   // only do this when calc is not running
+            dispatch_linear = !dispatch_linear;
+            emuconfig_publish();
+            cyclehist_reset(h);           // do not mix the measurements
+            cli_printf("  dispatch table %s", dispatch_linear ? "disabled" : "enabled");
+            break;
+
+    default:
+            break;
+  }
+}
+
+// core1 bus cycle stage timing and slack, see TIM_xxx in hp41_state.h
+void uif_timing(int i, int val) {
+  float us = 1.0e6f / clock_get_hz(clk_sys);     // us per clk_sys cycle
+  struct CycleHist *h;
+
+  switch (i) {
+    case timing_cmd_status:
+            cli_printf("  core1 bus cycle timing in clk_sys cycles, %d cycles per usec, measurement %s",
+                        clock_get_hz(clk_sys) / 1000000, timing_enabled ? "on" : "off, use system timing toggle");
+            cli_printf("  stage                  count        min     median        p99        max");
+            for (int j = 0; j < TIM_STAGES; j++) {
+              h = &timing_hist[j];
+              if (j == TIM_FIRST_SLACK) {
+                cli_printf("  slack is the idle time before the bus event, near miss below %d us", timing_margin_us);
+              }
+              if (h->count == 0) {
+                cli_printf("  %-20s %8d  not measured", timing_name[j], 0);
+                continue;
+              }
+              cli_printf("  %-20s %8d %10d %10d %10d %10d", timing_name[j], h->count,
+                          h->min, cyclehist_percentile(h, 50), cyclehist_percentile(h, 99), h->max);
+              cli_printf("  %-20s %8s %8.2f us %7.2f us %7.2f us %7.2f us", "", "",
+                          h->min * us, cyclehist_percentile(h, 50) * us, cyclehist_percentile(h, 99) * us, h->max * us);
+              if (j >= TIM_FIRST_SLACK) {
+                cli_printf("  %-20s near miss %d, late %d", "", h->near, h->late);
+              }
+            }
+            break;
+
+    case timing_cmd_reset:
+            if (!uif_pwo_low()) return;   // core1 updates the timing when the HP41 is running
+            timing_reset();
+            cli_printf("  bus cycle timing cleared");
+            break;
+
+    case timing_cmd_margin:
+            if (!uif_pwo_low()) return;   // the near miss counts are only valid for one margin
+            timing_set_margin(val);
+            timing_reset();
+            cli_printf("  near miss margin set to %d us, bus cycle timing cleared", timing_margin_us);
+            break;
+
+    case timing_cmd_toggle:
+            timing_enabled = !timing_enabled;
+            emuconfig_publish();          // core1 checks the setting once per bus cycle
+            cli_printf("  bus cycle and ROM fetch timing measurement %s", timing_enabled ? "on" : "off");
+            break;
+
+    default:
+            break;
+  }
+}
+
+// bus loop benchmark, simulated bus cycles are run through the bus loop on core0
+void uif_bench(int mix) {
+  int first = (mix < 0) ? 0 : mix;
+  int last = (mix < 0) ? SIM_MIXES - 1 : mix;
+  uint32_t us;
+  uint32_t n = SIM_CYCLES * SIM_BENCH_PASSES;
+  float ns = 1.0e9f / clock_get_hz(clk_sys);     // ns per clk_sys cycle
+  struct CycleHist *h;
+
+  if (!uif_pwo_low()) return;   // core1 must be idle, the bus loop on core0 uses the same state
+
+  cli_printf("  bus loop benchmark, %d simulated bus cycles per traffic mix", n);
+  cli_printf("  mix         cycles/s   ns/cycle  clk/cycle");
+  for (int m = first; m <= last; m++) {
+    sim_mix(m, sim_cycles, SIM_CYCLES);
+    sim_hist_reset();
+    us = 0;
+    for (int p = 0; p < SIM_BENCH_PASSES; p++) {
+      us += sim_run(sim_cycles, SIM_CYCLES, NULL, NULL);
+      if (sim_stopped) {
+        cli_printf("  benchmark stopped, the HP41 was switched on");
+        return;
+      }
+    }
+    if (us == 0) us = 1;
+    cli_printf("  %-8s %11d %10.1f %10.1f", sim_mix_name[m], (uint32_t)((uint64_t)n * 1000000 / us),
+                us * 1000.0f / n, us * 1000.0f / n / ns);
+    for (int j = TIM_T54; j < TIM_FIRST_SLACK; j++) {
+      h = &sim_hist[j];
+      if (h->count == 0) continue;
+      cli_printf("    %-20s median %5d  p99 %5d  max %5d clk", timing_name[j],
+                  cyclehist_percentile(h, 50), cyclehist_percentile(h, 99), h->max);
+    }
+  }
+}
+
 void uif_dir(const char *dir)
 {
   sd_dir(dir);
@@ -632,6 +852,22 @@ const char* file_types[] =
 #define COMPARE_DIFF_ERASE 3
 #define COMPARE_DIFF_SIZE 4
 
+// determine the file type from the upper case file extension, 0 if not supported
+static int import_type(const char *ext)
+{
+  int type = 0;
+  if (ext == NULL) return 0;
+  if (strcmp(ext, ".MOD") == 0) type = 1;     // can be MOD1 or MOD2
+  if (strcmp(ext, ".ROM") == 0) type = 3;     // ROM file
+  if (strcmp(ext, ".UMM") == 0) type = 4;     // User Memory
+  if (strcmp(ext, ".EXT") == 0) type = 5;     // Extended Memory
+  if (strcmp(ext, ".EXP") == 0) type = 6;     // Expanded Memory
+  if (strcmp(ext, ".TRM") == 0) type = 7;     // ROM mapping
+  if (strcmp(ext, ".TGL") == 0) type = 8;     // Global settings
+  if (strcmp(ext, ".TTF") == 0) type = 9;     // Tracer settings
+  return type;
+}
+
 int compare_openfile(FIL* fp, uint32_t offs)  
 {
   uint8_t buf[0x1000];          // 4K buffer
@@ -741,15 +977,7 @@ int compare_file(const char *fname)
   }
 
   // determine file type from the extension
-  int type = 0;
-  if (strcmp(ext, ".MOD") == 0) type = 1;     // can be MOD1 or MOD2
-  if (strcmp(ext, ".ROM") == 0) type = 3;     // ROM file
-  if (strcmp(ext, ".UMM") == 0) type = 4;     // User Memory
-  if (strcmp(ext, ".EXT") == 0) type = 5;     // Extended Memory
-  if (strcmp(ext, ".EXP") == 0) type = 6;     // Expanded Memory
-  if (strcmp(ext, ".TRM") == 0) type = 7;     // ROM mapping
-  if (strcmp(ext, ".TGL") == 0) type = 8;     // Global settings
-  if (strcmp(ext, ".TTF") == 0) type = 9;     // Tracer settings
+  int type = import_type(ext);
 
   // check if the file type is supported
   if (type == 0) {
@@ -827,12 +1055,64 @@ int compare_file(const char *fname)
     #define IMPORT_FRAM 4
 */
 
+// the file being imported and the time spent reading and programming, for the callbacks of ff_import_stream()
+static FIL *imp_fil;
+static uint64_t imp_t_read, imp_t_prog;
+static bool imp_read_error;
+
+static int import_read(uint8_t *buf, uint32_t len)
+{
+  uint64_t t = time_us_64();
+  UINT read;
+
+  FRESULT fr = f_read(imp_fil, buf, len, &read);
+  imp_t_read += time_us_64() - t;
+  if (FR_OK != fr) {
+    cli_printf("  file read error: %s (%d)", FRESULT_str(fr), fr);
+    imp_read_error = true;
+    return -1;
+  }
+  return read;
+}
+
+static void import_program(uint32_t offs, const uint8_t *buf, uint32_t num)
+{
+  uint64_t t = time_us_64();
+
+  uint32_t ints = save_and_disable_interrupts();
+  flash_range_program(FF_OFFSET + offs, buf, num);
+  restore_interrupts (ints);
+  imp_t_prog += time_us_64() - t;
+  tud_task();                               // keep the USB port updated between the pieces
+}
+
+static const struct FFImportIO import_io = { import_read, import_program };
+
+// program the header and the open file at offs in FLASH with ff_import_stream(), the FLASH must be erased
+// the time spent reading and programming is added to t_read and t_prog
+// returns false on a read error or a short file, the header is not programmed then
+static bool import_stream(FIL *fil, const ModuleMetaHeader_t *header, uint32_t offs, uint64_t *t_read, uint64_t *t_prog)
+{
+  imp_fil = fil;
+  imp_t_read = 0;
+  imp_t_prog = 0;
+  imp_read_error = false;
+  bool ok = ff_import_stream(header, offs, &import_io);
+  if (!ok && !imp_read_error) {
+    cli_printf("  file ended before %d bytes were read, not imported", header->FileSize);
+  }
+  *t_read += imp_t_read;
+  *t_prog += imp_t_prog;
+  return ok;
+}
+
 // import a single file and program in FLASH
 // also called by the import_all function
-void import_file(const char *fname, int option)
+// returns the number of bytes imported, 0 if the file was not imported
+uint32_t import_file(const char *fname, int option)
 {
-  uint8_t buf[0x1000];          // 4K buffer
   char ffname[32];
+  uint64_t start = time_us_64();
 
   // first sort out the file to be imported
 
@@ -840,7 +1120,7 @@ void import_file(const char *fname, int option)
   FRESULT fr = f_open(&fil, fname, FA_READ);
   if (FR_OK != fr) {
       cli_printf("  cannot open file: %s, %s (%d)", fname, FRESULT_str(fr), fr);
-      return;
+      return 0;
   }
 
   // make a copy of fname in ffname
@@ -865,21 +1145,13 @@ void import_file(const char *fname, int option)
   }
 
   // determine file type from the extension
-  int type = 0;  
-  if (strcmp(ext, ".MOD") == 0) type = 1;     // can be MOD1 or MOD2
-  if (strcmp(ext, ".ROM") == 0) type = 3;     // ROM file
-  if (strcmp(ext, ".UMM") == 0) type = 4;     // User Memory
-  if (strcmp(ext, ".EXT") == 0) type = 5;     // Extended Memory
-  if (strcmp(ext, ".EXP") == 0) type = 6;     // Expanded Memory
-  if (strcmp(ext, ".TRM") == 0) type = 7;     // ROM mapping
-  if (strcmp(ext, ".TGL") == 0) type = 8;     // Global settings  
-  if (strcmp(ext, ".TTF") == 0) type = 9;     // Tracer settings
+  int type = import_type(ext);
 
   // check if the file type is supported  
   if (type == 0) {
     cli_printf("  file type not supported"); 
     f_close(&fil);
-    return;
+    return 0;
   }
 
   // the file is now sorted out
@@ -895,29 +1167,29 @@ void import_file(const char *fname, int option)
       if (result == COMPARE_SAME) {
         cli_printf("  file is the same, no update needed");
         f_close(&fil);
-        return;
+        return 0;
       }
       if (result == COMPARE_NOT_FOUND) {
         cli_printf("  file not found in FLASH");
         f_close(&fil);
-        return;
+        return 0;
       }
       if (result == COMPARE_DIFF_SIZE) {
         cli_printf("  file size in FLASH is different, cannot update");
         f_close(&fil);
-        return;
+        return 0;
       }
       if (result == COMPARE_DIFF_ERASE) {
         cli_printf("  file in FLASH is different, requires erasing before updating");
         f_close(&fil);
-        return;
+        return 0;
       }
     } else {
       cli_printf("  file already in FLASH, cannot import again");     
     }
 
     f_close(&fil);
-    return;
+    return 0;
   }
 
   // now check where we can put the file
@@ -926,7 +1198,7 @@ void import_file(const char *fname, int option)
   if (offs == NOTFOUND ) {
     cli_printf("  no free space in FLASH");
     f_close(&fil);
-    return;
+    return 0;
   }
 
   #ifdef DEBUG
@@ -945,14 +1217,14 @@ void import_file(const char *fname, int option)
   if (offs == NOTFOUND) {
     cli_printf("  no free space in FLASH for this file");
     f_close(&fil);
-    return;
+    return 0;
   }
 
 
   if ((FF_SYSTEM_SIZE - offs) < (filesize + 256)) {
     cli_printf("  not enough space in FLASH for this file");
     f_close(&fil);
-    return;
+    return 0;
   }
 
   // offs now contains the address where to start programming
@@ -991,67 +1263,127 @@ void import_file(const char *fname, int option)
   
   // show the programming details in the CLI
   cli_printf("  flashing %-31s, type %04X, size %8d bytes at 0x%08X", header.FileName, header.FileType, header.FileSize, offs);
+  ff_flush_console();                         // the console output goes out before the interrupts are disabled
 
-  // ensure that any unused buffer is all 0xFF
-  memset(buf, 0xFF, 0x1000);
+  uint64_t t_read = 0, t_prog = 0;
+  if (!import_stream(&fil, &header, offs, &t_read, &t_prog)) {
+    f_close(&fil);
+    return 0;
+  }
+
+  // close the file
+  f_close(&fil);
 
-  // copy to header to the buffer
-  memcpy(buf, &header, sizeof(header));
+  uint32_t us = time_us_64() - start;
+  cli_printf("  %d bytes in %d ms, %d KB/s (read %d ms, program %d ms)", filesize, us / 1000,
+              (uint32_t)((uint64_t)filesize * 1000000 / 1024 / (us + 1)), (uint32_t)(t_read / 1000), (uint32_t)(t_prog / 1000));
+  return filesize;
+}
 
-  // and add the first part of the file
-  UINT read;
+#define IMPORT_PLAN_MAX 256         // max files in one pass of the bulk import
 
-  // create a pointer inside our buffer to the start of the file data
-  uint8_t* pp = buf + sizeof(header);
-  fr = f_read(&fil, pp, 0x1000 - sizeof(header), &read);
-  if (FR_OK != fr) {
-      cli_printf("  file read error: %s (%d)", FRESULT_str(fr), fr);
-      f_close(&fil);
-      return;
-  }  
-  
+// a file in the bulk import plan
+struct ImportPlan {
+  char      name[32];               // file name without the directory
+  uint32_t  size;                   // file size in bytes
+  uint8_t   type;                   // file type from the extension
+  uint32_t  offs;                   // planned offset of the header in FLASH
+};
 
-  // ensure that a multiple of 256 bytes is programmed including the header
-  // normally this is always 4K, but for small files it can be less
-  int bytestoprogram = read + sizeof(header);
-  bytestoprogram = (bytestoprogram + 0xFF) & ~0xFF;
+static struct ImportPlan imp_plan[IMPORT_PLAN_MAX];
 
+// erase the FLASH sectors in the range start..end that are not fully erased, each sector only once
+// the part of the first sector before start is kept, with dry the sectors are only counted
+// returns the number of sectors (to be) erased
+static int import_erase(uint32_t start, uint32_t end, bool dry)
+{
+  int n = 0;
 
-  // disable all interrupts, flash and restore interrupts
-  uint32_t ints = save_and_disable_interrupts();
-  flash_range_program(FF_OFFSET + offs, buf, bytestoprogram);
-  restore_interrupts (ints);
+  if (end > FF_SYSTEM_SIZE) end = FF_SYSTEM_SIZE;
+  for (uint32_t s = start & FLASH_SECTOR_OFFS; s < end; s += FLASH_SECTOR_SIZE) {
+    uint32_t from = (s < start) ? start : s;
+    uint32_t to = (s + FLASH_SECTOR_SIZE < end) ? s + FLASH_SECTOR_SIZE : end;
+    if (ff_erased(from, to - from, 1) == NOTFOUND) continue;    // this part is erased already
+    n++;
+    if (!dry) ff_erase_sector(s, from - s);
+    tud_task();                     // keep the USB port updated between the sectors
+  }
+  return n;
+}
 
-  // program the remaining part of the file
-  int left = filesize - read;                 // bytes left to read from the file
-  while (left > 0) {
-    memset(buf, 0xFF, 0x1000);                // ensure that any unused buffer is all 0xFF
-    fr = f_read(&fil, buf, 0x1000, &read);    // read up tp 4K bytes from the open file
-    offs = offs + bytestoprogram;             // increase the offset from the previous flashing
-
-    if (read != 0) {
-    // work out number of bytes to program and ensure that a multiple of 256 bytes is programmed
-      bytestoprogram = read;
-      bytestoprogram = (bytestoprogram + 0xFF) & ~0xFF;
-
-      // and flash the data
-      ints = save_and_disable_interrupts();
-      flash_range_program(FF_OFFSET + offs, buf, bytestoprogram);
-      restore_interrupts (ints);
-      left -= read;
-    } else {
+// scan the directory and plan the files that are not in FLASH yet
+// the files are packed in directory order from start on 256-byte boundaries
+// the directory entries before *seen were reported in an earlier pass and are skipped silently
+// *more is set when the plan is full, *end returns the end of the planned range
+// returns the number of files in the plan, -1 when the directory cannot be read
+static int import_plan(const char *p_dir, uint32_t start, int *seen, bool *more, uint32_t *end)
+{
+  DIR dj = {};                      // directory object
+  FILINFO fno = {};                 // file information
+  char ffname[32];
+  uint32_t offs = start;
+  int n = 0, k = 0;
+
+  *more = false;
+  FRESULT fr = f_findfirst(&dj, &fno, p_dir, "*");
+  if (FR_OK != fr) {
+    cli_printf("  cannot find first file: %s (%d)", FRESULT_str(fr), fr);
+    return -1;
+  }
+
+  while (fr == FR_OK && fno.fname[0]) {
+    tud_task();  // must keep the USB port updated
+    if (n == IMPORT_PLAN_MAX) {
+      *more = true;                 // this entry is for the next pass
       break;
     }
+    bool report = (k++ >= *seen);
+
+    if (fno.fattrib & AM_DIR) {
+      if (report) cli_printf("  skipping subdirectory %s", fno.fname);
+    } else if (strlen(fno.fname) > 30) {
+      if (report) cli_printf("  skipping %s, file name too long", fno.fname);
+    } else {
+      strcpy(ffname, fno.fname);
+      for (int i = 0; i < strlen(ffname); i++) {
+        ffname[i] = toupper(ffname[i]);
+      }
+      int type = import_type(strrchr(ffname, '.'));
+      uint32_t size = (uint32_t)fno.fsize;
+      uint32_t need = (size + sizeof(ModuleMetaHeader_t) + 255) & ~255;
+
+      if (type == 0) {
+        if (report) cli_printf("  skipping %-31s file type not supported", fno.fname);
+      } else if (ff_findfile(fno.fname) != NOTFOUND) {
+        if (report) cli_printf("  skipping %-31s already in FLASH", fno.fname);
+      } else if ((offs + need + 256) > FF_SYSTEM_SIZE) {
+        if (report) cli_printf("  skipping %-31s not enough space in FLASH", fno.fname);
+      } else {
+        strcpy(imp_plan[n].name, fno.fname);
+        imp_plan[n].size = size;
+        imp_plan[n].type = type;
+        imp_plan[n].offs = offs;
+        offs += need;
+        n++;
+      }
+    }
+    fr = f_findnext(&dj, &fno);     // search for next item
   }
 
-  // close the file
-  f_close(&fil);
+  f_closedir(&dj);
+  *seen = k;
+  *end = offs;
+  return n;
 }
 
 // import all files in the directory
 // i = 0  import all files in the directory
 // i = 2  import all files in the directory and update existing files
 // i = 3  check all files in the directory and compare with existing files, no import is done
+// the files are imported in passes of at most IMPORT_PLAN_MAX files
+// each pass scans the directory, plans a packed layout behind the end of the file chain,
+// erases every sector in the layout once and then streams the files in address order
+// holes of deleted files are not reused, flash compact takes care of those
 void uif_import_all(const char *dir, int i)
 {
 
@@ -1077,37 +1409,91 @@ void uif_import_all(const char *dir, int i)
     }
 
     cli_printf("  Import directory in FLASH: %s", p_dir);
-    DIR dj = {};      /* Directory object */
-    FILINFO fno = {}; /* File information */
     assert(p_dir);
-    fr = f_findfirst(&dj, &fno, p_dir, "*");
-    if (FR_OK != fr) {
-        cli_printf("  cannot find first file: %s (%d)", FRESULT_str(fr), fr);
-        return;
-    }
-    while (fr == FR_OK && fno.fname[0]) { /* Repeat while an item is found */
+    uint64_t start = time_us_64();
+    uint64_t t_read = 0, t_prog = 0;
+    uint32_t files = 0, bytes = 0;
+    int planned = 0, erased = 0;
+    int seen = 0;                   // directory entries reported in the earlier passes
+    bool more = true;
+
+    while (more) {
+      // plan the layout from the end of the file chain
+      uint32_t first = ff_lastfree(0);
+      if (first == NOTFOUND) {
+        cli_printf("  no free space in FLASH");
+        break;
+      }
+      uint32_t end;
+      int n = import_plan(p_dir, first, &seen, &more, &end);
+      if (n <= 0) break;
+
+      // the range includes the page of the new end of the chain
+      int plan = import_erase(first, end + 256, true);
+      cli_printf("  plan: %d files, %d bytes at 0x%08X..0x%08X, %d sectors to erase", n, end - first, first, end, plan);
+      planned += plan;
+      erased += import_erase(first, end + 256, false);
+
+      // stream the files in address order, a file that cannot be opened leaves no gap
+      uint32_t offs = first;
+      int done = 0;
+      for (int f = 0; f < n; f++) {
         tud_task();  // must keep the USB port updated
 
         // create string with full path and filename
         char fname[80];
         strcpy(fname, p_dir);
         strcat(fname, "/");
-        strcat(fname, fno.fname);
+        strcat(fname, imp_plan[f].name);
 
-        // filename is fno.fname	
-        // first check if this is a real file or a directory
-        // if the file is a directory then skip it
-        if (fno.fattrib & AM_DIR) {
-          cli_printf("  skipping subdirectory %s", fno.fname);
-        } else {
-          // no directory, import the file
-          import_file(fname, 0);
+        FIL fil;
+        fr = f_open(&fil, fname, FA_READ);
+        if (FR_OK != fr) {
+          cli_printf("  cannot open file: %s, %s (%d)", fname, FRESULT_str(fr), fr);
+          continue;
+        }
+        if (f_size(&fil) != imp_plan[f].size) {
+          cli_printf("  file %s changed since the scan, not imported", imp_plan[f].name);
+          f_close(&fil);
+          continue;
         }
-        fr = f_findnext(&dj, &fno); /* Search for next item */
+
+        ModuleMetaHeader_t header;
+        header.FileType = imp_plan[f].type;
+        strcpy(header.FileName, imp_plan[f].name);
+        header.FileSize = imp_plan[f].size;
+        header.NextFile = offs + ((header.FileSize + sizeof(header) + 255) & ~255);
+
+        // files only move down in the planned range, so this normally finds nothing to erase
+        erased += import_erase(offs, header.NextFile + 256, false);
+
+        uint64_t t = time_us_64();
+        cli_printf("  flashing %-31s, type %04X, size %8d bytes at 0x%08X", header.FileName, header.FileType, header.FileSize, offs);
+        ff_flush_console();         // the console output goes out before the interrupts are disabled
+
+        bool ok = import_stream(&fil, &header, offs, &t_read, &t_prog);
+        f_close(&fil);
+        // the header is only programmed when the whole file was read, after an error
+        // the next file erases the partly programmed space again
+        if (ff_erased(offs, 256, 1) != NOTFOUND) {
+          offs = header.NextFile;
+        }
+        if (!ok) continue;
+
+        uint32_t us = time_us_64() - t;
+        cli_printf("  %d bytes in %d ms, %d KB/s", header.FileSize, us / 1000,
+                    (uint32_t)((uint64_t)header.FileSize * 1000000 / 1024 / (us + 1)));
+        files++;
+        bytes += header.FileSize;
+        done++;
+      }
+      if (done == 0) break;         // nothing imported, do not try again
     }
 
-    // all done, close directory and finish
-    f_closedir(&dj);
+    uint32_t us = time_us_64() - start;
+    cli_printf("  %d files imported, %d bytes in %d ms, %d KB/s (read %d ms, program %d ms)", files, bytes, us / 1000,
+                (uint32_t)((uint64_t)bytes * 1000000 / 1024 / (us + 1)), (uint32_t)(t_read / 1000), (uint32_t)(t_prog / 1000));
+    cli_printf("  %d sectors erased, %d planned", erased, planned);
 }
 
 // import a file and program in FLASH
@@ -1516,6 +1902,7 @@ void uif_list(int i, const char *fname)
   V1_t *myV1;                         // pointer to the module contents in BIN format (5120 bytes)
   ModuleFileHeader_t *MODoffset;
   int filecounter = 0;                // counter for the number of files found in the directory
+  int dummies = 0;                    // dummy files, not counted but in the FLASH index
   
   if (!ff_isinited()) {
     cli_printf("  FLASH File system not initialized, please run INIT first");
@@ -1590,6 +1977,11 @@ void uif_list(int i, const char *fname)
       cli_printf("  ** Total files found:                            %d", filecounter);
       cli_printf("  ** END OF FILE SYSTEM **                         0x%08X", offs);
       cli_printf("  ** UNUSED SPACE UNTIL **                         0x%08X - appr %d Kbytes free", end, free/1024);
+      if (ff_index.valid && ((ff_index.end != offs) || (ff_index.files != filecounter + dummies))) {
+        // the index does not match the chain in FLASH, should not happen
+        ff_index_build();
+        cli_printf("  ** FLASH index rebuilt, %d files in %d us", ff_index.files, ff_index.build_us);
+      }
       return;
     }
 
@@ -1606,6 +1998,7 @@ void uif_list(int i, const char *fname)
       // dummy file
       cli_printfn("  ** DUMMY FILE **");
       filecounter--;  // count the number of files found
+      dummies++;      // can still be found by name
     }
     cli_printf(" ");
     if (i == 2) {
@@ -1711,7 +2104,12 @@ void uif_plug(int func, int Page, int Bank, const char *fname)          // plug
               return;
             }
 
-            cli_printf("  plugging file %s in Page %d", fname, Page);
+            if ((Bank > 1) && !TULIP_Pages.isPlugged(Page, 1)) {
+              cli_printf("  Page %X Bank 1 is not plugged, plug Bank 1 first", Page);
+              return;
+            }
+
+            cli_printf("  plugging file %s in Page %d Bank %d", fname, Page, Bank);
             // file exists and has the correct extension
             // check if the file is a MOD or ROM file
 
@@ -1748,7 +2146,7 @@ void uif_plug(int func, int Page, int Bank, const char *fname)          // plug
               */ 
               rom_flags = BANK_ACTIVE | BANK_FLASH | BANK_ROM | BANK_ENABLED;
               
-              TULIP_Pages.plug(Page, 1, rom_flags, offs); // plug the ROM in the given page
+              TULIP_Pages.plug(Page, Bank, rom_flags, offs); // plug the ROM in the given Page/Bank
               TULIP_Pages.save(); // save the page settings in FRAM
 
             }
@@ -1759,6 +2157,33 @@ void uif_plug(int func, int Page, int Bank, const char *fname)          // plug
             }
             break;
 
+    case plug_qrom: // plug a writeable QROM Page with the image that is in FRAM
+    case plug_file_qrom: // copy a ROM file to a QROM Page
+            if (func == plug_file_qrom) {
+              offs = ff_findfile(fname);
+              if (offs == NOTFOUND) {
+                cli_printf("  file \"%s\" not found", fname);
+                return;
+              }
+              MetaH = (ModuleMetaHeader_t*)(FF_SYSTEM_BASE + offs);
+              if (MetaH->FileType != FILETYPE_ROM) {
+                cli_printf("  only ROM files can be copied to QROM");
+                return;
+              }
+              myROMImage = (uint16_t*)(FF_SYSTEM_BASE + offs + sizeof(ModuleMetaHeader_t));
+              cli_printf("  copying file %s to QROM in Page %X", fname, Page);
+            } else {
+              myROMImage = NULL;
+              cli_printf("  plugging QROM in Page %X from FRAM 0x%05X", Page, QROM_FRAM(Page));
+            }
+            if (!TULIP_Pages.plugQROM(Page, (fname == NULL) ? "QROM" : fname, myROMImage)) {
+              cli_printf("  no free slot in the SRAM page cache, QROM not plugged");
+              return;
+            }
+            TULIP_Pages.save();
+            cli_printf("  Page %X is now writeable with WROM", Page);
+            break;
+
     default: 
             // no other actions defined here
             break;
@@ -1768,7 +2193,6 @@ void uif_plug(int func, int Page, int Bank, const char *fname)          // plug
   // after plugging, read the first couple of words for checking the ROM contents
 
   uint16_t addr = Page * 0x1000; // address of the page in FLASH
-  Bank = 1; // always bank 1 for now, as we only support one bank
 
   #ifdef DEBUG
   // read the first 16 words of the ROM image
@@ -1779,7 +2203,7 @@ void uif_plug(int func, int Page, int Bank, const char *fname)          // plug
 
     // print 16 bytes
     for (int m = 0; m < 16; m++) {
-      ShowPrintLen += sprintf(ShowPrint + ShowPrintLen, "%03X ", TULIP_Pages.getword(addr + m));
+      ShowPrintLen += sprintf(ShowPrint + ShowPrintLen, "%03X ", TULIP_Pages.getbankword(Page, Bank, m));
     }
     // print byte values as characters
     ShowPrintLen += sprintf(ShowPrint + ShowPrintLen, "  ");
@@ -1793,10 +2217,20 @@ void uif_plug(int func, int Page, int Bank, const char *fname)          // plug
 }
 
 // unplug and disable the selected Page
-void uif_unplug(int p)            // plug the selected ROM
+// b = 0 unplugs all Banks, b = 1..4 only the given Bank
+void uif_unplug(int p, int b)     // plug the selected ROM
 {
   if (!uif_pwo_low()) return;     // only do this when calc is not running
-  TULIP_Pages.unplug(p, 1);       // unplug the page p, bank 1
+  if (b != 0) {
+    TULIP_Pages.unplug(p, b);     // unplug only the given Bank
+    cli_printf("  unplugged Page %X Bank %d", p, b);
+    TULIP_Pages.save();
+    return;
+  }
+
+  for (int i = 1; i <= 4; i++) {
+    TULIP_Pages.unplug(p, i);     // unplug the page p, all Banks
+  }
 
   // must disable emulation of the page
   if (p == 6) {
@@ -1865,6 +2299,17 @@ void uif_cat(int p)
                                                                                     TULIP_Pages.getflags(i, 1),
                                                                                     TULIP_Pages.Pages[i].m_banks[1].b_img_name,
                                                                                     TULIP_Pages.image_offs(i,1));
+          // and the other Banks in this Page
+          for (int b = 2; b <= 4; b++) {
+            if (!TULIP_Pages.isPlugged(i, b)) continue;
+            TULIP_Pages.getRevision(i, b, rev);
+            cli_printf("           %d     %3d   %s       %2d      %04X    * %s  @ offs 0x%08X", b, TULIP_Pages.getXROM(i, b), 
+                                                                                    rev, 
+                                                                                    TULIP_Pages.getFunctions(i, b),
+                                                                                    TULIP_Pages.getflags(i, b),
+                                                                                    TULIP_Pages.Pages[i].m_banks[b].b_img_name,
+                                                                                    TULIP_Pages.image_offs(i, b));
+          }
         } else if (TULIP_Pages.isPlugged(i, 1) && TULIP_Pages.isEmbeddedROM(i, 1)) {
           // Emmbedded ROM
           int addr = i * 0x1000; // address of the page in FLASH
@@ -2001,6 +2446,7 @@ void uif_delete(const char *fname)
 
   // delete the file
   if (ff_write(offs, FILETYPE_DELETED)) {
+    ff_index_update(offs);
     cli_printf("  file \"%s\" marked as deleted", fname);
   } else {
     cli_printf("  file \"%s\": ERROR deleting file", fname);
@@ -2140,49 +2586,81 @@ void uif_printer(int i) {
 //   2  command 2 - dump
 //   3  command 3 - program FRAM test pattern
 //   4  command 4 - clear XMEM and test pattern
+//   5  command 5 - User Memory decoding self test
 //  10  plug 0 XMEM modules
 //  11  plug 1 XMEM module
 //  12  plug 2 XMEM modules
+//  20  toggle Memory Module 1
+//  21  toggle Memory Module 2
+//  22  toggle Memory Module 3
+//  23  toggle Memory Module 4
+//  24  toggle Quad Memory Module
+//  25  toggle X-Functions memory
 void uif_xmem(int i)          
 {
   int j;
   uint64_t reg_cont;
   int num_mods;
+  int setting;
 
-  if (!uif_pwo_low()) return;    // only do this when calc is not running
+  if ((i != 1) && !uif_pwo_low()) return;    // only do this when calc is not running, status is always allowed
 
   switch (i) {
     case 1: // status
             cli_printf("  XMEM modules plugged: %1d", globsetting.get(xmem_pages));
+            cli_printf("  X-Functions memory 040-0BF  %s", globsetting.get(xfun_enabled) ? "enabled" : "disabled");
+            cli_printf("  Memory Modules 1..4 %s %s %s %s  Quad %s",
+                          globsetting.get(mmod1_enabled) ? "ON " : "off",
+                          globsetting.get(mmod2_enabled) ? "ON " : "off",
+                          globsetting.get(mmod3_enabled) ? "ON " : "off",
+                          globsetting.get(mmod4_enabled) ? "ON " : "off",
+                          globsetting.get(mmod_quad_enabled) ? "ON " : "off");
+            cli_printf("  User Memory registers in SRAM, write-back to FRAM every %d ms, max %d registers per pass",
+                          USERMEM_FLUSH_INTERVAL, USERMEM_FLUSH_MAX);
+            cli_printf("  dirty registers     now %5d   max %5d", usermem_backlog(), usermem_stats.max_backlog);
+            cli_printf("  registers written   %10lu", usermem_stats.writes);
+            cli_printf("  written back        %10lu in %lu passes", usermem_stats.flushed, usermem_stats.passes);
+            cli_printf("  pass time           last %6lu us   max %6lu us", usermem_stats.last_pass_us, usermem_stats.max_pass_us);
+            cli_printf("  PWO low write-back  %10lu times", usermem_stats.forced);
+            cli_printf("  PWO low latency     last %6lu us   max %6lu us", usermem_stats.last_forced_us, usermem_stats.max_forced_us);
             break;
-    case 2: // dump XMEM contents, starting at FRAM 0x1E00
-            cli_printf("  XMEM contents from FRAM (non-zero registers only)");
+    case 2: // dump User Memory contents from the SRAM copy, main memory and XMEM
+            cli_printf("  User Memory contents (non-zero registers only)");
             cli_printf("  XMEM modules plugged: %1d", globsetting.get(xmem_pages));
-            for (j = 0; j < 0x200; j++) {
-              fram_read(SPI_PORT_FRAM, PIN_SPI0_CS, (XMEMstart + j * 8), (uint8_t*)&reg_cont, 8);
+            for (j = 0x040; j < USERMEM_REGS; j++) {
+              reg_cont = ((uint64_t)usermem_regs[j][1] << 32) | usermem_regs[j][0];
 
               // printf(" R%03d = 0x%" PRIx64 "\n", j * 8,);
               if (reg_cont != 0) {
-                cli_printf("  REG %03X = 0x%" PRIX64 "", j + 0x200, reg_cont);
+                cli_printf("  REG %03X = 0x%" PRIX64 "", j, reg_cont);
               }
             }
             break;
     case 3: // program test pattern in XMEM
             reg_cont = 0x4041404140414041;      // set reg_cont to init value
-            for (j = 0; j < 0x200; j++) {
+            for (j = 0x200; j < USERMEM_REGS; j++) {
               reg_cont = reg_cont + 0x0101010101010101;
-              fram_write(SPI_PORT_FRAM, PIN_SPI0_CS, (XMEMstart + j * 8), (uint8_t*)&reg_cont, 8);
+              usermem_regs[j][0] = (uint32_t)reg_cont;
+              usermem_regs[j][1] = (uint32_t)(reg_cont >> 32);
+              usermem_dirty[j] = 1;
             }
+            usermem_flush(USERMEM_REGS);
             cli_printf("  FRAM test pattern programmed in Extended Memory");
             cli_printf("  use xmem dump to verify");
             break;           
     case 4: // erase all XMEM
             reg_cont = 0;      // set reg_cont to 0
-            for (j = 0; j < 0x200; j++) {
-              fram_write(SPI_PORT_FRAM, PIN_SPI0_CS, (XMEMstart + j * 8), (uint8_t*)&reg_cont, 8);
+            for (j = 0x200; j < USERMEM_REGS; j++) {
+              usermem_regs[j][0] = 0;
+              usermem_regs[j][1] = 0;
+              usermem_dirty[j] = 1;
             }
+            usermem_flush(USERMEM_REGS);
             cli_printf("  all Extended Memory registers set to 0");
             break;    
+    case 5: // self test of the User Memory decoding
+            usermem_selftest();
+            break;
     case 10: // unplug all XMEM modules
             globsetting.set(xmem_pages, 0);
             globsetting.save();
@@ -2195,6 +2673,19 @@ void uif_xmem(int i)
             globsetting.set(xmem_pages, 2);
             globsetting.save();
             break;
+    case 20: // toggle Memory Module 1..4, Quad Memory or X-Functions memory
+    case 21:
+    case 22:
+    case 23:
+    case 24:
+    case 25:
+            setting = (i == 25) ? xfun_enabled : (mmod1_enabled + i - 20);
+            globsetting.set(setting, !globsetting.get(setting));
+            globsetting.save();
+            cli_printf("  %s %s", (i == 25) ? "X-Functions memory" : (i == 24) ? "Quad Memory Module" : "Memory Module",
+                          globsetting.get(setting) ? "enabled" : "disabled");
+            cli_printf("  do not use in combination with physical memory modules, HP41CV/CX have all main memory built in");
+            break;
     default:
             // no other actions defined here
             ;
@@ -2240,6 +2731,32 @@ void uif_tracer(int i) {
             cli_printf("  IL scope traffic    %s", globsetting.get(ilscope_IL_enabled) ? "enabled ":"disabled");
             cli_printf("  PILBox traffic      %s", globsetting.get(ilscope_PIL_enabled) ? "enabled ":"disabled");
             cli_printf("  tracing of IL regs  %s", globsetting.get(tracer_ilregs_on) ? "enabled ":"disabled");
+            cli_printf("  function names      %s", globsetting.get(tracer_symbols) ? "enabled ":"disabled");
+            cli_printf("  trace output        %s", trace_sd_active ? trace_sd_stats.fname :
+                                                        globsetting.get(tracer_binary) ? "binary" : "text");
+            cli_printf("  cycle gaps          %d (TraceBuffer overflow or PWO)", trace_gaps);
+            cli_printf("  blocked cycles      %d (not queued by core1)", trace_skipped);
+            if (trace_ring_stats.words > 0) {
+              float per_kb = (float)trace_ring_stats.records * 1024 / (trace_ring_stats.words * 4);
+              cli_printf("  TraceBuffer         %d KByte, %.1f cycles/KByte (%d with fixed %d byte records), about %d cycles deep",
+                          sizeof(trace_ring.buf) / 1024, per_kb, 1024 / sizeof(struct TLine), sizeof(struct TLine),
+                          (int)(per_kb * sizeof(trace_ring.buf) / 1024));
+              cli_printf("  TraceBuffer use     max %d%%, %d records dropped",
+                          (int)((uint64_t)trace_ring_stats.max_fill * 100 / TRACE_RING_WORDS), trace_ring.dropped);
+            }
+            if (tbin_stats.records > 0) {
+              cli_printf("  binary records      %d, %d bytes, %.2f bytes/record, %d key records",
+                          tbin_stats.records, tbin_stats.bytes, (float)tbin_stats.bytes / tbin_stats.records,
+                          tbin_stats.keys);
+            }
+            if (trace_out_stats.lines > 0) {
+              cli_printf("  trace output        %d lines/s, %d bytes/s (last second)", trace_out_stats.lines_s, trace_out_stats.bytes_s);
+              cli_printf("  trace output        %d lines, %d bytes in %d blocks of avg %d bytes, %d sent on timeout",
+                          trace_out_stats.lines, trace_out_stats.bytes, trace_out_stats.blocks,
+                          (trace_out_stats.blocks > 0) ? trace_out_stats.bytes / trace_out_stats.blocks : 0,
+                          trace_out_stats.timeouts);
+              cli_printf("  trace output        %d calls out of time, %d bytes not sent", trace_out_stats.budget, trace_out_stats.dropped);
+            }
             break;
     case 2: // trace
             globsetting.set(tracer_enabled, !globsetting.get(tracer_enabled));
@@ -2276,14 +2793,268 @@ void uif_tracer(int i) {
               return;
             }
             globsetting.save();
+            tracesetting.save();
             cli_printf("  tracer setting saved in FRAM");
             break; 
+    case trace_binary:
+            globsetting.set(tracer_binary, !globsetting.get(tracer_binary));
+            tbin_restart();
+            cli_printf("  trace output        %s", globsetting.get(tracer_binary) ? "binary" : "text");
+            break;
+    case trace_bintest:
+            tbin_selftest();
+            break;
+    case trace_fmtbench:
+            trace_format_bench();
+            break;
+    case trace_symbols:
+            globsetting.set(tracer_symbols, !globsetting.get(tracer_symbols));
+            cli_printf("  function names      %s", globsetting.get(tracer_symbols) ? "enabled ":"disabled");
+            break;
     default:
             // no other actions defined here
             ;         
   }          
 }        
 
+// trace pipeline telemetry, see trace_stats_show() in tracer.cpp
+//  NULL     show the counters since the last reset
+//  reset    start the counters from 0
+//  [n]      status line every n seconds on the console, 0 to stop
+void uif_tracer_stats(const char *arg) {
+  int secs;
+
+  if (arg == NULL) {
+    trace_stats_show();
+  } else if (strcmp(arg, "reset") == 0) {
+    trace_stats_reset();
+    cli_printf("  tracer stats reset");
+  } else if ((sscanf(arg, "%d", &secs) == 1) && (secs >= 0)) {
+    trace_stats_period(secs);
+    if (secs == 0) {
+      cli_printf("  tracer stats status lines stopped");
+    } else {
+      cli_printf("  tracer stats status line every %d s", secs);
+    }
+  } else {
+    cli_printf("  tracer stats: unknown argument %s, use reset or the number of seconds", arg);
+  }
+}
+
+// trace capture to the uSD card, see trace_sd_start() in tracer.cpp
+//  NULL     show the progress or the result of the last capture
+//  stop     stop the capture and close the file
+//  [file]   start the capture to a new file
+void uif_tracer_sd(const char *arg) {
+  if (arg == NULL) {
+    trace_sd_status();
+  } else if (strcmp(arg, "stop") == 0) {
+    if (!trace_sd_active) {
+      cli_printf("  tracer sd: no capture running");
+      return;
+    }
+    trace_sd_stop();
+  } else {
+    trace_sd_start(arg);
+  }
+}
+
+// snapshot capture in the TraceBuffer, see trace_snap_start() in tracer.cpp
+//  1        status        shows the state of the capture
+//  2        start         capture until tracer snap stop
+//  3..5     adr/inst/frame  capture until post records after the trigger value v
+//  6        stop          freeze the capture
+//  7        dump          send the frozen capture to the tracer port
+//  8        sd            write the frozen capture to fname on the uSD card
+//  9        off           back to live tracing
+// post is -1 for the default TRACE_SNAP_POST
+void uif_tracer_snap(int i, int v, int post, const char *fname) {
+  if (post < 0) post = TRACE_SNAP_POST;
+  switch (i) {
+    case snap_cmd_status:
+            trace_snap_status();
+            break;
+    case snap_cmd_start:
+            trace_snap_start(SNAP_TRIG_NONE, 0, post);
+            cli_printf("  snapshot capture started, freeze it with tracer snap stop");
+            break;
+    case snap_cmd_adr:
+    case snap_cmd_inst:
+    case snap_cmd_frame:
+            trace_snap_start(SNAP_TRIG_ADDR + i - snap_cmd_adr, v, post);
+            trace_snap_status();
+            break;
+    case snap_cmd_stop:
+            if (trace_snap.state == SNAP_OFF) {
+              cli_printf("  no snapshot capture, start one with tracer snap start");
+              return;
+            }
+            trace_snap_freeze();
+            trace_snap_status();
+            break;
+    case snap_cmd_dump:
+            trace_snap_dump();
+            break;
+    case snap_cmd_sd:
+            trace_snap_sd(fname);
+            break;
+    case snap_cmd_off:
+            trace_snap_off();
+            cli_printf("  snapshot capture off, live tracing continues");
+            break;
+    default:
+            ;
+  }
+}
+
+// profiler, see trace_prof_start() in tracer.cpp
+//  1        report        top n addresses, ranges and functions, 0 for the default
+//  2        start         clear the counters and start counting
+//  3        stop          stop counting
+//  4        csv           write all counters to fname on the uSD card
+//  5        off           back to live tracing
+void uif_tracer_prof(int i, int n, const char *fname) {
+  switch (i) {
+    case prof_cmd_report:
+            trace_prof_report(n);
+            break;
+    case prof_cmd_start:
+            trace_prof_start();
+            cli_printf("  profiler started, live tracing stops until tracer prof off");
+            break;
+    case prof_cmd_stop:
+            trace_prof_stop();
+            trace_prof_report(0);
+            break;
+    case prof_cmd_csv:
+            trace_prof_csv(fname);
+            break;
+    case prof_cmd_off:
+            trace_prof_off();
+            cli_printf("  profiler off, live tracing continues");
+            break;
+    default:
+            ;
+  }
+}
+
+// capture and replay of traced bus cycles, see replay_run() in tracer.cpp
+//  1        status        shows the capture and the result of the last replay
+//  2        capture       capture the next REPLAY_LINES consecutive traced cycles
+//  3        run           replay the capture through the bus loop on core0 and compare
+//  4        clear         discard the capture, live tracing gets the whole TraceBuffer again
+//  5        load          load the cycles from a binary trace file on the uSD card
+void uif_replay(int i, const char *fname) {
+  switch (i) {
+    case replay_cmd_status:
+            replay_status();
+            break;
+    case replay_cmd_capture:
+            if (!trace_enabled) {
+              cli_printf("  tracing is paused, nothing will be captured until it is resumed");
+            }
+            trace_ring_lend();            // the capture is kept in the upper half of the TraceBuffer
+            replay_count = 0;
+            replay_armed = true;
+            trace_filter_build();         // no blocked cycles during the capture
+            cli_printf("  capturing the next %d traced bus cycles", REPLAY_LINES);
+            break;
+    case replay_cmd_run:
+            if (!uif_pwo_low()) return;   // core1 must be idle, the bus loop on core0 uses the same state
+            if (replay_armed) {
+              cli_printf("  capture not complete, %d of %d cycles", replay_count, REPLAY_LINES);
+              return;
+            }
+            replay_run();
+            break;
+    case replay_cmd_clear:
+            replay_count = 0;
+            replay_armed = false;
+            trace_filter_build();         // block cycles again as set
+            trace_ring_return();
+            cli_printf("  replay capture cleared");
+            break;
+    case replay_cmd_load:
+            replay_file(fname);
+            break;
+    default:
+            ;
+  }
+}
+
+// block, pass and trigger filters of the tracer
+// the filters are compiled with trace_filter_build() after every change, use tracer save to keep them
+void uif_tracer_filter(int i, int v1, int v2, int bank) {
+  const char *tname[] = {"", "block", "pass", "trig", "count"};
+  const char *tstate[] = {"off", "armed", "on", "post"};
+  int n;
+
+  switch (i) {
+    case tfilter_list:
+            cli_printf("  #   type    start  end   count  bank  status");
+            for (n = 0; n < NUMFILTERS; n++) {
+              filter *f = &tracesetting.filters[n];
+              int tp = f->type & 0x7F;
+              if ((f->type == filter_none) || (tp > filter_trig_c)) continue;
+              cli_printf("  %2d  %-6s  %04X   %04X  %5d  %s     %s", n, tname[tp], f->start_adr, f->end_adr,
+                          f->count_adr, (f->bank == 0) ? "any" : (f->bank == 1) ? "1  " : (f->bank == 2) ? "2  " : (f->bank == 3) ? "3  " : "4  ",
+                          (f->type & 0x80) ? "active" : "inactive");
+            }
+            cli_printf("  trigger depth %d samples before, %d after, trigger %s, fired %d times",
+                        tracesetting.pre_depth, tracesetting.post_depth, tstate[trig_state], trig_fired);
+            if (trace_filter_full != 0) {
+              cli_printf("  %d bank qualified filters not used, too many Pages with bank filters", trace_filter_full);
+            }
+            return;
+    case tfilter_block:
+    case tfilter_pass:
+    case tfilter_trig:
+    case tfilter_count:
+            if ((i != tfilter_count) && (v2 < v1)) {
+              cli_printf("  end address must not be below the start address");
+              return;
+            }
+            n = tracesetting.add_filter(filter_block + i - tfilter_block, v1, v2, bank);
+            if (n < 0) {
+              cli_printf("  no free filter entry, delete one first");
+              return;
+            }
+            cli_printf("  filter %d added", n);
+            break;
+    case tfilter_del:
+            if (tracesetting.del_filter(v1) < 0) {
+              cli_printf("  filter %d not in use", v1);
+              return;
+            }
+            cli_printf("  filter %d deleted", v1);
+            break;
+    case tfilter_toggle:
+            n = tracesetting.toggle_filter(v1);
+            if (n == filter_none) {
+              cli_printf("  filter %d not in use", v1);
+              return;
+            }
+            cli_printf("  filter %d %s", v1, (n & 0x80) ? "active" : "inactive");
+            break;
+    case tfilter_depth:
+            if (v1 > TRACE_PRE_MAX) {
+              cli_printf("  at most %d samples before a trigger", TRACE_PRE_MAX);
+              v1 = TRACE_PRE_MAX;
+            }
+            tracesetting.pre_depth = v1;
+            tracesetting.post_depth = v2;
+            cli_printf("  trigger depth %d samples before, %d after", v1, v2);
+            break;
+    case tfilter_clear:
+            tracesetting.clear_filters();
+            cli_printf("  all filters deleted");
+            break;
+    default:
+            return;
+  }
+  trace_filter_build();
+}
+
 
 #define STORAGE_CMD_TOTAL_BYTES 100
 
@@ -2314,6 +3085,12 @@ void uif_flash(int i, uint32_t addr) {
             cli_printf("  FLASH CS size  : %X size indicator", flash_size);
             cli_printf("  FLASH size     : %d MByte reported by firmware", PICO_FLASH_SIZE_BYTES / (1024 * 1024));
             cli_printf("  FLASH capacity : %d bytes / %d MByte reported by device", capacity, capacity / (1024 * 1024));
+            if (ff_index.valid) {
+              cli_printf("  FLASH index    : %d files, %d free entries, end at 0x%08X, built in %d us",
+                          ff_index.files, ff_index.nfree, ff_index.end, ff_index.build_us);
+            } else {
+              cli_printf("  FLASH index    : not used, %d entries found, the chain in FLASH is searched", ff_index.count);
+            }
 
             break;
     case 2: // dump
@@ -2365,6 +3142,32 @@ void uif_flash(int i, uint32_t addr) {
             fram_show(dump_addr);
             break;
 
+    case 6: // compact
+            {
+              if (!ff_isinited()) {
+                cli_printf("  FLASH File system not initialized, please run INIT first");
+                return;
+              }
+              cli_printf("  compacting the FLASH File System");
+              uint64_t start = time_us_64();
+              uint32_t freed = 0;
+              int moved = ff_compact(&freed);
+              if (moved < 0) {
+                cli_printf("  FLASH File System chain is broken, not compacted");
+                return;
+              }
+              cli_printf("  %d files moved, %d bytes freed in %d ms, end of the chain at 0x%08X", 
+                          moved, freed, (uint32_t)((time_us_64() - start) / 1000), ff_lastfree(0));
+
+              // the plugged ROMs follow their files
+              int n = TULIP_Pages.relocate();
+              if (n > 0) {
+                TULIP_Pages.save();
+                cli_printf("  ROM map updated, %d Banks changed", n);
+              }
+            }
+            break;
+
     default:
             // no other actions defined here
             ;         
@@ -2455,7 +3258,9 @@ void welcome()
     printf("\n*   Welcome to TULIP4041 - The ULtimate Intelligent Peripheral for the HP41 ");
     printf("\n*   Total heap:  %d bytes", getTotalHeap());
     printf("\n*   Free heap:   %d bytes", getFreeHeap());
-    printf("\n    Tracebuffer: %d samples / %d bytes", TRACELENGTH, sizeof(TraceLine) * TRACELENGTH);
+    printf("\n    Tracebuffer: %d bytes", sizeof(trace_ring.buf));
+    printf("\n*   FLASH index: %d files, built in %d us%s", ff_index.files, ff_index.build_us,
+                ff_index.valid ? "" : " (not used)");
     printf("\n*   running at:  %d kHz\n", clock_get_hz(clk_sys)/1000);
     printf("\n****************************************************************************\n");
     measure_freqs();
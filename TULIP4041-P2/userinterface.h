@@ -77,6 +77,10 @@ void uif_calcreset();
 void uif_poweron();       
 void uif_configinit();    
 void uif_configlist();
+void uif_cache(int i);
+void uif_dispatch(int i);
+void uif_timing(int i, int val);
+void uif_bench(int mix);
 
 void measure_freqs(void);
 
@@ -96,7 +100,7 @@ void uif_list(int i, const char *fname);    // list
 void uif_delete(const char *fname);  // delete a file from FLASH/FRAM
 
 void uif_plug(int func, int Page, int Bank, const char *fname);          // plug the selected ROM 
-void uif_unplug(int i);        // unplug the selected ROM
+void uif_unplug(int i, int b);  // unplug the selected ROM, b = 0 for all Banks
 void uif_cat(int p);                // show the plugged ROMs
 
 void uif_fram(int i, uint32_t addr);       // FRAM functions
@@ -106,6 +110,12 @@ void uif_printer(int i);       // HP82143A printer functions
 void uif_xmem(int i);          // functions for Extended Memory control
 
 void uif_tracer(int i);        // functions for the bus tracer
+void uif_replay(int i, const char *fname);     // capture and replay of traced bus cycles
+void uif_tracer_filter(int i, int v1, int v2, int bank);   // tracer filters and triggers
+void uif_tracer_sd(const char *arg);   // trace capture to the uSD card
+void uif_tracer_snap(int i, int v, int post, const char *fname);   // snapshot capture in the TraceBuffer
+void uif_tracer_prof(int i, int n, const char *fname);   // profiler
+void uif_tracer_stats(const char *arg);   // trace pipeline telemetry
 
 void uif_rtc(int i, const char *args);    // RTC test functions
 